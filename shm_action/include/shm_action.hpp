@@ -3,7 +3,7 @@
 //! @brief メモリの格納方法を規定するクラスの定義
 //! @note 記法はROSに準拠する
 //!       http://wiki.ros.org/ja/CppStyleGuide
-//! 
+//!
 //! @example test1.hpp
 //! 共有メモリに関するテスト
 //! @example test1.cpp
@@ -13,9 +13,14 @@
 #ifndef __SHM_ACTION_LIB_H__
 #define __SHM_ACTION_LIB_H__
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 #include "shm_base.hpp"
+#include "shm_trace.hpp"
 
 namespace irlab
 {
@@ -29,6 +34,85 @@ enum ACTION_STATUS : uint8_t
   REJECTED,
   SUCCEEDED,
   PREEMPTED,
+  LOST,  //!< ゴールが既にゴールテーブルに存在しない(再利用された、またはサーバーが再起動した)
+};
+
+// ****************************************************************************
+//! @brief ゴールを識別するID
+//! @details 下位ACTION_GOAL_SLOT_BITSビットはゴールテーブル上のスロット番号、上位ビットは通し番号である．
+//! 0は無効なIDを表す．
+// ****************************************************************************
+using ActionGoalId = uint64_t;
+
+constexpr int      ACTION_GOAL_SLOT_BITS   = 16;
+constexpr uint64_t ACTION_GOAL_SLOT_MASK   = (1ULL << ACTION_GOAL_SLOT_BITS) - 1;
+constexpr int      DEFAULT_ACTION_GOAL_NUM = 16;
+//! ゴールごとのフィードバックのリングバッファの段数
+constexpr int      DEFAULT_ACTION_FEEDBACK_BUFFER_NUM = 32;
+
+// ****************************************************************************
+//! @enum ActionGoalState
+//! @brief ゴールテーブルのスロットの状態
+// ****************************************************************************
+enum ActionGoalState : uint32_t
+{
+  ACTION_GOAL_FREE = 0,  //!< 未使用
+  ACTION_GOAL_CLAIMED,   //!< クライアントがゴールを書き込み中
+  ACTION_GOAL_PENDING,   //!< サーバーの受理待ち
+  ACTION_GOAL_ACTIVE,    //!< サーバーが実行中
+  ACTION_GOAL_DONE,      //!< 完了(成功・拒否・中断)．結果は次に再利用されるまで読み出せる
+  ACTION_GOAL_FINISHING, //!< サーバーが結果と終了状態を書き込み中．書き終えるとDONEになる
+};
+
+// ****************************************************************************
+//! @struct ActionHeader
+//! @brief アクションの共有メモリ先頭に置かれる管理領域
+//! @details goal_numはサーバーの初期化完了後に最後に書き込まれるため、0の間はクライアントは接続できない．
+// ****************************************************************************
+struct ActionHeader
+{
+  std::atomic<uint32_t> goal_num;
+  std::atomic<uint32_t> feedback_buffer_num;
+  std::atomic<uint64_t> next_goal_number;
+  alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> goal_sequence;
+  std::atomic<uint32_t> goal_waiter_num;
+};
+
+// ****************************************************************************
+//! @struct ActionGoalSlot
+//! @brief ゴールテーブルの一つのゴールを保持するスロット
+//! @details stateは結果を待つクライアントの、cancel_requestedは中断要求を待つサーバーのfutexを兼ねる．
+//! フィードバックはスロットとは別のリングバッファに格納される．
+//! owner_pidとowner_start_timeはゴールを書き込み中のクライアントのプロセスを表し、書き込み中に終了した
+//! クライアントのスロットを他のクライアントが回収するために使う．owner_pidは書き込み中以外は0となる．
+//! シリアライズする型は SerializedStorageSize の容量に符号化して格納する．
+// ****************************************************************************
+template <class Goal, class Result>
+struct alignas(CACHE_LINE_SIZE) ActionGoalSlot
+{
+  std::atomic<uint32_t>                 state;
+  std::atomic<uint32_t>                 status;
+  std::atomic<uint32_t>                 cancel_requested;
+  std::atomic<uint32_t>                 waiter_num;
+  std::atomic<uint32_t>                 preempt_waiter_num;
+  std::atomic<uint32_t>                 owner_pid;
+  std::atomic<uint64_t>                 owner_start_time;
+  std::atomic<ActionGoalId>             goal_id;
+  typename MessageStorage<Goal>::type   goal;
+  typename MessageStorage<Result>::type result;
+};
+
+// ****************************************************************************
+//! @struct ActionFeedbackSample
+//! @brief フィードバックのリングバッファの一要素
+//! @details リングバッファはスロットごとに確保されるため、前のゴールの要素が残っている場合がある．
+//! 読み込み側はgoal_idを比較して対象のゴールの要素のみを取り出す．
+// ****************************************************************************
+template <class Feedback>
+struct ActionFeedbackSample
+{
+  ActionGoalId                            goal_id;
+  typename MessageStorage<Feedback>::type feedback;
 };
 
 // ****************************************************************************
@@ -37,7 +121,9 @@ enum ACTION_STATUS : uint8_t
 //! @details template classとして与えられた型またはクラスをリクエストおよびレスポンスとしてリクエストからレスポンスを出力するクラスである．
 //! sizeofによってメモリの使用量が把握できる型およびクラスに対応している．
 //! また、特殊なものはtemplate classを特殊化して対応する．
-//!  
+//! ゴールは固定長のゴールテーブルに格納され、ゴールIDを指定することで複数のゴールを同時に実行できる．
+//! ゴールIDを取らない関数は、最後に受理したゴールを対象とする．
+//!
 //! @note 通常であれば、生成された共有メモリはデストラクタで破棄されるべきだと考えるのが自然であるが、
 //! 意図せずプログラムが再起動したような場合に共有メモリが破棄されてしまうと、値の更新が読み取れなかったり
 //! 以前に送っていた指令が読み取れなくなったりするなどの問題が生じる可能性があるため、あえて破棄していない．
@@ -48,45 +134,54 @@ template <class Goal, class Result, class Feedback>
 class ActionServer
 {
 public:
-  ActionServer(std::string name, PERM perm = DEFAULT_PERM);
+  ActionServer(std::string name, PERM perm = DEFAULT_PERM, int goal_num = DEFAULT_ACTION_GOAL_NUM,
+               int feedback_buffer_num = DEFAULT_ACTION_FEEDBACK_BUFFER_NUM);
   ~ActionServer();
 
+  static size_t getMemorySize(int goal_num, int feedback_buffer_num);
+  static size_t getFeedbackRingOffset(int goal_num, int feedback_buffer_num, int goal_index);
+
   void waitNewGoalAvailable();
+  bool waitNewGoalAvailable(uint64_t timeout_usec);
+  bool getWaitTarget(WaitTarget *target);
   Goal acceptNewGoal();
+  Goal acceptNewGoal(ActionGoalId *goal_id);
   void rejectNewGoal();
 
   bool isPreemptRequested();
+  bool isPreemptRequested(ActionGoalId goal_id);
+  bool waitForPreempt(uint64_t timeout_usec);
+  bool waitForPreempt(ActionGoalId goal_id, uint64_t timeout_usec);
   void setPreempted();
+  void setPreempted(ActionGoalId goal_id);
 
   void publishResult(const Result& result);
+  void publishResult(ActionGoalId goal_id, const Result& result);
   void publishFeedback(const Feedback& feedback);
+  void publishFeedback(ActionGoalId goal_id, const Feedback& feedback);
 
 private:
-  void initializeExclusiveAccess();
+  using GoalSlot       = ActionGoalSlot<Goal, Result>;
+  using FeedbackSample = ActionFeedbackSample<Feedback>;
 
-  pthread_t thread;
+  GoalSlot *findSlot(ActionGoalId goal_id) const;
+  int       findPendingGoal() const;
+  void      finishGoal(ActionGoalId goal_id, ACTION_STATUS status, const Result *result = nullptr);
 
   std::string shm_name;
   PERM shm_perm;
   SharedMemory *shared_memory;
 
-  uint64_t start_timestamp_us;
-
   uint8_t *memory_ptr;
 
-  pthread_mutex_t *goal_mutex;
-  pthread_cond_t *goal_condition;
-  uint64_t *goal_timestamp_us;
-  Goal *goal_ptr;
-  pthread_mutex_t *result_mutex;
-  pthread_cond_t *result_condition;
-  uint64_t *result_timestamp_us;
-  Result *result_ptr;
-  Feedback *feedback_ptr;
-  ACTION_STATUS *status_ptr;
-  uint64_t *cancel_timestamp_us;
-
-  uint64_t current_goal_timestamp_usec;
+  ActionHeader *header;
+  GoalSlot     *slot_list;
+  int           slot_num;
+  int           feedback_buffer_num;
+
+  std::vector<std::unique_ptr<RingBuffer>> feedback_ring_list;
+
+  ActionGoalId current_goal_id;
 };
 
 // ****************************************************************************
@@ -94,6 +189,8 @@ private:
 //! @brief 共有メモリからトピックを取得する購読者を表現するクラス
 //! @details template classとして与えられた型またはクラスをトピックとして読み込むためのクラスである．
 //! また、トピックが更新されるまで待機するAPIを持つ．
+//! sendGoal() で得たゴールIDを指定することで、複数のゴールを同時に扱える．
+//! ゴールIDを取らない関数は、このクライアントが最後に送ったゴールを対象とする．
 // ****************************************************************************
 template <class Goal, class Result, class Feedback>
 class ActionClient
@@ -103,99 +200,134 @@ public:
   ~ActionClient();
 
   void cancelGoal();
+  void cancelGoal(ActionGoalId goal_id);
   Result getResult();
+  Result getResult(ActionGoalId goal_id);
   Feedback getFeedback();
+  Feedback getFeedback(ActionGoalId goal_id);
+  bool waitForFeedback(unsigned long wait_time_us);
+  bool waitForFeedback(ActionGoalId goal_id, unsigned long wait_time_us);
+  size_t drainFeedback(Feedback *feedback_list, size_t max_num);
+  size_t drainFeedback(ActionGoalId goal_id, Feedback *feedback_list, size_t max_num);
   ACTION_STATUS getStatus();
+  ACTION_STATUS getStatus(ActionGoalId goal_id);
   bool isServerConnected();
   bool sendGoal(Goal goal);
+  bool sendGoal(Goal goal, ActionGoalId *goal_id);
   bool waitForResult(unsigned long wait_time_us);
+  bool waitForResult(ActionGoalId goal_id, unsigned long wait_time_us);
   bool waitForServer(unsigned long wait_time_us);
 
 private:
+  using GoalSlot       = ActionGoalSlot<Goal, Result>;
+  using FeedbackSample = ActionFeedbackSample<Feedback>;
+
+  GoalSlot   *findSlot(ActionGoalId goal_id) const;
+  int         claimSlot();
+  int         reclaimDeadSlot();
+  RingBuffer *findFeedbackRing(ActionGoalId goal_id) const;
+  int         getNextFeedback(RingBuffer *ring, ActionGoalId goal_id);
+
   std::string shm_name;
   SharedMemory *shared_memory;
 
   uint8_t *memory_ptr;
 
-  pthread_mutex_t *goal_mutex;
-  pthread_cond_t *goal_condition;
-  uint64_t *goal_timestamp_us;
-  Goal *goal_ptr;
-  pthread_mutex_t *result_mutex;
-  pthread_cond_t *result_condition;
-  uint64_t *result_timestamp_us;
-  Result *result_ptr;
-  Feedback *feedback_ptr;
-  ACTION_STATUS *status_ptr;
-  uint64_t *cancel_timestamp_us;
-
-  uint64_t current_result_timestamp_usec;
+  ActionHeader *header;
+  GoalSlot     *slot_list;
+  int           slot_num;
+
+  std::vector<std::unique_ptr<RingBuffer>> feedback_ring_list;
+
+  ActionGoalId last_goal_id;
 };
 
+//! @brief フィードバックのリングバッファの境界を取得する
+//! @return size_t 境界[byte]
+//! @details RingBufferは先頭からの相対位置でスロットを揃えるため、先頭を同じ境界に置く．
+template <class Feedback>
+constexpr size_t
+getActionFeedbackRingAlignment()
+{
+  return (sizeof(ActionFeedbackSample<Feedback>) >= RingBuffer::PAGE_ALIGNED_ELEMENT_SIZE) ? RingBuffer::SLOT_PAGE_SIZE
+                                                                                           : CACHE_LINE_SIZE;
+}
+
 // ****************************************************************************
 // 関数定義
 // （テンプレートクラス内の関数の定義はコンパイル時に実体化するのでヘッダに書く）
 // ****************************************************************************
 template <class Goal, class Result, class Feedback>
-ActionServer<Goal, Result, Feedback>::ActionServer(std::string name, PERM perm)
+ActionServer<Goal, Result, Feedback>::ActionServer(std::string name, PERM perm, int goal_num, int feedback_buffer_num)
 : shm_name(name)
 , shm_perm(perm)
 , shared_memory(nullptr)
 , memory_ptr(nullptr)
+, header(nullptr)
+, slot_list(nullptr)
+, slot_num(goal_num)
+, feedback_buffer_num(feedback_buffer_num)
+, current_goal_id(0)
 {
-  if (!std::is_standard_layout<Goal>::value 
-    || !std::is_standard_layout<Result>::value 
-    || !std::is_standard_layout<Feedback>::value)
+  if (!is_transferable_message<Goal>()
+    || !is_transferable_message<Result>()
+    || !is_transferable_message<Feedback>())
   {
     throw std::runtime_error("shm::ActionServer: Be setted not POD class!");
   }
-  
+  if (slot_num <= 0 || static_cast<uint64_t>(slot_num) > ACTION_GOAL_SLOT_MASK)
+  {
+    throw std::runtime_error("shm::ActionServer: Invalid goal table size!");
+  }
+  if (feedback_buffer_num <= 0)
+  {
+    throw std::runtime_error("shm::ActionServer: Invalid feedback buffer size!");
+  }
+
   shared_memory = new SharedMemoryPosix(shm_name, O_RDWR|O_CREAT, shm_perm);
-  shared_memory->connect( (sizeof(pthread_mutex_t)+sizeof(pthread_cond_t)+sizeof(uint64_t)) * 2 + sizeof(Goal) + sizeof(Result) + sizeof(Feedback) + sizeof(ACTION_STATUS) + sizeof(uint64_t));
+  shared_memory->connect(getMemorySize(slot_num, feedback_buffer_num));
   if (shared_memory->isDisconnected())
   {
     throw std::runtime_error("shm::ActionServer: Cannot get memory!");
   }
 
-  uint8_t *data_ptr = shared_memory->getPtr();
-  memory_ptr = data_ptr;
-  goal_mutex = reinterpret_cast<pthread_mutex_t *>(data_ptr);
-  data_ptr += sizeof(pthread_mutex_t);
-  goal_condition = reinterpret_cast<pthread_cond_t *>(data_ptr);
-  data_ptr += sizeof(pthread_cond_t);
-  goal_timestamp_us = reinterpret_cast<uint64_t *>(data_ptr);
-  data_ptr += sizeof(uint64_t);
-  goal_ptr = reinterpret_cast<Goal *>(data_ptr);
-  data_ptr += sizeof(Goal);
-  result_mutex = reinterpret_cast<pthread_mutex_t *>(data_ptr);
-  data_ptr += sizeof(pthread_mutex_t);
-  result_condition = reinterpret_cast<pthread_cond_t *>(data_ptr);
-  data_ptr += sizeof(pthread_cond_t);
-  result_timestamp_us = reinterpret_cast<uint64_t *>(data_ptr);
-  data_ptr += sizeof(uint64_t);
-  result_ptr = reinterpret_cast<Result *>(data_ptr);
-  data_ptr += sizeof(Result);
-  feedback_ptr = reinterpret_cast<Feedback *>(data_ptr);
-  data_ptr += sizeof(Feedback);
-  status_ptr = reinterpret_cast<ACTION_STATUS *>(data_ptr);
-  data_ptr += sizeof(ACTION_STATUS);
-  cancel_timestamp_us = reinterpret_cast<uint64_t *>(data_ptr);
-
-  initializeExclusiveAccess();
-
-  *status_ptr = SUCCEEDED;
+  memory_ptr = shared_memory->getPtr();
+  header     = reinterpret_cast<ActionHeader *>(memory_ptr);
+  slot_list  = reinterpret_cast<GoalSlot *>(memory_ptr + sizeof(ActionHeader));
 
-  *cancel_timestamp_us = getCurrentTimeUSec();
-  start_timestamp_us = *cancel_timestamp_us;
-  *goal_timestamp_us = *cancel_timestamp_us;
-  *result_timestamp_us = *cancel_timestamp_us;
-
-  current_goal_timestamp_usec = *goal_timestamp_us;
+  // Hide the table from clients until it is initialized
+  header->goal_num.store(0, std::memory_order_release);
+  header->next_goal_number.store(0, std::memory_order_relaxed);
+  header->goal_sequence.store(0, std::memory_order_relaxed);
+  header->goal_waiter_num.store(0, std::memory_order_relaxed);
+  for (int i = 0; i < slot_num; i++)
+  {
+    slot_list[i].goal_id.store(0, std::memory_order_relaxed);
+    slot_list[i].status.store(SUCCEEDED, std::memory_order_relaxed);
+    slot_list[i].cancel_requested.store(0, std::memory_order_relaxed);
+    slot_list[i].waiter_num.store(0, std::memory_order_relaxed);
+    slot_list[i].preempt_waiter_num.store(0, std::memory_order_relaxed);
+    slot_list[i].owner_pid.store(0, std::memory_order_relaxed);
+    slot_list[i].owner_start_time.store(0, std::memory_order_relaxed);
+    slot_list[i].state.store(ACTION_GOAL_FREE, std::memory_order_release);
+    // Clients still waiting on a previous server instance see their goal as lost
+    futexWake(&slot_list[i].state);
+
+    unsigned char *ring_ptr = memory_ptr + getFeedbackRingOffset(slot_num, feedback_buffer_num, i);
+    feedback_ring_list.push_back(std::make_unique<RingBuffer>(ring_ptr, sizeof(FeedbackSample), feedback_buffer_num));
+    feedback_ring_list.back()->registerClient(RingBuffer::CLIENT_PUBLISHER);
+  }
+  header->feedback_buffer_num.store(static_cast<uint32_t>(feedback_buffer_num), std::memory_order_relaxed);
+  header->goal_num.store(static_cast<uint32_t>(slot_num), std::memory_order_release);
+  // Clients in waitForServer() sleep on goal_num until the table is published
+  futexWake(&header->goal_num);
 }
 
 template <class Goal, class Result, class Feedback>
 ActionServer<Goal, Result, Feedback>::~ActionServer()
 {
+  // The rings unregister themselves from the segment, so release them while it is still mapped
+  feedback_ring_list.clear();
   shared_memory->disconnect();
   if (shared_memory != nullptr)
   {
@@ -203,120 +335,370 @@ ActionServer<Goal, Result, Feedback>::~ActionServer()
   }
 }
 
+//! @brief 共有メモリの必要サイズを計算する
+//! @param [in] goal_num ゴールテーブルのスロット数
+//! @param [in] feedback_buffer_num ゴールごとのフィードバックのリングバッファの段数
+//! @return size_t 必要なバイト数
 template <class Goal, class Result, class Feedback>
-void
-ActionServer<Goal, Result, Feedback>::initializeExclusiveAccess()
-{
-  pthread_condattr_t goal_cond_attr;
-  pthread_condattr_init(&goal_cond_attr);
-  pthread_condattr_setpshared(&goal_cond_attr, PTHREAD_PROCESS_SHARED);
-  // Set clock to CLOCK_MONOTONIC to match getCurrentTimeUSec() usage
-  pthread_condattr_setclock(&goal_cond_attr, CLOCK_MONOTONIC);
-  pthread_cond_init(goal_condition, &goal_cond_attr);
-  pthread_condattr_destroy(&goal_cond_attr);
-
-  pthread_mutexattr_t goal_m_attr;
-  pthread_mutexattr_init(&goal_m_attr);
-  pthread_mutexattr_setpshared(&goal_m_attr, PTHREAD_PROCESS_SHARED);
-  pthread_mutex_init(goal_mutex, &goal_m_attr);
-  pthread_mutexattr_destroy(&goal_m_attr);
-
-  pthread_condattr_t result_cond_attr;
-  pthread_condattr_init(&result_cond_attr);
-  pthread_condattr_setpshared(&result_cond_attr, PTHREAD_PROCESS_SHARED);
-  // Set clock to CLOCK_MONOTONIC to match getCurrentTimeUSec() usage
-  pthread_condattr_setclock(&result_cond_attr, CLOCK_MONOTONIC);
-  pthread_cond_init(result_condition, &result_cond_attr);
-  pthread_condattr_destroy(&result_cond_attr);
-
-  pthread_mutexattr_t result_m_attr;
-  pthread_mutexattr_init(&result_m_attr);
-  pthread_mutexattr_setpshared(&result_m_attr, PTHREAD_PROCESS_SHARED);
-  pthread_mutex_init(result_mutex, &result_m_attr);
-  pthread_mutexattr_destroy(&result_m_attr);
+size_t
+ActionServer<Goal, Result, Feedback>::getMemorySize(int goal_num, int feedback_buffer_num)
+{
+  return getFeedbackRingOffset(goal_num, feedback_buffer_num, goal_num);
+}
+
+//! @brief フィードバックのリングバッファの位置を計算する
+//! @param [in] goal_num ゴールテーブルのスロット数
+//! @param [in] feedback_buffer_num ゴールごとのフィードバックのリングバッファの段数
+//! @param [in] goal_index スロット番号
+//! @return size_t 共有メモリの先頭からのオフセット[byte]
+//! @details リングバッファはゴールテーブルの後ろにスロット順に並ぶ．
+template <class Goal, class Result, class Feedback>
+size_t
+ActionServer<Goal, Result, Feedback>::getFeedbackRingOffset(int goal_num, int feedback_buffer_num, int goal_index)
+{
+  constexpr size_t alignment  = getActionFeedbackRingAlignment<Feedback>();
+  size_t           table_size = sizeof(ActionHeader) + sizeof(GoalSlot) * static_cast<size_t>(goal_num);
+  size_t           ring_size  = RingBuffer::getSize(sizeof(FeedbackSample), feedback_buffer_num);
+  table_size                  = (table_size + alignment - 1) & ~(alignment - 1);
+  ring_size                   = (ring_size + alignment - 1) & ~(alignment - 1);
+  return table_size + ring_size * static_cast<size_t>(goal_index);
+}
+
+//! @brief ゴールIDに対応するスロットを取得する
+//! @param [in] goal_id ゴールID
+//! @return GoalSlot* スロット(IDが無効、またはスロットが再利用されている場合はnullptr)
+template <class Goal, class Result, class Feedback>
+typename ActionServer<Goal, Result, Feedback>::GoalSlot *
+ActionServer<Goal, Result, Feedback>::findSlot(ActionGoalId goal_id) const
+{
+  uint64_t index = goal_id & ACTION_GOAL_SLOT_MASK;
+  if (goal_id == 0 || index >= static_cast<uint64_t>(slot_num) ||
+      slot_list[index].goal_id.load(std::memory_order_acquire) != goal_id)
+  {
+    return nullptr;
+  }
+  return &slot_list[index];
+}
+
+//! @brief 最も古い受理待ちのゴールを探す
+//! @return int スロット番号(受理待ちのゴールが無い場合は-1)
+template <class Goal, class Result, class Feedback>
+int
+ActionServer<Goal, Result, Feedback>::findPendingGoal() const
+{
+  int          next_slot = -1;
+  ActionGoalId next_id   = 0;
+  for (int i = 0; i < slot_num; i++)
+  {
+    ActionGoalId goal_id = slot_list[i].goal_id.load(std::memory_order_relaxed);
+    if (slot_list[i].state.load(std::memory_order_acquire) == ACTION_GOAL_PENDING &&
+        (next_slot < 0 || goal_id < next_id))
+    {
+      next_slot = i;
+      next_id   = goal_id;
+    }
+  }
+  return next_slot;
 }
 
 template <class Goal, class Result, class Feedback>
 void
 ActionServer<Goal, Result, Feedback>::waitNewGoalAvailable()
 {
-  // Fix race condition: Check timestamp inside mutex
-  pthread_mutex_lock(goal_mutex);
-  while (current_goal_timestamp_usec >= *goal_timestamp_us)
+  while (!waitNewGoalAvailable(1000000))
   {
-    // Wait on the condvar while holding the mutex
-    pthread_cond_wait(goal_condition, goal_mutex);
   }
-  pthread_mutex_unlock(goal_mutex);
+}
+
+//! @brief 受理待ちのゴールが届くまで待機する
+//! @param [in] timeout_usec 待ち時間[usec]
+//! @return bool 受理待ちのゴールがある場合は真、タイムアウトした場合は偽
+template <class Goal, class Result, class Feedback>
+bool
+ActionServer<Goal, Result, Feedback>::waitNewGoalAvailable(uint64_t timeout_usec)
+{
+  uint64_t start_time = getCurrentTimeUSec();
+  while (true)
+  {
+    // Read the sequence before scanning so that a goal sent in between makes FUTEX_WAIT return
+    uint32_t sequence = header->goal_sequence.load(std::memory_order_seq_cst);
+    if (findPendingGoal() >= 0)
+    {
+      return true;
+    }
+    uint64_t elapsed = getCurrentTimeUSec() - start_time;
+    if (elapsed >= timeout_usec)
+    {
+      return false;
+    }
+    header->goal_waiter_num.fetch_add(1, std::memory_order_seq_cst);
+    futexWait(&header->goal_sequence, sequence, timeout_usec - elapsed);
+    header->goal_waiter_num.fetch_sub(1, std::memory_order_seq_cst);
+  }
+}
+
+//! @brief WaitSetで新しいゴールを待つためのfutexワードを取得する
+//! @param [out] target ゴールの送信で進むシーケンスと受理待ちのゴールの確認
+//! @return bool 常に真
+template <class Goal, class Result, class Feedback>
+bool
+ActionServer<Goal, Result, Feedback>::getWaitTarget(WaitTarget *target)
+{
+  target->sequence   = &header->goal_sequence;
+  target->waiter_num = &header->goal_waiter_num;
+  target->is_ready   = [this]() { return findPendingGoal() >= 0; };
+  return true;
 }
 
 template <class Goal, class Result, class Feedback>
 Goal
 ActionServer<Goal, Result, Feedback>::acceptNewGoal()
 {
-  pthread_mutex_lock(goal_mutex);
-  *status_ptr = ACTIVE;
-  start_timestamp_us = getCurrentTimeUSec();
-  current_goal_timestamp_usec = *goal_timestamp_us;
-  Goal goal_copy = *goal_ptr;
-  pthread_mutex_unlock(goal_mutex);
+  return acceptNewGoal(nullptr);
+}
 
-  return goal_copy;
+//! @brief 最も古い受理待ちのゴールを受理する
+//! @param [out] goal_id 受理したゴールのID(nullptrの場合は格納しない)
+//! @return Goal 受理したゴール
+//! @details 受理待ちのゴールが無い場合は届くまで待機する．受理したゴールは以降のID無しの関数の対象となる．
+//! 復号できないゴールは拒否して次のゴールを待つ．
+template <class Goal, class Result, class Feedback>
+Goal
+ActionServer<Goal, Result, Feedback>::acceptNewGoal(ActionGoalId *goal_id)
+{
+  Goal goal;
+  while (true)
+  {
+    int slot = findPendingGoal();
+    if (slot < 0)
+    {
+      waitNewGoalAvailable();
+      continue;
+    }
+    uint32_t expected = ACTION_GOAL_PENDING;
+    if (!slot_list[slot].state.compare_exchange_strong(expected, ACTION_GOAL_ACTIVE, std::memory_order_acq_rel))
+    {
+      // Taken by another server thread or withdrawn
+      continue;
+    }
+    ActionGoalId accepted_id = slot_list[slot].goal_id.load(std::memory_order_acquire);
+    if (!MessageStorage<Goal>::load(slot_list[slot].goal, &goal))
+    {
+      finishGoal(accepted_id, REJECTED);
+      continue;
+    }
+    current_goal_id = accepted_id;
+    SHM_TRACE(ACTION_GOAL, shm_name, accepted_id);
+    if (goal_id != nullptr)
+    {
+      *goal_id = current_goal_id;
+    }
+    return goal;
+  }
 }
 
+//! @brief ゴールを拒否する
+//! @details 受理待ちのゴールがあれば最も古いものを、無ければ最後に受理したゴールを拒否する．
 template <class Goal, class Result, class Feedback>
 void
 ActionServer<Goal, Result, Feedback>::rejectNewGoal()
 {
-  *status_ptr = REJECTED;
-  current_goal_timestamp_usec = *goal_timestamp_us;
-  pthread_cond_broadcast(result_condition);
+  int slot = findPendingGoal();
+  if (slot >= 0)
+  {
+    uint32_t expected = ACTION_GOAL_PENDING;
+    if (slot_list[slot].state.compare_exchange_strong(expected, ACTION_GOAL_ACTIVE, std::memory_order_acq_rel))
+    {
+      finishGoal(slot_list[slot].goal_id.load(std::memory_order_acquire), REJECTED);
+      return;
+    }
+  }
+  finishGoal(current_goal_id, REJECTED);
 }
 
 template <class Goal, class Result, class Feedback>
 bool
 ActionServer<Goal, Result, Feedback>::isPreemptRequested()
 {
-  if (start_timestamp_us < *cancel_timestamp_us)
+  return isPreemptRequested(current_goal_id);
+}
+
+//! @brief ゴールの中断が要求されているか確認する
+//! @param [in] goal_id ゴールID
+//! @return bool 中断が要求されている場合は真
+template <class Goal, class Result, class Feedback>
+bool
+ActionServer<Goal, Result, Feedback>::isPreemptRequested(ActionGoalId goal_id)
+{
+  GoalSlot *slot = findSlot(goal_id);
+  return slot != nullptr && slot->cancel_requested.load(std::memory_order_acquire) != 0;
+}
+
+template <class Goal, class Result, class Feedback>
+bool
+ActionServer<Goal, Result, Feedback>::waitForPreempt(uint64_t timeout_usec)
+{
+  return waitForPreempt(current_goal_id, timeout_usec);
+}
+
+//! @brief ゴールの中断が要求されるまで待機する
+//! @param [in] goal_id ゴールID
+//! @param [in] timeout_usec 待ち時間[usec]
+//! @return bool 中断が要求された場合は真．タイムアウトした場合やゴールが終了した場合は偽
+//! @details クライアントの cancelGoal() によって直ちに起床する．
+//! 制御ループとは別のスレッドで呼び出すことで、中断要求を周期に依らずに処理できる．
+template <class Goal, class Result, class Feedback>
+bool
+ActionServer<Goal, Result, Feedback>::waitForPreempt(ActionGoalId goal_id, uint64_t timeout_usec)
+{
+  GoalSlot *slot = findSlot(goal_id);
+  if (slot == nullptr)
+  {
+    return false;
+  }
+
+  auto is_running = [&]()
+  {
+    uint32_t state = slot->state.load(std::memory_order_seq_cst);
+    return slot->goal_id.load(std::memory_order_acquire) == goal_id &&
+           (state == ACTION_GOAL_PENDING || state == ACTION_GOAL_ACTIVE);
+  };
+
+  uint64_t start_time = getCurrentTimeUSec();
+  while (true)
   {
-    return true;
+    if (slot->cancel_requested.load(std::memory_order_seq_cst) != 0)
+    {
+      return true;
+    }
+    uint64_t elapsed = getCurrentTimeUSec() - start_time;
+    if (elapsed >= timeout_usec)
+    {
+      return false;
+    }
+    slot->preempt_waiter_num.fetch_add(1, std::memory_order_seq_cst);
+    // Checked after registering so that finishGoal() either is seen here or sees the waiter and wakes it
+    if (!is_running())
+    {
+      slot->preempt_waiter_num.fetch_sub(1, std::memory_order_seq_cst);
+      return slot->cancel_requested.load(std::memory_order_seq_cst) != 0;
+    }
+    futexWait(&slot->cancel_requested, 0, timeout_usec - elapsed);
+    slot->preempt_waiter_num.fetch_sub(1, std::memory_order_seq_cst);
   }
-  return false;
 }
 
 template <class Goal, class Result, class Feedback>
 void
 ActionServer<Goal, Result, Feedback>::setPreempted()
 {
-  *status_ptr = PREEMPTED;
-
-  *result_timestamp_us = getCurrentTimeUSec();
+  setPreempted(current_goal_id);
+}
 
-  pthread_cond_broadcast(result_condition);
+//! @brief ゴールを中断として終了する
+//! @param [in] goal_id ゴールID
+template <class Goal, class Result, class Feedback>
+void
+ActionServer<Goal, Result, Feedback>::setPreempted(ActionGoalId goal_id)
+{
+  finishGoal(goal_id, PREEMPTED);
 }
 
 template <class Goal, class Result, class Feedback>
 void
 ActionServer<Goal, Result, Feedback>::publishResult(const Result& result)
 {
-  pthread_mutex_lock(result_mutex);
-  *result_ptr = result;
-  *status_ptr = SUCCEEDED;
-
-  *result_timestamp_us = getCurrentTimeUSec();
-  pthread_mutex_unlock(result_mutex);
+  publishResult(current_goal_id, result);
+}
 
-  pthread_cond_broadcast(result_condition);
+//! @brief ゴールの結果を書き込み、成功として終了する
+//! @param [in] goal_id ゴールID
+//! @param [in] result 結果
+template <class Goal, class Result, class Feedback>
+void
+ActionServer<Goal, Result, Feedback>::publishResult(ActionGoalId goal_id, const Result& result)
+{
+  finishGoal(goal_id, SUCCEEDED, &result);
 }
 
 template <class Goal, class Result, class Feedback>
 void
 ActionServer<Goal, Result, Feedback>::publishFeedback(const Feedback& feedback)
 {
-  // Use result_mutex to protect feedback updates (reusing existing mutex)
-  pthread_mutex_lock(result_mutex);
-  *feedback_ptr = feedback;
-  pthread_mutex_unlock(result_mutex);
+  publishFeedback(current_goal_id, feedback);
+}
+
+//! @brief ゴールのフィードバックを書き込む
+//! @param [in] goal_id ゴールID
+//! @param [in] feedback フィードバック
+//! @details ゴールごとのリングバッファに追記するため、結果の書き込みや他のゴールとは競合しない．
+//! クライアントが読み込む前にリングバッファが一周した場合、古いものから上書きされる．
+//! 一つのゴールのフィードバックは一つのスレッドから書き込むこと．
+template <class Goal, class Result, class Feedback>
+void
+ActionServer<Goal, Result, Feedback>::publishFeedback(ActionGoalId goal_id, const Feedback& feedback)
+{
+  if (findSlot(goal_id) == nullptr)
+  {
+    return;
+  }
+  RingBuffer *ring       = feedback_ring_list[goal_id & ACTION_GOAL_SLOT_MASK].get();
+  int         buffer_num = ring->reserveBuffer();
+  if (buffer_num < 0)
+  {
+    return;
+  }
+  FeedbackSample *sample = reinterpret_cast<FeedbackSample *>(ring->getBufferPtr(buffer_num));
+  sample->goal_id        = goal_id;
+  if (!MessageStorage<Feedback>::store(&sample->feedback, feedback))
+  {
+    ring->abortBuffer(buffer_num);
+    return;
+  }
+  ring->commitBuffer(buffer_num, getClockTimeUSec());
+  SHM_TRACE(ACTION_FEEDBACK, shm_name, goal_id);
+  ring->signal();
+}
+
+//! @brief 実行中のゴールを終了状態にし、結果を待つクライアントを起床させる
+//! @param [in] goal_id ゴールID
+//! @param [in] status 終了時の状態
+//! @param [in] result 結果(結果を書き込まない場合はnullptr)
+//! @details 先にFINISHINGへの遷移でゴールを確保してから結果と状態を書き込むため、
+//! 既に終了したゴールに対する遅れた呼び出しは何も書き換えない．
+template <class Goal, class Result, class Feedback>
+void
+ActionServer<Goal, Result, Feedback>::finishGoal(ActionGoalId goal_id, ACTION_STATUS status, const Result *result)
+{
+  GoalSlot *slot = findSlot(goal_id);
+  if (slot == nullptr)
+  {
+    return;
+  }
+  uint32_t expected = ACTION_GOAL_ACTIVE;
+  if (!slot->state.compare_exchange_strong(expected, ACTION_GOAL_FINISHING, std::memory_order_acq_rel))
+  {
+    // Already finished by another call: its status and result stay as they are
+    return;
+  }
+  if (result != nullptr)
+  {
+    // A result larger than its slot is marked invalid and the client reads the default value
+    MessageStorage<Result>::store(&slot->result, *result);
+  }
+  slot->status.store(status, std::memory_order_relaxed);
+  // Releases the result and status to clients; seq_cst also pairs with the waiter count below
+  slot->state.store(ACTION_GOAL_DONE, std::memory_order_seq_cst);
+  SHM_TRACE(ACTION_RESULT, shm_name, goal_id);
+  if (slot->waiter_num.load(std::memory_order_seq_cst) > 0)
+  {
+    futexWake(&slot->state);
+  }
+  // Release threads still waiting in waitForPreempt() for this goal
+  if (slot->preempt_waiter_num.load(std::memory_order_seq_cst) > 0)
+  {
+    futexWake(&slot->cancel_requested);
+  }
 }
 
 
@@ -324,10 +706,15 @@ template <class Goal, class Result, class Feedback>
 ActionClient<Goal, Result, Feedback>::ActionClient(std::string name)
 : shm_name(name)
 , shared_memory(nullptr)
+, memory_ptr(nullptr)
+, header(nullptr)
+, slot_list(nullptr)
+, slot_num(0)
+, last_goal_id(0)
 {
-  if (!std::is_standard_layout<Goal>::value 
-    || !std::is_standard_layout<Result>::value 
-    || !std::is_standard_layout<Feedback>::value)
+  if (!is_transferable_message<Goal>()
+    || !is_transferable_message<Result>()
+    || !is_transferable_message<Feedback>())
   {
     throw std::runtime_error("shm::ActionClient: Be setted not POD class!");
   }
@@ -337,6 +724,7 @@ ActionClient<Goal, Result, Feedback>::ActionClient(std::string name)
 template <class Goal, class Result, class Feedback>
 ActionClient<Goal, Result, Feedback>::~ActionClient()
 {
+  feedback_ring_list.clear();
   if (shared_memory != nullptr)
   {
     delete shared_memory;
@@ -355,37 +743,165 @@ ActionClient<Goal, Result, Feedback>::isServerConnected()
     {
       return false;
     }
-    uint8_t *data_ptr = shared_memory->getPtr();
-    memory_ptr = data_ptr;
-    goal_mutex = reinterpret_cast<pthread_mutex_t *>(data_ptr);
-    data_ptr += sizeof(pthread_mutex_t);
-    goal_condition = reinterpret_cast<pthread_cond_t *>(data_ptr);
-    data_ptr += sizeof(pthread_cond_t);
-    goal_timestamp_us = reinterpret_cast<uint64_t *>(data_ptr);
-    data_ptr += sizeof(uint64_t);
-    goal_ptr = reinterpret_cast<Goal *>(data_ptr);
-    data_ptr += sizeof(Goal);
-    result_mutex = reinterpret_cast<pthread_mutex_t *>(data_ptr);
-    data_ptr += sizeof(pthread_mutex_t);
-    result_condition = reinterpret_cast<pthread_cond_t *>(data_ptr);
-    data_ptr += sizeof(pthread_cond_t);
-    result_timestamp_us = reinterpret_cast<uint64_t *>(data_ptr);
-    data_ptr += sizeof(uint64_t);
-    result_ptr = reinterpret_cast<Result *>(data_ptr);
-    data_ptr += sizeof(Result);
-    feedback_ptr = reinterpret_cast<Feedback *>(data_ptr);
-    data_ptr += sizeof(Feedback);
-    status_ptr = reinterpret_cast<ACTION_STATUS *>(data_ptr);
-    data_ptr += sizeof(ACTION_STATUS);
-    cancel_timestamp_us = reinterpret_cast<uint64_t *>(data_ptr);
+    memory_ptr = shared_memory->getPtr();
+    header     = reinterpret_cast<ActionHeader *>(memory_ptr);
+    int num        = 0;
+    int buffer_num = 0;
+    if (shared_memory->getSize() >= sizeof(ActionHeader))
+    {
+      num        = static_cast<int>(header->goal_num.load(std::memory_order_acquire));
+      buffer_num = static_cast<int>(header->feedback_buffer_num.load(std::memory_order_relaxed));
+    }
+    // The server has not finished initializing, or the segment belongs to another layout
+    if (num <= 0 || buffer_num <= 0 ||
+        shared_memory->getSize() < ActionServer<Goal, Result, Feedback>::getMemorySize(num, buffer_num))
+    {
+      shared_memory->disconnect();
+      return false;
+    }
+
+    feedback_ring_list.clear();
+    try
+    {
+      for (int i = 0; i < num; i++)
+      {
+        size_t offset = ActionServer<Goal, Result, Feedback>::getFeedbackRingOffset(num, buffer_num, i);
+        feedback_ring_list.push_back(std::make_unique<RingBuffer>(memory_ptr + offset));
+        // The newest sample is kept for getFeedback() however old it is
+        feedback_ring_list.back()->setDataExpiryTime_us(0);
+      }
+    }
+    catch (const std::runtime_error &)
+    {
+      feedback_ring_list.clear();
+      shared_memory->disconnect();
+      return false;
+    }
+    slot_list = reinterpret_cast<GoalSlot *>(memory_ptr + sizeof(ActionHeader));
+    slot_num  = num;
   }
 
   return true;
 }
 
+//! @brief ゴールIDに対応するスロットを取得する
+//! @param [in] goal_id ゴールID
+//! @return GoalSlot* スロット(未接続、IDが無効、またはスロットが再利用されている場合はnullptr)
+template <class Goal, class Result, class Feedback>
+typename ActionClient<Goal, Result, Feedback>::GoalSlot *
+ActionClient<Goal, Result, Feedback>::findSlot(ActionGoalId goal_id) const
+{
+  uint64_t index = goal_id & ACTION_GOAL_SLOT_MASK;
+  if (slot_list == nullptr || goal_id == 0 || index >= static_cast<uint64_t>(slot_num) ||
+      slot_list[index].goal_id.load(std::memory_order_acquire) != goal_id)
+  {
+    return nullptr;
+  }
+  return &slot_list[index];
+}
+
+//! @brief ゴールを書き込むスロットを確保する
+//! @return int 確保したスロット番号(全てのスロットが受理待ちまたは実行中の場合は-1)
+//! @details 空きスロットが無い場合は、完了したゴールのうち最も古いものを再利用する．
+//! それも無い場合は、ゴールの書き込み中に終了したクライアントのスロットを回収する．
+template <class Goal, class Result, class Feedback>
+int
+ActionClient<Goal, Result, Feedback>::claimSlot()
+{
+  int claimed = -1;
+  while (claimed < 0)
+  {
+    int oldest_done = -1;
+    for (int i = 0; i < slot_num && claimed < 0; i++)
+    {
+      uint32_t state = slot_list[i].state.load(std::memory_order_acquire);
+      if (state == ACTION_GOAL_FREE)
+      {
+        if (slot_list[i].state.compare_exchange_strong(state, ACTION_GOAL_CLAIMED, std::memory_order_acq_rel))
+        {
+          claimed = i;
+        }
+      }
+      else if (state == ACTION_GOAL_DONE &&
+               (oldest_done < 0 || slot_list[i].goal_id.load(std::memory_order_relaxed) <
+                                       slot_list[oldest_done].goal_id.load(std::memory_order_relaxed)))
+      {
+        oldest_done = i;
+      }
+    }
+    if (claimed >= 0)
+    {
+      break;
+    }
+    if (oldest_done < 0)
+    {
+      claimed = reclaimDeadSlot();
+      if (claimed < 0)
+      {
+        return -1;
+      }
+      break;
+    }
+    uint32_t expected = ACTION_GOAL_DONE;
+    if (slot_list[oldest_done].state.compare_exchange_strong(expected, ACTION_GOAL_CLAIMED,
+                                                             std::memory_order_acq_rel))
+    {
+      claimed = oldest_done;
+    }
+  }
+
+  // The start time goes first so that a reader of the new pid never pairs it with a stale start time
+  slot_list[claimed].owner_start_time.store(getCurrentProcessStartTime(), std::memory_order_relaxed);
+  slot_list[claimed].owner_pid.store(static_cast<uint32_t>(getpid()), std::memory_order_release);
+  return claimed;
+}
+
+//! @brief ゴールの書き込み中に終了したクライアントのスロットを回収する
+//! @return int 回収したスロット番号(回収できるスロットが無い場合は-1)
+//! @details owner_pidを0に置き換えたクライアントだけが回収を行うため、同じスロットが二重に回収されることはない．
+//! 回収したスロットは書き込み中のまま呼び出し元が引き継ぐ．
+//! owner_pidが0のスロットは確保の直後であるため回収しない．
+template <class Goal, class Result, class Feedback>
+int
+ActionClient<Goal, Result, Feedback>::reclaimDeadSlot()
+{
+  uint32_t self_pid = static_cast<uint32_t>(getpid());
+  for (int i = 0; i < slot_num; i++)
+  {
+    GoalSlot &slot = slot_list[i];
+    if (slot.state.load(std::memory_order_acquire) != ACTION_GOAL_CLAIMED)
+    {
+      continue;
+    }
+    uint32_t pid = slot.owner_pid.load(std::memory_order_acquire);
+    if (pid == 0 || pid == self_pid ||
+        isProcessAlive(static_cast<pid_t>(pid), slot.owner_start_time.load(std::memory_order_relaxed)))
+    {
+      continue;
+    }
+    if (slot.owner_pid.compare_exchange_strong(pid, 0, std::memory_order_acq_rel) &&
+        slot.state.load(std::memory_order_acquire) == ACTION_GOAL_CLAIMED)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
 template <class Goal, class Result, class Feedback>
 bool
 ActionClient<Goal, Result, Feedback>::sendGoal(Goal goal)
+{
+  return sendGoal(goal, nullptr);
+}
+
+//! @brief ゴールを送信する
+//! @param [in] goal ゴール
+//! @param [out] goal_id 送信したゴールのID(nullptrの場合は格納しない)
+//! @return bool 送信できた場合は真．サーバーが無い場合やゴールテーブルが満杯の場合は偽
+template <class Goal, class Result, class Feedback>
+bool
+ActionClient<Goal, Result, Feedback>::sendGoal(Goal goal, ActionGoalId *goal_id)
 {
     // Check the action shared memory existance.
   if (!(isServerConnected()))
@@ -393,13 +909,38 @@ ActionClient<Goal, Result, Feedback>::sendGoal(Goal goal)
     return false;
   }
 
-  current_result_timestamp_usec = *result_timestamp_us;
+  if (!MessageStorage<Goal>::fits(goal))
+  {
+    throw std::runtime_error("shm::ActionClient: Goal is larger than its serialized slot!");
+  }
+  int slot = claimSlot();
+  if (slot < 0)
+  {
+    return false;
+  }
 
-  // Set request to shared memory
-  *goal_ptr = goal;
-  *goal_timestamp_us = getCurrentTimeUSec();
-  pthread_cond_broadcast(goal_condition);
+  // Change the ID first so that readers of the previous goal in this slot notice the reuse
+  GoalSlot    &goal_slot = slot_list[slot];
+  ActionGoalId new_id    = ((header->next_goal_number.fetch_add(1, std::memory_order_relaxed) + 1)
+                            << ACTION_GOAL_SLOT_BITS) | static_cast<uint64_t>(slot);
+  goal_slot.goal_id.store(new_id, std::memory_order_seq_cst);
+  MessageStorage<Goal>::store(&goal_slot.goal, goal);
+  goal_slot.status.store(ACTIVE, std::memory_order_relaxed);
+  goal_slot.cancel_requested.store(0, std::memory_order_relaxed);
+  goal_slot.owner_pid.store(0, std::memory_order_relaxed);
+  goal_slot.state.store(ACTION_GOAL_PENDING, std::memory_order_seq_cst);
+
+  header->goal_sequence.fetch_add(1, std::memory_order_seq_cst);
+  if (header->goal_waiter_num.load(std::memory_order_seq_cst) > 0)
+  {
+    futexWake(&header->goal_sequence);
+  }
 
+  last_goal_id = new_id;
+  if (goal_id != nullptr)
+  {
+    *goal_id = new_id;
+  }
   return true;
 }
 
@@ -407,89 +948,341 @@ template <class Goal, class Result, class Feedback>
 Result
 ActionClient<Goal, Result, Feedback>::getResult()
 {
-  return *result_ptr;
+  return getResult(last_goal_id);
+}
+
+//! @brief ゴールの結果を取得する
+//! @param [in] goal_id ゴールID
+//! @return Result 結果(ゴールが完了していない、または既に存在しない場合は既定値)
+template <class Goal, class Result, class Feedback>
+Result
+ActionClient<Goal, Result, Feedback>::getResult(ActionGoalId goal_id)
+{
+  GoalSlot *slot = findSlot(goal_id);
+  if (slot == nullptr || slot->state.load(std::memory_order_acquire) != ACTION_GOAL_DONE)
+  {
+    return Result();
+  }
+  Result result;
+  bool   is_loaded = MessageStorage<Result>::load(slot->result, &result);
+  // The slot may have been reused for another goal while copying
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (!is_loaded || slot->goal_id.load(std::memory_order_relaxed) != goal_id)
+  {
+    return Result();
+  }
+  return result;
 }
 
 template <class Goal, class Result, class Feedback>
 Feedback
 ActionClient<Goal, Result, Feedback>::getFeedback()
 {
-  pthread_mutex_lock(result_mutex);
-  Feedback feedback_copy = *feedback_ptr;
-  pthread_mutex_unlock(result_mutex);
-  return feedback_copy;
+  return getFeedback(last_goal_id);
 }
 
+//! @brief ゴールの最新のフィードバックを取得する
+//! @param [in] goal_id ゴールID
+//! @return Feedback フィードバック(まだ届いていない、またはゴールが既に存在しない場合は既定値)
+//! @details 未読のフィードバックの読み込み位置は変わらない．
 template <class Goal, class Result, class Feedback>
-ACTION_STATUS
-ActionClient<Goal, Result, Feedback>::getStatus()
+Feedback
+ActionClient<Goal, Result, Feedback>::getFeedback(ActionGoalId goal_id)
 {
-  return *status_ptr;
+  RingBuffer *ring = findFeedbackRing(goal_id);
+  if (ring == nullptr)
+  {
+    return Feedback();
+  }
+
+  // Copy the newest sample and retry if the server overwrote it during the copy
+  FeedbackSample sample;
+  int            buffer_num;
+  do
+  {
+    buffer_num = ring->getNewestBufferNum();
+    if (buffer_num < 0)
+    {
+      return Feedback();
+    }
+    sample = *reinterpret_cast<FeedbackSample *>(ring->getBufferPtr(buffer_num));
+  } while (!ring->verifyBuffer(buffer_num));
+
+  // The newest sample still belongs to the previous goal in this slot
+  Feedback feedback;
+  if (sample.goal_id != goal_id || !MessageStorage<Feedback>::load(sample.feedback, &feedback))
+  {
+    return Feedback();
+  }
+  return feedback;
 }
 
 template <class Goal, class Result, class Feedback>
-void
-ActionClient<Goal, Result, Feedback>::cancelGoal()
+bool
+ActionClient<Goal, Result, Feedback>::waitForFeedback(unsigned long wait_time_us)
 {
-  *cancel_timestamp_us = getCurrentTimeUSec();
+  return waitForFeedback(last_goal_id, wait_time_us);
 }
 
+//! @brief ゴールの未読のフィードバックが届くまで待機する
+//! @param [in] goal_id ゴールID
+//! @param [in] wait_time_us 待ち時間[usec]
+//! @return bool 未読のフィードバックがある場合は真．タイムアウトした場合やゴールが既に存在しない場合は偽
+//! @details 未読のフィードバックは drainFeedback() で読み込む．
 template <class Goal, class Result, class Feedback>
 bool
-ActionClient<Goal, Result, Feedback>::waitForResult(unsigned long wait_time_us)
+ActionClient<Goal, Result, Feedback>::waitForFeedback(ActionGoalId goal_id, unsigned long wait_time_us)
 {
-  struct timespec ts;
-  long sec  = static_cast<long>(wait_time_us / 1000000);
-  long mod_sec = static_cast<long>(wait_time_us % 1000000);
-  // Use CLOCK_MONOTONIC to avoid NTP time sync issues
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  ts.tv_sec += sec;
-  ts.tv_nsec+= mod_sec * 1000;
-  if (1000000000 <= ts.tv_nsec)
+  RingBuffer *ring = findFeedbackRing(goal_id);
+  if (ring == nullptr)
   {
-    ts.tv_nsec -= 1000000000;
-    ts.tv_sec  += 1;
+    return false;
   }
-  
-  while (current_result_timestamp_usec >= *result_timestamp_us)
+
+  uint64_t start_time = getCurrentTimeUSec();
+  while (getNextFeedback(ring, goal_id) < 0)
   {
-    // Wait on the condvar
-    pthread_mutex_lock(result_mutex);
-    int ret = pthread_cond_timedwait(result_condition, result_mutex, &ts);
-    pthread_mutex_unlock(result_mutex);
-    if (ret == ETIMEDOUT)
+    uint64_t elapsed = getCurrentTimeUSec() - start_time;
+    if (elapsed >= wait_time_us || findSlot(goal_id) == nullptr)
     {
       return false;
     }
+    ring->waitFor(wait_time_us - elapsed);
   }
   return true;
 }
 
+template <class Goal, class Result, class Feedback>
+size_t
+ActionClient<Goal, Result, Feedback>::drainFeedback(Feedback *feedback_list, size_t max_num)
+{
+  return drainFeedback(last_goal_id, feedback_list, max_num);
+}
+
+//! @brief ゴールの未読のフィードバックを書き込み順にまとめて読み込む
+//! @param [in] goal_id ゴールID
+//! @param [out] feedback_list 格納先の配列
+//! @param [in] max_num 格納先の配列の要素数
+//! @return size_t 格納したフィードバックの数
+//! @details 読み込む前にサーバーに上書きされたフィードバックは読み飛ばされる．
+template <class Goal, class Result, class Feedback>
+size_t
+ActionClient<Goal, Result, Feedback>::drainFeedback(ActionGoalId goal_id, Feedback *feedback_list, size_t max_num)
+{
+  RingBuffer *ring = findFeedbackRing(goal_id);
+  if (ring == nullptr || feedback_list == nullptr)
+  {
+    return 0;
+  }
+
+  size_t read_num = 0;
+  while (read_num < max_num)
+  {
+    int buffer_num = getNextFeedback(ring, goal_id);
+    if (buffer_num < 0)
+    {
+      break;
+    }
+    FeedbackSample *sample    = reinterpret_cast<FeedbackSample *>(ring->getBufferPtr(buffer_num));
+    bool            is_loaded = MessageStorage<Feedback>::load(sample->feedback, &feedback_list[read_num]);
+    if (ring->consumeBuffer(buffer_num) && is_loaded)
+    {
+      read_num++;
+    }
+  }
+  return read_num;
+}
+
+//! @brief ゴールIDに対応するフィードバックのリングバッファを取得する
+//! @param [in] goal_id ゴールID
+//! @return RingBuffer* リングバッファ(未接続、IDが無効、またはスロットが再利用されている場合はnullptr)
+template <class Goal, class Result, class Feedback>
+RingBuffer *
+ActionClient<Goal, Result, Feedback>::findFeedbackRing(ActionGoalId goal_id) const
+{
+  if (findSlot(goal_id) == nullptr)
+  {
+    return nullptr;
+  }
+  return feedback_ring_list[goal_id & ACTION_GOAL_SLOT_MASK].get();
+}
+
+//! @brief ゴールの未読のフィードバックのうち最も古いものを探す
+//! @param [in] ring フィードバックのリングバッファ
+//! @param [in] goal_id ゴールID
+//! @return int バッファ番号(未読のフィードバックが無い場合は-1)
+//! @details 他のゴールのフィードバックは読み飛ばす．読み込み後は consumeBuffer() で読み込み位置を進めること．
+template <class Goal, class Result, class Feedback>
+int
+ActionClient<Goal, Result, Feedback>::getNextFeedback(RingBuffer *ring, ActionGoalId goal_id)
+{
+  while (true)
+  {
+    int buffer_num = ring->getNextBufferNum();
+    if (buffer_num < 0)
+    {
+      return -1;
+    }
+    ActionGoalId sample_id = reinterpret_cast<FeedbackSample *>(ring->getBufferPtr(buffer_num))->goal_id;
+    if (ring->verifyBuffer(buffer_num) && sample_id == goal_id)
+    {
+      return buffer_num;
+    }
+    // A sample of the previous goal in this slot, or one overwritten while reading its ID
+    ring->consumeBuffer(buffer_num);
+  }
+}
+
+template <class Goal, class Result, class Feedback>
+ACTION_STATUS
+ActionClient<Goal, Result, Feedback>::getStatus()
+{
+  return getStatus(last_goal_id);
+}
+
+//! @brief ゴールの状態を取得する
+//! @param [in] goal_id ゴールID
+//! @return ACTION_STATUS 状態．完了前のゴールはACTIVE、既に存在しないゴールはLOST
+template <class Goal, class Result, class Feedback>
+ACTION_STATUS
+ActionClient<Goal, Result, Feedback>::getStatus(ActionGoalId goal_id)
+{
+  GoalSlot *slot = findSlot(goal_id);
+  if (slot == nullptr)
+  {
+    return LOST;
+  }
+  uint32_t state = slot->state.load(std::memory_order_acquire);
+  if (state == ACTION_GOAL_FREE || state == ACTION_GOAL_CLAIMED)
+  {
+    return LOST;
+  }
+  if (state != ACTION_GOAL_DONE)
+  {
+    return ACTIVE;
+  }
+  return static_cast<ACTION_STATUS>(slot->status.load(std::memory_order_relaxed));
+}
+
+template <class Goal, class Result, class Feedback>
+void
+ActionClient<Goal, Result, Feedback>::cancelGoal()
+{
+  cancelGoal(last_goal_id);
+}
+
+//! @brief ゴールの中断を要求する
+//! @param [in] goal_id ゴールID
+//! @details サーバーの waitForPreempt() で待機しているスレッドを起床させる．
+template <class Goal, class Result, class Feedback>
+void
+ActionClient<Goal, Result, Feedback>::cancelGoal(ActionGoalId goal_id)
+{
+  GoalSlot *slot = findSlot(goal_id);
+  if (slot == nullptr)
+  {
+    return;
+  }
+  // seq_cst ordering pairs with waitForPreempt(): either the server sees the request or this sees its waiter
+  slot->cancel_requested.store(1, std::memory_order_seq_cst);
+  if (slot->preempt_waiter_num.load(std::memory_order_seq_cst) > 0)
+  {
+    futexWake(&slot->cancel_requested);
+  }
+}
+
 template <class Goal, class Result, class Feedback>
 bool
-ActionClient<Goal, Result, Feedback>::waitForServer(uint64_t wait_time_us)
+ActionClient<Goal, Result, Feedback>::waitForResult(unsigned long wait_time_us)
 {
-  static const uint64_t SLEEP_PERIOD_us = 100000;
+  return waitForResult(last_goal_id, wait_time_us);
+}
 
-  if (isServerConnected())
+//! @brief ゴールが完了するまで待機する
+//! @param [in] goal_id ゴールID
+//! @param [in] wait_time_us 待ち時間[usec]
+//! @return bool ゴールが完了した場合は真．タイムアウトした場合やゴールが既に存在しない場合は偽
+template <class Goal, class Result, class Feedback>
+bool
+ActionClient<Goal, Result, Feedback>::waitForResult(ActionGoalId goal_id, unsigned long wait_time_us)
+{
+  GoalSlot *slot = findSlot(goal_id);
+  if (slot == nullptr)
   {
-    return true;
+    return false;
   }
 
-  for (uint64_t time_index = 0; time_index < wait_time_us / SLEEP_PERIOD_us; time_index++)
+  uint64_t start_time = getCurrentTimeUSec();
+  while (true)
   {
-    if (isServerConnected())
+    uint32_t state = slot->state.load(std::memory_order_seq_cst);
+    if (slot->goal_id.load(std::memory_order_acquire) != goal_id)
+    {
+      return false;
+    }
+    if (state == ACTION_GOAL_DONE)
     {
       return true;
     }
-    usleep(SLEEP_PERIOD_us);
+    if (state != ACTION_GOAL_PENDING && state != ACTION_GOAL_ACTIVE && state != ACTION_GOAL_FINISHING)
+    {
+      // The table was reset by a restarted server
+      return false;
+    }
+    uint64_t elapsed = getCurrentTimeUSec() - start_time;
+    if (elapsed >= wait_time_us)
+    {
+      return false;
+    }
+    slot->waiter_num.fetch_add(1, std::memory_order_seq_cst);
+    futexWait(&slot->state, state, wait_time_us - elapsed);
+    slot->waiter_num.fetch_sub(1, std::memory_order_seq_cst);
   }
+}
 
-  return false;
+//! @brief サーバーが起動するまで待機する
+//! @param [in] wait_time_us 待ち時間[usec]
+//! @return bool サーバーに接続できた場合は真、タイムアウトした場合は偽
+//! @details 共有メモリが作成されるまではinotifyの通知で、ゴールテーブルが初期化されるまではfutexで待機する．
+template <class Goal, class Result, class Feedback>
+bool
+ActionClient<Goal, Result, Feedback>::waitForServer(unsigned long wait_time_us)
+{
+  // Upper bound of one sleep, in case the segment is replaced while waiting on the old one
+  static const uint64_t RECHECK_PERIOD_us = 100000;
+
+  uint64_t start_time    = getCurrentTimeUSec();
+  uint32_t last_goal_num = 0;
+  while (!isServerConnected())
+  {
+    uint64_t elapsed = getCurrentTimeUSec() - start_time;
+    if (elapsed >= wait_time_us ||
+        !shared_memory->waitForSize(sizeof(ActionHeader), wait_time_us - elapsed) || !shared_memory->connect())
+    {
+      return false;
+    }
+
+    elapsed            = getCurrentTimeUSec() - start_time;
+    uint64_t wait_usec = std::min(RECHECK_PERIOD_us, wait_time_us - std::min<uint64_t>(elapsed, wait_time_us));
+    std::atomic<uint32_t> *goal_num = &reinterpret_cast<ActionHeader *>(shared_memory->getPtr())->goal_num;
+    uint32_t               num      = goal_num->load(std::memory_order_acquire);
+    if (num == 0)
+    {
+      futexWait(goal_num, 0, wait_usec);
+    }
+    else if (num == last_goal_num)
+    {
+      // Still not attachable after initialization: a server of another type or layout owns the name
+      usleep(wait_usec);
+    }
+    last_goal_num = num;
+    shared_memory->disconnect();
+  }
+  return true;
 }
 
 }
 
 }
 
-#endif //__SHM_ACTION_LIB_H__
\ No newline at end of file
+#endif //__SHM_ACTION_LIB_H__
@@ -3,6 +3,7 @@
 #include <chrono>
 #include <vector>
 #include <atomic>
+#include <memory>
 
 #include "shm_base.hpp"
 #include "shm_action.hpp"
@@ -684,6 +685,359 @@ TEST_F(SHMActionTest, PerformanceTest)
     EXPECT_EQ(actions_completed.load(), num_actions);
 }
 
+// Several goals run at once, each tracked by its own ID
+TEST_F(SHMActionTest, ConcurrentGoalsTest)
+{
+    irlab::shm::ActionServer<SimpleGoal, SimpleResult, SimpleFeedback> server("/test_action");
+
+    // One server thread per goal, as a manipulation stack would run arm, gripper and base
+    std::vector<std::thread> worker_threads;
+    for (int i = 0; i < 3; i++)
+    {
+        worker_threads.emplace_back([&]() {
+            irlab::shm::ActionGoalId goal_id;
+            SimpleGoal goal = server.acceptNewGoal(&goal_id);
+            for (int step = 0; step < 20; step++)
+            {
+                if (server.isPreemptRequested(goal_id))
+                {
+                    server.setPreempted(goal_id);
+                    return;
+                }
+                server.publishFeedback(goal_id, SimpleFeedback(goal.value + step * 0.01f));
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            server.publishResult(goal_id, SimpleResult(goal.value * 2));
+        });
+    }
+
+    irlab::shm::ActionClient<SimpleGoal, SimpleResult, SimpleFeedback> client("/test_action");
+    ASSERT_TRUE(client.waitForServer(1000000));
+
+    irlab::shm::ActionGoalId goal_ids[3];
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_TRUE(client.sendGoal(SimpleGoal(i + 1), &goal_ids[i]));
+    }
+    EXPECT_NE(goal_ids[0], goal_ids[1]);
+    EXPECT_NE(goal_ids[1], goal_ids[2]);
+
+    // All three are in flight together; only the second one is cancelled
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECT_EQ(client.getStatus(goal_ids[i]), irlab::shm::ACTIVE);
+    }
+    SimpleFeedback feedback = client.getFeedback(goal_ids[2]);
+    EXPECT_GE(feedback.progress, 3.0f);
+    EXPECT_LT(feedback.progress, 4.0f);
+    client.cancelGoal(goal_ids[1]);
+
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECT_TRUE(client.waitForResult(goal_ids[i], 2000000));
+    }
+    EXPECT_EQ(client.getStatus(goal_ids[0]), irlab::shm::SUCCEEDED);
+    EXPECT_EQ(client.getResult(goal_ids[0]).result, 2);
+    EXPECT_EQ(client.getStatus(goal_ids[1]), irlab::shm::PREEMPTED);
+    EXPECT_EQ(client.getStatus(goal_ids[2]), irlab::shm::SUCCEEDED);
+    EXPECT_EQ(client.getResult(goal_ids[2]).result, 6);
+
+    for (auto& t : worker_threads)
+    {
+        t.join();
+    }
+}
+
+// Only the first call that finishes a goal decides its status and result
+TEST_F(SHMActionTest, LateFinishTest)
+{
+    irlab::shm::ActionServer<SimpleGoal, SimpleResult, SimpleFeedback> server("/test_action");
+    irlab::shm::ActionClient<SimpleGoal, SimpleResult, SimpleFeedback> client("/test_action");
+    ASSERT_TRUE(client.waitForServer(1000000));
+
+    irlab::shm::ActionGoalId goal_id;
+    ASSERT_TRUE(client.sendGoal(SimpleGoal(1)));
+    server.acceptNewGoal(&goal_id);
+    server.publishResult(goal_id, SimpleResult(7));
+    server.setPreempted(goal_id);
+    server.publishResult(goal_id, SimpleResult(8));
+    EXPECT_TRUE(client.waitForResult(1000000));
+    EXPECT_EQ(client.getStatus(), irlab::shm::SUCCEEDED);
+    EXPECT_EQ(client.getResult().result, 7);
+
+    // Racing finishes leave a status consistent with the result
+    for (int i = 0; i < 100; i++)
+    {
+        ASSERT_TRUE(client.sendGoal(SimpleGoal(i)));
+        server.acceptNewGoal(&goal_id);
+        std::thread preempt_thread([&]() { server.setPreempted(goal_id); });
+        server.publishResult(goal_id, SimpleResult(i));
+        preempt_thread.join();
+        ASSERT_TRUE(client.waitForResult(1000000));
+        if (client.getStatus() == irlab::shm::SUCCEEDED)
+        {
+            EXPECT_EQ(client.getResult().result, i);
+        }
+        else
+        {
+            EXPECT_EQ(client.getStatus(), irlab::shm::PREEMPTED);
+        }
+    }
+}
+
+// A full goal table refuses new goals, and finished goals are recycled oldest first
+TEST_F(SHMActionTest, GoalTableCapacityTest)
+{
+    irlab::shm::ActionServer<SimpleGoal, SimpleResult, SimpleFeedback> server("/test_action",
+                                                                              irlab::shm::DEFAULT_PERM, 2);
+    irlab::shm::ActionClient<SimpleGoal, SimpleResult, SimpleFeedback> client("/test_action");
+    ASSERT_TRUE(client.waitForServer(1000000));
+
+    irlab::shm::ActionGoalId first_id, second_id, third_id;
+    ASSERT_TRUE(client.sendGoal(SimpleGoal(1), &first_id));
+    ASSERT_TRUE(client.sendGoal(SimpleGoal(2), &second_id));
+    EXPECT_FALSE(client.sendGoal(SimpleGoal(3), &third_id));
+
+    for (int i = 0; i < 2; i++)
+    {
+        irlab::shm::ActionGoalId goal_id;
+        SimpleGoal goal = server.acceptNewGoal(&goal_id);
+        server.publishResult(goal_id, SimpleResult(goal.value * 10));
+    }
+    EXPECT_EQ(client.getResult(first_id).result, 10);
+    EXPECT_EQ(client.getResult(second_id).result, 20);
+
+    // The oldest finished goal gives its slot to the new one
+    ASSERT_TRUE(client.sendGoal(SimpleGoal(3), &third_id));
+    EXPECT_EQ(client.getStatus(first_id), irlab::shm::LOST);
+    EXPECT_FALSE(client.waitForResult(first_id, 1000));
+    EXPECT_EQ(client.getStatus(second_id), irlab::shm::SUCCEEDED);
+    EXPECT_EQ(client.getStatus(third_id), irlab::shm::ACTIVE);
+}
+
+// High-rate feedback is queued per goal and read in order without loss
+TEST_F(SHMActionTest, FeedbackStreamTest)
+{
+    irlab::shm::ActionServer<SimpleGoal, SimpleResult, SimpleFeedback> server(
+        "/test_action", irlab::shm::DEFAULT_PERM, irlab::shm::DEFAULT_ACTION_GOAL_NUM, 128);
+
+    std::thread server_thread([&]() {
+        SimpleGoal goal = server.acceptNewGoal();
+        for (int i = 0; i < 100; i++)
+        {
+            server.publishFeedback(SimpleFeedback(static_cast<float>(i)));
+        }
+        server.publishResult(SimpleResult(goal.value));
+    });
+
+    irlab::shm::ActionClient<SimpleGoal, SimpleResult, SimpleFeedback> client("/test_action");
+    ASSERT_TRUE(client.waitForServer(1000000));
+    ASSERT_TRUE(client.sendGoal(SimpleGoal(7)));
+
+    std::vector<SimpleFeedback> received;
+    SimpleFeedback              batch[16];
+    while (received.size() < 100 && client.waitForFeedback(1000000))
+    {
+        size_t read_num = client.drainFeedback(batch, 16);
+        received.insert(received.end(), batch, batch + read_num);
+    }
+    ASSERT_EQ(received.size(), 100u);
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_FLOAT_EQ(received[i].progress, static_cast<float>(i));
+    }
+    EXPECT_EQ(client.drainFeedback(batch, 16), 0u);
+    EXPECT_FLOAT_EQ(client.getFeedback().progress, 99.0f);
+
+    EXPECT_TRUE(client.waitForResult(1000000));
+    EXPECT_EQ(client.getResult().result, 7);
+    server_thread.join();
+}
+
+// Feedback left in a recycled slot is not reported for the next goal
+TEST_F(SHMActionTest, FeedbackGoalIsolationTest)
+{
+    irlab::shm::ActionServer<SimpleGoal, SimpleResult, SimpleFeedback> server("/test_action",
+                                                                              irlab::shm::DEFAULT_PERM, 1);
+    irlab::shm::ActionClient<SimpleGoal, SimpleResult, SimpleFeedback> client("/test_action");
+    ASSERT_TRUE(client.waitForServer(1000000));
+
+    irlab::shm::ActionGoalId first_id, second_id;
+    ASSERT_TRUE(client.sendGoal(SimpleGoal(1), &first_id));
+    server.acceptNewGoal();
+    server.publishFeedback(SimpleFeedback(1.0f));
+    server.publishResult(SimpleResult(1));
+    EXPECT_FLOAT_EQ(client.getFeedback(first_id).progress, 1.0f);
+
+    ASSERT_TRUE(client.sendGoal(SimpleGoal(2), &second_id));
+    server.acceptNewGoal();
+    SimpleFeedback batch[4];
+    EXPECT_FLOAT_EQ(client.getFeedback(second_id).progress, 0.0f);
+    EXPECT_FALSE(client.waitForFeedback(second_id, 1000));
+    EXPECT_EQ(client.drainFeedback(second_id, batch, 4), 0u);
+
+    server.publishFeedback(SimpleFeedback(2.0f));
+    EXPECT_TRUE(client.waitForFeedback(second_id, 1000000));
+    ASSERT_EQ(client.drainFeedback(second_id, batch, 4), 1u);
+    EXPECT_FLOAT_EQ(batch[0].progress, 2.0f);
+    EXPECT_FLOAT_EQ(client.getFeedback(second_id).progress, 2.0f);
+}
+
+// cancelGoal() wakes a server thread blocked in waitForPreempt() without polling
+TEST_F(SHMActionTest, PreemptNotificationTest)
+{
+    irlab::shm::ActionServer<SimpleGoal, SimpleResult, SimpleFeedback> server("/test_action");
+    irlab::shm::ActionClient<SimpleGoal, SimpleResult, SimpleFeedback> client("/test_action");
+    ASSERT_TRUE(client.waitForServer(1000000));
+    ASSERT_TRUE(client.sendGoal(SimpleGoal(1)));
+    server.acceptNewGoal();
+    EXPECT_FALSE(server.waitForPreempt(1000));
+
+    std::atomic<bool>                     preempted{false};
+    std::chrono::steady_clock::time_point wake_time;
+    std::thread server_thread([&]() {
+        preempted = server.waitForPreempt(5000000);
+        wake_time = std::chrono::steady_clock::now();
+        server.setPreempted();
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto cancel_time = std::chrono::steady_clock::now();
+    client.cancelGoal();
+    EXPECT_TRUE(client.waitForResult(1000000));
+    server_thread.join();
+
+    EXPECT_TRUE(preempted);
+    EXPECT_LT(wake_time - cancel_time, std::chrono::milliseconds(50));
+    EXPECT_EQ(client.getStatus(), irlab::shm::PREEMPTED);
+
+    // A finished goal no longer blocks the waiter
+    EXPECT_TRUE(client.sendGoal(SimpleGoal(2)));
+    irlab::shm::ActionGoalId goal_id;
+    server.acceptNewGoal(&goal_id);
+    std::thread finish_thread([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        server.publishResult(goal_id, SimpleResult(2));
+    });
+    auto start_time = std::chrono::steady_clock::now();
+    EXPECT_FALSE(server.waitForPreempt(goal_id, 5000000));
+    EXPECT_LT(std::chrono::steady_clock::now() - start_time, std::chrono::milliseconds(1000));
+    finish_thread.join();
+}
+
+// waitForServer() returns as soon as the server publishes its goal table
+TEST_F(SHMActionTest, ServerStartupNotificationTest)
+{
+    irlab::shm::ActionClient<SimpleGoal, SimpleResult, SimpleFeedback> client("/test_action");
+    EXPECT_FALSE(client.waitForServer(10000));
+
+    std::chrono::steady_clock::time_point created_time;
+    std::unique_ptr<irlab::shm::ActionServer<SimpleGoal, SimpleResult, SimpleFeedback>> server;
+    std::thread server_thread([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        server = std::make_unique<irlab::shm::ActionServer<SimpleGoal, SimpleResult, SimpleFeedback>>("/test_action");
+        created_time = std::chrono::steady_clock::now();
+    });
+
+    EXPECT_TRUE(client.waitForServer(2000000));
+    auto connected_time = std::chrono::steady_clock::now();
+    server_thread.join();
+    EXPECT_LT(connected_time - created_time, std::chrono::milliseconds(50));
+    EXPECT_TRUE(client.sendGoal(SimpleGoal(1)));
+}
+
+// A WaitSet wakes the thread driving the server as soon as a goal is sent
+TEST_F(SHMActionTest, WaitSetGoalTest)
+{
+    irlab::shm::ActionServer<SimpleGoal, SimpleResult, SimpleFeedback> server("/test_action");
+    irlab::shm::ActionClient<SimpleGoal, SimpleResult, SimpleFeedback> client("/test_action");
+    ASSERT_TRUE(client.waitForServer(1000000));
+
+    irlab::shm::WaitSet wait_set;
+    size_t handle = wait_set.add(server);
+    EXPECT_TRUE(wait_set.wait(10000).empty());
+
+    std::chrono::steady_clock::time_point send_time;
+    std::thread client_thread([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        send_time = std::chrono::steady_clock::now();
+        client.sendGoal(SimpleGoal(5));
+    });
+    std::vector<size_t> ready_list = wait_set.wait(5000000);
+    auto wake_time = std::chrono::steady_clock::now();
+    client_thread.join();
+    ASSERT_EQ(ready_list, std::vector<size_t>{handle});
+    EXPECT_LT(wake_time - send_time, std::chrono::milliseconds(20));
+
+    // The goal stays pending until it is accepted
+    EXPECT_EQ(wait_set.wait(0), ready_list);
+    irlab::shm::ActionGoalId goal_id;
+    EXPECT_EQ(server.acceptNewGoal(&goal_id).value, 5);
+    EXPECT_TRUE(wait_set.wait(1000).empty());
+    server.publishResult(goal_id, SimpleResult(10));
+    EXPECT_TRUE(client.waitForResult(1000000));
+}
+
+// Non-standard-layout goal, result and feedback sent through the flat codec
+struct NamedGoal
+{
+    std::string name;
+    std::vector<double> targets;
+};
+SHM_REFLECT(NamedGoal, name, targets)
+
+struct NamedResult
+{
+    std::vector<std::string> reached;
+};
+SHM_REFLECT(NamedResult, reached)
+
+struct NamedFeedback
+{
+    std::string stage;
+};
+SHM_REFLECT(NamedFeedback, stage)
+
+TEST_F(SHMActionTest, SerializedMessageActionTest)
+{
+    irlab::shm::ActionServer<NamedGoal, NamedResult, NamedFeedback> server("/test_action");
+
+    std::thread server_thread([&]() {
+        NamedGoal   goal = server.acceptNewGoal();
+        NamedResult result;
+        for (size_t i = 0; i < goal.targets.size(); i++)
+        {
+            NamedFeedback feedback;
+            feedback.stage = goal.name + "/" + std::to_string(i);
+            server.publishFeedback(feedback);
+            result.reached.push_back(feedback.stage);
+        }
+        server.publishResult(result);
+    });
+
+    irlab::shm::ActionClient<NamedGoal, NamedResult, NamedFeedback> client("/test_action");
+    ASSERT_TRUE(client.waitForServer(1000000));
+
+    NamedGoal goal;
+    goal.name = "arm";
+    goal.targets.assign(irlab::shm::DEFAULT_SERIALIZED_STORAGE_SIZE, 0.0);
+    EXPECT_THROW(client.sendGoal(goal), std::runtime_error);
+
+    goal.targets = { 0.1, 0.2, 0.3 };
+    ASSERT_TRUE(client.sendGoal(goal));
+    EXPECT_TRUE(client.waitForResult(1000000));
+    server_thread.join();
+
+    EXPECT_EQ(client.getStatus(), irlab::shm::SUCCEEDED);
+    EXPECT_EQ(client.getResult().reached, std::vector<std::string>({ "arm/0", "arm/1", "arm/2" }));
+    EXPECT_EQ(client.getFeedback().stage, "arm/2");
+
+    NamedFeedback batch[8];
+    ASSERT_EQ(client.drainFeedback(batch, 8), 3u);
+    EXPECT_EQ(batch[0].stage, "arm/0");
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,256 @@
+//!
+//! @file shm_bag.hpp
+//! @brief トピックを記録・再生するためのログファイルと記録・再生クラスの定義
+//! @note 記法はROSに準拠する
+//!       http://wiki.ros.org/ja/CppStyleGuide
+//!
+
+#ifndef __SHM_BAG_LIB_H__
+#define __SHM_BAG_LIB_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "shm_base.hpp"
+#include "shm_pub_sub.hpp"
+#include "shm_pub_sub_vector.hpp"
+
+namespace irlab
+{
+
+namespace shm
+{
+
+// ****************************************************************************
+//! @struct BagWriterOptions
+//! @brief ログファイルの書き込み設定
+// ****************************************************************************
+struct BagWriterOptions
+{
+  //! チャンクの大きさ[byte]．チャンク単位でまとめて書き込み、索引もチャンク単位で作る
+  size_t chunk_size = 4 * 1024 * 1024;
+  //! 真の場合はO_DIRECTでページキャッシュを経由せずに書き込む(対応しないファイルシステムでは無視する)
+  bool use_direct_io = false;
+};
+
+// ****************************************************************************
+//! @struct BagTopicInfo
+//! @brief ログファイルに記録されたトピックの情報
+// ****************************************************************************
+struct BagTopicInfo
+{
+  uint32_t    topic_id = 0;
+  std::string name;
+  //! 記録中に見たリングバッファのスロットの大きさ[byte]の最大値
+  size_t      element_size = 0;
+  int         buffer_num   = 0;
+  uint64_t    message_num  = 0;
+};
+
+// ****************************************************************************
+//! @struct BagMessage
+//! @brief ログファイルから読み出した一つのトピック
+//! @details data は割り当てたファイルを直接指すため、BagReaderより長く保持してはならない．
+// ****************************************************************************
+struct BagMessage
+{
+  uint32_t             topic_id     = 0;
+  uint64_t             timestamp_us = 0;
+  const unsigned char *data         = nullptr;
+  size_t               size         = 0;
+};
+
+// ****************************************************************************
+//! @class BagWriter
+//! @brief トピックをチャンク単位でログファイルに追記するクラス
+//! @details ファイルの先頭にヘッダとトピック表を置き、その後にチャンクを並べる．
+//! 各チャンクには時刻順にトピックのバイト列とタイムスタンプを詰め、満杯になるとページ境界に揃えて一度に書き込む．
+//! close() で末尾にチャンクの索引を書き込むため、再生時はファイルを走査せずに任意の時刻へ移動できる．
+//! 索引を書く前に終了した場合でも、BagReaderがチャンクを順に辿って索引を作り直す．
+// ****************************************************************************
+class BagWriter
+{
+public:
+  BagWriter(const std::string &path, const BagWriterOptions &options = BagWriterOptions());
+  ~BagWriter();
+
+  BagWriter(const BagWriter &)            = delete;
+  BagWriter &operator=(const BagWriter &) = delete;
+
+  uint32_t       addTopic(const std::string &name, size_t element_size, int buffer_num);
+  void           updateTopic(uint32_t topic_id, size_t element_size, int buffer_num);
+  void           write(uint32_t topic_id, uint64_t timestamp_us, const void *data, size_t size);
+  unsigned char *reserveRecord(uint32_t topic_id, uint64_t timestamp_us, size_t size);
+  void           commitRecord();
+  void           abortRecord();
+  void           flush();
+  void           close();
+  uint64_t       getMessageNum() const;
+  uint64_t       getUnflushedTime_us() const;
+
+  //! ヘッダとトピック表の領域の大きさ[byte]
+  static constexpr size_t HEADER_SIZE = 64 * 1024;
+  //! 記録できるトピック数の上限
+  static constexpr size_t TOPIC_MAX_NUM = 240;
+  //! O_DIRECTのための書き込みの境界[byte]
+  static constexpr size_t BLOCK_SIZE = 4096;
+
+private:
+  struct IndexEntry
+  {
+    uint64_t offset;
+    uint64_t first_time_us;
+    uint64_t last_time_us;
+    uint64_t message_num;
+  };
+
+  void writeBlock(const unsigned char *data, size_t size, uint64_t offset);
+  void writeHeader();
+
+  int                       fd;
+  BagWriterOptions          writer_options;
+  unsigned char            *header_buffer;
+  unsigned char            *chunk_buffer;
+  size_t                    chunk_capacity;
+  size_t                    chunk_used;
+  uint32_t                  chunk_message_num;
+  uint64_t                  chunk_first_time_us;
+  uint64_t                  chunk_last_time_us;
+  uint64_t                  chunk_open_time_us;
+  size_t                    reserved_size;
+  uint64_t                  reserved_time_us;
+  uint32_t                  reserved_topic_id;
+  uint64_t                  file_offset;
+  uint64_t                  message_num;
+  uint64_t                  start_time_us;
+  uint64_t                  end_time_us;
+  std::vector<BagTopicInfo> topic_list;
+  std::vector<IndexEntry>   index_list;
+};
+
+// ****************************************************************************
+//! @class BagReader
+//! @brief ログファイルを読み込み専用で割り当て、記録されたトピックを順に読み出すクラス
+//! @details 読み出したトピックはコピーせずに割り当てた領域を指す．seek() はチャンクの索引を二分探索する．
+// ****************************************************************************
+class BagReader
+{
+public:
+  explicit BagReader(const std::string &path);
+  ~BagReader();
+
+  BagReader(const BagReader &)            = delete;
+  BagReader &operator=(const BagReader &) = delete;
+
+  const std::vector<BagTopicInfo> &getTopicList() const;
+  uint64_t                         getStartTime_us() const;
+  uint64_t                         getEndTime_us() const;
+  uint64_t                         getMessageNum() const;
+  size_t                           getChunkNum() const;
+  bool                             isIndexed() const;
+  void                             seek(uint64_t timestamp_us);
+  bool                             next(BagMessage *message);
+
+private:
+  struct IndexEntry
+  {
+    uint64_t offset;
+    uint64_t first_time_us;
+    uint64_t last_time_us;
+    uint64_t message_num;
+  };
+
+  bool loadIndex();
+  void rebuildIndex();
+
+  unsigned char            *file_ptr;
+  size_t                    file_size;
+  bool                      is_indexed;
+  uint64_t                  start_time_us;
+  uint64_t                  end_time_us;
+  uint64_t                  message_num;
+  std::vector<BagTopicInfo> topic_list;
+  std::vector<IndexEntry>   index_list;
+  size_t                    current_chunk;
+  size_t                    current_offset;
+  uint32_t                  current_message;
+  uint64_t                  skip_time_us;
+};
+
+// ****************************************************************************
+//! @class BagRecorder
+//! @brief 複数のトピックをキューモードの購読者として読み込み、ログファイルに記録するクラス
+//! @details トピックの型を知らずに、リングバッファのスロットのバイト列をそのまま記録する．
+//! リングバッファが一周する前に読み込めなかったトピックは失われ、getLostNum() に数えられる．
+//! まだ存在しないトピックは出版されるまで待ち、容量の拡張などで作り直された場合は接続し直す．
+// ****************************************************************************
+class BagRecorder
+{
+public:
+  BagRecorder(const std::string &path, const std::vector<std::string> &topic_name_list,
+              const BagWriterOptions &options = BagWriterOptions());
+  ~BagRecorder();
+
+  size_t   recordOnce(uint64_t timeout_usec);
+  void     close();
+  uint64_t getMessageNum() const;
+  uint64_t getLostNum() const;
+
+  //! 書き込んでいないチャンクを保持する最長の時間[usec]．これを過ぎると満杯でなくても書き込む
+  static constexpr uint64_t FLUSH_PERIOD_USEC = 1000000;
+
+private:
+  struct Topic
+  {
+    std::string                        name;
+    uint32_t                           topic_id = 0;
+    bool                               is_added = false;
+    std::unique_ptr<SharedMemoryPosix> shared_memory;
+    std::unique_ptr<RingBuffer>        ring_buffer;
+  };
+
+  bool   connectTopic(Topic &topic);
+  size_t drainTopic(Topic &topic);
+
+  BagWriter                           writer;
+  std::vector<std::unique_ptr<Topic>> topic_list;
+  WaitSet                             wait_set;
+  uint64_t                            lost_num;
+};
+
+// ****************************************************************************
+//! @class BagPlayer
+//! @brief ログファイルのトピックを記録時の間隔で出版し直すクラス
+//! @details 各トピックは Publisher<std::vector<unsigned char>> で記録時と同じスロットの大きさに確保して出版するため、
+//! 固定長のトピックは Subscriber<T>、可変長のトピックは Subscriber<std::vector<T>> でそのまま読み込める．
+// ****************************************************************************
+class BagPlayer
+{
+public:
+  explicit BagPlayer(const std::string &path);
+  ~BagPlayer();
+
+  void       setRate(double rate);
+  void       seek(uint64_t offset_usec);
+  bool       playOnce();
+  uint64_t   getPlayedNum() const;
+  BagReader &getReader();
+
+private:
+  using TopicPublisher = Publisher<std::vector<unsigned char>>;
+
+  BagReader                                    reader;
+  std::vector<std::unique_ptr<TopicPublisher>> publisher_list;
+  double                                       play_rate;
+  bool                                         is_started;
+  uint64_t                                     base_bag_time_us;
+  uint64_t                                     base_wall_time_us;
+  uint64_t                                     played_num;
+};
+
+}  // namespace shm
+
+}  // namespace irlab
+
+#endif /* __SHM_BAG_LIB_H__ */
@@ -0,0 +1,722 @@
+#include <shm_bag.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace irlab
+{
+
+namespace shm
+{
+
+// On-disk layout. All integers are in the byte order of the recording host.
+//
+//   [0, HEADER_SIZE)  BagFileHeader, then BagTopicEntry[TOPIC_MAX_NUM] from BLOCK_SIZE
+//   chunks            BagChunkHeader followed by records, each padded to a BLOCK_SIZE multiple
+//   index             BagIndexEntry[chunk_num], written by close()
+//
+// A record is a BagRecordHeader followed by data_size bytes, padded to 8 bytes.
+
+static constexpr char     BAG_MAGIC[8]     = { 'S', 'H', 'M', 'B', 'A', 'G', '\0', '\1' };
+static constexpr uint32_t BAG_VERSION      = 1;
+static constexpr uint32_t BAG_CHUNK_MAGIC  = 0x4b4e4843;  // "CHNK"
+static constexpr size_t   BAG_RECORD_ALIGN = 8;
+
+struct BagFileHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t topic_num;
+  uint64_t chunk_num;
+  uint64_t message_num;
+  uint64_t index_offset;
+  uint64_t start_time_us;
+  uint64_t end_time_us;
+};
+
+struct BagTopicEntry
+{
+  uint32_t topic_id;
+  int32_t  buffer_num;
+  uint64_t element_size;
+  uint64_t message_num;
+  char     name[232];
+};
+static_assert(sizeof(BagTopicEntry) == 256, "BagTopicEntry must stay 256 bytes");
+static_assert(BagWriter::BLOCK_SIZE + sizeof(BagTopicEntry) * BagWriter::TOPIC_MAX_NUM <= BagWriter::HEADER_SIZE,
+              "Topic table must fit in the header area");
+
+struct BagChunkHeader
+{
+  uint32_t magic;
+  uint32_t message_num;
+  uint64_t chunk_size;
+  uint64_t data_size;
+  uint64_t first_time_us;
+  uint64_t last_time_us;
+  uint64_t reserved[3];
+};
+static_assert(sizeof(BagChunkHeader) == 64, "BagChunkHeader must stay 64 bytes");
+
+struct BagRecordHeader
+{
+  uint32_t topic_id;
+  uint32_t reserved;
+  uint64_t timestamp_us;
+  uint64_t data_size;
+};
+
+//! @brief 境界への切り上げ
+//! @param [in] size 大きさ[byte]
+//! @param [in] alignment 境界[byte](2の冪)
+//! @return size_t 切り上げた大きさ[byte]
+static size_t
+alignSize(size_t size, size_t alignment)
+{
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+//! @brief チャンクがファイルに収まっているかの確認
+//! @param [in] file_ptr 割り当てたファイルの先頭
+//! @param [in] file_size ファイルの大きさ[byte]
+//! @param [in] offset チャンクの位置[byte]
+//! @return bool ヘッダ、チャンク、その中のトピックの領域がファイルに収まっていれば真
+//! @details 壊れたファイルの値で加算が桁あふれしないよう、残りの大きさと比較する．
+static bool
+isValidChunk(const unsigned char *file_ptr, size_t file_size, uint64_t offset)
+{
+  if (offset < BagWriter::HEADER_SIZE || offset > file_size || file_size - offset < sizeof(BagChunkHeader))
+  {
+    return false;
+  }
+  const BagChunkHeader *chunk = reinterpret_cast<const BagChunkHeader *>(file_ptr + offset);
+  return chunk->magic == BAG_CHUNK_MAGIC && chunk->chunk_size >= sizeof(BagChunkHeader) &&
+         chunk->chunk_size <= file_size - offset && chunk->data_size >= sizeof(BagChunkHeader) &&
+         chunk->data_size <= chunk->chunk_size;
+}
+
+//! @brief チャンク内のトピックのヘッダの取得
+//! @param [in] chunk チャンクの先頭
+//! @param [in] record_offset チャンクの先頭からのトピックの位置[byte]
+//! @return const BagRecordHeader* ヘッダとデータがチャンクの書き込み済みの領域に収まらない場合はnullptr
+static const BagRecordHeader *
+getRecord(const BagChunkHeader *chunk, uint64_t record_offset)
+{
+  if (record_offset > chunk->data_size || chunk->data_size - record_offset < sizeof(BagRecordHeader))
+  {
+    return nullptr;
+  }
+  const BagRecordHeader *record = reinterpret_cast<const BagRecordHeader *>(
+      reinterpret_cast<const unsigned char *>(chunk) + record_offset);
+  if (record->data_size > chunk->data_size - record_offset - sizeof(BagRecordHeader))
+  {
+    return nullptr;
+  }
+  return record;
+}
+
+//! @brief O_DIRECTで書き込めるようにページ境界に揃えた領域を確保する
+//! @param [in] size 大きさ[byte]
+//! @return unsigned char* 0で初期化した領域
+static unsigned char *
+allocateBlock(size_t size)
+{
+  void *ptr = nullptr;
+  if (posix_memalign(&ptr, BagWriter::BLOCK_SIZE, size) != 0)
+  {
+    throw std::runtime_error("shm::BagWriter: Cannot allocate chunk buffer!");
+  }
+  std::memset(ptr, 0, size);
+  return static_cast<unsigned char *>(ptr);
+}
+
+//! @brief コンストラクタ
+//! @param [in] path ログファイルのパス(既に存在する場合は上書きする)
+//! @param [in] options チャンクの大きさとO_DIRECTの使用
+//! @return なし
+BagWriter::BagWriter(const std::string &path, const BagWriterOptions &options)
+  : fd(-1)
+  , writer_options(options)
+  , header_buffer(nullptr)
+  , chunk_buffer(nullptr)
+  , chunk_capacity(alignSize(std::max(options.chunk_size, BLOCK_SIZE), BLOCK_SIZE))
+  , chunk_used(sizeof(BagChunkHeader))
+  , chunk_message_num(0)
+  , chunk_first_time_us(0)
+  , chunk_last_time_us(0)
+  , chunk_open_time_us(0)
+  , reserved_size(0)
+  , reserved_time_us(0)
+  , reserved_topic_id(0)
+  , file_offset(HEADER_SIZE)
+  , message_num(0)
+  , start_time_us(0)
+  , end_time_us(0)
+{
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined(O_DIRECT)
+  if (writer_options.use_direct_io)
+  {
+    fd = open(path.c_str(), flags | O_DIRECT, 0644);
+  }
+#endif
+  if (fd < 0)
+  {
+    // tmpfs and some other file systems reject O_DIRECT; fall back to large page-aligned writes
+    fd = open(path.c_str(), flags, 0644);
+  }
+  if (fd < 0)
+  {
+    throw std::runtime_error("shm::BagWriter: Cannot open " + path + "!");
+  }
+  header_buffer = allocateBlock(HEADER_SIZE);
+  chunk_buffer  = allocateBlock(chunk_capacity);
+  writeHeader();
+}
+
+//! @brief デストラクタ
+//! @details close() していなければ、残りのチャンクと索引を書き込んで閉じる．
+BagWriter::~BagWriter()
+{
+  try
+  {
+    close();
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << e.what() << std::endl;
+  }
+  free(header_buffer);
+  free(chunk_buffer);
+}
+
+//! @brief トピックの登録
+//! @param [in] name トピック名
+//! @param [in] element_size リングバッファのスロットの大きさ[byte]
+//! @param [in] buffer_num リングバッファのバッファ数
+//! @return uint32_t 記録に使うトピックのID
+uint32_t
+BagWriter::addTopic(const std::string &name, size_t element_size, int buffer_num)
+{
+  if (topic_list.size() >= TOPIC_MAX_NUM)
+  {
+    throw std::runtime_error("shm::BagWriter: Too many topics!");
+  }
+  if (name.size() >= sizeof(BagTopicEntry::name))
+  {
+    throw std::runtime_error("shm::BagWriter: Topic name is too long!");
+  }
+  BagTopicInfo info;
+  info.topic_id     = static_cast<uint32_t>(topic_list.size());
+  info.name         = name;
+  info.element_size = element_size;
+  info.buffer_num   = buffer_num;
+  topic_list.push_back(info);
+  // Written now so that a recording that is never closed still names its topics
+  writeHeader();
+  return info.topic_id;
+}
+
+//! @brief トピックの情報の更新
+//! @param [in] topic_id トピックのID
+//! @param [in] element_size 作り直されたリングバッファのスロットの大きさ[byte]
+//! @param [in] buffer_num 作り直されたリングバッファのバッファ数
+//! @return なし
+//! @details 再生時に全てのトピックを格納できるよう、スロットの大きさは最大値を残す．
+void
+BagWriter::updateTopic(uint32_t topic_id, size_t element_size, int buffer_num)
+{
+  BagTopicInfo &info = topic_list.at(topic_id);
+  if (element_size <= info.element_size && buffer_num <= info.buffer_num)
+  {
+    return;
+  }
+  info.element_size = std::max(info.element_size, element_size);
+  info.buffer_num   = std::max(info.buffer_num, buffer_num);
+  writeHeader();
+}
+
+//! @brief トピックの書き込み
+//! @param [in] topic_id トピックのID
+//! @param [in] timestamp_us タイムスタンプ[usec]
+//! @param [in] data トピックの先頭アドレス
+//! @param [in] size トピックの大きさ[byte]
+//! @return なし
+void
+BagWriter::write(uint32_t topic_id, uint64_t timestamp_us, const void *data, size_t size)
+{
+  std::memcpy(reserveRecord(topic_id, timestamp_us, size), data, size);
+  commitRecord();
+}
+
+//! @brief チャンク上にトピックの領域を予約する
+//! @param [in] topic_id トピックのID
+//! @param [in] timestamp_us タイムスタンプ[usec]
+//! @param [in] size トピックの大きさ[byte]
+//! @return unsigned char* トピックを書き込む領域．commitRecord() または abortRecord() まで有効
+//! @details 共有メモリのスロットから直接コピーし、上書きされていた場合に abortRecord() で取り消すために使う．
+unsigned char *
+BagWriter::reserveRecord(uint32_t topic_id, uint64_t timestamp_us, size_t size)
+{
+  if (fd < 0)
+  {
+    throw std::runtime_error("shm::BagWriter: Writer is already closed!");
+  }
+  if (topic_id >= topic_list.size())
+  {
+    throw std::runtime_error("shm::BagWriter: Unknown topic ID!");
+  }
+  size_t record_size = alignSize(sizeof(BagRecordHeader) + size, BAG_RECORD_ALIGN);
+  if (chunk_used + record_size > chunk_capacity)
+  {
+    flush();
+    if (chunk_used + record_size > chunk_capacity)
+    {
+      // A single topic larger than a chunk gets a chunk of its own size
+      free(chunk_buffer);
+      chunk_capacity = alignSize(sizeof(BagChunkHeader) + record_size, BLOCK_SIZE);
+      chunk_buffer   = allocateBlock(chunk_capacity);
+    }
+  }
+  BagRecordHeader *record = reinterpret_cast<BagRecordHeader *>(chunk_buffer + chunk_used);
+  record->topic_id        = topic_id;
+  record->reserved        = 0;
+  record->timestamp_us    = timestamp_us;
+  record->data_size       = size;
+  reserved_size           = record_size;
+  reserved_time_us        = timestamp_us;
+  reserved_topic_id       = topic_id;
+  return reinterpret_cast<unsigned char *>(record + 1);
+}
+
+//! @brief 予約した領域の確定
+//! @param なし
+//! @return なし
+void
+BagWriter::commitRecord()
+{
+  if (reserved_size == 0)
+  {
+    return;
+  }
+  if (chunk_message_num == 0)
+  {
+    chunk_first_time_us = reserved_time_us;
+    chunk_last_time_us  = reserved_time_us;
+    chunk_open_time_us  = getCurrentTimeUSec();
+  }
+  if (message_num == 0)
+  {
+    start_time_us = reserved_time_us;
+    end_time_us   = reserved_time_us;
+  }
+  // Topics from different publishers may arrive slightly out of order
+  chunk_first_time_us = std::min(chunk_first_time_us, reserved_time_us);
+  chunk_last_time_us  = std::max(chunk_last_time_us, reserved_time_us);
+  start_time_us       = std::min(start_time_us, reserved_time_us);
+  end_time_us         = std::max(end_time_us, reserved_time_us);
+  chunk_used += reserved_size;
+  chunk_message_num++;
+  message_num++;
+  topic_list[reserved_topic_id].message_num++;
+  reserved_size = 0;
+}
+
+//! @brief 予約した領域の取り消し
+//! @param なし
+//! @return なし
+void
+BagWriter::abortRecord()
+{
+  reserved_size = 0;
+}
+
+//! @brief 書きかけのチャンクをファイルに書き込む
+//! @param なし
+//! @return なし
+//! @details チャンクの末尾はページ境界まで0で埋める．
+void
+BagWriter::flush()
+{
+  if (fd < 0 || chunk_message_num == 0)
+  {
+    return;
+  }
+  size_t          chunk_size = alignSize(chunk_used, BLOCK_SIZE);
+  BagChunkHeader *header     = reinterpret_cast<BagChunkHeader *>(chunk_buffer);
+  std::memset(header, 0, sizeof(BagChunkHeader));
+  header->magic         = BAG_CHUNK_MAGIC;
+  header->message_num   = chunk_message_num;
+  header->chunk_size    = chunk_size;
+  header->data_size     = chunk_used;
+  header->first_time_us = chunk_first_time_us;
+  header->last_time_us  = chunk_last_time_us;
+  std::memset(chunk_buffer + chunk_used, 0, chunk_size - chunk_used);
+  writeBlock(chunk_buffer, chunk_size, file_offset);
+
+  index_list.push_back({ file_offset, chunk_first_time_us, chunk_last_time_us, chunk_message_num });
+  file_offset += chunk_size;
+  chunk_used        = sizeof(BagChunkHeader);
+  chunk_message_num = 0;
+}
+
+//! @brief 残りのチャンクと索引を書き込んでファイルを閉じる
+//! @param なし
+//! @return なし
+void
+BagWriter::close()
+{
+  if (fd < 0)
+  {
+    return;
+  }
+  abortRecord();
+  flush();
+
+  size_t         index_size   = alignSize(std::max<size_t>(sizeof(IndexEntry) * index_list.size(), 1), BLOCK_SIZE);
+  unsigned char *index_buffer = allocateBlock(index_size);
+  std::memcpy(index_buffer, index_list.data(), sizeof(IndexEntry) * index_list.size());
+  try
+  {
+    writeBlock(index_buffer, index_size, file_offset);
+  }
+  catch (...)
+  {
+    free(index_buffer);
+    throw;
+  }
+  free(index_buffer);
+
+  BagFileHeader *header = reinterpret_cast<BagFileHeader *>(header_buffer);
+  header->index_offset  = file_offset;
+  writeHeader();
+  ::close(fd);
+  fd = -1;
+}
+
+//! @brief 書き込んだトピック数の取得
+//! @param なし
+//! @return uint64_t 確定したトピック数
+uint64_t
+BagWriter::getMessageNum() const
+{
+  return message_num;
+}
+
+//! @brief 書きかけのチャンクを保持している時間の取得
+//! @param なし
+//! @return uint64_t 書きかけのチャンクに最初のトピックを確定してからの時間[usec]．空の場合は0
+uint64_t
+BagWriter::getUnflushedTime_us() const
+{
+  return (chunk_message_num == 0) ? 0 : getCurrentTimeUSec() - chunk_open_time_us;
+}
+
+//! @brief ページ境界に揃えた領域の書き込み
+//! @param [in] data 先頭アドレス
+//! @param [in] size 大きさ[byte]
+//! @param [in] offset ファイル上の位置[byte]
+//! @return なし
+void
+BagWriter::writeBlock(const unsigned char *data, size_t size, uint64_t offset)
+{
+  size_t written = 0;
+  while (written < size)
+  {
+    ssize_t result = pwrite(fd, data + written, size - written, static_cast<off_t>(offset + written));
+    if (result < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (result <= 0)
+    {
+      throw std::runtime_error("shm::BagWriter: Cannot write the log file: " + std::string(strerror(errno)) + "!");
+    }
+    written += static_cast<size_t>(result);
+  }
+}
+
+//! @brief ヘッダとトピック表の書き込み
+//! @param なし
+//! @return なし
+void
+BagWriter::writeHeader()
+{
+  BagFileHeader *header = reinterpret_cast<BagFileHeader *>(header_buffer);
+  std::memcpy(header->magic, BAG_MAGIC, sizeof(BAG_MAGIC));
+  header->version       = BAG_VERSION;
+  header->topic_num     = static_cast<uint32_t>(topic_list.size());
+  header->chunk_num     = index_list.size();
+  header->message_num   = message_num;
+  header->start_time_us = start_time_us;
+  header->end_time_us   = end_time_us;
+
+  BagTopicEntry *entries = reinterpret_cast<BagTopicEntry *>(header_buffer + BLOCK_SIZE);
+  for (const BagTopicInfo &info : topic_list)
+  {
+    BagTopicEntry &entry = entries[info.topic_id];
+    std::memset(&entry, 0, sizeof(BagTopicEntry));
+    entry.topic_id     = info.topic_id;
+    entry.buffer_num   = info.buffer_num;
+    entry.element_size = info.element_size;
+    entry.message_num  = info.message_num;
+    std::memcpy(entry.name, info.name.c_str(), info.name.size());
+  }
+  writeBlock(header_buffer, HEADER_SIZE, 0);
+}
+
+//! @brief コンストラクタ
+//! @param [in] path ログファイルのパス
+//! @return なし
+//! @details ファイル全体を読み込み専用で割り当てる．索引が無い場合はチャンクを順に辿って作り直す．
+BagReader::BagReader(const std::string &path)
+  : file_ptr(nullptr)
+  , file_size(0)
+  , is_indexed(false)
+  , start_time_us(0)
+  , end_time_us(0)
+  , message_num(0)
+  , current_chunk(0)
+  , current_offset(0)
+  , current_message(0)
+  , skip_time_us(0)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    throw std::runtime_error("shm::BagReader: Cannot open " + path + "!");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < BagWriter::HEADER_SIZE)
+  {
+    ::close(fd);
+    throw std::runtime_error("shm::BagReader: " + path + " is not a log file!");
+  }
+  file_size = static_cast<size_t>(st.st_size);
+  void *ptr = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (ptr == MAP_FAILED)
+  {
+    throw std::runtime_error("shm::BagReader: Cannot map " + path + "!");
+  }
+  file_ptr = static_cast<unsigned char *>(ptr);
+  madvise(file_ptr, file_size, MADV_SEQUENTIAL);
+
+  const BagFileHeader *header = reinterpret_cast<const BagFileHeader *>(file_ptr);
+  if (std::memcmp(header->magic, BAG_MAGIC, sizeof(BAG_MAGIC)) != 0 || header->version != BAG_VERSION ||
+      header->topic_num > BagWriter::TOPIC_MAX_NUM)
+  {
+    munmap(file_ptr, file_size);
+    throw std::runtime_error("shm::BagReader: " + path + " is not a log file!");
+  }
+
+  const BagTopicEntry *entries = reinterpret_cast<const BagTopicEntry *>(file_ptr + BagWriter::BLOCK_SIZE);
+  for (uint32_t i = 0; i < header->topic_num; i++)
+  {
+    BagTopicInfo info;
+    info.topic_id     = entries[i].topic_id;
+    info.name         = std::string(entries[i].name, strnlen(entries[i].name, sizeof(entries[i].name)));
+    info.element_size = entries[i].element_size;
+    info.buffer_num   = entries[i].buffer_num;
+    info.message_num  = entries[i].message_num;
+    topic_list.push_back(info);
+  }
+
+  is_indexed = loadIndex();
+  if (is_indexed)
+  {
+    start_time_us = header->start_time_us;
+    end_time_us   = header->end_time_us;
+    message_num   = header->message_num;
+  }
+  else
+  {
+    rebuildIndex();
+  }
+  seek(0);
+}
+
+BagReader::~BagReader()
+{
+  munmap(file_ptr, file_size);
+}
+
+//! @brief 記録されたトピックの一覧の取得
+//! @param なし
+//! @return const std::vector<BagTopicInfo>& トピックIDの順に並んだ一覧
+const std::vector<BagTopicInfo> &
+BagReader::getTopicList() const
+{
+  return topic_list;
+}
+
+//! @brief 最初のトピックのタイムスタンプ[usec]の取得
+uint64_t
+BagReader::getStartTime_us() const
+{
+  return start_time_us;
+}
+
+//! @brief 最後のトピックのタイムスタンプ[usec]の取得
+uint64_t
+BagReader::getEndTime_us() const
+{
+  return end_time_us;
+}
+
+//! @brief 記録されたトピック数の取得
+uint64_t
+BagReader::getMessageNum() const
+{
+  return message_num;
+}
+
+//! @brief チャンク数の取得
+size_t
+BagReader::getChunkNum() const
+{
+  return index_list.size();
+}
+
+//! @brief 索引付きで閉じられたファイルかどうか
+//! @return bool 索引を読み込んだ場合は真、チャンクを辿って作り直した場合は偽
+bool
+BagReader::isIndexed() const
+{
+  return is_indexed;
+}
+
+//! @brief 読み出し位置の移動
+//! @param [in] timestamp_us この時刻以降の最初のトピックから読み出す
+//! @return なし
+//! @details 索引を二分探索して該当するチャンクの先頭に移動し、チャンク内のそれより古いトピックは next() で読み飛ばす．
+void
+BagReader::seek(uint64_t timestamp_us)
+{
+  auto chunk = std::lower_bound(index_list.begin(), index_list.end(), timestamp_us,
+                                [](const IndexEntry &entry, uint64_t time) { return entry.last_time_us < time; });
+  current_chunk   = static_cast<size_t>(chunk - index_list.begin());
+  current_offset  = sizeof(BagChunkHeader);
+  current_message = 0;
+  skip_time_us    = timestamp_us;
+}
+
+//! @brief 次のトピックの読み出し
+//! @param [out] message 読み出したトピック．data は割り当てたファイルを直接指す
+//! @return bool 読み出せた場合は真、末尾に達した場合は偽
+bool
+BagReader::next(BagMessage *message)
+{
+  while (current_chunk < index_list.size())
+  {
+    const IndexEntry &entry = index_list[current_chunk];
+    if (current_message >= entry.message_num)
+    {
+      current_chunk++;
+      current_offset  = sizeof(BagChunkHeader);
+      current_message = 0;
+      continue;
+    }
+    // Chunks were validated by loadIndex() or rebuildIndex(); records are checked before their size is trusted
+    const BagChunkHeader  *chunk  = reinterpret_cast<const BagChunkHeader *>(file_ptr + entry.offset);
+    const BagRecordHeader *record = getRecord(chunk, current_offset);
+    if (record == nullptr)
+    {
+      throw std::runtime_error("shm::BagReader: Corrupted chunk!");
+    }
+    current_offset += alignSize(sizeof(BagRecordHeader) + record->data_size, BAG_RECORD_ALIGN);
+    current_message++;
+    if (record->timestamp_us < skip_time_us)
+    {
+      continue;
+    }
+    skip_time_us          = 0;
+    message->topic_id     = record->topic_id;
+    message->timestamp_us = record->timestamp_us;
+    message->data         = reinterpret_cast<const unsigned char *>(record + 1);
+    message->size         = record->data_size;
+    return true;
+  }
+  return false;
+}
+
+//! @brief ファイル末尾の索引の読み込み
+//! @param なし
+//! @return bool close() で書き込まれた索引がある場合は真
+bool
+BagReader::loadIndex()
+{
+  const BagFileHeader *header = reinterpret_cast<const BagFileHeader *>(file_ptr);
+  if (header->index_offset == 0 || header->index_offset > file_size ||
+      header->chunk_num > (file_size - header->index_offset) / sizeof(IndexEntry))
+  {
+    return false;
+  }
+  const IndexEntry *entries = reinterpret_cast<const IndexEntry *>(file_ptr + header->index_offset);
+  index_list.assign(entries, entries + header->chunk_num);
+  for (const IndexEntry &entry : index_list)
+  {
+    // Same bounds as rebuildIndex(), since next() relies on the data size of each chunk
+    if (!isValidChunk(file_ptr, file_size, entry.offset))
+    {
+      index_list.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+//! @brief チャンクを先頭から辿って索引を作り直す
+//! @param なし
+//! @return なし
+//! @details 書き込み途中で終了したファイルでは、最後に書き込みが完了したチャンクまでを読み出せる．
+void
+BagReader::rebuildIndex()
+{
+  index_list.clear();
+  message_num = 0;
+  for (BagTopicInfo &info : topic_list)
+  {
+    info.message_num = 0;
+  }
+
+  size_t offset = BagWriter::HEADER_SIZE;
+  while (offset + sizeof(BagChunkHeader) <= file_size)
+  {
+    if (!isValidChunk(file_ptr, file_size, offset))
+    {
+      break;
+    }
+    const BagChunkHeader *chunk = reinterpret_cast<const BagChunkHeader *>(file_ptr + offset);
+    // Per-topic counts are only stored by close(), so count the records of the chunk
+    size_t record_offset = sizeof(BagChunkHeader);
+    for (uint32_t i = 0; i < chunk->message_num; i++)
+    {
+      const BagRecordHeader *record = getRecord(chunk, record_offset);
+      if (record == nullptr)
+      {
+        break;
+      }
+      if (record->topic_id < topic_list.size())
+      {
+        topic_list[record->topic_id].message_num++;
+      }
+      record_offset += alignSize(sizeof(BagRecordHeader) + record->data_size, BAG_RECORD_ALIGN);
+    }
+
+    if (index_list.empty())
+    {
+      start_time_us = chunk->first_time_us;
+      end_time_us   = chunk->last_time_us;
+    }
+    start_time_us = std::min(start_time_us, chunk->first_time_us);
+    end_time_us   = std::max(end_time_us, chunk->last_time_us);
+    message_num += chunk->message_num;
+    index_list.push_back({ offset, chunk->first_time_us, chunk->last_time_us, chunk->message_num });
+    offset += chunk->chunk_size;
+  }
+}
+
+}  // namespace shm
+
+}  // namespace irlab
@@ -0,0 +1,287 @@
+#include <shm_bag.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace irlab
+{
+
+namespace shm
+{
+
+//! @brief コンストラクタ
+//! @param [in] path ログファイルのパス
+//! @param [in] topic_name_list 記録するトピック名の一覧
+//! @param [in] options ログファイルの書き込み設定
+//! @return なし
+//! @details まだ出版されていないトピックは、出版された時点から記録する．
+BagRecorder::BagRecorder(const std::string &path, const std::vector<std::string> &topic_name_list,
+                         const BagWriterOptions &options)
+  : writer(path, options)
+  , lost_num(0)
+{
+  for (const std::string &name : topic_name_list)
+  {
+    topic_list.push_back(std::make_unique<Topic>());
+    Topic *topic = topic_list.back().get();
+    topic->name  = name;
+    wait_set.addTarget([this, topic](WaitTarget *target)
+                       { return connectTopic(*topic) && topic->ring_buffer->getWaitTarget(target); });
+  }
+}
+
+BagRecorder::~BagRecorder()
+{
+  close();
+}
+
+//! @brief 届いたトピックの記録
+//! @param [in] timeout_usec いずれかのトピックが届くまで待つ最長の時間[usec]
+//! @return size_t 記録したトピック数
+//! @details 書き込んでいないチャンクが FLUSH_PERIOD_USEC より古くなった場合は、満杯でなくても書き込む．
+//! 出版者が共有メモリを作り直したことは待機中には検出できないため、短い待ち時間で繰り返し呼び出すこと．
+size_t
+BagRecorder::recordOnce(uint64_t timeout_usec)
+{
+  size_t record_num = 0;
+  for (size_t handle : wait_set.wait(timeout_usec))
+  {
+    record_num += drainTopic(*topic_list[handle]);
+  }
+  if (writer.getUnflushedTime_us() > FLUSH_PERIOD_USEC)
+  {
+    writer.flush();
+  }
+  return record_num;
+}
+
+//! @brief 残りのトピックを記録してログファイルを閉じる
+//! @param なし
+//! @return なし
+void
+BagRecorder::close()
+{
+  for (auto &topic : topic_list)
+  {
+    drainTopic(*topic);
+  }
+  writer.close();
+}
+
+//! @brief 記録したトピック数の取得
+//! @param なし
+//! @return uint64_t 記録したトピック数
+uint64_t
+BagRecorder::getMessageNum() const
+{
+  return writer.getMessageNum();
+}
+
+//! @brief 記録できなかったトピック数の取得
+//! @param なし
+//! @return uint64_t 読み込む前に出版者に上書きされたトピック数
+uint64_t
+BagRecorder::getLostNum() const
+{
+  uint64_t result = lost_num;
+  for (const auto &topic : topic_list)
+  {
+    if (topic->ring_buffer != nullptr)
+    {
+      result += topic->ring_buffer->getOverrunNum();
+    }
+  }
+  return result;
+}
+
+//! @brief トピックの共有メモリへの接続
+//! @param [in,out] topic 接続するトピック
+//! @return bool 接続できた場合は真
+//! @details 共有メモリが作り直されていた場合は、古い共有メモリに残ったトピックを記録してから接続し直す．
+bool
+BagRecorder::connectTopic(Topic &topic)
+{
+  if (topic.shared_memory == nullptr)
+  {
+    topic.shared_memory = std::make_unique<SharedMemoryPosix>(topic.name, O_RDWR, static_cast<PERM>(0));
+  }
+  if (!topic.shared_memory->isDisconnected())
+  {
+    if (topic.ring_buffer != nullptr)
+    {
+      return true;
+    }
+  }
+  else if (topic.ring_buffer != nullptr)
+  {
+    // The old mapping stays valid after unlink, so nothing published before the recreation is lost
+    drainTopic(topic);
+    lost_num += topic.ring_buffer->getOverrunNum();
+    topic.ring_buffer.reset();
+  }
+
+  topic.shared_memory->disconnect();
+  topic.shared_memory->connect();
+  unsigned char *ptr = topic.shared_memory->getPtr();
+  if (topic.shared_memory->isDisconnected() || ptr == nullptr || !RingBuffer::checkInitialized(ptr) ||
+      !RingBuffer::checkLayoutVersion(ptr))
+  {
+    return false;
+  }
+
+  topic.ring_buffer = std::make_unique<RingBuffer>(ptr);
+  topic.ring_buffer->registerClient(RingBuffer::CLIENT_SUBSCRIBER);
+
+  RingBufferLayout header_layout = RingBuffer::calculateAlignedLayout(0, 1);
+  int              buffer_num    = static_cast<int>(*reinterpret_cast<size_t *>(ptr + header_layout.buf_num_offset));
+  if (!topic.is_added)
+  {
+    topic.topic_id = writer.addTopic(topic.name, topic.ring_buffer->getElementSize(), buffer_num);
+    topic.is_added = true;
+  }
+  else
+  {
+    writer.updateTopic(topic.topic_id, topic.ring_buffer->getElementSize(), buffer_num);
+  }
+  return true;
+}
+
+//! @brief 未読のトピックを全て記録する
+//! @param [in,out] topic 記録するトピック
+//! @return size_t 記録したトピック数
+//! @details スロットからチャンクへ直接コピーし、コピー中に上書きされた場合は取り消す．
+size_t
+BagRecorder::drainTopic(Topic &topic)
+{
+  if (topic.ring_buffer == nullptr)
+  {
+    return 0;
+  }
+  size_t record_num = 0;
+  int    buffer     = topic.ring_buffer->getNextBufferNum();
+  while (buffer >= 0)
+  {
+    size_t         size   = std::min(topic.ring_buffer->getDataSize(buffer), topic.ring_buffer->getElementSize());
+    unsigned char *record = writer.reserveRecord(topic.topic_id, topic.ring_buffer->getTimestamp_us(), size);
+    std::memcpy(record, topic.ring_buffer->getBufferPtr(buffer), size);
+    if (topic.ring_buffer->consumeBuffer(buffer))
+    {
+      writer.commitRecord();
+      record_num++;
+    }
+    else
+    {
+      writer.abortRecord();
+    }
+    buffer = topic.ring_buffer->getNextBufferNum();
+  }
+  return record_num;
+}
+
+//! @brief コンストラクタ
+//! @param [in] path ログファイルのパス
+//! @return なし
+//! @details 出版者は各トピックを最初に再生する時点で作る．
+BagPlayer::BagPlayer(const std::string &path)
+  : reader(path)
+  , publisher_list(reader.getTopicList().size())
+  , play_rate(1.0)
+  , is_started(false)
+  , base_bag_time_us(0)
+  , base_wall_time_us(0)
+  , played_num(0)
+{
+}
+
+BagPlayer::~BagPlayer() = default;
+
+//! @brief 再生速度の設定
+//! @param [in] rate 記録時に対する再生速度の倍率(0の場合は待たずに再生する)
+//! @return なし
+void
+BagPlayer::setRate(double rate)
+{
+  if (rate < 0.0)
+  {
+    throw std::runtime_error("shm::BagPlayer: Rate must not be negative!");
+  }
+  play_rate  = rate;
+  is_started = false;
+}
+
+//! @brief 再生位置の移動
+//! @param [in] offset_usec 記録の開始からの時間[usec]
+//! @return なし
+//! @details 索引を使うため、ファイルを先頭から読み込まずに移動できる．
+void
+BagPlayer::seek(uint64_t offset_usec)
+{
+  reader.seek(reader.getStartTime_us() + offset_usec);
+  is_started = false;
+}
+
+//! @brief 次のトピックの再生
+//! @param なし
+//! @return bool 再生した場合は真、末尾に達した場合は偽
+//! @details 記録時の間隔を再生速度で割った時刻まで待ってから出版する．
+bool
+BagPlayer::playOnce()
+{
+  BagMessage message;
+  if (!reader.next(&message))
+  {
+    return false;
+  }
+
+  const BagTopicInfo &info = reader.getTopicList().at(message.topic_id);
+  if (publisher_list[message.topic_id] == nullptr)
+  {
+    // Sized like the recorded ring, so Subscriber<T> and Subscriber<std::vector<T>> attach unchanged
+    publisher_list[message.topic_id] = std::make_unique<TopicPublisher>(info.name, std::max(info.buffer_num, 1));
+    publisher_list[message.topic_id]->reserve(info.element_size);
+  }
+
+  if (!is_started)
+  {
+    base_bag_time_us  = message.timestamp_us;
+    base_wall_time_us = getCurrentTimeUSec();
+    is_started        = true;
+  }
+  if (play_rate > 0.0 && message.timestamp_us > base_bag_time_us)
+  {
+    uint64_t target_time_us =
+        base_wall_time_us + static_cast<uint64_t>((message.timestamp_us - base_bag_time_us) / play_rate);
+    uint64_t current_time_us = getCurrentTimeUSec();
+    if (target_time_us > current_time_us)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(target_time_us - current_time_us));
+    }
+  }
+
+  publisher_list[message.topic_id]->publish(message.data, message.size);
+  played_num++;
+  return true;
+}
+
+//! @brief 再生したトピック数の取得
+//! @param なし
+//! @return uint64_t 再生したトピック数
+uint64_t
+BagPlayer::getPlayedNum() const
+{
+  return played_num;
+}
+
+//! @brief 読み込みに使うBagReaderの取得
+//! @param なし
+//! @return BagReader& トピックの一覧や記録時間の確認に使う
+BagReader &
+BagPlayer::getReader()
+{
+  return reader;
+}
+
+}  // namespace shm
+
+}  // namespace irlab
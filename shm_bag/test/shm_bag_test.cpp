@@ -0,0 +1,285 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "shm_base.hpp"
+#include "shm_pub_sub.hpp"
+#include "shm_pub_sub_vector.hpp"
+#include "shm_bag.hpp"
+
+// Test fixture for the log file, recorder and player
+class SHMBagTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        path = "/tmp/shm_bag_test_" + std::to_string(getpid()) + ".bag";
+        cleanUp();
+    }
+
+    void TearDown() override
+    {
+        cleanUp();
+    }
+
+    void cleanUp()
+    {
+        std::remove(path.c_str());
+        irlab::shm::disconnectMemory("test_bag_int");
+        irlab::shm::disconnectMemory("test_bag_vector");
+    }
+
+    std::string path;
+};
+
+// Messages written across many chunks are read back in order
+TEST_F(SHMBagTest, WriteReadTest)
+{
+    irlab::shm::BagWriterOptions options;
+    options.chunk_size = 4096;
+    {
+        irlab::shm::BagWriter writer(path, options);
+        uint32_t first  = writer.addTopic("/first", sizeof(int), 3);
+        uint32_t second = writer.addTopic("/second", 64, 4);
+        for (int i = 0; i < 1000; i++)
+        {
+            writer.write(first, 1000 + i * 10, &i, sizeof(i));
+            if (i % 10 == 0)
+            {
+                std::vector<unsigned char> data(i % 64, static_cast<unsigned char>(i));
+                writer.write(second, 1000 + i * 10 + 5, data.data(), data.size());
+            }
+        }
+        // Larger than a chunk, so it gets a chunk of its own
+        std::vector<unsigned char> large(10000, 0xab);
+        writer.updateTopic(second, large.size(), 4);
+        writer.write(second, 20000, large.data(), large.size());
+        EXPECT_EQ(writer.getMessageNum(), 1101u);
+    }
+
+    irlab::shm::BagReader reader(path);
+    EXPECT_TRUE(reader.isIndexed());
+    EXPECT_GT(reader.getChunkNum(), 10u);
+    EXPECT_EQ(reader.getMessageNum(), 1101u);
+    EXPECT_EQ(reader.getStartTime_us(), 1000u);
+    EXPECT_EQ(reader.getEndTime_us(), 20000u);
+    ASSERT_EQ(reader.getTopicList().size(), 2u);
+    EXPECT_EQ(reader.getTopicList()[0].name, "/first");
+    EXPECT_EQ(reader.getTopicList()[0].message_num, 1000u);
+    EXPECT_EQ(reader.getTopicList()[1].element_size, 10000u);
+    EXPECT_EQ(reader.getTopicList()[1].message_num, 101u);
+
+    irlab::shm::BagMessage message;
+    int      next_value = 0;
+    uint64_t last_time  = 0;
+    size_t   read_num   = 0;
+    while (reader.next(&message))
+    {
+        EXPECT_GE(message.timestamp_us, last_time);
+        last_time = message.timestamp_us;
+        if (message.topic_id == 0)
+        {
+            ASSERT_EQ(message.size, sizeof(int));
+            int value;
+            std::memcpy(&value, message.data, sizeof(value));
+            EXPECT_EQ(value, next_value++);
+        }
+        read_num++;
+    }
+    EXPECT_EQ(read_num, 1101u);
+    EXPECT_EQ(message.size, 10000u);
+    EXPECT_EQ(message.data[9999], 0xab);
+}
+
+// Seeking uses the index and skips older messages of the chunk it lands in
+TEST_F(SHMBagTest, SeekTest)
+{
+    irlab::shm::BagWriterOptions options;
+    options.chunk_size = 4096;
+    {
+        irlab::shm::BagWriter writer(path, options);
+        uint32_t topic = writer.addTopic("/first", sizeof(int), 3);
+        for (int i = 0; i < 10000; i++)
+        {
+            writer.write(topic, static_cast<uint64_t>(i) * 1000, &i, sizeof(i));
+        }
+    }
+
+    irlab::shm::BagReader  reader(path);
+    irlab::shm::BagMessage message;
+    reader.seek(4700500);
+    ASSERT_TRUE(reader.next(&message));
+    EXPECT_EQ(message.timestamp_us, 4701000u);
+    EXPECT_EQ(*reinterpret_cast<const int *>(message.data), 4701);
+
+    reader.seek(0);
+    ASSERT_TRUE(reader.next(&message));
+    EXPECT_EQ(message.timestamp_us, 0u);
+
+    reader.seek(100000000);
+    EXPECT_FALSE(reader.next(&message));
+}
+
+// A file whose writer never closed it is still readable up to the last full chunk
+TEST_F(SHMBagTest, RecoveryTest)
+{
+    irlab::shm::BagWriterOptions options;
+    options.chunk_size = 4096;
+    irlab::shm::BagWriter writer(path, options);
+    uint32_t topic = writer.addTopic("/first", sizeof(int), 3);
+    for (int i = 0; i < 3000; i++)
+    {
+        writer.write(topic, static_cast<uint64_t>(i), &i, sizeof(i));
+    }
+    writer.flush();
+    int unflushed = -1;
+    writer.write(topic, 5000, &unflushed, sizeof(unflushed));
+
+    irlab::shm::BagReader reader(path);
+    EXPECT_FALSE(reader.isIndexed());
+    EXPECT_EQ(reader.getMessageNum(), 3000u);
+    EXPECT_EQ(reader.getTopicList()[0].message_num, 3000u);
+    EXPECT_EQ(reader.getEndTime_us(), 2999u);
+
+    irlab::shm::BagMessage message;
+    reader.seek(1500);
+    ASSERT_TRUE(reader.next(&message));
+    EXPECT_EQ(*reinterpret_cast<const int *>(message.data), 1500);
+}
+
+// Corrupted sizes are rejected instead of reading beyond the mapped file
+TEST_F(SHMBagTest, CorruptedFileTest)
+{
+    auto write_file = [this]() {
+        irlab::shm::BagWriterOptions options;
+        options.chunk_size = 4096;
+        irlab::shm::BagWriter writer(path, options);
+        uint32_t topic = writer.addTopic("/first", sizeof(int), 3);
+        for (int i = 0; i < 10; i++)
+        {
+            writer.write(topic, static_cast<uint64_t>(i), &i, sizeof(i));
+        }
+    };
+    auto patch_file = [this](off_t offset, uint64_t value) {
+        int fd = open(path.c_str(), O_WRONLY);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(pwrite(fd, &value, sizeof(value), offset), static_cast<ssize_t>(sizeof(value)));
+        close(fd);
+    };
+    // The first chunk follows the file header; its first record follows the 64-byte chunk header
+    const off_t chunk_offset  = static_cast<off_t>(irlab::shm::BagWriter::HEADER_SIZE);
+    const off_t record_offset = chunk_offset + 64;
+
+    // A record size that wraps around when added to its offset
+    write_file();
+    patch_file(record_offset + 16, 0xfffffffffffffff0ull);
+    {
+        irlab::shm::BagReader  reader(path);
+        irlab::shm::BagMessage message;
+        EXPECT_TRUE(reader.isIndexed());
+        EXPECT_THROW(reader.next(&message), std::runtime_error);
+    }
+
+    // A chunk larger than the file is not trusted from the index
+    write_file();
+    patch_file(chunk_offset + 16, 0xfffffffffffffff0ull);
+    {
+        irlab::shm::BagReader  reader(path);
+        irlab::shm::BagMessage message;
+        EXPECT_FALSE(reader.isIndexed());
+        EXPECT_EQ(reader.getMessageNum(), 0u);
+        EXPECT_FALSE(reader.next(&message));
+    }
+
+    // An index entry count whose size overflows
+    write_file();
+    patch_file(16, 0x2000000000000001ull);
+    {
+        irlab::shm::BagReader  reader(path);
+        irlab::shm::BagMessage message;
+        EXPECT_FALSE(reader.isIndexed());
+        EXPECT_EQ(reader.getMessageNum(), 10u);
+        ASSERT_TRUE(reader.next(&message));
+        EXPECT_EQ(*reinterpret_cast<const int *>(message.data), 0);
+    }
+}
+
+// Recorded topics are published again and read by the original subscriber types
+TEST_F(SHMBagTest, RecordPlayTest)
+{
+    {
+        irlab::shm::Publisher<int>                int_pub("/test_bag_int", 16);
+        irlab::shm::Publisher<std::vector<float>> vector_pub("/test_bag_vector", 16);
+        irlab::shm::BagRecorder recorder(path, { "/test_bag_int", "/test_bag_vector" });
+        for (int i = 0; i < 20; i++)
+        {
+            int_pub.publish(i);
+            vector_pub.publish(std::vector<float>(i + 1, static_cast<float>(i)));
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            recorder.recordOnce(10000);
+        }
+        recorder.close();
+        EXPECT_EQ(recorder.getMessageNum(), 40u);
+        EXPECT_EQ(recorder.getLostNum(), 0u);
+    }
+    irlab::shm::disconnectMemory("test_bag_int");
+    irlab::shm::disconnectMemory("test_bag_vector");
+
+    irlab::shm::BagPlayer player(path);
+    ASSERT_EQ(player.getReader().getTopicList().size(), 2u);
+    // Start at the second half; played back four times faster
+    uint64_t duration = player.getReader().getEndTime_us() - player.getReader().getStartTime_us();
+    player.seek(duration / 2);
+    player.setRate(4.0);
+
+    // The first message creates the topic, so subscribers attach after it
+    ASSERT_TRUE(player.playOnce());
+    irlab::shm::Subscriber<int>                int_sub("/test_bag_int");
+    irlab::shm::Subscriber<std::vector<float>> vector_sub("/test_bag_vector");
+    ASSERT_TRUE(player.playOnce());
+
+    std::vector<int> int_values;
+    std::vector<int> vector_lengths;
+    auto             start = std::chrono::steady_clock::now();
+    bool             is_success;
+    while (true)
+    {
+        int value = int_sub.subscribe(&is_success);
+        if (is_success && (int_values.empty() || int_values.back() != value))
+        {
+            int_values.push_back(value);
+        }
+        const std::vector<float> &data = vector_sub.subscribe(&is_success);
+        if (is_success && (vector_lengths.empty() || vector_lengths.back() != static_cast<int>(data.size())))
+        {
+            EXPECT_FLOAT_EQ(data.back(), static_cast<float>(data.size() - 1));
+            vector_lengths.push_back(static_cast<int>(data.size()));
+        }
+        if (!player.playOnce())
+        {
+            break;
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    ASSERT_FALSE(int_values.empty());
+    EXPECT_GE(int_values.front(), 9);
+    EXPECT_LE(int_values.front(), 12);
+    EXPECT_EQ(int_values.back(), 19);
+    EXPECT_EQ(vector_lengths.back(), 20);
+    EXPECT_GE(player.getPlayedNum(), 18u);
+    // Roughly half the recording at four times the speed
+    EXPECT_LT(static_cast<uint64_t>(elapsed.count()), duration / 4);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -18,18 +18,23 @@
 #include <mutex>
 #include <atomic>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <type_traits>
+#include <vector>
 extern "C" {
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/time.h>
 #include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
 }
+#include "shm_codec.hpp"
 
 namespace irlab
 {
@@ -55,6 +60,21 @@ is_arm_platform()
 #endif
 }
 
+/*!
+ * \~english     Cache line size used to keep writer-hot and reader-hot fields of shared memory apart.
+ *               Every process sharing a topic must be built with the same value.
+ * \~japanese-en 共有メモリ上で書き込み側と読み込み側が頻繁に更新するフィールドを分離するキャッシュライン長．
+ *               トピックを共有するプロセスは全て同じ値でビルドする必要がある．
+ */
+#ifndef SHM_CACHE_LINE_SIZE
+#if defined(__APPLE__) && defined(__aarch64__)
+#define SHM_CACHE_LINE_SIZE 128
+#else
+#define SHM_CACHE_LINE_SIZE 64
+#endif
+#endif
+constexpr size_t CACHE_LINE_SIZE = SHM_CACHE_LINE_SIZE;
+
 /*!
  * \~english     Get required alignment for type T
  * \~japanese-en 型Tに必要なアライメントを取得
@@ -147,6 +167,22 @@ is_aligned(const void *ptr)
   }
 }
 
+/*!
+ * \~english     Hint to the processor that the caller is busy-waiting
+ * \~japanese-en ビジーウェイト中であることをプロセッサに通知
+ */
+inline void
+cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield" ::: "memory");
+#else
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
 /*!
  * \~english     Permissions for shared memory
  * \~japanese-en 共有メモリに付与する権限を表す
@@ -188,6 +224,71 @@ const PERM DEFAULT_PERM = static_cast<PERM>(PERM_USER_READ | PERM_USER_WRITE | P
 
 int      disconnectMemory(std::string name);
 uint64_t getCurrentTimeUSec();
+uint64_t getClockTimeUSec();
+bool     futexWait(std::atomic<uint32_t> *word, uint32_t expected_value, uint64_t timeout_usec);
+int      futexWake(std::atomic<uint32_t> *word, int wake_num = std::numeric_limits<int>::max());
+bool     futexWaitMultiple(std::atomic<uint32_t> *const *words, const uint32_t *expected_values, size_t word_num,
+                           uint64_t timeout_usec);
+uint64_t getProcessStartTime(pid_t pid);
+uint64_t getCurrentProcessStartTime();
+bool     isProcessAlive(pid_t pid, uint64_t start_time);
+
+// ****************************************************************************
+//! @struct SharedMemoryOptions
+//! @brief \~english     Backing and placement options for a shared memory segment
+//!        \~japanese-en 共有メモリの確保方法と配置に関する設定
+//! @details
+//! \~english     Every process connecting to the same topic must use the same huge_page_dir.
+//! \~japanese-en 同じトピックに接続するプロセスは、全て同じ huge_page_dir を指定する必要がある．
+// ****************************************************************************
+struct SharedMemoryOptions
+{
+  //! \~english Mount point of a hugetlbfs (e.g. /dev/hugepages); empty uses POSIX shared memory in /dev/shm
+  //! \~japanese-en hugetlbfsのマウントポイント(例: /dev/hugepages)．空の場合は/dev/shmのPOSIX共有メモリを使う
+  std::string huge_page_dir = "";
+  //! \~english Pre-fault every page on connect
+  //! \~japanese-en 接続時に全ページを事前にフォールトさせる
+  bool populate = false;
+  //! \~english Lock the mapping in RAM with mlock()
+  //! \~japanese-en mlock()でマッピングを物理メモリに固定する
+  bool lock = false;
+  //! \~english NUMA node the pages are bound to with mbind(); negative leaves the kernel default policy
+  //! \~japanese-en mbind()でページを割り当てるNUMAノード．負の場合はカーネルの既定の方針に従う
+  int numa_node = -1;
+  //! \~english Register publishers in, and look subscribers up from, the topic registry (see TopicRegistry)
+  //! \~japanese-en 出版者をトピックレジストリに登録し、購読者はレジストリから検索する(TopicRegistry を参照)
+  bool use_topic_registry = false;
+};
+
+// ****************************************************************************
+//! @struct ThreadAttributes
+//! @brief \~english     Scheduling, placement and memory settings of a real-time thread
+//!        \~japanese-en リアルタイムスレッドのスケジューリング、配置、メモリに関する設定
+//! @details
+//! \~english     SCHED_FIFO and SCHED_RR need CAP_SYS_NICE or a sufficient RLIMIT_RTPRIO.
+//! \~japanese-en SCHED_FIFO と SCHED_RR には CAP_SYS_NICE、または十分な RLIMIT_RTPRIO が必要である．
+// ****************************************************************************
+struct ThreadAttributes
+{
+  //! \~english Scheduling policy (SCHED_FIFO or SCHED_RR); SCHED_OTHER keeps the inherited policy
+  //! \~japanese-en スケジューリングポリシー(SCHED_FIFO、SCHED_RR)．SCHED_OTHER の場合は生成元のものを引き継ぐ
+  int sched_policy = SCHED_OTHER;
+  //! \~english Priority for SCHED_FIFO and SCHED_RR (1-99); ignored for SCHED_OTHER
+  //! \~japanese-en SCHED_FIFO と SCHED_RR の優先度(1-99)．SCHED_OTHER の場合は無視する
+  int sched_priority = 0;
+  //! \~english CPUs the thread may run on; empty leaves the affinity unchanged
+  //! \~japanese-en スレッドを実行するCPU番号の集合．空の場合は変更しない
+  std::vector<int> cpu_list;
+  //! \~english Stack size of a created thread [byte]; 0 keeps the default
+  //! \~japanese-en 生成するスレッドのスタックの大きさ[byte]．0の場合は既定値
+  size_t stack_size = 0;
+  //! \~english Lock all current and future pages of the process with mlockall()
+  //! \~japanese-en mlockall()でプロセスの現在と将来の全ページを物理メモリに固定する
+  bool lock_memory = false;
+};
+
+void initThreadAttr(pthread_attr_t *thread_attr, const ThreadAttributes &attributes);
+void applyThreadAttributes(const ThreadAttributes &attributes);
 
 // ****************************************************************************
 //! @class SharedMemory
@@ -207,8 +308,9 @@ public:
   size_t         getSize() const;
   unsigned char *getPtr();
 
-  virtual bool isDisconnected() const                         = 0;
-  virtual bool isExists(uint64_t timeout_usec = 500000) const = 0;
+  virtual bool isDisconnected() const                                   = 0;
+  virtual bool isExists(uint64_t timeout_usec = 500000) const           = 0;
+  virtual bool waitForSize(size_t min_size, uint64_t timeout_usec) const = 0;
 
 protected:
   int            shm_fd;
@@ -227,7 +329,8 @@ protected:
 class SharedMemoryPosix : public SharedMemory
 {
 public:
-  SharedMemoryPosix(std::string name, int oflag, PERM perm);
+  SharedMemoryPosix(std::string name, int oflag, PERM perm,
+                    const SharedMemoryOptions &options = SharedMemoryOptions());
   ~SharedMemoryPosix();
 
   virtual bool connect(size_t size = 0);
@@ -243,67 +346,519 @@ public:
    */
   bool isExists(uint64_t timeout_usec = 500000) const;
 
+  /**
+   * @brief Wait until the shared memory is created with at least the given size
+   * @param min_size Size in bytes to wait for
+   * @param timeout_usec Timeout in microseconds
+   * @return true if the shared memory exists with at least min_size bytes, false on timeout
+   */
+  bool waitForSize(size_t min_size, uint64_t timeout_usec) const;
+
 protected:
-  std::string shm_name;
+  int  openFile(int oflag) const;
+  void applyOptions();
+
+  std::string         shm_name;
+  std::string         shm_file_name;
+  SharedMemoryOptions shm_options;
+  mutable int         watch_fd;
+};
+
+// ****************************************************************************
+//! @struct RingBufferLayout
+//! @brief \~english     Byte offsets of each field of a ring buffer in shared memory
+//!        \~japanese-en 共有メモリ上のリングバッファ各フィールドのバイトオフセット
+// ****************************************************************************
+struct RingBufferLayout
+{
+  size_t layout_version_offset;
+  size_t mutex_offset;
+  size_t cond_offset;
+  size_t element_size_offset;
+  size_t buf_num_offset;
+  size_t type_hash_offset;
+  size_t generation_offset;
+  size_t notify_offset;
+  size_t write_index_offset;
+  size_t reserve_index_offset;
+  size_t timestamp_offset;
+  size_t data_size_offset;
+  size_t sequence_offset;
+  size_t pin_offset;
+  size_t commit_offset;
+  size_t client_offset;
+  size_t metrics_offset;
+  size_t data_offset;
+  size_t slot_size;
+  size_t total_size;
+};
+
+// ****************************************************************************
+//! @struct RingBufferClient
+//! @brief \~english     Entry of the client registry kept in the ring buffer header
+//!        \~japanese-en リングバッファのヘッダに置かれるクライアント登録情報
+//! @details \~english     cursor is the read cursor of a subscriber, or the in-flight ticket + 1 of a publisher.
+//!                          Each entry occupies its own cache line because readers update their cursor on every read.
+//!          \~japanese-en cursor はSubscriberの場合は読み込みカーソル、Publisherの場合は書き込み中のチケット+1である．
+//!                          読み込みのたびにカーソルが更新されるため、各エントリは個別のキャッシュラインに置く．
+// ****************************************************************************
+struct alignas(CACHE_LINE_SIZE) RingBufferClient
+{
+  std::atomic<uint32_t> pid;
+  std::atomic<uint32_t> role;
+  std::atomic<uint64_t> cursor;
+};
+
+// ****************************************************************************
+//! @brief \~english     Number of buckets of the publish-to-read latency histogram
+//!        \~japanese-en 書き込みから読み込みまでの遅延ヒストグラムのビン数
+//! @details \~english     Bucket 0 counts latencies below 1us, bucket i counts [2^(i-1), 2^i) us, and the last bucket
+//!                          also counts everything above.
+//!          \~japanese-en ビン0は1us未満、ビンiは[2^(i-1), 2^i) usの遅延を数える．最後のビンはそれ以上も含む．
+// ****************************************************************************
+constexpr size_t RING_BUFFER_LATENCY_BUCKET_NUM = 24;
+
+// ****************************************************************************
+//! @struct RingBufferClientMetrics
+//! @brief \~english     Counters kept in the ring buffer header for one client entry
+//!        \~japanese-en リングバッファのヘッダにクライアントごとに置かれる計測値
+//! @details \~english     Only the owner of the client entry updates these, with relaxed atomics on its own cache
+//!                          lines, so that counting costs no contention. The counters are not reset when an entry is
+//!                          reused, so their sum over all entries only grows. Instances that are not registered share
+//!                          one extra entry.
+//!          \~japanese-en クライアント登録情報の所有者のみが、個別のキャッシュライン上でrelaxedのatomic操作で更新するため、
+//!                          計測による競合は生じない．エントリが再利用されても値は初期化しないため、全エントリの合計は単調増加する．
+//!                          未登録のインスタンスは追加の一つのエントリを共有する．
+// ****************************************************************************
+struct alignas(CACHE_LINE_SIZE) RingBufferClientMetrics
+{
+  std::atomic<uint64_t> publish_num;
+  std::atomic<uint64_t> last_publish_time_us;
+  std::atomic<uint64_t> drop_num;
+  std::atomic<uint64_t> retry_num;
+  std::atomic<uint64_t> read_num;
+  std::atomic<uint64_t> overrun_num;
+  std::atomic<uint64_t> latency_histogram[RING_BUFFER_LATENCY_BUCKET_NUM];
+};
+
+// ****************************************************************************
+//! @struct RingBufferMetrics
+//! @brief \~english     Snapshot of the counters of one ring buffer summed over all clients
+//!        \~japanese-en 全クライアントの計測値を合計したリングバッファの計測値
+// ****************************************************************************
+struct RingBufferMetrics
+{
+  //! \~english Committed topics
+  //! \~japanese-en 確定したトピック数
+  uint64_t publish_num = 0;
+  //! \~english Timestamp of the newest commit [usec], 0 if none
+  //! \~japanese-en 最新の確定のタイムスタンプ[usec]．無い場合は0
+  uint64_t last_publish_time_us = 0;
+  //! \~english Topics dropped because every slot was pinned
+  //! \~japanese-en 全スロットが固定されていたために破棄したトピック数
+  uint64_t drop_num = 0;
+  //! \~english Pinned slots skipped and waits for a slot still owned by a slower writer
+  //! \~japanese-en 固定されたスロットを飛ばした回数と、遅い書き込みが保持するスロットを待った回数
+  uint64_t retry_num = 0;
+  //! \~english Distinct topics read by subscribers
+  //! \~japanese-en Subscriberが読み込んだトピック数(同じトピックの再読み込みは数えない)
+  uint64_t read_num = 0;
+  //! \~english Topics overwritten before a queue mode subscriber read them
+  //! \~japanese-en キューモードのSubscriberが読む前に上書きされたトピック数
+  uint64_t overrun_num = 0;
+  //! \~english Publish-to-read latency histogram, see RING_BUFFER_LATENCY_BUCKET_NUM
+  //! \~japanese-en 書き込みから読み込みまでの遅延ヒストグラム(RING_BUFFER_LATENCY_BUCKET_NUM参照)
+  uint64_t latency_histogram[RING_BUFFER_LATENCY_BUCKET_NUM] = {};
+};
+
+// ****************************************************************************
+//! @struct WaitTarget
+//! @brief \~english     Futex word and readiness check used by WaitSet to wait on one object
+//!        \~japanese-en WaitSetが一つのオブジェクトを待つために使うfutexワードと準備完了の判定
+//! @details \~english     Writers advance sequence after making their data visible, and call futexWake() on it only
+//!                          while waiter_num is non-zero. is_ready() must become true no later than sequence changes.
+//!          \~japanese-en 書き込み側はデータを公開した後にsequenceを進め、waiter_numが0でない場合のみfutexWake()を呼ぶ．
+//!                          is_ready()はsequenceが変化する時点までに真になる必要がある．
+// ****************************************************************************
+struct WaitTarget
+{
+  std::atomic<uint32_t> *sequence   = nullptr;
+  std::atomic<uint32_t> *waiter_num = nullptr;
+  std::function<bool()>  is_ready;
 };
 
 // ****************************************************************************
 //! @class RingBuffer
 //! @brief \~english     Class that is described ring-buffer used for shared memory
 //!        \~japanese-en 共有メモリで使用するリングバッファを記述したクラス
-//! @details
+//! @details \~english     Slots are selected by a monotonic write index shared by all processes. Each slot carries a
+//!                          sequence number (seqlock): odd while being written, 2*(index+1) once committed.
+//!                          Readers copy the slot and compare the sequence again with verifyBuffer() to detect
+//!                          torn reads, or pin the slot with pinBuffer() so that writers skip it.
+//!                          Any number of writer processes reserve slots with a fetch-add ticket, and the write
+//!                          index only advances over consecutive completed tickets.
+//!          \~japanese-en 書き込み先は全プロセスで共有する単調増加の書き込みインデックスで決定する．
+//!                          各スロットはシーケンス番号(seqlock)を持ち、書き込み中は奇数、確定後は2*(index+1)となる．
+//!                          読み込み側はコピー後に verifyBuffer() でシーケンスを再確認し、書き込み途中の読み込みを検出する．
+//!                          または pinBuffer() でスロットを固定し、書き込み側にそのスロットを飛ばさせる．
+//!                          複数の書き込みプロセスはfetch-addのチケットでスロットを予約し、
+//!                          書き込みインデックスは連続して完了したチケットの分だけ進む．
 // ****************************************************************************
 class RingBuffer
 {
 public:
-  static size_t getSize(size_t element_size, int buffer_num);
-  static bool   checkInitialized(unsigned char *first_ptr);
-  static bool   waitForInitialization(unsigned char *first_ptr, uint64_t timeout_usec);
-  static size_t calculateAlignedLayout(size_t element_size, int buffer_num, size_t &mutex_offset, size_t &cond_offset,
-                                       size_t &element_size_offset, size_t &buf_num_offset, size_t &timestamp_offset,
-                                       size_t &data_offset);
-
-  RingBuffer(unsigned char *first_ptr, size_t size = 0, int buffer_num = 0);
+  static size_t           getSize(size_t element_size, int buffer_num);
+  static bool             checkInitialized(unsigned char *first_ptr);
+  static bool             waitForInitialization(unsigned char *first_ptr, uint64_t timeout_usec);
+  static uint32_t         getGeneration(unsigned char *first_ptr);
+  static size_t           getRequiredSize(unsigned char *first_ptr);
+  static RingBufferLayout calculateAlignedLayout(size_t element_size, int buffer_num);
+  static bool             checkAttachable(unsigned char *first_ptr, size_t element_size, int buffer_num);
+  static bool             checkAttachable(unsigned char *first_ptr, int buffer_num);
+  static bool             checkLayoutVersion(unsigned char *first_ptr);
+
+  RingBuffer(unsigned char *first_ptr, size_t size = 0, int buffer_num = 0, uint64_t input_type_hash = 0);
   ~RingBuffer();
 
-  uint64_t       getTimestamp_us() const;
-  void           setTimestamp_us(uint64_t input_time_us, int buffer_num);
-  int            getNewestBufferNum();
-  int            getOldestBufferNum();
-  bool           allocateBuffer(int buffer_num);
-  size_t         getElementSize() const;
-  unsigned char *getDataList();
-  void           signal();
-  bool           waitFor(uint64_t timeout_usec);
-  bool           isUpdated() const;
-  void           setDataExpiryTime_us(uint64_t time_us);
-  void           markAsInitialized();
+  uint64_t          getTimestamp_us() const;
+  void              setTimestamp_us(uint64_t input_time_us, int buffer_num);
+  int               getNewestBufferNum();
+  int               getOldestBufferNum();
+  bool              allocateBuffer(int buffer_num);
+  int               reserveBuffer();
+  void              commitBuffer(int buffer_num, uint64_t input_time_us);
+  void              abortBuffer(int buffer_num);
+  bool              hasReservedBuffer() const;
+  bool              isCurrentGeneration() const;
+  bool              sealForResize();
+  bool              verifyBuffer(int buffer_num) const;
+  uint64_t          getReadSequence() const;
+  uint64_t          getSequenceNumber(int buffer_num) const;
+  uint64_t          getWriteIndex() const;
+  bool              pinBuffer(int buffer_num);
+  void              unpinBuffer(int buffer_num);
+  int               getNextBufferNum();
+  bool              consumeBuffer(int buffer_num);
+  uint64_t          getOverrunNum() const;
+  bool              registerClient(uint32_t role);
+  void              unregisterClient();
+  void              abandonClient();
+  size_t            getClientNum(uint32_t role) const;
+  uint64_t          getSlowestCursor() const;
+  size_t            getElementSize() const;
+  uint64_t          getTypeHash() const;
+  void              setDataSize(int buffer_num, size_t data_size);
+  size_t            getDataSize(int buffer_num) const;
+  unsigned char    *getDataList();
+  unsigned char    *getBufferPtr(int buffer_num);
+  void              signal();
+  bool              waitFor(uint64_t timeout_usec);
+  bool              getWaitTarget(WaitTarget *target);
+  bool              isUpdated() const;
+  RingBufferMetrics getMetrics() const;
+  void              setDataExpiryTime_us(uint64_t time_us);
+  void              setSpinTime_us(uint64_t time_us);
+  void              markAsInitialized();
+
+  static constexpr uint32_t CLIENT_PUBLISHER  = 1;
+  static constexpr uint32_t CLIENT_SUBSCRIBER = 2;
+  static constexpr size_t   CLIENT_MAX_NUM    = 32;
+
+  //! \~english Layout tag stored in the header: 'RB' in the upper half, revision in the lower half
+  //! \~japanese-en ヘッダに格納するレイアウト識別子．上位16bitは'RB'、下位16bitは版数
+  static constexpr uint32_t LAYOUT_VERSION            = 0x52420004;
+  static constexpr size_t   PAGE_ALIGNED_ELEMENT_SIZE = 64 * 1024;
+  static constexpr size_t   SLOT_PAGE_SIZE            = 4096;
 
 private:
   void initializeExclusiveAccess();
   void initializeAlignedPointers();
   bool waitForPthreadInitialization(uint64_t timeout_usec);
+  void waitForSlot(uint64_t ticket);
+  void takeOverTicket(uint64_t ticket);
+  bool acquireSlot(uint64_t ticket);
+  void completeTicket(int buffer_num, uint64_t ticket);
+  void advanceWriteIndex();
+  void recordRead(int buffer_num, uint64_t current_time_us);
+
+  RingBufferClientMetrics *getOwnMetrics() const;
 
   unsigned char *memory_ptr;
 
-  std::atomic<uint32_t> *initialization_flag;
-  std::atomic<uint32_t> *pthread_init_flag;
-  pthread_mutex_t       *mutex;
-  pthread_cond_t        *condition;
-  size_t                *element_size;
-  size_t                *buf_num;
-  std::atomic<uint64_t> *timestamp_list;
-  unsigned char         *data_list;
+  std::atomic<uint32_t>   *initialization_flag;
+  std::atomic<uint32_t>   *pthread_init_flag;
+  uint32_t                *layout_version;
+  uint32_t                *cache_line_size;
+  pthread_mutex_t         *mutex;
+  pthread_cond_t          *condition;
+  size_t                  *element_size;
+  size_t                  *buf_num;
+  uint64_t                *type_hash;
+  std::atomic<uint32_t>   *generation;
+  std::atomic<uint32_t>   *update_sequence;
+  std::atomic<uint32_t>   *waiter_num;
+  std::atomic<uint64_t>   *write_index;
+  std::atomic<uint64_t>   *reserve_index;
+  std::atomic<uint64_t>   *timestamp_list;
+  std::atomic<uint64_t>   *data_size_list;
+  std::atomic<uint64_t>   *sequence_list;
+  std::atomic<uint32_t>   *pin_list;
+  std::atomic<uint64_t>   *commit_list;
+  RingBufferClient        *client_list;
+  RingBufferClientMetrics *metrics_list;
+  unsigned char           *data_list;
+  size_t                   slot_size;
 
   uint64_t timestamp_us;
+  uint64_t read_index;
+  uint64_t read_sequence;
+  uint64_t read_cursor;
+  uint64_t counted_sequence;
+  uint64_t overrun_num;
+  int      reserved_buffer;
+  int      client_entry;
   uint64_t data_expiry_time_us;
+  uint64_t spin_time_us;
+  uint32_t attached_generation;
 
+  static constexpr uint64_t UNINITIALIZED_CURSOR    = std::numeric_limits<uint64_t>::max();
   static constexpr uint32_t INITIALIZED             = 1;
   static constexpr uint32_t NOT_INITIALIZED         = 0;
   static constexpr uint32_t PTHREAD_INITIALIZED     = 1;
   static constexpr uint32_t PTHREAD_NOT_INITIALIZED = 0;
 };
 
+// ****************************************************************************
+//! @class WaitSet
+//! @brief \~english     Waits on many subscribers, service servers and action servers at once
+//!        \~japanese-en 複数のSubscriber、ServiceServer、ActionServerをまとめて待つクラス
+//! @details \~english     Any object with bool getWaitTarget(WaitTarget *) can be added. wait() sleeps in one
+//!                          futex_waitv call on the futex words of every object and returns the ready ones,
+//!                          so one thread can serve many topics without polling them in turn.
+//!                          Objects not attached to their shared memory yet are re-checked periodically.
+//!                          Added objects must outlive the WaitSet or be removed first.
+//!          \~japanese-en bool getWaitTarget(WaitTarget *) を持つオブジェクトを登録できる．wait()は全てのオブジェクトの
+//!                          futexワードを一度のfutex_waitvで待ち、準備ができたものを返すため、
+//!                          一つのスレッドで複数のトピックを順にポーリングせずに扱える．
+//!                          まだ共有メモリに接続していないオブジェクトは一定周期で確認する．
+//!                          登録したオブジェクトはWaitSetより長く存在するか、先に削除する必要がある．
+// ****************************************************************************
+class WaitSet
+{
+public:
+  template <class T>
+  size_t add(T &waitable);
+  size_t addTarget(std::function<bool(WaitTarget *)> get_target);
+  void   remove(size_t handle);
+  size_t size() const;
+
+  std::vector<size_t> wait(uint64_t timeout_usec);
+
+  //! \~english Maximum number of objects watched in one futex_waitv call; the rest are polled
+  //! \~japanese-en 一度のfutex_waitvで監視するオブジェクト数の上限．超えた分はポーリングで確認する
+  static constexpr size_t WATCH_MAX_NUM = 128;
+  //! \~english Re-check period for objects that are not attached or beyond WATCH_MAX_NUM [usec]
+  //! \~japanese-en 未接続またはWATCH_MAX_NUMを超えたオブジェクトの再確認周期[usec]
+  static constexpr uint64_t RECHECK_PERIOD_USEC = 10000;
+
+private:
+  std::vector<std::function<bool(WaitTarget *)>> entry_list;
+  std::vector<WaitTarget>                        target_list;
+  std::vector<std::atomic<uint32_t> *>           word_list;
+  std::vector<std::atomic<uint32_t> *>           waiter_list;
+  std::vector<uint32_t>                          value_list;
+};
+
+// ****************************************************************************
+//! @struct TopicInfo
+//! @brief \~english     Type and segment information of a topic kept in the topic registry
+//!        \~japanese-en トピックレジストリに記録するトピックの型と共有メモリの情報
+// ****************************************************************************
+struct TopicInfo
+{
+  //! \~english Topic name as given to the publisher
+  //! \~japanese-en 出版者に与えたトピック名
+  std::string name;
+  //! \~english Fingerprint of the slot type (getTopicTypeHash()), 0 if untyped
+  //! \~japanese-en スロットの型の指紋(getTopicTypeHash())．型を持たない場合は0
+  uint64_t type_hash = 0;
+  //! \~english Slot size of the ring buffer [byte]
+  //! \~japanese-en リングバッファのスロットの大きさ[byte]
+  size_t element_size = 0;
+  //! \~english Number of slots of the ring buffer
+  //! \~japanese-en リングバッファのスロット数
+  size_t buffer_num = 0;
+  //! \~english Process that registered the topic last
+  //! \~japanese-en 最後にトピックを登録したプロセス
+  pid_t pid = 0;
+};
+
+// ****************************************************************************
+//! @struct TopicRegistryEntry
+//! @brief \~english     One entry of the topic registry in shared memory
+//!        \~japanese-en 共有メモリ上のトピックレジストリの1エントリ
+//! @details \~english     sequence is a seqlock: 0 while never used, odd while being written and even once written.
+//!          \~japanese-en sequence はseqlockであり、未使用の間は0、書き込み中は奇数、書き込み後は偶数となる．
+// ****************************************************************************
+struct alignas(CACHE_LINE_SIZE) TopicRegistryEntry
+{
+  std::atomic<uint32_t> sequence;
+  std::atomic<uint32_t> pid;
+  std::atomic<uint64_t> type_hash;
+  std::atomic<uint64_t> element_size;
+  std::atomic<uint64_t> buffer_num;
+  char                  name[CACHE_LINE_SIZE * 2];
+};
+
+// ****************************************************************************
+//! @class TopicRegistry
+//! @brief \~english     Shared table from topic names to their type and segment information
+//!        \~japanese-en トピック名から型と共有メモリの情報を引くための共有の表
+//! @details \~english     Publishers created with SharedMemoryOptions::use_topic_registry register their topic, so
+//!                          that subscribers check the type and whether the topic exists with one lookup in memory
+//!                          that is already mapped, instead of opening the topic segment on every attempt.
+//!                          The table is an open-addressing hash table of ENTRY_NUM entries that are never freed:
+//!                          a topic keeps its entry after its publisher exits and re-registering updates it.
+//!          \~japanese-en SharedMemoryOptions::use_topic_registry を指定した出版者はトピックを登録する．
+//!                          購読者は試行のたびにトピックの共有メモリを開く代わりに、接続済みのメモリを一度検索して
+//!                          トピックの有無と型を確認する．表は ENTRY_NUM 個のエントリを持つオープンアドレス法の
+//!                          ハッシュ表であり、エントリは解放しない．出版者の終了後もエントリは残り、再登録で更新される．
+// ****************************************************************************
+class TopicRegistry
+{
+public:
+  explicit TopicRegistry(const std::string &registry_name = DEFAULT_NAME, PERM perm = DEFAULT_PERM);
+
+  bool                   registerTopic(const TopicInfo &info);
+  bool                   lookup(const std::string &name, TopicInfo *info) const;
+  std::vector<TopicInfo> getTopicList() const;
+
+  //! \~english Shared-memory name of the default registry
+  //! \~japanese-en 既定のレジストリの共有メモリ名
+  static constexpr const char *DEFAULT_NAME = "topic_registry";
+  //! \~english Number of entries, which bounds the number of registered topics
+  //! \~japanese-en エントリ数．登録できるトピック数の上限となる
+  static constexpr size_t ENTRY_NUM = 256;
+  //! \~english Layout tag stored in the header: 'TR' in the upper half, revision in the lower half
+  //! \~japanese-en ヘッダに格納するレイアウト識別子．上位16bitは'TR'、下位16bitは版数
+  static constexpr uint32_t LAYOUT_VERSION = 0x54520001;
+
+private:
+  bool readEntry(const TopicRegistryEntry &entry, TopicInfo *info) const;
+
+  std::unique_ptr<SharedMemoryPosix> shared_memory;
+  TopicRegistryEntry                *entry_list;
+};
+
+// ****************************************************************************
+//! @class TopicConnection
+//! @brief \~english     Connection manager that attaches a subscriber to the ring buffer segment of a topic
+//!        \~japanese-en 購読者をトピックのリングバッファの共有メモリに接続する接続管理クラス
+//! @details \~english     poll() never blocks: each call advances the attach by one step (open and map, then wait
+//!                          for the initialization flag) and returns whether the ring buffer can be read, so that
+//!                          a node starting many subscribers does not wait for each topic in turn.
+//!                          The mapping is kept while the segment stays linked. A publisher that restarts on the
+//!                          same segment bumps the generation in the header, which is detected without re-mapping;
+//!                          the segment is re-mapped only when it was unlinked and recreated, or when the new ring
+//!                          buffer does not fit in the mapping. getAttachNum() changes on every new attach so that
+//!                          the owner knows when to rebuild its RingBuffer. waitForAttach() sleeps on inotify while
+//!                          the segment is missing and on the initialization futex while it is being initialized.
+//!                          A ring buffer from createRingBuffer() keeps its mapping alive, so a slot borrowed from
+//!                          it stays readable after the connection has moved on to a new mapping.
+//!          \~japanese-en poll() はブロックしない．呼び出しごとに接続を1段階(オープンとマップ、初期化フラグの確認)
+//!                          進め、リングバッファを読めるかどうかを返す．多数の購読者を持つノードも、
+//!                          トピックごとに順に待つことなく起動できる．マッピングは共有メモリが削除されない限り保持する．
+//!                          同じ共有メモリ上でPublisherが再起動するとヘッダの世代が増え、再マップせずに検出できる．
+//!                          再マップは共有メモリが削除されて作り直された場合と、新しいリングバッファが
+//!                          マッピングに収まらない場合のみ行う．getAttachNum() は新たに接続するたびに変わるため、
+//!                          所有者はこれで RingBuffer を作り直す時期を知る．waitForAttach() は共有メモリが無い間は
+//!                          inotifyで、初期化中は初期化フラグのfutexでスリープする．
+//!                          createRingBuffer() のリングバッファはマッピングを保持するため、接続が新しいマッピングに
+//!                          移った後も、そのリングバッファから借りたスロットは読み込める．
+// ****************************************************************************
+class TopicConnection
+{
+public:
+  TopicConnection(const std::string &name, const SharedMemoryOptions &options = SharedMemoryOptions());
+
+  bool           poll();
+  bool           waitForAttach(uint64_t timeout_usec);
+  void           disconnect();
+  bool           isAttached() const;
+  unsigned char *getPtr();
+  uint64_t       getAttachNum() const;
+  uint64_t       getMapNum() const;
+
+  std::shared_ptr<RingBuffer> createRingBuffer();
+
+private:
+  bool mapSegment();
+
+  std::string                   shm_name;
+  SharedMemoryOptions           shm_options;
+  std::shared_ptr<SharedMemory> shared_memory;
+  bool                          is_attached;
+  uint32_t                      generation;
+  uint64_t                      attach_num;
+  uint64_t                      map_num;
+};
+
+// ****************************************************************************
+//! @class SimulatedClock
+//! @brief \~english     Clock segment in shared memory that a simulator drives for every process of the stack
+//!        \~japanese-en シミュレータが駆動し、全プロセスで共有する共有メモリ上の時計
+//! @details \~english     Once a process calls useSimulatedClock(), or is started with the SHM_SIMULATED_CLOCK
+//!                          environment variable set to the clock name, getClockTimeUSec() returns the time of
+//!                          this segment instead of CLOCK_MONOTONIC_RAW. Message timestamps, data expiry and read
+//!                          latencies then follow the simulation, which may run faster than real time. Timeouts
+//!                          and periods still sleep in real time. The order of messages never depends on their
+//!                          timestamps: readers order slots by the write index of the ring buffer.
+//!          \~japanese-en useSimulatedClock() を呼び出したプロセス、または環境変数 SHM_SIMULATED_CLOCK に時計の名前を
+//!                          設定して起動したプロセスでは、getClockTimeUSec() は CLOCK_MONOTONIC_RAW の代わりに
+//!                          この共有メモリの時刻を返す．トピックのタイムスタンプ、データの有効期限、読み込みの遅延は
+//!                          実時間より速く進むこともあるシミュレーションに従う．待ち時間と周期は実時間のままである．
+//!                          トピックの順序はタイムスタンプによらず、リングバッファの書き込みインデックスで決まる．
+// ****************************************************************************
+class SimulatedClock
+{
+public:
+  explicit SimulatedClock(const std::string &clock_name = DEFAULT_NAME, PERM perm = DEFAULT_PERM);
+
+  uint64_t getTime_us() const;
+  void     setTime_us(uint64_t input_time_us);
+  void     advance_us(uint64_t duration_us);
+
+  const std::atomic<uint64_t> *getTimeWord() const;
+
+  //! \~english Shared-memory name of the default clock
+  //! \~japanese-en 既定の時計の共有メモリ名
+  static constexpr const char *DEFAULT_NAME = "simulated_clock";
+  //! \~english Layout tag stored in the header: 'SC' in the upper half, revision in the lower half
+  //! \~japanese-en ヘッダに格納するレイアウト識別子．上位16bitは'SC'、下位16bitは版数
+  static constexpr uint32_t LAYOUT_VERSION = 0x53430001;
+
+private:
+  std::unique_ptr<SharedMemoryPosix> shared_memory;
+  std::atomic<uint64_t>             *time_us;
+};
+
+void useSimulatedClock(const std::string &clock_name = SimulatedClock::DEFAULT_NAME);
+void useSystemClock();
+bool isSimulatedClock();
+
+//! @brief \~english     Add an object to the set
+//!        \~japanese-en オブジェクトを登録する
+//! @param [in] waitable \~english     Object providing bool getWaitTarget(WaitTarget *)
+//!                      \~japanese-en bool getWaitTarget(WaitTarget *) を持つオブジェクト
+//! @return size_t \~english     Handle reported by wait() when the object is ready
+//!                \~japanese-en 準備ができた際に wait() が返すハンドル
+template <class T>
+size_t
+WaitSet::add(T &waitable)
+{
+  return addTarget([&waitable](WaitTarget *target) { return waitable.getWaitTarget(target); });
+}
+
 }  // namespace shm
 
 }  // namespace irlab
@@ -0,0 +1,801 @@
+//!
+//! @file shm_codec.hpp
+//! @brief \~english     Serialization hook for topics, services and actions whose types are not standard layout
+//!        \~japanese-en 標準レイアウトでない型をトピック、サービス、アクションで扱うためのシリアライズの定義
+//! @note \~english     The notation is complianted ROS Cpp style guide.
+//!       \~japanese-en 記法はROSに準拠する
+//!       \~            http://wiki.ros.org/ja/CppStyleGuide
+//!
+
+#ifndef __SHM_CODEC_LIB_H__
+#define __SHM_CODEC_LIB_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace irlab
+{
+
+namespace shm
+{
+
+// ****************************************************************************
+//! @struct MessageCodec
+//! @brief \~english     Trait that encodes a message type into shared memory
+//!        \~japanese-en メッセージの型を共有メモリ上のバイト列に変換するトレイト
+//! @details \~english     Specialize it to transfer a type that is not standard layout. A specialization provides
+//!                          static size_t getSize(const T &) returning the exact encoded size,
+//!                          static size_t serialize(const T &, unsigned char *) writing that many bytes, and
+//!                          static bool deserialize(const unsigned char *, size_t, T *) that returns false on
+//!                          malformed input instead of reading past the given size.
+//!                          serialize() writes straight into the ring slot, and deserialize() reuses the
+//!                          capacity of the destination, so a codec needs no intermediate buffer.
+//!                          Types declared with SHM_REFLECT() get the flat codec without a specialization.
+//!          \~japanese-en 標準レイアウトでない型を扱う場合に特殊化する．特殊化は、符号化後の大きさを返す
+//!                          static size_t getSize(const T &)、その大きさを書き込む
+//!                          static size_t serialize(const T &, unsigned char *)、および不正な入力に対して
+//!                          与えた大きさを超えて読まずに偽を返す static bool deserialize(const unsigned char *, size_t, T *)
+//!                          を持つ．serialize() はリングバッファのスロットに直接書き込み、deserialize() は格納先の
+//!                          容量を再利用するため、中間バッファを必要としない．
+//!                          SHM_REFLECT() で宣言した型は特殊化せずにフラット形式で符号化される．
+// ****************************************************************************
+template <class T, class Enable = void>
+struct MessageCodec
+{
+};
+
+// ****************************************************************************
+//! @brief \~english     True if MessageCodec<T> is specialized for T
+//!        \~japanese-en MessageCodec<T> が特殊化されていれば真
+// ****************************************************************************
+template <class T, class Enable = void>
+struct is_serialized_message : std::false_type
+{
+};
+
+template <class T>
+struct is_serialized_message<T, std::void_t<decltype(MessageCodec<T>::getSize(std::declval<const T &>()))>>
+  : std::true_type
+{
+};
+
+// ****************************************************************************
+//! @brief \~english     True if T can be transferred, either as raw bytes or through its codec
+//!        \~japanese-en Tをバイト列のまま、またはシリアライズして転送できれば真
+// ****************************************************************************
+template <class T>
+constexpr bool
+is_transferable_message()
+{
+  return std::is_standard_layout<T>::value || is_serialized_message<T>::value;
+}
+
+// ****************************************************************************
+// Compile-time reflection
+// ****************************************************************************
+
+// Applies M to each of up to 32 arguments
+#define SHM_REFLECT_EXPAND(x) x
+#define SHM_REFLECT_FE_1(M, a) M(a)
+#define SHM_REFLECT_FE_2(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_1(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_3(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_2(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_4(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_3(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_5(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_4(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_6(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_5(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_7(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_6(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_8(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_7(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_9(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_8(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_10(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_9(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_11(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_10(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_12(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_11(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_13(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_12(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_14(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_13(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_15(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_14(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_16(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_15(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_17(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_16(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_18(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_17(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_19(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_18(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_20(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_19(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_21(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_20(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_22(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_21(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_23(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_22(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_24(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_23(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_25(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_24(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_26(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_25(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_27(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_26(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_28(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_27(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_29(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_28(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_30(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_29(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_31(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_30(M, __VA_ARGS__))
+#define SHM_REFLECT_FE_32(M, a, ...) M(a) SHM_REFLECT_EXPAND(SHM_REFLECT_FE_31(M, __VA_ARGS__))
+#define SHM_REFLECT_SELECT( \
+  _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, \
+  _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, \
+  NAME, ...) NAME
+#define SHM_REFLECT_FOR_EACH(M, ...) \
+  SHM_REFLECT_EXPAND(SHM_REFLECT_SELECT(__VA_ARGS__, \
+    SHM_REFLECT_FE_32, SHM_REFLECT_FE_31, SHM_REFLECT_FE_30, SHM_REFLECT_FE_29, \
+    SHM_REFLECT_FE_28, SHM_REFLECT_FE_27, SHM_REFLECT_FE_26, SHM_REFLECT_FE_25, \
+    SHM_REFLECT_FE_24, SHM_REFLECT_FE_23, SHM_REFLECT_FE_22, SHM_REFLECT_FE_21, \
+    SHM_REFLECT_FE_20, SHM_REFLECT_FE_19, SHM_REFLECT_FE_18, SHM_REFLECT_FE_17, \
+    SHM_REFLECT_FE_16, SHM_REFLECT_FE_15, SHM_REFLECT_FE_14, SHM_REFLECT_FE_13, \
+    SHM_REFLECT_FE_12, SHM_REFLECT_FE_11, SHM_REFLECT_FE_10, SHM_REFLECT_FE_9, \
+    SHM_REFLECT_FE_8, SHM_REFLECT_FE_7, SHM_REFLECT_FE_6, SHM_REFLECT_FE_5, \
+    SHM_REFLECT_FE_4, SHM_REFLECT_FE_3, SHM_REFLECT_FE_2, SHM_REFLECT_FE_1)(M, __VA_ARGS__))
+
+#define SHM_REFLECT_VISIT(member) visitor(message.member);
+#define SHM_REFLECT_HASH_MEMBER(member)                                               \
+  hash = ::irlab::shm::hashFingerprint(hash, #member);                                \
+  hash = ::irlab::shm::hashFingerprint(hash, ::irlab::shm::getTypeFingerprint<decltype(LayoutType::member)>());
+#define SHM_REFLECT_HASH_OFFSET(member) \
+  SHM_REFLECT_HASH_MEMBER(member) hash = ::irlab::shm::hashFingerprint(hash, offsetof(LayoutType, member));
+
+//! \~english     Declare the members encoded by the flat codec, in order. Use it in the namespace of Type,
+//!               after its definition: SHM_REFLECT(Pose, frame_id, position, covariance)
+//! \~japanese-en フラット形式で符号化するメンバを順に宣言する．Typeと同じ名前空間で、定義の後に記述する．
+//!               例: SHM_REFLECT(Pose, frame_id, position, covariance)
+#define SHM_REFLECT(Type, ...)                                            \
+  template <class Visitor>                                                \
+  inline void shmReflectMembers(Type &message, Visitor &&visitor)         \
+  {                                                                       \
+    SHM_REFLECT_FOR_EACH(SHM_REFLECT_VISIT, __VA_ARGS__)                  \
+  }                                                                       \
+  template <class Visitor>                                                \
+  inline void shmReflectMembers(const Type &message, Visitor &&visitor)   \
+  {                                                                       \
+    SHM_REFLECT_FOR_EACH(SHM_REFLECT_VISIT, __VA_ARGS__)                  \
+  }                                                                       \
+  constexpr uint64_t shmReflectLayout(const Type *)                       \
+  {                                                                       \
+    using LayoutType = Type;                                              \
+    uint64_t hash    = ::irlab::shm::FINGERPRINT_OFFSET_BASIS;            \
+    SHM_REFLECT_FOR_EACH(SHM_REFLECT_HASH_MEMBER, __VA_ARGS__)            \
+    return hash;                                                          \
+  }
+
+//! \~english     Declare the members of a standard-layout type, in order, so that its type fingerprint covers the
+//!               names, types and offsets of the fields. The type is still copied as raw bytes. Use it in the
+//!               namespace of Type, after its definition: SHM_LAYOUT(Pose, x, y, theta)
+//! \~japanese-en 標準レイアウトの型のメンバを順に宣言し、型の指紋にフィールドの名前、型、オフセットを含める．
+//!               型はそのままバイト列としてコピーされる．Typeと同じ名前空間で、定義の後に記述する．
+//!               例: SHM_LAYOUT(Pose, x, y, theta)
+#define SHM_LAYOUT(Type, ...)                                             \
+  constexpr uint64_t shmReflectLayout(const Type *)                       \
+  {                                                                       \
+    using LayoutType = Type;                                              \
+    uint64_t hash    = ::irlab::shm::FINGERPRINT_OFFSET_BASIS;            \
+    SHM_REFLECT_FOR_EACH(SHM_REFLECT_HASH_OFFSET, __VA_ARGS__)            \
+    return hash;                                                          \
+  }
+
+// ****************************************************************************
+//! @brief \~english     True if T was declared with SHM_REFLECT()
+//!        \~japanese-en TがSHM_REFLECT()で宣言されていれば真
+// ****************************************************************************
+struct ReflectionProbe
+{
+  template <class Member>
+  void
+  operator()(const Member &) const
+  {
+  }
+};
+
+template <class T, class Enable = void>
+struct has_reflection : std::false_type
+{
+};
+
+template <class T>
+struct has_reflection<T, std::void_t<decltype(shmReflectMembers(std::declval<const T &>(), ReflectionProbe()))>>
+  : std::true_type
+{
+};
+
+// ****************************************************************************
+//! @class FlatCodec
+//! @brief \~english     Default codec that lays out reflected members one after another
+//!        \~japanese-en 反映したメンバを順に並べる既定の符号化
+//! @details \~english     Trivially copyable members are copied as raw bytes, std::string and std::vector are
+//!                          prefixed with a 32-bit length, and nested reflected types are encoded in place.
+//!                          Members with their own MessageCodec are prefixed with their encoded size.
+//!                          Integers keep the byte order of the host, as every process shares the same memory.
+//!          \~japanese-en トリビアルにコピー可能なメンバはそのまま、std::string と std::vector は32bitの長さを前置して
+//!                          書き込み、入れ子のSHM_REFLECT型はその場に展開する．独自のMessageCodecを持つメンバは
+//!                          符号化後の大きさを前置する．全てのプロセスが同じメモリを共有するため、
+//!                          整数はホストのバイト順のまま扱う．
+// ****************************************************************************
+class FlatCodec
+{
+public:
+  template <class T>
+  static size_t getSize(const T &value);
+  template <class T>
+  static void write(const T &value, unsigned char *&ptr);
+  template <class T>
+  static bool read(T *value, const unsigned char *&ptr, const unsigned char *end);
+
+private:
+  template <class T>
+  struct is_vector : std::false_type
+  {
+  };
+  template <class T, class Allocator>
+  struct is_vector<std::vector<T, Allocator>> : std::true_type
+  {
+  };
+  template <class T>
+  struct is_array : std::false_type
+  {
+  };
+  template <class T, size_t N>
+  struct is_array<std::array<T, N>> : std::true_type
+  {
+  };
+  template <class T>
+  struct dependent_false : std::false_type
+  {
+  };
+
+  template <class T>
+  static constexpr bool
+  isRaw()
+  {
+    return std::is_trivially_copyable<T>::value && std::is_standard_layout<T>::value && !has_reflection<T>::value &&
+           !is_serialized_message<T>::value;
+  }
+
+  static void writeLength(size_t length, unsigned char *&ptr);
+  static bool readLength(size_t *length, const unsigned char *&ptr, const unsigned char *end);
+};
+
+template <class T>
+size_t
+FlatCodec::getSize(const T &value)
+{
+  if constexpr (isRaw<T>())
+  {
+    return sizeof(T);
+  }
+  else if constexpr (std::is_same<T, std::string>::value)
+  {
+    return sizeof(uint32_t) + value.size();
+  }
+  else if constexpr (is_vector<T>::value)
+  {
+    using Element = typename T::value_type;
+    if constexpr (isRaw<Element>())
+    {
+      return sizeof(uint32_t) + sizeof(Element) * value.size();
+    }
+    else
+    {
+      size_t size = sizeof(uint32_t);
+      for (const Element &element : value)
+      {
+        size += getSize(element);
+      }
+      return size;
+    }
+  }
+  else if constexpr (is_array<T>::value)
+  {
+    size_t size = 0;
+    for (const auto &element : value)
+    {
+      size += getSize(element);
+    }
+    return size;
+  }
+  else if constexpr (has_reflection<T>::value)
+  {
+    size_t size = 0;
+    shmReflectMembers(value, [&size](const auto &member) { size += getSize(member); });
+    return size;
+  }
+  else if constexpr (is_serialized_message<T>::value)
+  {
+    return sizeof(uint32_t) + MessageCodec<T>::getSize(value);
+  }
+  else
+  {
+    static_assert(dependent_false<T>::value, "shm::FlatCodec: Member type has no known encoding");
+    return 0;
+  }
+}
+
+template <class T>
+void
+FlatCodec::write(const T &value, unsigned char *&ptr)
+{
+  if constexpr (isRaw<T>())
+  {
+    std::memcpy(ptr, &value, sizeof(T));
+    ptr += sizeof(T);
+  }
+  else if constexpr (std::is_same<T, std::string>::value)
+  {
+    writeLength(value.size(), ptr);
+    std::memcpy(ptr, value.data(), value.size());
+    ptr += value.size();
+  }
+  else if constexpr (is_vector<T>::value)
+  {
+    using Element = typename T::value_type;
+    writeLength(value.size(), ptr);
+    if constexpr (isRaw<Element>())
+    {
+      // One copy for the whole array instead of one per element
+      std::memcpy(ptr, value.data(), sizeof(Element) * value.size());
+      ptr += sizeof(Element) * value.size();
+    }
+    else
+    {
+      for (const Element &element : value)
+      {
+        write(element, ptr);
+      }
+    }
+  }
+  else if constexpr (is_array<T>::value)
+  {
+    for (const auto &element : value)
+    {
+      write(element, ptr);
+    }
+  }
+  else if constexpr (has_reflection<T>::value)
+  {
+    shmReflectMembers(value, [&ptr](const auto &member) { write(member, ptr); });
+  }
+  else
+  {
+    unsigned char *size_ptr = ptr;
+    ptr += sizeof(uint32_t);
+    size_t size = MessageCodec<T>::serialize(value, ptr);
+    writeLength(size, size_ptr);
+    ptr += size;
+  }
+}
+
+template <class T>
+bool
+FlatCodec::read(T *value, const unsigned char *&ptr, const unsigned char *end)
+{
+  if constexpr (isRaw<T>())
+  {
+    if (static_cast<size_t>(end - ptr) < sizeof(T))
+    {
+      return false;
+    }
+    std::memcpy(value, ptr, sizeof(T));
+    ptr += sizeof(T);
+    return true;
+  }
+  else if constexpr (std::is_same<T, std::string>::value)
+  {
+    size_t length;
+    if (!readLength(&length, ptr, end) || static_cast<size_t>(end - ptr) < length)
+    {
+      return false;
+    }
+    // assign() keeps the capacity of the reused string
+    value->assign(reinterpret_cast<const char *>(ptr), length);
+    ptr += length;
+    return true;
+  }
+  else if constexpr (is_vector<T>::value)
+  {
+    using Element = typename T::value_type;
+    size_t length;
+    if (!readLength(&length, ptr, end))
+    {
+      return false;
+    }
+    if constexpr (isRaw<Element>())
+    {
+      if (static_cast<size_t>(end - ptr) / sizeof(Element) < length)
+      {
+        return false;
+      }
+      value->resize(length);
+      std::memcpy(value->data(), ptr, sizeof(Element) * length);
+      ptr += sizeof(Element) * length;
+      return true;
+    }
+    else
+    {
+      // Every element takes at least one byte, which bounds the length of a corrupted prefix
+      if (static_cast<size_t>(end - ptr) < length)
+      {
+        return false;
+      }
+      value->resize(length);
+      for (Element &element : *value)
+      {
+        if (!read(&element, ptr, end))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+  }
+  else if constexpr (is_array<T>::value)
+  {
+    for (auto &element : *value)
+    {
+      if (!read(&element, ptr, end))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+  else if constexpr (has_reflection<T>::value)
+  {
+    bool is_valid = true;
+    shmReflectMembers(*value, [&](auto &member) { is_valid = is_valid && read(&member, ptr, end); });
+    return is_valid;
+  }
+  else
+  {
+    size_t size;
+    if (!readLength(&size, ptr, end) || static_cast<size_t>(end - ptr) < size ||
+        !MessageCodec<T>::deserialize(ptr, size, value))
+    {
+      return false;
+    }
+    ptr += size;
+    return true;
+  }
+}
+
+inline void
+FlatCodec::writeLength(size_t length, unsigned char *&ptr)
+{
+  uint32_t value = static_cast<uint32_t>(length);
+  std::memcpy(ptr, &value, sizeof(value));
+  ptr += sizeof(value);
+}
+
+inline bool
+FlatCodec::readLength(size_t *length, const unsigned char *&ptr, const unsigned char *end)
+{
+  uint32_t value;
+  if (static_cast<size_t>(end - ptr) < sizeof(value))
+  {
+    return false;
+  }
+  std::memcpy(&value, ptr, sizeof(value));
+  ptr += sizeof(value);
+  *length = value;
+  return true;
+}
+
+// ****************************************************************************
+//! @brief \~english     Flat codec used for every type declared with SHM_REFLECT()
+//!        \~japanese-en SHM_REFLECT()で宣言した型に使うフラット形式の符号化
+// ****************************************************************************
+template <class T>
+struct MessageCodec<T, std::enable_if_t<has_reflection<T>::value>>
+{
+  static size_t
+  getSize(const T &message)
+  {
+    return FlatCodec::getSize(message);
+  }
+
+  static size_t
+  serialize(const T &message, unsigned char *buffer)
+  {
+    unsigned char *ptr = buffer;
+    FlatCodec::write(message, ptr);
+    return static_cast<size_t>(ptr - buffer);
+  }
+
+  static bool
+  deserialize(const unsigned char *buffer, size_t size, T *message)
+  {
+    const unsigned char *ptr = buffer;
+    return FlatCodec::read(message, ptr, buffer + size) && ptr == buffer + size;
+  }
+};
+
+// ****************************************************************************
+// Type fingerprint
+// ****************************************************************************
+
+//! \~english Initial value of the FNV-1a hash used by type fingerprints
+//! \~japanese-en 型の指紋に用いるFNV-1aハッシュの初期値
+constexpr uint64_t FINGERPRINT_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+//! \~english Multiplier of the FNV-1a hash used by type fingerprints
+//! \~japanese-en 型の指紋に用いるFNV-1aハッシュの乗数
+constexpr uint64_t FINGERPRINT_PRIME = 0x100000001b3ULL;
+
+//! @brief \~english     Mix the 8 bytes of a value into a fingerprint
+//!        \~japanese-en 値の8バイトを指紋に混ぜる
+constexpr uint64_t
+hashFingerprint(uint64_t hash, uint64_t value)
+{
+  for (int i = 0; i < 8; i++)
+  {
+    hash = (hash ^ ((value >> (i * 8)) & 0xff)) * FINGERPRINT_PRIME;
+  }
+  return hash;
+}
+
+//! @brief \~english     Mix a NUL-terminated name into a fingerprint
+//!        \~japanese-en NUL終端の名前を指紋に混ぜる
+constexpr uint64_t
+hashFingerprint(uint64_t hash, const char *name)
+{
+  for (; *name != '\0'; name++)
+  {
+    hash = (hash ^ static_cast<unsigned char>(*name)) * FINGERPRINT_PRIME;
+  }
+  return (hash ^ 0xff) * FINGERPRINT_PRIME;
+}
+
+template <class T>
+constexpr uint64_t getTypeFingerprint();
+
+// ****************************************************************************
+//! @brief \~english     True if T was declared with SHM_REFLECT() or SHM_LAYOUT()
+//!        \~japanese-en TがSHM_REFLECT()またはSHM_LAYOUT()で宣言されていれば真
+// ****************************************************************************
+template <class T, class Enable = void>
+struct has_layout_hash : std::false_type
+{
+};
+
+template <class T>
+struct has_layout_hash<T, std::void_t<decltype(shmReflectLayout(static_cast<const T *>(nullptr)))>> : std::true_type
+{
+};
+
+// ****************************************************************************
+//! @struct TypeLayout
+//! @brief \~english     Trait that hashes the field layout of a type for its fingerprint
+//!        \~japanese-en 型の指紋のためにフィールドの配置をハッシュするトレイト
+//! @details \~english     Arithmetic types, enumerations, arrays, std::string, std::vector and types declared with
+//!                          SHM_REFLECT() or SHM_LAYOUT() are covered. Other structures hash to 0, so only their
+//!                          size and alignment are compared; specialize the trait with a static constexpr
+//!                          uint64_t value to describe them.
+//!          \~japanese-en 算術型、列挙型、配列、std::string、std::vector、SHM_REFLECT() または SHM_LAYOUT() で
+//!                          宣言した型に対応する．その他の構造体は0となり、大きさとアライメントのみを比較する．
+//!                          それらを記述する場合は static constexpr uint64_t value を持つよう特殊化する．
+// ****************************************************************************
+template <class T, class Enable = void>
+struct TypeLayout
+{
+  static constexpr uint64_t value = 0;
+};
+
+template <class T>
+struct TypeLayout<T, std::enable_if_t<std::is_arithmetic<T>::value>>
+{
+  static constexpr uint64_t value = hashFingerprint(
+      hashFingerprint(FINGERPRINT_OFFSET_BASIS, std::is_floating_point<T>::value ? "float"
+                                                : std::is_same<T, bool>::value   ? "bool"
+                                                : std::is_signed<T>::value       ? "int"
+                                                                                 : "uint"),
+      sizeof(T));
+};
+
+template <class T>
+struct TypeLayout<T, std::enable_if_t<std::is_enum<T>::value>>
+{
+  static constexpr uint64_t value =
+      hashFingerprint(hashFingerprint(FINGERPRINT_OFFSET_BASIS, "enum"), getTypeFingerprint<std::underlying_type_t<T>>());
+};
+
+template <class T, size_t N>
+struct TypeLayout<T[N]>
+{
+  static constexpr uint64_t value =
+      hashFingerprint(hashFingerprint(hashFingerprint(FINGERPRINT_OFFSET_BASIS, "array"), N), getTypeFingerprint<T>());
+};
+
+template <class T, size_t N>
+struct TypeLayout<std::array<T, N>> : TypeLayout<T[N]>
+{
+};
+
+template <class Traits, class Allocator>
+struct TypeLayout<std::basic_string<char, Traits, Allocator>>
+{
+  static constexpr uint64_t value = hashFingerprint(FINGERPRINT_OFFSET_BASIS, "string");
+};
+
+template <class T, class Allocator>
+struct TypeLayout<std::vector<T, Allocator>>
+{
+  static constexpr uint64_t value =
+      hashFingerprint(hashFingerprint(FINGERPRINT_OFFSET_BASIS, "vector"), getTypeFingerprint<T>());
+};
+
+template <class T>
+struct TypeLayout<T, std::enable_if_t<has_layout_hash<T>::value>>
+{
+  static constexpr uint64_t value = shmReflectLayout(static_cast<const T *>(nullptr));
+};
+
+// ****************************************************************************
+//! @brief \~english     Compile-time fingerprint of a type: its size, alignment and field layout
+//!        \~japanese-en 型の大きさ、アライメント、フィールドの配置から求めるコンパイル時の指紋
+//! @details \~english     Serialized types are fingerprinted by their fields only, since their encoding does not
+//!                          depend on the size of the object.
+//!          \~japanese-en シリアライズする型は符号化がオブジェクトの大きさに依存しないため、フィールドのみから求める．
+// ****************************************************************************
+template <class T>
+constexpr uint64_t
+getTypeFingerprint()
+{
+  if constexpr (is_serialized_message<T>::value)
+  {
+    return hashFingerprint(hashFingerprint(FINGERPRINT_OFFSET_BASIS, "serialized"), TypeLayout<T>::value);
+  }
+  else
+  {
+    return hashFingerprint(hashFingerprint(hashFingerprint(FINGERPRINT_OFFSET_BASIS, sizeof(T)), alignof(T)),
+                           TypeLayout<T>::value);
+  }
+}
+
+// ****************************************************************************
+//! @brief \~english     Fingerprint stored in the header of a ring buffer whose slots hold T
+//!        \~japanese-en Tを格納するリングバッファのヘッダに記録する指紋
+//! @details \~english     Scalar and vector topics of the same T share it. It is 0 for unsigned char: byte topics
+//!                          carry other types for the bag, the bridge and the Python bindings, so they attach to and
+//!                          accept any topic. A fingerprint of 0 is never checked.
+//!          \~japanese-en 同じTのスカラーとベクトルのトピックは同じ値を持つ．unsigned char の場合は0とする．
+//!                          バイト列のトピックはバッグ、ブリッジ、Pythonで他の型を運ぶため、どのトピックにも接続できる．
+//!                          指紋が0の場合は確認しない．
+// ****************************************************************************
+template <class T>
+constexpr uint64_t
+getTopicTypeHash()
+{
+  if constexpr (std::is_same<T, unsigned char>::value)
+  {
+    return 0;
+  }
+  else
+  {
+    return getTypeFingerprint<T>();
+  }
+}
+
+//! @brief \~english     True if a topic written with one fingerprint can be read with the other
+//!        \~japanese-en 一方の指紋で書き込んだトピックを他方の指紋で読み込めれば真
+constexpr bool
+checkTypeHash(uint64_t stored_hash, uint64_t expected_hash)
+{
+  return stored_hash == 0 || expected_hash == 0 || stored_hash == expected_hash;
+}
+
+// ****************************************************************************
+//! @brief \~english     Default capacity of a serialized request, response, goal, result or feedback [byte]
+//!        \~japanese-en シリアライズしたリクエスト、レスポンス、ゴール、結果、フィードバックの既定の容量[byte]
+// ****************************************************************************
+constexpr size_t DEFAULT_SERIALIZED_STORAGE_SIZE = 4096;
+
+// ****************************************************************************
+//! @struct SerializedStorageSize
+//! @brief \~english     Capacity reserved for one serialized T in service and action slots [byte]
+//!        \~japanese-en サービスとアクションのスロットにシリアライズしたTを格納する容量[byte]
+//! @details \~english     Service and action slots have a fixed size, unlike topics whose slots grow.
+//!                          Specialize this trait for types that may encode to more than
+//!                          DEFAULT_SERIALIZED_STORAGE_SIZE bytes.
+//!          \~japanese-en トピックのスロットと異なり、サービスとアクションのスロットは固定長である．
+//!                          DEFAULT_SERIALIZED_STORAGE_SIZE を超える可能性のある型はこのトレイトを特殊化する．
+// ****************************************************************************
+template <class T>
+struct SerializedStorageSize : std::integral_constant<size_t, DEFAULT_SERIALIZED_STORAGE_SIZE>
+{
+};
+
+// ****************************************************************************
+//! @struct SerializedStorage
+//! @brief \~english     Fixed-capacity bytes holding one serialized message inside a slot
+//!        \~japanese-en スロット内で一つのシリアライズしたメッセージを保持する固定長の領域
+// ****************************************************************************
+template <size_t Capacity>
+struct SerializedStorage
+{
+  uint64_t      size;
+  unsigned char data[Capacity];
+};
+
+// ****************************************************************************
+//! @struct MessageStorage
+//! @brief \~english     How a message is stored in a service or action slot
+//!        \~japanese-en サービスまたはアクションのスロットへのメッセージの格納方法
+//! @details \~english     Standard-layout types are stored as they are. Serialized types are stored through
+//!                          their codec in a SerializedStorage.
+//!          \~japanese-en 標準レイアウトの型はそのまま格納し、シリアライズする型は符号化して SerializedStorage に格納する．
+// ****************************************************************************
+template <class T, class Enable = void>
+struct MessageStorage
+{
+  using type = T;
+
+  static bool
+  fits(const T &)
+  {
+    return true;
+  }
+
+  static bool
+  store(type *storage, const T &message)
+  {
+    *storage = message;
+    return true;
+  }
+
+  static bool
+  load(const type &storage, T *message)
+  {
+    *message = storage;
+    return true;
+  }
+  static void
+  invalidate(type *)
+  {
+  }
+};
+
+template <class T>
+struct MessageStorage<T, std::enable_if_t<is_serialized_message<T>::value>>
+{
+  using type = SerializedStorage<SerializedStorageSize<T>::value>;
+
+  static bool
+  fits(const T &message)
+  {
+    return MessageCodec<T>::getSize(message) <= SerializedStorageSize<T>::value;
+  }
+
+  //! @return \~english     False if the message is larger than the storage; the storage is then marked invalid
+  //!         \~japanese-en 容量を超える場合は偽．その場合、格納先は無効になる
+  static bool
+  store(type *storage, const T &message)
+  {
+    if (!fits(message))
+    {
+      invalidate(storage);
+      return false;
+    }
+    storage->size = MessageCodec<T>::serialize(message, storage->data);
+    return true;
+  }
+
+  //! @brief \~english     Mark the storage so that load() fails
+  //!        \~japanese-en load() が失敗するよう格納先を無効にする
+  static void
+  invalidate(type *storage)
+  {
+    storage->size = std::numeric_limits<uint64_t>::max();
+  }
+
+  static bool
+  load(const type &storage, T *message)
+  {
+    return storage.size <= SerializedStorageSize<T>::value &&
+           MessageCodec<T>::deserialize(storage.data, static_cast<size_t>(storage.size), message);
+  }
+};
+
+}  // namespace shm
+
+}  // namespace irlab
+
+#endif /* __SHM_CODEC_LIB_H__ */
@@ -0,0 +1,219 @@
+//!
+//! @file shm_trace.hpp
+//! @brief \~english     Tracepoints of topics, services and actions recorded in a per-process trace ring
+//!        \~japanese-en トピック、サービス、アクションのトレースポイントとプロセスごとのトレースリング
+//! @note \~english     The notation is complianted ROS Cpp style guide.
+//!       \~japanese-en 記法はROSに準拠する
+//!       \~            http://wiki.ros.org/ja/CppStyleGuide
+//!
+
+#ifndef __SHM_TRACE_LIB_H__
+#define __SHM_TRACE_LIB_H__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "shm_base.hpp"
+
+#if !defined(SHM_DISABLE_TRACING) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+// USDT probes "shm:<EVENT>" for perf and bpftrace; a nop instruction until a tracer attaches
+#define SHM_TRACE_USDT(event, name, sequence) DTRACE_PROBE2(shm, event, (name).c_str(), sequence)
+#endif
+#endif
+#ifndef SHM_TRACE_USDT
+#define SHM_TRACE_USDT(event, name, sequence) ((void)0)
+#endif
+
+namespace irlab
+{
+
+namespace shm
+{
+
+// ****************************************************************************
+//! @enum TRACE_EVENT
+//! @brief \~english     Tracepoints recorded by publishers, subscribers, services and actions
+//!        \~japanese-en Publisher、Subscriber、サービス、アクションが記録するトレースポイント
+// ****************************************************************************
+enum TRACE_EVENT : uint32_t
+{
+  TRACE_PUBLISH_BEGIN = 1,  /*!<
+                             * \~english     Publish started, before a slot is reserved
+                             * \~japanese-en 出版の開始(スロットの予約前)
+                             */
+  TRACE_PUBLISH_COMMIT,     /*!<
+                             * \~english     Slot committed
+                             * \~japanese-en スロットの確定
+                             */
+  TRACE_SUBSCRIBE,          /*!<
+                             * \~english     Topic read by a subscriber
+                             * \~japanese-en Subscriberによる読み込み
+                             */
+  TRACE_WAIT_WAKE,          /*!<
+                             * \~english     waitFor() woken by an update
+                             * \~japanese-en 更新による waitFor() の起床
+                             */
+  TRACE_SERVICE_REQUEST,    /*!<
+                             * \~english     Request taken by a server worker
+                             * \~japanese-en ワーカーによるリクエストの取得
+                             */
+  TRACE_SERVICE_RESPONSE,   /*!<
+                             * \~english     Response returned
+                             * \~japanese-en レスポンスの返却
+                             */
+  TRACE_ACTION_GOAL,        /*!<
+                             * \~english     Goal accepted
+                             * \~japanese-en ゴールの受理
+                             */
+  TRACE_ACTION_FEEDBACK,    /*!<
+                             * \~english     Feedback committed
+                             * \~japanese-en フィードバックの確定
+                             */
+  TRACE_ACTION_RESULT,      /*!<
+                             * \~english     Goal finished
+                             * \~japanese-en ゴールの終了
+                             */
+};
+
+// ****************************************************************************
+//! @struct TraceSlot
+//! @brief \~english     One record of the trace ring in shared memory
+//!        \~japanese-en 共有メモリ上のトレースリングの1レコード
+//! @details \~english     Written under a seqlock: odd while being written, 2 * (index + 1) once complete.
+//!                          The name is split into words so that a reader never races on plain memory.
+//!          \~japanese-en シーケンスロックで書き込む．書き込み中は奇数、完了後は 2 * (インデックス + 1) となる．
+//!                          読み込み側が通常のメモリと競合しないよう、名前はワードに分けて格納する．
+// ****************************************************************************
+struct alignas(CACHE_LINE_SIZE) TraceSlot
+{
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint64_t> time_us;
+  std::atomic<uint64_t> topic_sequence;
+  std::atomic<uint32_t> event;
+  std::atomic<uint32_t> thread_id;
+  std::atomic<uint64_t> name[4];
+};
+
+// ****************************************************************************
+//! @struct TraceRecord
+//! @brief \~english     Trace record read back from a trace ring
+//!        \~japanese-en トレースリングから読み出したレコード
+// ****************************************************************************
+struct TraceRecord
+{
+  uint64_t    time_us;    /*!<
+                           * \~english     CLOCK_MONOTONIC_RAW [usec]
+                           * \~japanese-en CLOCK_MONOTONIC_RAW の時刻[usec]
+                           */
+  uint64_t    sequence;   /*!<
+                           * \~english     Topic sequence, call ID or goal ID
+                           * \~japanese-en トピックの通し番号、呼び出しIDまたはゴールID
+                           */
+  TRACE_EVENT event;      /*!<
+                           * \~english     Tracepoint
+                           * \~japanese-en トレースポイント
+                           */
+  pid_t       pid;        /*!<
+                           * \~english     Process that recorded it
+                           * \~japanese-en 記録したプロセス
+                           */
+  pid_t       thread_id;  /*!<
+                           * \~english     Thread that recorded it
+                           * \~japanese-en 記録したスレッド
+                           */
+  std::string name;       /*!<
+                           * \~english     Topic name (truncated)
+                           * \~japanese-en トピック名(切り詰められる)
+                           */
+};
+
+// ****************************************************************************
+//! @class TraceBuffer
+//! @brief \~english     Lock-free trace ring in shared memory
+//!        \~japanese-en 共有メモリ上のロックフリーなトレースリング
+//! @details \~english     Writers claim a record with one fetch-add and never wait, so any thread may record.
+//!                          The ring lives in shared memory so that "shm_tool trace" can dump a running process
+//!                          without stopping it. Old records are overwritten once the ring wraps around.
+//!          \~japanese-en 書き込み側は1回のfetch-addでレコードを確保して待たないため、どのスレッドからも記録できる．
+//!                          "shm_tool trace" が動作中のプロセスを止めずに出力できるよう、共有メモリ上に置く．
+//!                          一周すると古いレコードから上書きされる．
+// ****************************************************************************
+class TraceBuffer
+{
+public:
+  TraceBuffer(const std::string &trace_name, size_t record_num = DEFAULT_RECORD_NUM, PERM perm = DEFAULT_PERM);
+
+  void                     record(TRACE_EVENT event, const std::string &name, uint64_t sequence, uint64_t time_us);
+  std::vector<TraceRecord> read() const;
+
+  static size_t      getSize(size_t record_num);
+  static bool        readRecords(const unsigned char *first_ptr, size_t size, std::vector<TraceRecord> *record_list);
+  static std::string getMemoryName(pid_t pid);
+
+  //! \~english Records of the per-process ring created by enableTracing()
+  //! \~japanese-en enableTracing() が作成するプロセスごとのリングのレコード数
+  static constexpr size_t DEFAULT_RECORD_NUM = 65536;
+  //! \~english Layout tag stored in the header: 'TC' in the upper half, revision in the lower half
+  //! \~japanese-en ヘッダに格納するレイアウト識別子．上位16bitは'TC'、下位16bitは版数
+  static constexpr uint32_t LAYOUT_VERSION = 0x54430001;
+
+private:
+  std::unique_ptr<SharedMemoryPosix> shared_memory;
+  std::atomic<uint64_t>             *write_index;
+  TraceSlot                         *slot_list;
+  size_t                             slot_num;
+};
+
+//! \~english Set by enableTracing(); read by every tracepoint
+//! \~japanese-en enableTracing() が設定し、全てのトレースポイントが読む
+extern std::atomic<bool> tracing_enabled;
+
+void                     enableTracing(size_t record_num = TraceBuffer::DEFAULT_RECORD_NUM);
+void                     disableTracing();
+void                     recordTrace(TRACE_EVENT event, const std::string &name, uint64_t sequence,
+                                     uint64_t time_us = 0);
+std::vector<TraceRecord> readTrace();
+void                     writeChromeTrace(std::ostream &stream, const std::vector<TraceRecord> &record_list);
+
+//! @brief \~english     Check whether tracepoints are recorded
+//!        \~japanese-en トレースポイントを記録するかの確認
+//! @return bool \~english     True after enableTracing() or when started with SHM_TRACE set
+//!              \~japanese-en enableTracing() の後、または環境変数 SHM_TRACE を設定して起動した場合は真
+inline bool
+isTracing()
+{
+  return tracing_enabled.load(std::memory_order_relaxed);
+}
+
+}  // namespace shm
+
+}  // namespace irlab
+
+//! \~english Tracepoints compile to nothing with -DSHM_DISABLE_TRACING (cmake -DENABLE_TRACING=OFF); otherwise
+//!           a tracepoint costs one relaxed load while not recording, plus the USDT arguments if sys/sdt.h exists.
+//! \~japanese-en -DSHM_DISABLE_TRACING (cmake -DENABLE_TRACING=OFF) の場合トレースポイントは何も生成しない．
+//!           それ以外では記録していない間の負荷は1回のrelaxedな読み込みと、sys/sdt.h がある場合のUSDTの引数のみである．
+#if defined(SHM_DISABLE_TRACING)
+#define SHM_TRACE_TIME() (static_cast<uint64_t>(0))
+#define SHM_TRACE_AT(event, name, sequence, time_us) ((void)0)
+#else
+#define SHM_TRACE_TIME() (::irlab::shm::isTracing() ? ::irlab::shm::getCurrentTimeUSec() : 0)
+#define SHM_TRACE_AT(event, name, sequence, time_us)                                                \
+  do                                                                                                \
+  {                                                                                                 \
+    SHM_TRACE_USDT(event, name, sequence);                                                          \
+    if (::irlab::shm::isTracing())                                                                  \
+    {                                                                                               \
+      ::irlab::shm::recordTrace(::irlab::shm::TRACE_##event, name, sequence, time_us);              \
+    }                                                                                               \
+  } while (0)
+#endif
+#define SHM_TRACE(event, name, sequence) SHM_TRACE_AT(event, name, sequence, 0)
+
+#endif /* __SHM_TRACE_LIB_H__ */
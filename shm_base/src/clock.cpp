@@ -0,0 +1,158 @@
+#include <shm_base.hpp>
+#include <cstdlib>
+
+namespace irlab
+{
+
+namespace shm
+{
+
+namespace
+{
+
+//! 時刻のワード．nullptrの場合は CLOCK_MONOTONIC_RAW を使う
+std::atomic<const std::atomic<uint64_t> *> simulated_time(nullptr);
+std::mutex                                 clock_mutex;
+
+//! @brief 接続した時計の一覧
+//! @return std::vector<std::unique_ptr<SimulatedClock>>& 一覧
+//! @details 他のスレッドが切り替え前の時計のワードを読んでいる可能性があるため、時計はプロセスの終了まで解放しない．
+std::vector<std::unique_ptr<SimulatedClock>> &
+getClockList()
+{
+  static std::vector<std::unique_ptr<SimulatedClock>> clock_list;
+  return clock_list;
+}
+
+//! @brief 環境変数 SHM_SIMULATED_CLOCK による時計の選択
+//! @details コードを変更せずに、スタック全体のプロセスをシミュレーション時刻で動作させる．
+struct EnvironmentClock
+{
+  EnvironmentClock()
+  {
+    const char *clock_name = std::getenv("SHM_SIMULATED_CLOCK");
+    if (clock_name == nullptr || clock_name[0] == '\0')
+    {
+      return;
+    }
+    try
+    {
+      useSimulatedClock(clock_name);
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+};
+EnvironmentClock environment_clock;
+
+}  // namespace
+
+//! @brief トピックの時刻の取得
+//! @return uint64_t 時刻[usec]
+//! @details シミュレーション時刻を使う場合はその時刻を、それ以外は getCurrentTimeUSec() を返す．
+//! タイムスタンプ、データの有効期限、読み込みの遅延に使う．待ち時間の計測には getCurrentTimeUSec() を使うこと．
+uint64_t
+getClockTimeUSec()
+{
+  const std::atomic<uint64_t> *time_word = simulated_time.load(std::memory_order_acquire);
+  return (time_word != nullptr) ? time_word->load(std::memory_order_acquire) : getCurrentTimeUSec();
+}
+
+//! @brief シミュレーション時刻への切り替え
+//! @param [in] clock_name 時計の共有メモリ名
+//! @return なし
+//! @details 時計が無ければ時刻0で作成するため、シミュレータより先に起動したプロセスも接続できる．
+void
+useSimulatedClock(const std::string &clock_name)
+{
+  std::lock_guard<std::mutex> lock(clock_mutex);
+  getClockList().push_back(std::make_unique<SimulatedClock>(clock_name));
+  simulated_time.store(getClockList().back()->getTimeWord(), std::memory_order_release);
+}
+
+//! @brief CLOCK_MONOTONIC_RAW への切り替え
+//! @param なし
+//! @return なし
+void
+useSystemClock()
+{
+  simulated_time.store(nullptr, std::memory_order_release);
+}
+
+//! @brief シミュレーション時刻を使っているかの確認
+//! @param なし
+//! @return bool シミュレーション時刻を使っている場合は真
+bool
+isSimulatedClock()
+{
+  return simulated_time.load(std::memory_order_acquire) != nullptr;
+}
+
+//! @brief コンストラクタ
+//! @param [in] clock_name 時計の共有メモリ名
+//! @param [in] perm 作成する場合の権限
+//! @return なし
+//! @details 時計が無ければ作成する．時刻は別のキャッシュラインに置き、読み込み側がヘッダと共有しないようにする．
+SimulatedClock::SimulatedClock(const std::string &clock_name, PERM perm)
+  : shared_memory(std::make_unique<SharedMemoryPosix>(clock_name, O_RDWR | O_CREAT, perm))
+  , time_us(nullptr)
+{
+  shared_memory->connect(CACHE_LINE_SIZE * 2);
+  if (shared_memory->isDisconnected())
+  {
+    throw std::runtime_error("shm::SimulatedClock: Cannot get memory!");
+  }
+
+  std::atomic<uint32_t> *layout_version = reinterpret_cast<std::atomic<uint32_t> *>(shared_memory->getPtr());
+  uint32_t               version        = 0;
+  if (!layout_version->compare_exchange_strong(version, LAYOUT_VERSION, std::memory_order_acq_rel) &&
+      version != LAYOUT_VERSION)
+  {
+    throw std::runtime_error("shm::SimulatedClock: Clock layout version mismatch!");
+  }
+  time_us = reinterpret_cast<std::atomic<uint64_t> *>(shared_memory->getPtr() + CACHE_LINE_SIZE);
+}
+
+//! @brief 時刻の取得
+//! @param なし
+//! @return uint64_t 時刻[usec]
+uint64_t
+SimulatedClock::getTime_us() const
+{
+  return time_us->load(std::memory_order_acquire);
+}
+
+//! @brief 時刻の設定
+//! @param [in] input_time_us 時刻[usec]
+//! @return なし
+//! @details シミュレーションのリセットのために時刻を戻すこともできる．その場合、戻す前のタイムスタンプを持つトピックは
+//! 有効期限が切れたものとして扱われる．
+void
+SimulatedClock::setTime_us(uint64_t input_time_us)
+{
+  time_us->store(input_time_us, std::memory_order_release);
+}
+
+//! @brief 時刻を進める
+//! @param [in] duration_us 進める時間[usec]
+//! @return なし
+void
+SimulatedClock::advance_us(uint64_t duration_us)
+{
+  time_us->fetch_add(duration_us, std::memory_order_acq_rel);
+}
+
+//! @brief 時刻のワードの取得
+//! @param なし
+//! @return const std::atomic<uint64_t>* 共有メモリ上の時刻
+const std::atomic<uint64_t> *
+SimulatedClock::getTimeWord() const
+{
+  return time_us;
+}
+
+}  // namespace shm
+
+}  // namespace irlab
@@ -0,0 +1,137 @@
+#include <shm_base.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#if defined(__linux__)
+extern "C" {
+#include <linux/futex.h>
+#include <sys/syscall.h>
+}
+#endif
+
+namespace irlab
+{
+
+namespace shm
+{
+
+//! @brief 共有メモリ上の32bitワードの値が変化するまで待機する
+//! @param [in] word 待機対象のワード
+//! @param [in] expected_value 待機開始時に期待するワードの値
+//! @param [in] timeout_usec 待ち時間[usec]
+//! @return bool タイムアウトした場合は偽、それ以外(起床・値の不一致・割り込み)は真
+//! @details プロセス間で共有されるfutexを使用するため、FUTEX_PRIVATE_FLAGは付与しない．
+//! 条件変数と異なり、待機中のプロセスが終了しても共有メモリ上に壊れる内部状態を持たない．
+//! 真が返った場合でも値が変化したとは限らないため、呼び出し側で条件を再確認すること．
+bool
+futexWait(std::atomic<uint32_t> *word, uint32_t expected_value, uint64_t timeout_usec)
+{
+#if defined(__linux__)
+  struct timespec timeout;
+  timeout.tv_sec  = static_cast<time_t>(timeout_usec / 1000000);
+  timeout.tv_nsec = static_cast<long>((timeout_usec % 1000000) * 1000);
+
+  // FUTEX_WAIT interprets the timeout as a relative CLOCK_MONOTONIC duration
+  long result = syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected_value, &timeout, nullptr, 0);
+  if (result < 0 && errno == ETIMEDOUT)
+  {
+    return false;
+  }
+  return true;
+#else
+  // Fallback for platforms without futex: short sleep, caller re-checks the condition
+  uint64_t sleep_usec = std::min(timeout_usec, static_cast<uint64_t>(100));
+  std::this_thread::sleep_for(std::chrono::microseconds(sleep_usec));
+  return word->load(std::memory_order_acquire) != expected_value || sleep_usec < timeout_usec;
+#endif
+}
+
+//! @brief 複数の32bitワードのいずれかの値が変化するまで待機する
+//! @param [in] words 待機対象のワードの配列
+//! @param [in] expected_values 各ワードについて待機開始時に期待する値の配列
+//! @param [in] word_num ワード数(FUTEX_WAITV_MAX=128以下)
+//! @param [in] timeout_usec 待ち時間[usec]
+//! @return bool タイムアウトした場合は偽、それ以外は真
+//! @details futex_waitv(Linux 5.16以降)を使用する．使用できないカーネルでは先頭のワードのみを最大1msだけ待つため、
+//! 呼び出し側は全てのワードの条件を再確認すること．
+bool
+futexWaitMultiple(std::atomic<uint32_t> *const *words, const uint32_t *expected_values, size_t word_num,
+                  uint64_t timeout_usec)
+{
+  if (word_num == 0)
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(timeout_usec));
+    return false;
+  }
+#if defined(__linux__)
+  // Same layout as struct futex_waitv, declared here so that older kernel headers still compile
+  struct FutexWaitv
+  {
+    uint64_t val;
+    uint64_t uaddr;
+    uint32_t flags;
+    uint32_t reserved;
+  };
+  constexpr size_t   FUTEX_WAITV_MAX_NUM = 128;
+  constexpr uint32_t FUTEX_SIZE_32       = 0x02;
+#if defined(SYS_futex_waitv)
+  constexpr long FUTEX_WAITV_SYSCALL = SYS_futex_waitv;
+#else
+  constexpr long FUTEX_WAITV_SYSCALL = 449;
+#endif
+
+  static std::atomic<bool> waitv_supported(true);
+  if (waitv_supported.load(std::memory_order_relaxed) && word_num <= FUTEX_WAITV_MAX_NUM)
+  {
+    FutexWaitv waiters[FUTEX_WAITV_MAX_NUM];
+    for (size_t i = 0; i < word_num; i++)
+    {
+      waiters[i].val      = expected_values[i];
+      waiters[i].uaddr    = reinterpret_cast<uintptr_t>(words[i]);
+      waiters[i].flags    = FUTEX_SIZE_32;
+      waiters[i].reserved = 0;
+    }
+
+    // futex_waitv takes an absolute deadline
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    uint64_t nsec    = static_cast<uint64_t>(deadline.tv_nsec) + (timeout_usec % 1000000) * 1000;
+    deadline.tv_sec += static_cast<time_t>(timeout_usec / 1000000 + nsec / 1000000000);
+    deadline.tv_nsec = static_cast<long>(nsec % 1000000000);
+
+    long result = syscall(FUTEX_WAITV_SYSCALL, waiters, static_cast<unsigned int>(word_num), 0, &deadline,
+                          CLOCK_MONOTONIC);
+    if (result >= 0 || errno != ENOSYS)
+    {
+      return !(result < 0 && errno == ETIMEDOUT);
+    }
+    waitv_supported.store(false, std::memory_order_relaxed);
+  }
+#endif
+  // Fallback: wait on the first word only and bound the sleep, the caller re-checks the rest
+  uint64_t wait_usec = std::min(timeout_usec, static_cast<uint64_t>(1000));
+  return futexWait(words[0], expected_values[0], wait_usec) || wait_usec < timeout_usec;
+}
+
+//! @brief 共有メモリ上の32bitワードで待機しているスレッドを起床させる
+//! @param [in] word 起床対象のワード
+//! @param [in] wake_num 起床させる最大数
+//! @return int 起床させたスレッド数(エラー時は-1)
+int
+futexWake(std::atomic<uint32_t> *word, int wake_num)
+{
+#if defined(__linux__)
+  return static_cast<int>(
+      syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, wake_num, nullptr, nullptr, 0));
+#else
+  (void)word;
+  (void)wake_num;
+  return 0;
+#endif
+}
+
+}  // namespace shm
+
+}  // namespace irlab
@@ -0,0 +1,88 @@
+#include <shm_base.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <signal.h>
+#include <unistd.h>
+
+namespace irlab
+{
+
+namespace shm
+{
+
+//! @brief プロセスの起動時刻を取得する
+//! @param [in] pid プロセスID
+//! @return uint64_t 起動時刻(/proc/<pid>/stat の starttime[clock tick])．取得できない場合は0
+//! @details プロセスIDは再利用されるため、起動時刻と組にすることで同じプロセスかを判別する．
+uint64_t
+getProcessStartTime(pid_t pid)
+{
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+  FILE *file = fopen(path, "r");
+  if (file == nullptr)
+  {
+    return 0;
+  }
+  char   buffer[1024];
+  size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+  fclose(file);
+  buffer[length] = '\0';
+
+  // The command name may contain spaces and parentheses, so count the fields from the last ')'
+  const char *field = strrchr(buffer, ')');
+  if (field == nullptr)
+  {
+    return 0;
+  }
+  // starttime is field 22; the field after ')' is field 3 (state)
+  for (int i = 2; i < 22 && field != nullptr; i++)
+  {
+    field = strchr(field + 1, ' ');
+  }
+  if (field == nullptr)
+  {
+    return 0;
+  }
+  return strtoull(field + 1, nullptr, 10);
+}
+
+//! @brief 自プロセスの起動時刻を取得する
+//! @return uint64_t 起動時刻．fork() した子プロセスでは子プロセスの起動時刻を返す
+uint64_t
+getCurrentProcessStartTime()
+{
+  thread_local pid_t    cached_pid        = 0;
+  thread_local uint64_t cached_start_time = 0;
+  pid_t                 pid               = getpid();
+  if (pid != cached_pid)
+  {
+    cached_start_time = getProcessStartTime(pid);
+    cached_pid        = pid;
+  }
+  return cached_start_time;
+}
+
+//! @brief プロセスが生存しているかを確認する
+//! @param [in] pid プロセスID
+//! @param [in] start_time 記録した起動時刻(0の場合は比較しない)
+//! @return bool 生存している場合は真．終了した場合やプロセスIDが別のプロセスに再利用されている場合は偽
+bool
+isProcessAlive(pid_t pid, uint64_t start_time)
+{
+  if (kill(pid, 0) != 0 && errno != EPERM)
+  {
+    return false;
+  }
+  if (start_time == 0)
+  {
+    return true;
+  }
+  uint64_t current_start_time = getProcessStartTime(pid);
+  return current_start_time == 0 || current_start_time == start_time;
+}
+
+}  // namespace shm
+
+}  // namespace irlab
@@ -1,8 +1,11 @@
 #include <shm_base.hpp>
+#include <algorithm>
 #include <condition_variable>
 #include <limits>
 #include <chrono>
 #include <thread>
+#include <cerrno>
+#include <signal.h>
 
 namespace irlab
 {
@@ -22,9 +25,7 @@ size_t
 RingBuffer::getSize(size_t element_size, int buffer_num)
 {
   // Use aligned layout calculation for accurate size
-  size_t mutex_offset, cond_offset, element_size_offset, buf_num_offset, timestamp_offset, data_offset;
-  return calculateAlignedLayout(element_size, buffer_num, mutex_offset, cond_offset, element_size_offset,
-                                buf_num_offset, timestamp_offset, data_offset);
+  return calculateAlignedLayout(element_size, buffer_num).total_size;
 }
 
 bool
@@ -39,31 +40,90 @@ RingBuffer::checkInitialized(unsigned char *first_ptr)
   return (initialization_flag->load(std::memory_order_relaxed) == RingBuffer::INITIALIZED);
 }
 
+//! @brief 初期化完了待ち
+//! @param [in] first_ptr 共有メモリの先頭アドレス
+//! @param [in] timeout_usec 待ち時間[usec]
+//! @return bool 時間内に初期化された場合は真
+//! @details 初期化フラグのfutexでスリープし、作成側の初期化完了時の futexWake() で起床する．
 bool
 RingBuffer::waitForInitialization(unsigned char *first_ptr, uint64_t timeout_usec)
 {
-  auto start_time       = getCurrentTimeUSec();
-  auto timeout_duration = timeout_usec;
+  if (first_ptr == nullptr)
+  {
+    return false;
+  }
 
-  while (!RingBuffer::checkInitialized(first_ptr))
+  std::atomic<uint32_t> *initialization_flag = reinterpret_cast<std::atomic<uint32_t> *>(first_ptr);
+  uint64_t               start_time          = getCurrentTimeUSec();
+  while (true)
   {
-    auto current_time = getCurrentTimeUSec();
-    if (current_time - start_time >= timeout_duration)
+    uint32_t flag = initialization_flag->load(std::memory_order_acquire);
+    if (flag == RingBuffer::INITIALIZED)
+    {
+      return true;
+    }
+
+    uint64_t elapsed = getCurrentTimeUSec() - start_time;
+    if (elapsed >= timeout_usec)
     {
       return false;
     }
-    std::this_thread::sleep_for(std::chrono::microseconds(50));  // Reduced wait interval for faster response
+    futexWait(initialization_flag, flag, timeout_usec - elapsed);
   }
+}
 
-  return true;
+//! @brief 共有メモリを作成したPublisherの世代の取得
+//! @param [in] first_ptr 共有メモリの先頭アドレス
+//! @return uint32_t 世代．リングバッファを作成し直すたびに増える
+//! @details 同じ共有メモリ上でPublisherが再起動したことを、再マップせずに検出するために使う．
+uint32_t
+RingBuffer::getGeneration(unsigned char *first_ptr)
+{
+  RingBufferLayout header_layout = calculateAlignedLayout(0, 1);
+  return reinterpret_cast<std::atomic<uint32_t> *>(first_ptr + header_layout.generation_offset)
+      ->load(std::memory_order_acquire);
 }
 
+//! @brief ヘッダに記録された形式のリングバッファ全体のサイズ
+//! @param [in] first_ptr 初期化済みの共有メモリの先頭アドレス
+//! @return size_t 必要なマップのサイズ[byte]
 size_t
-RingBuffer::calculateAlignedLayout(size_t element_size, int buffer_num, size_t &mutex_offset, size_t &cond_offset,
-                                   size_t &element_size_offset, size_t &buf_num_offset, size_t &timestamp_offset,
-                                   size_t &data_offset)
+RingBuffer::getRequiredSize(unsigned char *first_ptr)
+{
+  RingBufferLayout header_layout = calculateAlignedLayout(0, 1);
+  return getSize(*reinterpret_cast<size_t *>(first_ptr + header_layout.element_size_offset),
+                 static_cast<int>(*reinterpret_cast<size_t *>(first_ptr + header_layout.buf_num_offset)));
+}
+
+//! @brief オフセットを境界に切り上げる
+//! @param [in] offset オフセット[byte]
+//! @param [in] alignment 境界[byte](2の冪)
+//! @return size_t 切り上げたオフセット[byte]
+static size_t
+alignOffset(size_t offset, size_t alignment)
+{
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+//! @brief 共有メモリ上のレイアウトの版数の確認
+//! @param [in] first_ptr 共有メモリの先頭アドレス
+//! @return bool 自プロセスと同じ版数・キャッシュライン長で初期化されていれば真
+bool
+RingBuffer::checkLayoutVersion(unsigned char *first_ptr)
+{
+  RingBufferLayout header_layout = calculateAlignedLayout(0, 1);
+  uint32_t        *version_ptr   = reinterpret_cast<uint32_t *>(first_ptr + header_layout.layout_version_offset);
+  return version_ptr[0] == LAYOUT_VERSION && version_ptr[1] == CACHE_LINE_SIZE;
+}
+
+RingBufferLayout
+RingBuffer::calculateAlignedLayout(size_t element_size, int buffer_num)
 {
-  size_t current_offset = 0;
+  RingBufferLayout layout;
+  size_t           current_offset = 0;
+
+  // Fields written by one side and polled by the other each start on their own cache line, so that
+  // publisher stores and subscriber loads of unrelated fields do not bounce the same line.
 
   // 1. initialization_flag (std::atomic<uint32_t>) - starts at beginning
   current_offset = 0;
@@ -71,83 +131,207 @@ RingBuffer::calculateAlignedLayout(size_t element_size, int buffer_num, size_t &
   // 2. pthread_init_flag (std::atomic<uint32_t>) - aligned to 8 bytes for ARM
   current_offset += get_aligned_size<std::atomic<uint32_t>>(1);
 
-  // 3. mutex (pthread_mutex_t) - aligned to 8 bytes for ARM
-  mutex_offset   = (current_offset + get_alignment<pthread_mutex_t>() - 1) & ~(get_alignment<pthread_mutex_t>() - 1);
-  current_offset = mutex_offset + sizeof(pthread_mutex_t);
+  // 3. layout_version and cache_line_size (uint32_t * 2) - checked by peers before using any other offset
+  layout.layout_version_offset = alignOffset(current_offset + sizeof(std::atomic<uint32_t>), get_alignment<uint64_t>());
+  current_offset               = layout.layout_version_offset + sizeof(uint32_t) * 2;
+
+  // 4. element_size (size_t) - aligned to 8 bytes for ARM
+  layout.element_size_offset = alignOffset(current_offset, get_alignment<size_t>());
+  current_offset             = layout.element_size_offset + sizeof(size_t);
+
+  // 5. buf_num (size_t) - aligned to 8 bytes for ARM
+  layout.buf_num_offset = alignOffset(current_offset, get_alignment<size_t>());
+  current_offset        = layout.buf_num_offset + sizeof(size_t);
+
+  // 5b. type_hash (uint64_t) - fingerprint of the slot type, checked once on attach
+  layout.type_hash_offset = alignOffset(current_offset, get_alignment<uint64_t>());
+  current_offset          = layout.type_hash_offset + sizeof(uint64_t);
+
+  // 5c. generation (std::atomic<uint32_t>) - bumped by every publisher that (re)creates the ring
+  layout.generation_offset = alignOffset(current_offset, get_alignment<std::atomic<uint32_t>>());
+  current_offset           = layout.generation_offset + sizeof(std::atomic<uint32_t>);
+
+  // 6. mutex (pthread_mutex_t) - aligned to 8 bytes for ARM
+  layout.mutex_offset = alignOffset(current_offset, get_alignment<pthread_mutex_t>());
+  current_offset      = layout.mutex_offset + sizeof(pthread_mutex_t);
+
+  // 7. condition (pthread_cond_t) - aligned to 8 bytes for ARM
+  layout.cond_offset = alignOffset(current_offset, get_alignment<pthread_cond_t>());
+  current_offset     = layout.cond_offset + sizeof(pthread_cond_t);
+
+  // 8. update_sequence and waiter_num (std::atomic<uint32_t> * 2) - futex words, own cache line
+  layout.notify_offset = alignOffset(current_offset, CACHE_LINE_SIZE);
+  current_offset       = layout.notify_offset + sizeof(std::atomic<uint32_t>) * 2;
+
+  // 9. write_index (std::atomic<uint64_t>) - advanced by writers, polled by readers, own cache line
+  layout.write_index_offset = alignOffset(current_offset, CACHE_LINE_SIZE);
+  current_offset            = layout.write_index_offset + sizeof(std::atomic<uint64_t>);
+
+  // 10. reserve_index (std::atomic<uint64_t>) - writer ticket counter, own cache line
+  layout.reserve_index_offset = alignOffset(current_offset, CACHE_LINE_SIZE);
+  current_offset              = layout.reserve_index_offset + sizeof(std::atomic<uint64_t>);
+
+  // 11. timestamp_list (std::atomic<uint64_t> * buffer_num) - written by writers
+  layout.timestamp_offset = alignOffset(current_offset, CACHE_LINE_SIZE);
+  current_offset          = layout.timestamp_offset + sizeof(std::atomic<uint64_t>) * buffer_num;
+
+  // 12. data_size_list (std::atomic<uint64_t> * buffer_num) - payload bytes per slot, written by writers
+  layout.data_size_offset = alignOffset(current_offset, get_alignment<std::atomic<uint64_t>>());
+  current_offset          = layout.data_size_offset + sizeof(std::atomic<uint64_t>) * buffer_num;
 
-  // 4. condition (pthread_cond_t) - aligned to 8 bytes for ARM
-  cond_offset    = (current_offset + get_alignment<pthread_cond_t>() - 1) & ~(get_alignment<pthread_cond_t>() - 1);
-  current_offset = cond_offset + sizeof(pthread_cond_t);
+  // 13. sequence_list (std::atomic<uint64_t> * buffer_num) - written by writers
+  layout.sequence_offset = alignOffset(current_offset, get_alignment<std::atomic<uint64_t>>());
+  current_offset         = layout.sequence_offset + sizeof(std::atomic<uint64_t>) * buffer_num;
 
-  // 5. element_size (size_t) - aligned to 8 bytes for ARM
-  element_size_offset = (current_offset + get_alignment<size_t>() - 1) & ~(get_alignment<size_t>() - 1);
-  current_offset      = element_size_offset + sizeof(size_t);
+  // 14. commit_list (std::atomic<uint64_t> * buffer_num) - last completed ticket + 1, written by writers
+  layout.commit_offset = alignOffset(current_offset, get_alignment<std::atomic<uint64_t>>());
+  current_offset       = layout.commit_offset + sizeof(std::atomic<uint64_t>) * buffer_num;
 
-  // 6. buf_num (size_t) - aligned to 8 bytes for ARM
-  buf_num_offset = (current_offset + get_alignment<size_t>() - 1) & ~(get_alignment<size_t>() - 1);
-  current_offset = buf_num_offset + sizeof(size_t);
+  // 15. pin_list (std::atomic<uint32_t> * buffer_num) - written by readers, own cache line
+  layout.pin_offset = alignOffset(current_offset, CACHE_LINE_SIZE);
+  current_offset    = layout.pin_offset + sizeof(std::atomic<uint32_t>) * buffer_num;
 
-  // 7. timestamp_list (std::atomic<uint64_t> * buffer_num) - aligned to 8 bytes for ARM
-  timestamp_offset =
-      (current_offset + get_alignment<std::atomic<uint64_t>>() - 1) & ~(get_alignment<std::atomic<uint64_t>>() - 1);
-  current_offset = timestamp_offset + sizeof(std::atomic<uint64_t>) * buffer_num;
+  // 16. client_list (RingBufferClient * CLIENT_MAX_NUM) - one cache line per entry
+  layout.client_offset = alignOffset(current_offset, alignof(RingBufferClient));
+  current_offset       = layout.client_offset + sizeof(RingBufferClient) * CLIENT_MAX_NUM;
 
-  // 8. data_list (aligned for element type) - use maximum alignment for safety
-  const size_t data_alignment =
-      std::max(get_alignment<uint64_t>(), static_cast<size_t>(8));  // At least 8-byte aligned on ARM
-  data_offset    = (current_offset + data_alignment - 1) & ~(data_alignment - 1);
-  current_offset = data_offset + element_size * buffer_num;
+  // 17. metrics_list (RingBufferClientMetrics * (CLIENT_MAX_NUM + 1)) - per client, the last one for unregistered
+  layout.metrics_offset = alignOffset(current_offset, alignof(RingBufferClientMetrics));
+  current_offset        = layout.metrics_offset + sizeof(RingBufferClientMetrics) * (CLIENT_MAX_NUM + 1);
 
-  return current_offset;
+  // 18. data_list - every slot starts on a cache line, or on a page for large payloads
+  const size_t slot_alignment = (element_size >= PAGE_ALIGNED_ELEMENT_SIZE) ? SLOT_PAGE_SIZE : CACHE_LINE_SIZE;
+  layout.slot_size            = alignOffset(element_size, slot_alignment);
+  layout.data_offset          = alignOffset(current_offset, slot_alignment);
+  layout.total_size           = layout.data_offset + layout.slot_size * buffer_num;
+
+  return layout;
+}
+
+//! @brief 既存のリングバッファへの参加可否
+//! @param [in] first_ptr 共有メモリの先頭アドレス
+//! @param [in] element_size 要素サイズ
+//! @param [in] buffer_num バッファ数
+//! @return bool 初期化済みで同じ形式であり、動作中のPublisherが存在する場合は真
+//! @details 真の場合、Publisherは初期化せずに既存のリングバッファに参加して書き込みを行う．
+bool
+RingBuffer::checkAttachable(unsigned char *first_ptr, size_t element_size, int buffer_num)
+{
+  RingBufferLayout header_layout = calculateAlignedLayout(0, 1);
+  return checkAttachable(first_ptr, buffer_num) &&
+         *reinterpret_cast<size_t *>(first_ptr + header_layout.element_size_offset) == element_size;
+}
+
+//! @brief 要素サイズによらない既存のリングバッファへの参加可否
+//! @param [in] first_ptr 共有メモリの先頭アドレス
+//! @param [in] buffer_num バッファ数
+//! @return bool 初期化済みでバッファ数が等しく、動作中のPublisherが存在する場合は真
+//! @details 可変長のトピックのPublisherが、他のPublisherが拡張したリングバッファにその要素サイズのまま参加するために使う．
+bool
+RingBuffer::checkAttachable(unsigned char *first_ptr, int buffer_num)
+{
+  if (!checkInitialized(first_ptr))
+  {
+    return false;
+  }
+  RingBufferLayout header_layout = calculateAlignedLayout(0, 1);
+  if (!checkLayoutVersion(first_ptr) ||
+      *reinterpret_cast<size_t *>(first_ptr + header_layout.buf_num_offset) != static_cast<size_t>(buffer_num))
+  {
+    return false;
+  }
+
+  size_t           element_size = *reinterpret_cast<size_t *>(first_ptr + header_layout.element_size_offset);
+  RingBufferLayout layout       = calculateAlignedLayout(element_size, buffer_num);
+  RingBufferClient *clients = reinterpret_cast<RingBufferClient *>(first_ptr + layout.client_offset);
+  for (size_t i = 0; i < CLIENT_MAX_NUM; i++)
+  {
+    uint32_t pid = clients[i].pid.load(std::memory_order_acquire);
+    if (pid != 0 && clients[i].role.load(std::memory_order_relaxed) == CLIENT_PUBLISHER &&
+        (kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM))
+    {
+      return true;
+    }
+  }
+  return false;
 }
 
 //! @brief コンストラクタ
-//! @param [in] 共有メモリ名
+//! @param [in] first_ptr 共有メモリの先頭アドレス
+//! @param [in] size 要素サイズ[byte]
+//! @param [in] buffer_num バッファ数．0の場合は既存のリングバッファに接続する
+//! @param [in] input_type_hash スロットの型の指紋．作成時のみ記録する
 //! @return なし
 //! @details 共有メモリへのアクセスを行う．
-RingBuffer::RingBuffer(unsigned char *first_ptr, size_t size, int buffer_num)
+RingBuffer::RingBuffer(unsigned char *first_ptr, size_t size, int buffer_num, uint64_t input_type_hash)
   : memory_ptr(first_ptr)
   , timestamp_us(0)
+  , read_index(0)
+  , read_sequence(0)
+  , read_cursor(UNINITIALIZED_CURSOR)
+  , counted_sequence(0)
+  , overrun_num(0)
+  , reserved_buffer(-1)
+  , client_entry(-1)
   , data_expiry_time_us(2000000)
+  , spin_time_us(0)
+  , attached_generation(0)
 {
   // Use aligned layout calculation for ARM compatibility
-  size_t mutex_offset, cond_offset, element_size_offset, buf_num_offset, timestamp_offset, data_offset;
+  RingBufferLayout layout;
 
-  if (buffer_num != 0 && size != 0)
+  if (buffer_num != 0)
   {
-    // Calculate aligned layout for new buffer creation
-    calculateAlignedLayout(size, buffer_num, mutex_offset, cond_offset, element_size_offset, buf_num_offset,
-                           timestamp_offset, data_offset);
+    // Calculate aligned layout for new buffer creation (size may be 0 for an empty vector topic)
+    layout = calculateAlignedLayout(size, buffer_num);
   }
   else
   {
     // Reading existing buffer - need to extract parameters first
     // IMPORTANT: Must use aligned offsets, not sizeof() sum, to match the writer's layout
-    size_t temp_mutex_offset, temp_cond_offset, temp_element_size_offset, temp_buf_num_offset, temp_timestamp_offset, temp_data_offset;
+
+    // A peer built with another layout revision or cache line size places every later field elsewhere
+    if (!checkLayoutVersion(memory_ptr))
+    {
+      throw std::runtime_error("shm::RingBuffer: Shared memory layout version mismatch!");
+    }
 
     // First pass: calculate offsets with dummy values to find element_size and buf_num locations
-    calculateAlignedLayout(0, 1, temp_mutex_offset, temp_cond_offset, temp_element_size_offset, temp_buf_num_offset,
-                           temp_timestamp_offset, temp_data_offset);
+    RingBufferLayout temp_layout = calculateAlignedLayout(0, 1);
 
     // Now read element_size and buf_num using aligned offsets
-    element_size = reinterpret_cast<size_t *>(memory_ptr + temp_element_size_offset);
-    buf_num = reinterpret_cast<size_t *>(memory_ptr + temp_buf_num_offset);
+    element_size = reinterpret_cast<size_t *>(memory_ptr + temp_layout.element_size_offset);
+    buf_num      = reinterpret_cast<size_t *>(memory_ptr + temp_layout.buf_num_offset);
 
     // Second pass: calculate aligned layout based on actual parameters from shared memory
-    calculateAlignedLayout(*element_size, *buf_num, mutex_offset, cond_offset, element_size_offset, buf_num_offset,
-                           timestamp_offset, data_offset);
+    layout = calculateAlignedLayout(*element_size, *buf_num);
   }
 
   // Initialize pointers using calculated aligned offsets
   initialization_flag = reinterpret_cast<std::atomic<uint32_t> *>(memory_ptr);
   pthread_init_flag =
       reinterpret_cast<std::atomic<uint32_t> *>(memory_ptr + get_aligned_size<std::atomic<uint32_t>>(1));
-  mutex          = reinterpret_cast<pthread_mutex_t *>(memory_ptr + mutex_offset);
-  condition      = reinterpret_cast<pthread_cond_t *>(memory_ptr + cond_offset);
-  element_size   = reinterpret_cast<size_t *>(memory_ptr + element_size_offset);
-  buf_num        = reinterpret_cast<size_t *>(memory_ptr + buf_num_offset);
-  timestamp_list = reinterpret_cast<std::atomic<uint64_t> *>(memory_ptr + timestamp_offset);
-  data_list      = memory_ptr + data_offset;
+  layout_version  = reinterpret_cast<uint32_t *>(memory_ptr + layout.layout_version_offset);
+  cache_line_size = layout_version + 1;
+  mutex           = reinterpret_cast<pthread_mutex_t *>(memory_ptr + layout.mutex_offset);
+  condition       = reinterpret_cast<pthread_cond_t *>(memory_ptr + layout.cond_offset);
+  element_size    = reinterpret_cast<size_t *>(memory_ptr + layout.element_size_offset);
+  buf_num         = reinterpret_cast<size_t *>(memory_ptr + layout.buf_num_offset);
+  type_hash       = reinterpret_cast<uint64_t *>(memory_ptr + layout.type_hash_offset);
+  generation      = reinterpret_cast<std::atomic<uint32_t> *>(memory_ptr + layout.generation_offset);
+  update_sequence = reinterpret_cast<std::atomic<uint32_t> *>(memory_ptr + layout.notify_offset);
+  waiter_num      = update_sequence + 1;
+  write_index     = reinterpret_cast<std::atomic<uint64_t> *>(memory_ptr + layout.write_index_offset);
+  reserve_index   = reinterpret_cast<std::atomic<uint64_t> *>(memory_ptr + layout.reserve_index_offset);
+  timestamp_list  = reinterpret_cast<std::atomic<uint64_t> *>(memory_ptr + layout.timestamp_offset);
+  data_size_list  = reinterpret_cast<std::atomic<uint64_t> *>(memory_ptr + layout.data_size_offset);
+  sequence_list   = reinterpret_cast<std::atomic<uint64_t> *>(memory_ptr + layout.sequence_offset);
+  pin_list        = reinterpret_cast<std::atomic<uint32_t> *>(memory_ptr + layout.pin_offset);
+  commit_list     = reinterpret_cast<std::atomic<uint64_t> *>(memory_ptr + layout.commit_offset);
+  client_list     = reinterpret_cast<RingBufferClient *>(memory_ptr + layout.client_offset);
+  metrics_list    = reinterpret_cast<RingBufferClientMetrics *>(memory_ptr + layout.metrics_offset);
+  data_list       = memory_ptr + layout.data_offset;
+  slot_size       = layout.slot_size;
 
   // Initialize values for new buffers
   if (buffer_num != 0)
@@ -163,30 +347,68 @@ RingBuffer::RingBuffer(unsigned char *first_ptr, size_t size, int buffer_num)
   {
     // Mark as not initialized first
     initialization_flag->store(NOT_INITIALIZED, std::memory_order_relaxed);
+    // Release orders the flag reset before the new generation, so that a subscriber seeing the new
+    // generation never sees the previous INITIALIZED flag
+    generation->fetch_add(1, std::memory_order_release);
+    *layout_version  = LAYOUT_VERSION;
+    *cache_line_size = CACHE_LINE_SIZE;
+    *type_hash       = input_type_hash;
 
     initializeExclusiveAccess();
 
-    // Initialize all timestamp buffers to 0
+    update_sequence->store(0, std::memory_order_relaxed);
+    waiter_num->store(0, std::memory_order_relaxed);
+    write_index->store(0, std::memory_order_relaxed);
+    reserve_index->store(0, std::memory_order_relaxed);
+
+    // Initialize all timestamp buffers, slot sequences, pin counts and completed tickets to 0 (empty)
     for (size_t i = 0; i < *buf_num; ++i)
     {
       timestamp_list[i].store(0, std::memory_order_relaxed);
+      data_size_list[i].store(0, std::memory_order_relaxed);
+      sequence_list[i].store(0, std::memory_order_relaxed);
+      pin_list[i].store(0, std::memory_order_relaxed);
+      commit_list[i].store(0, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < CLIENT_MAX_NUM; ++i)
+    {
+      client_list[i].pid.store(0, std::memory_order_relaxed);
+      client_list[i].role.store(0, std::memory_order_relaxed);
+      client_list[i].cursor.store(0, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i <= CLIENT_MAX_NUM; ++i)
+    {
+      RingBufferClientMetrics &metrics = metrics_list[i];
+      metrics.publish_num.store(0, std::memory_order_relaxed);
+      metrics.last_publish_time_us.store(0, std::memory_order_relaxed);
+      metrics.drop_num.store(0, std::memory_order_relaxed);
+      metrics.retry_num.store(0, std::memory_order_relaxed);
+      metrics.read_num.store(0, std::memory_order_relaxed);
+      metrics.overrun_num.store(0, std::memory_order_relaxed);
+      for (auto &bucket : metrics.latency_histogram)
+      {
+        bucket.store(0, std::memory_order_relaxed);
+      }
     }
 
     // Ensure all memory operations are complete before marking as initialized
     std::atomic_thread_fence(std::memory_order_release);
 
-    // Mark as initialized after all setup is complete
+    // Mark as initialized after all setup is complete, and wake processes in waitForInitialization()
     initialization_flag->store(INITIALIZED, std::memory_order_release);
+    futexWake(initialization_flag);
   }
   else
   {
     // For subscriber accessing existing memory, just set up pointers
     // Initialization check will be done via checkInitialized()
   }
+  attached_generation = generation->load(std::memory_order_acquire);
 }
 
 RingBuffer::~RingBuffer()
 {
+  unregisterClient();
 }
 
 void
@@ -203,6 +425,8 @@ RingBuffer::initializeExclusiveAccess()
   pthread_mutexattr_init(&m_attr);
   pthread_mutexattr_setpshared(&m_attr, PTHREAD_PROCESS_SHARED);
   pthread_mutexattr_setrobust(&m_attr, PTHREAD_MUTEX_ROBUST);
+  // A low-priority holder is boosted so that a real-time waiter is not blocked by unrelated threads
+  pthread_mutexattr_setprotocol(&m_attr, PTHREAD_PRIO_INHERIT);
   pthread_mutex_init(mutex, &m_attr);
   pthread_mutexattr_destroy(&m_attr);
 }
@@ -213,12 +437,53 @@ RingBuffer::getElementSize() const
   return *element_size;
 }
 
+//! @brief スロットの型の指紋の取得
+//! @return uint64_t 作成時に記録した getTopicTypeHash() の値．型を指定せずに作成した場合は0
+uint64_t
+RingBuffer::getTypeHash() const
+{
+  return *type_hash;
+}
+
 unsigned char *
 RingBuffer::getDataList()
 {
   return data_list;
 }
 
+//! @brief スロットに格納したデータサイズの設定
+//! @param [in] buffer_num reserveBuffer() で予約したバッファ番号
+//! @param [in] data_size データサイズ[byte](要素サイズ以下)
+//! @return なし
+//! @details 可変長のトピック向けに、確定前に実際に書き込んだバイト数を記録する．
+//! 設定しない場合は要素サイズとなる．
+void
+RingBuffer::setDataSize(int buffer_num, size_t data_size)
+{
+  data_size_list[buffer_num].store(std::min(data_size, *element_size), std::memory_order_relaxed);
+}
+
+//! @brief スロットに格納されたデータサイズの取得
+//! @param [in] buffer_num バッファ番号
+//! @return size_t データサイズ[byte]
+//! @details 読み込み後に verifyBuffer() が真であれば、データと同じ書き込みの値であることが保証される．
+size_t
+RingBuffer::getDataSize(int buffer_num) const
+{
+  return std::min(static_cast<size_t>(data_size_list[buffer_num].load(std::memory_order_relaxed)), *element_size);
+}
+
+//! @brief スロットの先頭アドレス取得
+//! @param [in] buffer_num バッファ番号
+//! @return unsigned char* スロットの先頭アドレス
+//! @details スロットはキャッシュライン境界(大きな要素はページ境界)に配置されるため、
+//! getDataList() から要素サイズ単位で位置を計算せず、この関数を使うこと．
+unsigned char *
+RingBuffer::getBufferPtr(int buffer_num)
+{
+  return data_list + static_cast<size_t>(buffer_num) * slot_size;
+}
+
 //! @brief タイムスタンプ取得
 //! @param なし
 //! @return なし
@@ -229,158 +494,833 @@ RingBuffer::getTimestamp_us() const
   return timestamp_us;
 }
 
-//! @brief タイムスタンプ取得
-//! @param なし
+//! @brief タイムスタンプ設定
+//! @param [in] input_time_us タイムスタンプ[usec]
+//! @param [in] buffer_num バッファ番号
 //! @return なし
-//! @details 直近で読み込んだトピックのタイムスタンプを返す．
+//! @details allocateBuffer() で確保したバッファの場合、タイムスタンプを設定して書き込みを確定する．
 void
 RingBuffer::setTimestamp_us(uint64_t input_time_us, int buffer_num)
 {
-  timestamp_list[buffer_num] = input_time_us;
+  commitBuffer(buffer_num, input_time_us);
 }
 
+//! @brief 最新バッファ番号の取得
+//! @param なし
+//! @return int 最新のトピックが格納されたバッファ番号(データなし・期限切れの場合は-1)
+//! @details 書き込みインデックスから最新のスロットを求めるため、バッファ数によらずO(1)で動作する．
+//! 固定により飛ばされたインデックスは1つ前のインデックスを参照する．
+//! 読み込み後は verifyBuffer() でデータが上書きされていないことを確認すること．
 int
 RingBuffer::getNewestBufferNum()
 {
-  uint64_t timestamp_buf         = 0;
-  size_t   newest_buffer         = -1;
-  bool     found_valid_timestamp = false;
+  // A writer may lap the reader between loading the index and the slot sequence; retry a bounded
+  // number of times with the newer index rather than returning a slot that is being overwritten.
+  constexpr int MAX_RETRY_NUM = 16;
+  for (int retry = 0; retry < MAX_RETRY_NUM; retry++)
+  {
+    uint64_t index = write_index->load(std::memory_order_acquire);
+    read_index     = index;
+    if (client_entry >= 0)
+    {
+      client_list[client_entry].cursor.store(index, std::memory_order_relaxed);
+    }
+
+    uint64_t oldest_index  = (index > *buf_num) ? index - *buf_num : 0;
+    bool     is_lapped     = false;
+    int      newest_buffer = -1;
+    for (uint64_t i = index; i > oldest_index; i--)
+    {
+      int      buffer   = static_cast<int>((i - 1) % *buf_num);
+      uint64_t sequence = sequence_list[buffer].load(std::memory_order_acquire);
+      if (sequence == i * 2)
+      {
+        newest_buffer = buffer;
+        read_sequence = sequence;
+        break;
+      }
+      if (sequence > i * 2 || (sequence & 1))
+      {
+        is_lapped = true;
+        break;
+      }
+      // Smaller sequence: the ticket was skipped or aborted, so the previous index holds the newest topic
+    }
+    if (is_lapped)
+    {
+      cpu_relax();
+      continue;
+    }
+    if (newest_buffer < 0)
+    {
+      return -1;
+    }
+    timestamp_us = timestamp_list[newest_buffer].load(std::memory_order_relaxed);
+
+    uint64_t current_time_us = getClockTimeUSec();
+
+    // If data_expiry_time_us is 0, disable expiry check
+    if (data_expiry_time_us <= 0 || current_time_us - timestamp_us < data_expiry_time_us)
+    {
+      recordRead(newest_buffer, current_time_us);
+      return newest_buffer;
+    }
+    // std::cerr << "Data is expiry By time. (duration: " << current_time_us - timestamp_us
+    //           << ", expiry time: " << data_expiry_time_us << ")" << std::endl;
+
+    return -1;
+  }
+
+  return -1;
+}
+
+//! @brief 次に書き込まれるバッファ番号の取得
+//! @param なし
+//! @return int バッファ番号
+//! @details 書き込みインデックスが指すスロット(最も古いトピック)の番号を返す．
+int
+RingBuffer::getOldestBufferNum()
+{
+  return static_cast<int>(write_index->load(std::memory_order_acquire) % *buf_num);
+}
+
+//! @brief バッファの確保
+//! @param [in] buffer_num バッファ番号
+//! @return bool 確保できた場合は真
+//! @details 指定したバッファが次の書き込み先であり、他の書き込み中でない場合のみ確保する．
+//! 確保したバッファは setTimestamp_us() で確定する．新規コードでは reserveBuffer() を使用すること．
+bool
+RingBuffer::allocateBuffer(int buffer_num)
+{
+  if (buffer_num < 0 || static_cast<size_t>(buffer_num) >= *buf_num)
+  {
+    return false;
+  }
+  uint64_t ticket = write_index->load(std::memory_order_acquire);
+  if (ticket % *buf_num != static_cast<size_t>(buffer_num))
+  {
+    return false;
+  }
+  // Claim the ticket only while no other reservation is in flight, so that the slot is already free
+  if (!reserve_index->compare_exchange_strong(ticket, ticket + 1, std::memory_order_acq_rel))
+  {
+    // The buffer is already allocated
+    getOwnMetrics()->retry_num.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return acquireSlot(ticket);
+}
 
+//! @brief 書き込み用バッファの予約
+//! @param なし
+//! @return int 予約したバッファ番号(全てのスロットがSubscriberに固定されている場合は-1)
+//! @details 共有のチケットをfetch-addで取得し、チケットに対応するスロットを書き込み中(奇数シーケンス)にして返す．
+//! 複数のプロセスから同時に呼び出してよい．pinBuffer() で固定されたスロットは上書きせずに飛ばし、
+//! 次のチケットを取得する．書き込み後は commitBuffer() で確定するか、 abortBuffer() で破棄すること．
+int
+RingBuffer::reserveBuffer()
+{
+  // Each pinned slot costs one ticket; give up after a full lap so that a fully pinned ring drops the topic
   for (size_t i = 0; i < *buf_num; i++)
   {
-    uint64_t ts = timestamp_list[i].load();
+    uint64_t ticket = reserve_index->fetch_add(1, std::memory_order_acq_rel);
+    if (client_entry >= 0)
+    {
+      // Lets other writers recover the ticket if this process dies while holding it
+      client_list[client_entry].cursor.store(ticket + 1, std::memory_order_release);
+    }
+    waitForSlot(ticket);
+    if (acquireSlot(ticket))
+    {
+      reserved_buffer = static_cast<int>(ticket % *buf_num);
+      data_size_list[reserved_buffer].store(*element_size, std::memory_order_relaxed);
+      return reserved_buffer;
+    }
+    getOwnMetrics()->retry_num.fetch_add(1, std::memory_order_relaxed);
+  }
+  getOwnMetrics()->drop_num.fetch_add(1, std::memory_order_relaxed);
+  return -1;
+}
+
+//! @brief 書き込みの確定
+//! @param [in] buffer_num reserveBuffer() で予約したバッファ番号
+//! @param [in] input_time_us タイムスタンプ[usec]
+//! @return なし
+//! @details シーケンスを偶数に戻してチケットを完了し、完了済みのチケットが連続する分だけ書き込みインデックスを進める．
+void
+RingBuffer::commitBuffer(int buffer_num, uint64_t input_time_us)
+{
+  timestamp_list[buffer_num].store(input_time_us, std::memory_order_relaxed);
+  reserved_buffer = -1;
 
-    if (ts != std::numeric_limits<uint64_t>::max() && ts > 0 && ts >= timestamp_buf)
+  uint64_t sequence = sequence_list[buffer_num].load(std::memory_order_relaxed);
+  if (!(sequence & 1))
+  {
+    // Not reserved: only the timestamp is updated
+    return;
+  }
+  // Fails only if the slot was taken over after this writer stalled for too long (see waitForSlot())
+  if (!sequence_list[buffer_num].compare_exchange_strong(sequence, sequence + 1, std::memory_order_release,
+                                                         std::memory_order_relaxed))
+  {
+    return;
+  }
+  completeTicket(buffer_num, sequence / 2);
+
+  RingBufferClientMetrics *metrics = getOwnMetrics();
+  metrics->publish_num.fetch_add(1, std::memory_order_relaxed);
+  metrics->last_publish_time_us.store(input_time_us, std::memory_order_relaxed);
+}
+
+//! @brief 書き込みの破棄
+//! @param [in] buffer_num reserveBuffer() で予約したバッファ番号
+//! @return なし
+//! @details 書き込み途中のデータは以前のトピックを壊している可能性があるため、スロットを空にしてチケットを完了する．
+void
+RingBuffer::abortBuffer(int buffer_num)
+{
+  reserved_buffer = -1;
+
+  uint64_t sequence = sequence_list[buffer_num].load(std::memory_order_relaxed);
+  if (!(sequence & 1))
+  {
+    return;
+  }
+  if (sequence_list[buffer_num].compare_exchange_strong(sequence, 0, std::memory_order_release,
+                                                        std::memory_order_relaxed))
+  {
+    completeTicket(buffer_num, sequence / 2);
+  }
+}
+
+//! @brief 予約中のバッファの有無
+//! @param なし
+//! @return bool このインスタンスが reserveBuffer() で予約したバッファを確定・破棄していなければ真
+bool
+RingBuffer::hasReservedBuffer() const
+{
+  return reserved_buffer >= 0;
+}
+
+//! @brief 接続したリングバッファの有効性の確認
+//! @param なし
+//! @return bool 接続時と同じ世代で、拡張のために封鎖されていなければ真
+//! @details reserveBuffer() の後に偽となった場合、書き込み中のスロットは新しい世代の領域と重なる可能性があるため、
+//! abortBuffer() で破棄して接続し直すこと．
+bool
+RingBuffer::isCurrentGeneration() const
+{
+  // Pairs with the seq_cst exchange in sealForResize(): either this load sees the seal, or the sealer
+  // sees the ticket reserved before it and waits for it
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  return initialization_flag->load(std::memory_order_seq_cst) == INITIALIZED &&
+         generation->load(std::memory_order_acquire) == attached_generation;
+}
+
+//! @brief 拡張のためのリングバッファの封鎖
+//! @param なし
+//! @return bool 封鎖できた場合は真(他のPublisherが既に封鎖または初期化し直している場合は偽)
+//! @details 初期化フラグを下ろして新たな書き込みを止め、予約済みのチケットが全て完了するまで待機する．
+//! 真の場合、呼び出し元は共有メモリを作り直す責任を負う．封鎖したリングバッファは初期化済みに戻らないため、
+//! 他のPublisherは isCurrentGeneration() で封鎖を検出して新しい共有メモリに接続し直す．
+bool
+RingBuffer::sealForResize()
+{
+  uint32_t expected = INITIALIZED;
+  if (generation->load(std::memory_order_acquire) != attached_generation ||
+      !initialization_flag->compare_exchange_strong(expected, NOT_INITIALIZED, std::memory_order_seq_cst))
+  {
+    return false;
+  }
+
+  // Writers that reserved before the seal commit or abort; a dead one is taken over as in waitForSlot()
+  constexpr uint64_t TAKEOVER_TIME_US = 1000000;
+  uint64_t           stalled_index    = 0;
+  uint64_t           start_time       = 0;
+  while (true)
+  {
+    uint64_t index = write_index->load(std::memory_order_acquire);
+    if (index >= reserve_index->load(std::memory_order_seq_cst))
     {
-      timestamp_buf         = ts;
-      newest_buffer         = i;
-      found_valid_timestamp = true;
+      return true;
     }
+    if (start_time == 0 || index != stalled_index)
+    {
+      start_time    = getCurrentTimeUSec();
+      stalled_index = index;
+    }
+    else if (getCurrentTimeUSec() - start_time >= TAKEOVER_TIME_US)
+    {
+      takeOverTicket(index);
+      if (write_index->load(std::memory_order_acquire) == index)
+      {
+        // Held by a live writer that never finishes; recreating the segment drops its message
+        return true;
+      }
+      start_time = 0;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
   }
+}
 
-  // If no valid timestamp found, return -1
-  if (!found_valid_timestamp)
+//! @brief チケットに対応するスロットが空くまで待機する
+//! @param [in] ticket 取得したチケット
+//! @return なし
+//! @details 書き込みインデックスが1周前のチケットを越えるまで待機する．
+//! 完了しただけでは不十分であり、書き込みインデックスが越える前にスロットを再利用すると、
+//! 完了の記録が上書きされて書き込みインデックスが進まなくなる．
+//! 一定時間進まない場合は takeOverTicket() で終了したプロセスのチケットを回収する．
+void
+RingBuffer::waitForSlot(uint64_t ticket)
+{
+  if (ticket < *buf_num)
   {
-    return -1;
+    return;
   }
+  constexpr uint32_t SPIN_NUM         = 1024;
+  constexpr uint64_t TAKEOVER_TIME_US = 1000000;
+  uint64_t           required_index   = ticket - *buf_num + 1;
+  uint64_t           stalled_index    = 0;
+  uint64_t           start_time       = 0;
+  for (uint32_t spin = 0;; spin++)
+  {
+    uint64_t index = write_index->load(std::memory_order_acquire);
+    if (index >= required_index)
+    {
+      return;
+    }
+    if (spin < SPIN_NUM)
+    {
+      cpu_relax();
+      continue;
+    }
+    if (start_time == 0 || index != stalled_index)
+    {
+      start_time    = getCurrentTimeUSec();
+      stalled_index = index;
+    }
+    else if (getCurrentTimeUSec() - start_time >= TAKEOVER_TIME_US)
+    {
+      takeOverTicket(index);
+      start_time = 0;
+    }
+    // Sleep rather than yield so that a preempted writer holding the frontier gets the CPU back
+    getOwnMetrics()->retry_num.fetch_add(1, std::memory_order_relaxed);
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+}
+
+//! @brief 終了したプロセスのチケットの回収
+//! @param [in] ticket 書き込みインデックスが指すチケット
+//! @return なし
+//! @details チケットを保持したまま終了したPublisherが登録情報に残っている場合のみ、スロットを空にして完了させる．
+//! 動作中のプロセスや未登録のインスタンスが保持するチケットは、書き込みの遅延と区別できないため回収しない．
+void
+RingBuffer::takeOverTicket(uint64_t ticket)
+{
+  for (size_t i = 0; i < CLIENT_MAX_NUM; i++)
+  {
+    uint32_t pid = client_list[i].pid.load(std::memory_order_acquire);
+    if (pid == 0 || client_list[i].role.load(std::memory_order_relaxed) != CLIENT_PUBLISHER ||
+        client_list[i].cursor.load(std::memory_order_acquire) != ticket + 1)
+    {
+      continue;
+    }
+    if (kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM)
+    {
+      return;
+    }
+    if (!client_list[i].pid.compare_exchange_strong(pid, 0, std::memory_order_acq_rel))
+    {
+      return;
+    }
+
+    int      buffer   = static_cast<int>(ticket % *buf_num);
+    uint64_t sequence = ticket * 2 + 1;
+    sequence_list[buffer].compare_exchange_strong(sequence, 0, std::memory_order_acq_rel);
+    completeTicket(buffer, ticket);
+    return;
+  }
+}
 
-  timestamp_us = timestamp_buf;
+//! @brief チケットに対応するスロットの獲得
+//! @param [in] ticket 取得したチケット
+//! @return bool 獲得できた場合は真(Subscriberに固定されていた場合は偽で、チケットは完了扱いとなる)
+bool
+RingBuffer::acquireSlot(uint64_t ticket)
+{
+  int      buffer       = static_cast<int>(ticket % *buf_num);
+  uint64_t old_sequence = sequence_list[buffer].load(std::memory_order_relaxed);
 
-  // If data_expiry_time_us is 0, disable expiry check
-  if (data_expiry_time_us <= 0)
+  // Dekker-style handshake with pinBuffer(): publish the odd sequence first, then look for readers.
+  // Either the reader observes the odd sequence and gives up, or this load observes its pin.
+  sequence_list[buffer].store(ticket * 2 + 1, std::memory_order_seq_cst);
+  if (pin_list[buffer].load(std::memory_order_seq_cst) == 0)
   {
-    return newest_buffer;
+    // The odd sequence must be visible before any byte of the payload is modified
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
   }
 
-  uint64_t current_time_us = getCurrentTimeUSec();
+  // Pinned by a subscriber: the payload is untouched, so the previous topic stays valid
+  sequence_list[buffer].store(old_sequence, std::memory_order_release);
+  completeTicket(buffer, ticket);
+  return false;
+}
 
-  if (current_time_us - timestamp_us < data_expiry_time_us)
+//! @brief チケットの完了
+//! @param [in] buffer_num スロット番号
+//! @param [in] ticket 完了したチケット
+//! @return なし
+void
+RingBuffer::completeTicket(int buffer_num, uint64_t ticket)
+{
+  commit_list[buffer_num].store(ticket + 1, std::memory_order_release);
+  if (client_entry >= 0)
   {
-    return newest_buffer;
+    // Clear the in-flight ticket recorded by reserveBuffer() (no-op when recovering another writer's ticket)
+    uint64_t in_flight = ticket + 1;
+    client_list[client_entry].cursor.compare_exchange_strong(in_flight, 0, std::memory_order_release,
+                                                             std::memory_order_relaxed);
   }
-  // std::cerr << "Data is expiry By time. (duration: " << current_time_us - timestamp_us
-  //           << ", expiry time: " << data_expiry_time_us << ")" << std::endl;
+  advanceWriteIndex();
+}
 
-  return -1;
+//! @brief 書き込みインデックスの前進
+//! @param なし
+//! @return なし
+//! @details 完了済みのチケットが連続する限り書き込みインデックスを進める．
+//! 先に完了した書き込みプロセスの分も、後から完了したプロセスがまとめて進める．
+void
+RingBuffer::advanceWriteIndex()
+{
+  uint64_t index = write_index->load(std::memory_order_acquire);
+  while (commit_list[index % *buf_num].load(std::memory_order_acquire) == index + 1)
+  {
+    if (write_index->compare_exchange_weak(index, index + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+    {
+      index++;
+    }
+  }
+}
+
+//! @brief 読み込んだバッファのシーケンス番号の取得
+//! @return uint64_t getNewestBufferNum() で最後に取得したスロットのシーケンス番号
+//! @details 書き込みごとに一意に増加するため、同じ値であれば前回読み込んだトピックから更新されていない．
+uint64_t
+RingBuffer::getReadSequence() const
+{
+  return read_sequence;
 }
 
+//! @brief スロットに書き込み中または書き込み済みのトピックの通し番号の取得
+//! @param [in] buffer_num reserveBuffer() で予約したバッファ番号
+//! @return uint64_t 1から始まる通し番号．確定の前後で変わらず、読み込み側の getReadSequence() / 2 と一致する
+uint64_t
+RingBuffer::getSequenceNumber(int buffer_num) const
+{
+  return (sequence_list[buffer_num].load(std::memory_order_relaxed) + 1) / 2;
+}
+
+//! @brief 書き込みインデックスの取得
+//! @return uint64_t 確定したトピックの数(最新のトピックの通し番号)
+uint64_t
+RingBuffer::getWriteIndex() const
+{
+  return write_index->load(std::memory_order_acquire);
+}
+
+//! @brief 読み込んだバッファの検証
+//! @param [in] buffer_num getNewestBufferNum() で取得したバッファ番号
+//! @return bool 読み込み中に上書きされていなければ真
+//! @details 偽の場合、コピーしたデータは書き込み途中の可能性があるため破棄して読み直すこと．
+bool
+RingBuffer::verifyBuffer(int buffer_num) const
+{
+  // Keep the payload copy from being reordered after the sequence re-check
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return sequence_list[buffer_num].load(std::memory_order_relaxed) == read_sequence;
+}
+
+//! @brief 読み込んだバッファの固定
+//! @param [in] buffer_num getNewestBufferNum() で取得したバッファ番号
+//! @return bool 固定できた場合は真(既に上書きが始まっていた場合は偽)
+//! @details 固定中のスロットは reserveBuffer() に飛ばされるため、コピーせずに参照し続けられる．
+//! 参照を終えたら unpinBuffer() で解放すること．固定したままプロセスが終了した場合、
+//! Publisherが再生成されるまでそのスロットは使用されない．
+bool
+RingBuffer::pinBuffer(int buffer_num)
+{
+  // Pairs with the seq_cst store/load in reserveBuffer()
+  pin_list[buffer_num].fetch_add(1, std::memory_order_seq_cst);
+  if (sequence_list[buffer_num].load(std::memory_order_seq_cst) == read_sequence)
+  {
+    return true;
+  }
+  pin_list[buffer_num].fetch_sub(1, std::memory_order_release);
+  return false;
+}
+
+//! @brief 未読の最も古いバッファ番号の取得
+//! @param なし
+//! @return int 読み込みカーソルが指すトピックのバッファ番号(未読のトピックがない場合は-1)
+//! @details 取りこぼしなく順番に読み込むためのキューモード用の関数．
+//! 初回はリングバッファに残っている最も古いトピックからカーソルを開始する．
+//! Publisherに追い越されたトピックは読み飛ばしてオーバーラン数に加算する．
+//! 読み込み後は consumeBuffer() でカーソルを進めること．
 int
-RingBuffer::getOldestBufferNum()
+RingBuffer::getNextBufferNum()
 {
-  if (timestamp_us == 0)
+  while (true)
   {
-    timestamp_us = UINT64_MAX;
+    uint64_t index = write_index->load(std::memory_order_acquire);
+    if (read_cursor == UNINITIALIZED_CURSOR || index < read_cursor)
+    {
+      // First read, or the publisher was restarted and the index went back to 0
+      read_cursor = (index > *buf_num) ? index - *buf_num : 0;
+    }
+    if (read_cursor == index)
+    {
+      read_index = index;
+      return -1;
+    }
+    if (index - read_cursor > *buf_num)
+    {
+      uint64_t lapped_num = index - *buf_num - read_cursor;
+      overrun_num += lapped_num;
+      getOwnMetrics()->overrun_num.fetch_add(lapped_num, std::memory_order_relaxed);
+      read_cursor = index - *buf_num;
+    }
+
+    int      buffer   = static_cast<int>(read_cursor % *buf_num);
+    uint64_t sequence = sequence_list[buffer].load(std::memory_order_acquire);
+    uint64_t expected = (read_cursor + 1) * 2;
+    if (sequence == expected)
+    {
+      read_sequence = sequence;
+      timestamp_us  = timestamp_list[buffer].load(std::memory_order_relaxed);
+      return buffer;
+    }
+    if (sequence > expected || (sequence & 1))
+    {
+      // Overwritten by a newer index before it could be read
+      overrun_num++;
+      getOwnMetrics()->overrun_num.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Otherwise the writer skipped this index because the slot was pinned: nothing was lost
+    read_cursor++;
   }
-  uint64_t timestamp_buf = timestamp_list[0];
-  size_t   oldest_buffer = 0;
-  for (size_t i = 0; i < *buf_num; i++)
+}
+
+//! @brief 読み込んだバッファの消費
+//! @param [in] buffer_num getNextBufferNum() で取得したバッファ番号
+//! @return bool 読み込み中に上書きされていなければ真
+//! @details 読み込みカーソルを次のトピックに進める．偽の場合、そのトピックはオーバーランとして数えられる．
+bool
+RingBuffer::consumeBuffer(int buffer_num)
+{
+  bool is_valid = verifyBuffer(buffer_num);
+  if (is_valid)
   {
-    if (timestamp_list[i] < timestamp_buf)
+    recordRead(buffer_num, getClockTimeUSec());
+  }
+  else
+  {
+    overrun_num++;
+    getOwnMetrics()->overrun_num.fetch_add(1, std::memory_order_relaxed);
+  }
+  read_cursor++;
+  // isUpdated() stays true while unread topics remain in the ring
+  read_index = read_cursor;
+  if (client_entry >= 0)
+  {
+    client_list[client_entry].cursor.store(read_cursor, std::memory_order_relaxed);
+  }
+  return is_valid;
+}
+
+//! @brief 計測値の取得
+//! @param なし
+//! @return RingBufferMetrics 全クライアントの計測値の合計
+//! @details 共有メモリ上の値を読むだけであるため、トピックを読み書きしていないプロセスからも取得できる．
+RingBufferMetrics
+RingBuffer::getMetrics() const
+{
+  RingBufferMetrics result;
+  for (size_t i = 0; i <= CLIENT_MAX_NUM; i++)
+  {
+    const RingBufferClientMetrics &metrics = metrics_list[i];
+    result.publish_num += metrics.publish_num.load(std::memory_order_relaxed);
+    result.last_publish_time_us =
+        std::max(result.last_publish_time_us, metrics.last_publish_time_us.load(std::memory_order_relaxed));
+    result.drop_num += metrics.drop_num.load(std::memory_order_relaxed);
+    result.retry_num += metrics.retry_num.load(std::memory_order_relaxed);
+    result.read_num += metrics.read_num.load(std::memory_order_relaxed);
+    result.overrun_num += metrics.overrun_num.load(std::memory_order_relaxed);
+    for (size_t bucket = 0; bucket < RING_BUFFER_LATENCY_BUCKET_NUM; bucket++)
     {
-      timestamp_buf = timestamp_list[i];
-      oldest_buffer = i;
+      result.latency_histogram[bucket] += metrics.latency_histogram[bucket].load(std::memory_order_relaxed);
     }
   }
+  return result;
+}
 
-  timestamp_us = timestamp_buf;
-  return oldest_buffer;
+//! @brief このインスタンスが更新する計測値の取得
+//! @param なし
+//! @return RingBufferClientMetrics* 登録済みの場合は自身のエントリ、未登録の場合は共有のエントリ
+RingBufferClientMetrics *
+RingBuffer::getOwnMetrics() const
+{
+  return &metrics_list[(client_entry >= 0) ? static_cast<size_t>(client_entry) : CLIENT_MAX_NUM];
+}
+
+//! @brief 読み込みの計測
+//! @param [in] buffer_num 読み込んだバッファ番号
+//! @param [in] current_time_us 現在時刻[usec]
+//! @return なし
+//! @details 同じトピックを繰り返し読み込んだ場合は最初の一回のみ数える．
+void
+RingBuffer::recordRead(int buffer_num, uint64_t current_time_us)
+{
+  if (read_sequence == counted_sequence)
+  {
+    return;
+  }
+  counted_sequence = read_sequence;
+
+  uint64_t publish_time_us = timestamp_list[buffer_num].load(std::memory_order_relaxed);
+  uint64_t latency_us      = (current_time_us > publish_time_us) ? current_time_us - publish_time_us : 0;
+  size_t   bucket          = 0;
+  while (latency_us > 0 && bucket < RING_BUFFER_LATENCY_BUCKET_NUM - 1)
+  {
+    latency_us >>= 1;
+    bucket++;
+  }
+  RingBufferClientMetrics *metrics = getOwnMetrics();
+  metrics->read_num.fetch_add(1, std::memory_order_relaxed);
+  metrics->latency_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+//! @brief オーバーラン数の取得
+//! @param なし
+//! @return uint64_t キューモードで読み込む前に上書きされたトピックの数
+uint64_t
+RingBuffer::getOverrunNum() const
+{
+  return overrun_num;
 }
 
+//! @brief クライアントの登録
+//! @param [in] role CLIENT_PUBLISHER または CLIENT_SUBSCRIBER
+//! @return bool 登録できた場合は真(登録数が上限に達している場合は偽)
+//! @details ヘッダのクライアント登録情報にプロセスIDと読み込みカーソルを記録する．
+//! 登録せずに終了したプロセスの登録情報は、次の登録時に再利用される．
 bool
-RingBuffer::allocateBuffer(int buffer_num)
+RingBuffer::registerClient(uint32_t role)
 {
-  if (buffer_num < 0 || buffer_num >= *buf_num)
+  unregisterClient();
+
+  uint32_t pid = static_cast<uint32_t>(getpid());
+  for (size_t i = 0; i < CLIENT_MAX_NUM; i++)
   {
-    return false;
+    uint32_t entry_pid = client_list[i].pid.load(std::memory_order_acquire);
+    if (entry_pid != 0 && (kill(static_cast<pid_t>(entry_pid), 0) == 0 || errno == EPERM))
+    {
+      continue;
+    }
+    if (entry_pid != 0 && client_list[i].role.load(std::memory_order_relaxed) == CLIENT_PUBLISHER &&
+        client_list[i].cursor.load(std::memory_order_acquire) != 0)
+    {
+      // A dead publisher still holding a ticket is left for takeOverTicket()
+      continue;
+    }
+    // Free entry, or one left behind by a process that exited without unregistering
+    if (client_list[i].pid.compare_exchange_strong(entry_pid, pid, std::memory_order_acq_rel))
+    {
+      // Subscribers track their read cursor, publishers their in-flight ticket + 1 (0 when idle)
+      uint64_t cursor = (role == CLIENT_SUBSCRIBER) ? write_index->load(std::memory_order_relaxed) : 0;
+      client_list[i].cursor.store(cursor, std::memory_order_relaxed);
+      client_list[i].role.store(role, std::memory_order_release);
+      client_entry = static_cast<int>(i);
+      return true;
+    }
   }
-  uint64_t temp_buffer_timestamp = timestamp_list[buffer_num].load(std::memory_order_acquire);
-  if (temp_buffer_timestamp == std::numeric_limits<uint64_t>::max())
+  return false;
+}
+
+//! @brief クライアントの登録解除
+//! @param なし
+//! @return なし
+void
+RingBuffer::unregisterClient()
+{
+  if (client_entry < 0)
   {
-    // The buffer is already allocated
-    return false;
+    return;
+  }
+  client_list[client_entry].role.store(0, std::memory_order_relaxed);
+  client_list[client_entry].pid.store(0, std::memory_order_release);
+  client_entry = -1;
+}
+
+//! @brief 共有メモリに触れずにクライアントの登録を破棄する
+//! @param なし
+//! @return なし
+//! @details 共有メモリが初期化し直された場合やアンマップされた場合に、他のクライアントのエントリを
+//! 消さないようにデストラクタより前に呼ぶ．
+void
+RingBuffer::abandonClient()
+{
+  client_entry = -1;
+}
+
+//! @brief 登録されているクライアント数の取得
+//! @param [in] role CLIENT_PUBLISHER または CLIENT_SUBSCRIBER
+//! @return size_t 登録数
+size_t
+RingBuffer::getClientNum(uint32_t role) const
+{
+  size_t client_num = 0;
+  for (size_t i = 0; i < CLIENT_MAX_NUM; i++)
+  {
+    if (client_list[i].pid.load(std::memory_order_acquire) != 0 &&
+        client_list[i].role.load(std::memory_order_acquire) == role)
+    {
+      client_num++;
+    }
+  }
+  return client_num;
+}
+
+//! @brief 最も遅れているSubscriberの読み込みカーソルの取得
+//! @param なし
+//! @return uint64_t 読み込みカーソル(Subscriberが登録されていない場合はuint64_tの最大値)
+//! @details 書き込みインデックスとの差が、そのSubscriberの未読のトピック数となる．
+uint64_t
+RingBuffer::getSlowestCursor() const
+{
+  uint64_t slowest_cursor = std::numeric_limits<uint64_t>::max();
+  for (size_t i = 0; i < CLIENT_MAX_NUM; i++)
+  {
+    if (client_list[i].pid.load(std::memory_order_acquire) != 0 &&
+        client_list[i].role.load(std::memory_order_acquire) == CLIENT_SUBSCRIBER)
+    {
+      slowest_cursor = std::min(slowest_cursor, client_list[i].cursor.load(std::memory_order_relaxed));
+    }
+  }
+  return slowest_cursor;
+}
+
+//! @brief バッファの固定解除
+//! @param [in] buffer_num pinBuffer() で固定したバッファ番号
+//! @return なし
+//! @details 固定中にPublisherが同じ共有メモリ上でリングバッファを初期化し直した場合、固定数は既に0に
+//! 戻されているため何もしない．
+void
+RingBuffer::unpinBuffer(int buffer_num)
+{
+  if (generation->load(std::memory_order_acquire) != attached_generation)
+  {
+    return;
   }
-  return timestamp_list[buffer_num].compare_exchange_weak(temp_buffer_timestamp, std::numeric_limits<uint64_t>::max(),
-                                                          std::memory_order_relaxed);
+  // Release ordering keeps every read of the payload before the writer can reuse the slot
+  pin_list[buffer_num].fetch_sub(1, std::memory_order_release);
 }
 
+//! @brief トピックの更新通知
+//! @param なし
+//! @return なし
+//! @details 更新シーケンスを進め、待機中のSubscriberが存在する場合のみfutexで起床させる．
+//! 待機者がいない場合はシステムコールを発行しないため、publish時のコストはatomic操作のみとなる．
+//! @note pthread_cond_broadcast は プロセス間で使用すると永久にブロックする可能性がある。
+//! Subscriberプロセスが pthread_cond_timedwait の内部プロトコル実行中に終了すると、
+//! condition variable の内部状態（waiterカウンタ）が壊れ、
+//! 次の pthread_cond_broadcast が __condvar_quiesce_and_switch_g1 内の
+//! futex_wait で永久にブロックする。
+//! futex は共有メモリ上の32bitワードの値比較のみで待機するため、待機中のプロセスが終了しても
+//! 壊れる内部状態を持たない。waiter_num が残った場合も、余分な FUTEX_WAKE が発行されるだけである。
 void
 RingBuffer::signal()
 {
-  // NOTE: pthread_cond_broadcast は プロセス間で使用すると永久にブロックする可能性がある。
-  // Subscriberプロセスが pthread_cond_timedwait の内部プロトコル実行中に終了すると、
-  // condition variable の内部状態（waiterカウンタ）が壊れ、
-  // 次の pthread_cond_broadcast が __condvar_quiesce_and_switch_g1 内の
-  // futex_wait で永久にブロックする。
-  // PTHREAD_MUTEX_ROBUST は mutex の問題をカバーするが、
-  // condition variable には同等の仕組み（PTHREAD_COND_ROBUST）が存在しない。
-  //
-  // データの更新有無は timestamp_list の atomic 操作で判定可能なため、
-  // condition variable によるシグナリングは不要。
-  // Subscriber 側は waitFor() 内で isUpdated() をポーリングして検知する。
+  // seq_cst ordering pairs with waitFor(): either the waiter observes the new sequence,
+  // or this load observes the waiter registration and issues the wakeup.
+  update_sequence->fetch_add(1, std::memory_order_seq_cst);
+  if (waiter_num->load(std::memory_order_seq_cst) > 0)
+  {
+    futexWake(update_sequence);
+  }
 }
 
 //! @brief トピックの更新待ち
 //! @param timeout_usec 待ち時間[usec]
 //! @return bool トピックが更新されたかどうか
-//! @details 待ち時間の間、トピックの更新をポーリングで待ち続ける．
+//! @details setSpinTime_us() で設定した時間だけビジーウェイトで更新を確認した後、
+//!          更新シーケンスのfutexでスリープし、signal() による起床を待つ．
 //!          更新された場合または待ち時間が経過した場合、関数を終了する．
-//! @note pthread_cond_timedwait を使用しない理由は signal() のコメントを参照
 bool
 RingBuffer::waitFor(uint64_t timeout_usec)
 {
   uint64_t start_time = getCurrentTimeUSec();
 
-  while (!isUpdated())
+  // Bounded spin phase for isolated cores: avoids the sleep/wake cost entirely
+  if (spin_time_us > 0)
   {
+    uint64_t spin_limit = std::min(spin_time_us, timeout_usec);
+    while (!isUpdated())
+    {
+      if (getCurrentTimeUSec() - start_time >= spin_limit)
+      {
+        break;
+      }
+      cpu_relax();
+    }
+  }
+
+  while (true)
+  {
+    // Read the sequence before checking the data so that a publish between the check
+    // and the futex call changes the word and makes FUTEX_WAIT return immediately.
+    uint32_t sequence = update_sequence->load(std::memory_order_seq_cst);
+    if (isUpdated())
+    {
+      return true;
+    }
+
     uint64_t elapsed = getCurrentTimeUSec() - start_time;
     if (elapsed >= timeout_usec)
     {
       return false;
     }
-    std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+    waiter_num->fetch_add(1, std::memory_order_seq_cst);
+    futexWait(update_sequence, sequence, timeout_usec - elapsed);
+    waiter_num->fetch_sub(1, std::memory_order_seq_cst);
   }
+}
 
+//! @brief WaitSetで待つためのfutexワードの取得
+//! @param [out] target 更新シーケンス、待機者数および未読の確認
+//! @return bool 常に真
+//! @details waitFor() と同じ更新シーケンスを使うため、signal() で起床する．
+bool
+RingBuffer::getWaitTarget(WaitTarget *target)
+{
+  target->sequence   = update_sequence;
+  target->waiter_num = waiter_num;
+  target->is_ready   = [this]() { return isUpdated(); };
   return true;
 }
 
 //! @brief 共有メモリの更新確認
 //! @param なし
 //! @return bool
-//! @details 直近で読み込んだタイムスタンプより新しいタイムスタンプが書き込まれたか確認する．
+//! @details 直近で読み込んだ時点から書き込みインデックスが進んだか確認する．
 //! 更新があった場合には真を、ない場合には偽を返す．
 bool
 RingBuffer::isUpdated() const
 {
-  for (size_t i = 0; i < *buf_num; i++)
-  {
-    uint64_t ts = timestamp_list[i].load();
-    // Skip buffers being allocated (UINT64_MAX) and invalid timestamps (0)
-    if (ts != std::numeric_limits<uint64_t>::max() && ts > 0 && timestamp_us < ts)
-    {
-      return true;
-    }
-  }
-  return false;
+  // Compare for inequality so that a restarted publisher (index reset to 0) is also detected
+  return write_index->load(std::memory_order_acquire) != read_index;
 }
 
 void
@@ -389,10 +1329,21 @@ RingBuffer::setDataExpiryTime_us(uint64_t time_us)
   data_expiry_time_us = time_us;
 }
 
+//! @brief 更新待ち時のビジーウェイト時間の設定
+//! @param time_us ビジーウェイト時間[usec](0でスリープのみ)
+//! @return なし
+//! @details 専有コアで動作するSubscriber向けに、スリープ前に更新をポーリングする時間を設定する．
+void
+RingBuffer::setSpinTime_us(uint64_t time_us)
+{
+  spin_time_us = time_us;
+}
+
 void
 RingBuffer::markAsInitialized()
 {
   initialization_flag->store(INITIALIZED, std::memory_order_release);
+  futexWake(initialization_flag);
 }
 
 }  // namespace shm
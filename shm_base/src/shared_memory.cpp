@@ -1,4 +1,25 @@
 #include <shm_base.hpp>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <chrono>
+#include <thread>
+#if defined(__linux__)
+extern "C" {
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+}
+#endif
+
+// Memory policy constants from <numaif.h>, defined here to avoid a libnuma dependency
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)
+#endif
 
 namespace irlab
 {
@@ -49,14 +70,18 @@ SharedMemory::getPtr()
   return shm_ptr;
 }
 
-SharedMemoryPosix::SharedMemoryPosix(std::string name, int oflag, PERM perm)
+SharedMemoryPosix::SharedMemoryPosix(std::string name, int oflag, PERM perm, const SharedMemoryOptions &options)
   : SharedMemory(oflag, perm)
   , shm_name(name)
+  , shm_options(options)
+  , watch_fd(-1)
 {
   if (shm_name[0] == '/')
   {
     shm_name = shm_name.erase(0, 1);
   }
+  // Built once: waitForSize() reopens the file on every event in the directory
+  shm_file_name = "/shm_" + regex_replace(shm_name, std::regex("/"), "_");
 }
 
 SharedMemoryPosix::~SharedMemoryPosix()
@@ -65,14 +90,71 @@ SharedMemoryPosix::~SharedMemoryPosix()
   {
     close(shm_fd);
   }
+  if (watch_fd >= 0)
+  {
+    close(watch_fd);
+  }
+}
+
+//! @brief 共有メモリのファイルを開く
+//! @param [in] oflag ファイルを開く際のフラグ
+//! @return int ファイルディスクリプタ(失敗時は負)
+//! @details huge_page_dir が指定されている場合は、hugetlbfs上のファイルを開く．
+int
+SharedMemoryPosix::openFile(int oflag) const
+{
+  if (shm_options.huge_page_dir.empty())
+  {
+    return shm_open(shm_file_name.c_str(), oflag, static_cast<mode_t>(shm_perm));
+  }
+  return open((shm_options.huge_page_dir + shm_file_name).c_str(), oflag, static_cast<mode_t>(shm_perm));
+}
+
+//! @brief マッピングにNUMAノードの割り当て、事前フォールト、ページの固定を適用する
+//! @return なし
+//! @details ページがフォールトする前に割り当て方針を設定する必要があるため、
+//! NUMAノードが指定されている場合はMAP_POPULATEを使わず、割り当て方針の設定後に各ページに触れる．
+void
+SharedMemoryPosix::applyOptions()
+{
+#if defined(__linux__)
+  if (shm_options.numa_node >= 0)
+  {
+    constexpr size_t           MASK_BITS = sizeof(unsigned long) * 8;
+    size_t                     node      = static_cast<size_t>(shm_options.numa_node);
+    std::vector<unsigned long> node_mask(node / MASK_BITS + 1, 0);
+    node_mask[node / MASK_BITS] |= 1UL << (node % MASK_BITS);
+    if (syscall(SYS_mbind, shm_ptr, shm_size, MPOL_BIND, node_mask.data(), node_mask.size() * MASK_BITS + 1,
+                MPOL_MF_MOVE) < 0)
+    {
+      disconnect();
+      throw std::runtime_error("shm::SharedMemoryPosix: Could not bind shared memory to the NUMA node!");
+    }
+
+    if (shm_options.populate)
+    {
+      size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+      for (size_t offset = 0; offset < shm_size; offset += page_size)
+      {
+        // A read fault allocates the page of a shared mapping under the policy set above
+        volatile unsigned char touch = shm_ptr[offset];
+        (void)touch;
+      }
+    }
+  }
+#endif
+
+  if (shm_options.lock && mlock(shm_ptr, shm_size) < 0)
+  {
+    disconnect();
+    throw std::runtime_error("shm::SharedMemoryPosix: Could not lock shared memory!");
+  }
 }
 
 bool
 SharedMemoryPosix::connect(size_t size)
 {
-  std::string str_buf = "/shm_" + regex_replace(shm_name, std::regex("/"), "_");
-
-  shm_fd = shm_open(str_buf.c_str(), shm_oflag, static_cast<mode_t>(shm_perm));
+  shm_fd = openFile(shm_oflag);
   if (shm_fd < 0)
   {
     return false;
@@ -86,6 +168,15 @@ SharedMemoryPosix::connect(size_t size)
   else
   {
     shm_size = size;
+#if defined(__linux__)
+    struct statfs fs_stat;
+    if (!shm_options.huge_page_dir.empty() && fstatfs(shm_fd, &fs_stat) == 0 && fs_stat.f_bsize > 0)
+    {
+      // hugetlbfs only accepts sizes that are a multiple of the huge page size
+      size_t huge_page_size = static_cast<size_t>(fs_stat.f_bsize);
+      shm_size              = (shm_size + huge_page_size - 1) / huge_page_size * huge_page_size;
+    }
+#endif
     if (stat.st_size < shm_size)
     {
       if (ftruncate(shm_fd, shm_size) < 0)
@@ -96,7 +187,14 @@ SharedMemoryPosix::connect(size_t size)
       fstat(shm_fd, &stat);
     }
   }
-  shm_ptr = reinterpret_cast<unsigned char *>(mmap(NULL, stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0));
+  int map_flag = MAP_SHARED;
+#if defined(MAP_POPULATE)
+  if (shm_options.populate && shm_options.numa_node < 0)
+  {
+    map_flag |= MAP_POPULATE;
+  }
+#endif
+  shm_ptr = reinterpret_cast<unsigned char *>(mmap(NULL, stat.st_size, PROT_READ | PROT_WRITE, map_flag, shm_fd, 0));
 
   if (shm_ptr == MAP_FAILED)
   {
@@ -105,6 +203,7 @@ SharedMemoryPosix::connect(size_t size)
     return false;
   }
 
+  applyOptions();
   return true;
 }
 
@@ -160,6 +259,10 @@ SharedMemoryPosix::disconnectAndUnlink()
   // Only unlink if no other processes/threads are using it
   if (should_unlink)
   {
+    if (!shm_options.huge_page_dir.empty())
+    {
+      return unlink((shm_options.huge_page_dir + shm_file_name).c_str());
+    }
     return disconnectMemory(shm_name);
   }
 
@@ -186,10 +289,8 @@ SharedMemoryPosix::isDisconnected() const
 bool
 SharedMemoryPosix::isExists(uint64_t timeout_usec) const
 {
-  std::string str_buf = "/shm_" + regex_replace(shm_name, std::regex("/"), "_");
-
   // Try to open the shared memory (read-only, no create)
-  int fd = shm_open(str_buf.c_str(), O_RDONLY, 0);
+  int fd = openFile(O_RDONLY);
   if (fd < 0)
   {
     // Shared memory file does not exist
@@ -229,6 +330,96 @@ SharedMemoryPosix::isExists(uint64_t timeout_usec) const
   return result;
 }
 
+//! @brief 共有メモリが作成され、指定したサイズ以上になるまで待機する
+//! @param [in] min_size 待機するサイズ[byte]
+//! @param [in] timeout_usec 待ち時間[usec]
+//! @return bool 指定したサイズ以上の共有メモリが存在する場合は真、タイムアウトした場合は偽
+//! @details Linuxでは共有メモリを置くディレクトリをinotifyで監視し、ファイルの作成やサイズの変更の通知で起床する．
+//! inotifyが使えない場合は一定周期で確認する．
+bool
+SharedMemoryPosix::waitForSize(size_t min_size, uint64_t timeout_usec) const
+{
+  constexpr uint64_t POLL_PERIOD_USEC = 10000;
+
+  auto has_size = [&]()
+  {
+    int fd = openFile(O_RDONLY);
+    if (fd < 0)
+    {
+      return false;
+    }
+    struct stat st;
+    bool        result = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= min_size;
+    close(fd);
+    return result;
+  };
+
+  if (has_size())
+  {
+    return true;
+  }
+
+  int watch_descriptor = -1;
+#if defined(__linux__)
+  if (watch_fd < 0)
+  {
+    // Kept until destruction: closing an inotify instance waits for an RCU grace period (~10ms)
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  }
+  if (watch_fd >= 0)
+  {
+    std::string dir = shm_options.huge_page_dir.empty() ? "/dev/shm" : shm_options.huge_page_dir;
+    // ftruncate() on a file in the directory is reported as IN_MODIFY
+    watch_descriptor = inotify_add_watch(watch_fd, dir.c_str(), IN_CREATE | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB);
+  }
+#endif
+
+  uint64_t start_time = getCurrentTimeUSec();
+  bool     result     = false;
+  while (true)
+  {
+    // The watch is registered before the check so that a creation in between is still reported
+    if (has_size())
+    {
+      result = true;
+      break;
+    }
+    uint64_t elapsed = getCurrentTimeUSec() - start_time;
+    if (elapsed >= timeout_usec)
+    {
+      break;
+    }
+    uint64_t wait_usec = timeout_usec - elapsed;
+
+    if (watch_descriptor < 0)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(std::min(wait_usec, POLL_PERIOD_USEC)));
+      continue;
+    }
+#if defined(__linux__)
+    struct pollfd poll_fd = { watch_fd, POLLIN, 0 };
+    int timeout_ms = static_cast<int>(std::min<uint64_t>((wait_usec + 999) / 1000, static_cast<uint64_t>(INT_MAX)));
+    if (poll(&poll_fd, 1, timeout_ms) > 0)
+    {
+      // Any event in the directory triggers a re-check, so the events themselves are discarded
+      alignas(struct inotify_event) char event_buffer[4096];
+      while (read(watch_fd, event_buffer, sizeof(event_buffer)) > 0)
+      {
+      }
+    }
+#endif
+  }
+
+#if defined(__linux__)
+  if (watch_descriptor >= 0)
+  {
+    // Stop queueing events while nobody waits; events already queued are discarded by the next wait
+    inotify_rm_watch(watch_fd, watch_descriptor);
+  }
+#endif
+  return result;
+}
+
 }  // namespace shm
 
 }  // namespace irlab
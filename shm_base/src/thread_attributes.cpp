@@ -0,0 +1,149 @@
+#include <shm_base.hpp>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+
+namespace irlab
+{
+
+namespace shm
+{
+
+namespace
+{
+
+//! @brief 優先度の検証
+//! @param [in] attributes スレッドの設定
+//! @return なし
+//! @details リアルタイムポリシーの場合のみ、ポリシーの範囲内であることを確認する．
+void
+checkPriority(const ThreadAttributes &attributes)
+{
+  if (attributes.sched_policy != SCHED_FIFO && attributes.sched_policy != SCHED_RR)
+  {
+    return;
+  }
+  if (attributes.sched_priority < sched_get_priority_min(attributes.sched_policy) ||
+      attributes.sched_priority > sched_get_priority_max(attributes.sched_policy))
+  {
+    throw std::runtime_error("shm::ThreadAttributes: Priority is out of range for the policy!");
+  }
+}
+
+//! @brief プロセスのメモリの固定
+//! @param なし
+//! @return なし
+void
+lockMemory()
+{
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+  {
+    throw std::runtime_error(std::string("shm::ThreadAttributes: Cannot lock memory (") + std::strerror(errno) +
+                             ")!");
+  }
+}
+
+#if defined(__linux__)
+//! @brief CPU番号の集合の作成
+//! @param [in] cpu_list CPU番号の一覧
+//! @return cpu_set_t CPUの集合
+cpu_set_t
+makeCpuSet(const std::vector<int> &cpu_list)
+{
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int cpu : cpu_list)
+  {
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+      throw std::runtime_error("shm::ThreadAttributes: CPU number is out of range!");
+    }
+    CPU_SET(cpu, &cpu_set);
+  }
+  return cpu_set;
+}
+#endif
+
+}  // namespace
+
+//! @brief スレッド生成時の属性の設定
+//! @param [in,out] thread_attr pthread_attr_init() で初期化した属性
+//! @param [in] attributes スレッドの設定
+//! @return なし
+//! @details スケジューリングは明示的に指定するため、生成したスレッドは最初から指定したポリシーとCPUで動作する．
+//! 権限が不足する場合は pthread_create() が EPERM で失敗する．lock_memory はこの時点でプロセス全体に適用する．
+void
+initThreadAttr(pthread_attr_t *thread_attr, const ThreadAttributes &attributes)
+{
+  checkPriority(attributes);
+  if (attributes.sched_policy != SCHED_OTHER)
+  {
+    sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = attributes.sched_priority;
+    pthread_attr_setinheritsched(thread_attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(thread_attr, attributes.sched_policy);
+    pthread_attr_setschedparam(thread_attr, &param);
+  }
+#if defined(__linux__)
+  if (!attributes.cpu_list.empty())
+  {
+    cpu_set_t cpu_set = makeCpuSet(attributes.cpu_list);
+    pthread_attr_setaffinity_np(thread_attr, sizeof(cpu_set), &cpu_set);
+  }
+#endif
+  if (attributes.stack_size > 0)
+  {
+    if (pthread_attr_setstacksize(thread_attr, attributes.stack_size) != 0)
+    {
+      throw std::runtime_error("shm::ThreadAttributes: Stack size is too small!");
+    }
+  }
+  if (attributes.lock_memory)
+  {
+    lockMemory();
+  }
+}
+
+//! @brief 呼び出したスレッドへの設定の適用
+//! @param [in] attributes スレッドの設定
+//! @return なし
+//! @details 既に動作しているスレッドのため、stack_size は無視する．
+//! std::thread で生成したスレッドや、ActionServer を処理するスレッドの先頭で呼び出す．
+void
+applyThreadAttributes(const ThreadAttributes &attributes)
+{
+  checkPriority(attributes);
+  if (attributes.sched_policy != SCHED_OTHER)
+  {
+    sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = attributes.sched_priority;
+    int result           = pthread_setschedparam(pthread_self(), attributes.sched_policy, &param);
+    if (result != 0)
+    {
+      throw std::runtime_error(std::string("shm::ThreadAttributes: Cannot set the scheduling policy (") +
+                               std::strerror(result) + ")!");
+    }
+  }
+#if defined(__linux__)
+  if (!attributes.cpu_list.empty())
+  {
+    cpu_set_t cpu_set = makeCpuSet(attributes.cpu_list);
+    int       result  = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (result != 0)
+    {
+      throw std::runtime_error(std::string("shm::ThreadAttributes: Cannot set the CPU affinity (") +
+                               std::strerror(result) + ")!");
+    }
+  }
+#endif
+  if (attributes.lock_memory)
+  {
+    lockMemory();
+  }
+}
+
+}  // namespace shm
+
+}  // namespace irlab
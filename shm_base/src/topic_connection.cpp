@@ -0,0 +1,216 @@
+#include <shm_base.hpp>
+
+namespace irlab
+{
+
+namespace shm
+{
+
+//! @brief 最後の所有者が手放した時点でアンマップされる共有メモリの作成
+//! @param [in] name トピック名
+//! @param [in] options 共有メモリの設定
+//! @return std::shared_ptr<SharedMemory> まだ開いていない共有メモリ
+static std::shared_ptr<SharedMemory>
+createSharedMemory(const std::string &name, const SharedMemoryOptions &options)
+{
+  return std::shared_ptr<SharedMemory>(new SharedMemoryPosix(name, O_RDWR, static_cast<PERM>(0), options),
+                                       [](SharedMemory *memory)
+                                       {
+                                         memory->disconnect();
+                                         delete memory;
+                                       });
+}
+
+//! @brief コンストラクタ
+//! @param [in] name トピック名
+//! @param [in] options 共有メモリの設定
+//! @return なし
+//! @details 共有メモリはまだ開かない．最初の poll() または waitForAttach() で接続を始める．
+TopicConnection::TopicConnection(const std::string &name, const SharedMemoryOptions &options)
+  : shm_name(name)
+  , shm_options(options)
+  , shared_memory(createSharedMemory(name, options))
+  , is_attached(false)
+  , generation(0)
+  , attach_num(0)
+  , map_num(0)
+{
+}
+
+//! @brief 接続を1段階進める
+//! @param なし
+//! @return bool 初期化済みのリングバッファに接続している場合は真
+//! @details ブロックせずに、共有メモリのオープンとマップ、初期化の確認、世代の確認を行う．
+//! 共有メモリが削除されていればマップし直し、世代が変わっていれば新たな接続として getAttachNum() を進める．
+bool
+TopicConnection::poll()
+{
+  if (shared_memory->isDisconnected())
+  {
+    // Never mapped yet, or unlinked by a publisher; the old mapping no longer receives data
+    if (is_attached || shared_memory->getPtr() != nullptr)
+    {
+      disconnect();
+    }
+    if (!mapSegment())
+    {
+      return false;
+    }
+  }
+
+  // Read the generation first: the creator resets the flag before bumping it, so a new generation
+  // is never paired with the INITIALIZED flag of the previous one
+  unsigned char *ptr                = shared_memory->getPtr();
+  uint32_t       current_generation = RingBuffer::getGeneration(ptr);
+  if (!RingBuffer::checkInitialized(ptr))
+  {
+    // Being created or restarted in place: keep the mapping and try again on the next call
+    is_attached = false;
+    return false;
+  }
+  if (is_attached && current_generation == generation)
+  {
+    return true;
+  }
+
+  if (!RingBuffer::checkLayoutVersion(ptr))
+  {
+    throw std::runtime_error("shm::TopicConnection: Shared memory layout version mismatch!");
+  }
+  if (RingBuffer::getRequiredSize(ptr) > shared_memory->getSize())
+  {
+    // The restarted publisher grew the segment beyond the mapping
+    disconnect();
+    if (!mapSegment() || RingBuffer::getGeneration(shared_memory->getPtr()) != current_generation ||
+        !RingBuffer::checkInitialized(shared_memory->getPtr()) ||
+        RingBuffer::getRequiredSize(shared_memory->getPtr()) > shared_memory->getSize())
+    {
+      return false;
+    }
+  }
+
+  generation  = current_generation;
+  is_attached = true;
+  attach_num++;
+  return true;
+}
+
+//! @brief 接続待ち
+//! @param [in] timeout_usec 待ち時間[usec]
+//! @return bool 時間内に接続できた場合は真
+//! @details 共有メモリが無い間はinotifyで作成を待ち、初期化中は初期化フラグのfutexで初期化完了を待つ．
+bool
+TopicConnection::waitForAttach(uint64_t timeout_usec)
+{
+  uint64_t start_time = getCurrentTimeUSec();
+  while (!poll())
+  {
+    uint64_t elapsed = getCurrentTimeUSec() - start_time;
+    if (elapsed >= timeout_usec)
+    {
+      return false;
+    }
+    if (shared_memory->isDisconnected())
+    {
+      shared_memory->waitForSize(RingBuffer::getSize(0, 0), timeout_usec - elapsed);
+    }
+    else
+    {
+      RingBuffer::waitForInitialization(shared_memory->getPtr(), timeout_usec - elapsed);
+    }
+  }
+  return true;
+}
+
+//! @brief 切断
+//! @param なし
+//! @return なし
+//! @details 次の poll() で最初から接続し直す．
+//! createRingBuffer() のリングバッファが残っている場合は、マッピングをそれらに任せて新しい共有メモリに切り替える．
+void
+TopicConnection::disconnect()
+{
+  if (shared_memory.use_count() > 1)
+  {
+    // Borrowed slots still read the old mapping; the last ring buffer on it unmaps it
+    shared_memory = createSharedMemory(shm_name, shm_options);
+  }
+  else
+  {
+    shared_memory->disconnect();
+  }
+  is_attached = false;
+}
+
+//! @brief 接続状態の取得
+//! @param なし
+//! @return bool 直前の poll() で接続していた場合は真
+bool
+TopicConnection::isAttached() const
+{
+  return is_attached;
+}
+
+//! @brief マップした共有メモリの先頭アドレスの取得
+//! @param なし
+//! @return unsigned char* 先頭アドレス．マップしていない場合はnullptr
+unsigned char *
+TopicConnection::getPtr()
+{
+  return shared_memory->getPtr();
+}
+
+//! @brief 接続回数の取得
+//! @param なし
+//! @return uint64_t 新たな世代のリングバッファに接続した回数
+//! @details 値が変わった場合、所有者はリングバッファを作り直す必要がある．
+uint64_t
+TopicConnection::getAttachNum() const
+{
+  return attach_num;
+}
+
+//! @brief 現在のマッピング上のリングバッファの作成
+//! @param なし
+//! @return std::shared_ptr<RingBuffer> リングバッファ．破棄されるまでマッピングを保持する
+//! @details poll() が真を返した後に呼び出すこと．
+std::shared_ptr<RingBuffer>
+TopicConnection::createRingBuffer()
+{
+  std::shared_ptr<SharedMemory> memory = shared_memory;
+  // The deleter destroys the ring buffer first: unregistering the client still writes to the mapping
+  return std::shared_ptr<RingBuffer>(new RingBuffer(memory->getPtr()), [memory](RingBuffer *ring) { delete ring; });
+}
+
+//! @brief マップ回数の取得
+//! @param なし
+//! @return uint64_t 共有メモリをマップした回数
+uint64_t
+TopicConnection::getMapNum() const
+{
+  return map_num;
+}
+
+//! @brief 共有メモリのマップ
+//! @param なし
+//! @return bool ヘッダを読める大きさの共有メモリをマップできた場合は真
+//! @details 作成直後でまだ大きさが設定されていない共有メモリはマップしない．
+bool
+TopicConnection::mapSegment()
+{
+  if (!shared_memory->connect())
+  {
+    return false;
+  }
+  if (shared_memory->getSize() < RingBuffer::getSize(0, 0))
+  {
+    disconnect();
+    return false;
+  }
+  map_num++;
+  return true;
+}
+
+}  // namespace shm
+
+}  // namespace irlab
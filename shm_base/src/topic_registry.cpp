@@ -0,0 +1,206 @@
+#include <shm_base.hpp>
+#include <cstring>
+#include <thread>
+
+namespace irlab
+{
+
+namespace shm
+{
+
+namespace
+{
+
+//! エントリの書き込みを待つ最大時間[usec]．書き込み中に終了したプロセスのエントリは飛ばす
+constexpr uint64_t CLAIM_WAIT_USEC = 100000;
+
+//! @brief レジストリのキーとなるトピック名
+//! @param [in] name トピック名
+//! @return std::string 先頭の'/'を除いた名前
+//! @details "/topic" と "topic" は同じ共有メモリを指すため、同じエントリに対応させる．
+std::string
+normalizeName(const std::string &name)
+{
+  return (!name.empty() && name[0] == '/') ? name.substr(1) : name;
+}
+
+//! @brief 名前の書き込み中のエントリが書き込み済みになるまで待つ
+//! @param [in] entry エントリ
+//! @return uint32_t 待った後のシーケンス番号．時間内に書き込まれなかった場合は1
+uint32_t
+waitForClaim(const TopicRegistryEntry &entry)
+{
+  uint32_t sequence   = entry.sequence.load(std::memory_order_acquire);
+  uint64_t start_time = getCurrentTimeUSec();
+  while (sequence == 1 && getCurrentTimeUSec() - start_time < CLAIM_WAIT_USEC)
+  {
+    std::this_thread::yield();
+    sequence = entry.sequence.load(std::memory_order_acquire);
+  }
+  return sequence;
+}
+
+}  // namespace
+
+//! @brief コンストラクタ
+//! @param [in] registry_name レジストリの共有メモリ名
+//! @param [in] perm 作成する場合の権限
+//! @return なし
+//! @details レジストリが無ければ作成する．ゼロで埋められた共有メモリはそのまま空の表として使える．
+TopicRegistry::TopicRegistry(const std::string &registry_name, PERM perm)
+  : shared_memory(std::make_unique<SharedMemoryPosix>(registry_name, O_RDWR | O_CREAT, perm))
+  , entry_list(nullptr)
+{
+  shared_memory->connect(CACHE_LINE_SIZE + sizeof(TopicRegistryEntry) * ENTRY_NUM);
+  if (shared_memory->isDisconnected())
+  {
+    throw std::runtime_error("shm::TopicRegistry: Cannot get memory!");
+  }
+
+  std::atomic<uint32_t> *layout_version = reinterpret_cast<std::atomic<uint32_t> *>(shared_memory->getPtr());
+  uint32_t               version        = 0;
+  if (!layout_version->compare_exchange_strong(version, LAYOUT_VERSION, std::memory_order_acq_rel) &&
+      version != LAYOUT_VERSION)
+  {
+    throw std::runtime_error("shm::TopicRegistry: Registry layout version mismatch!");
+  }
+  entry_list = reinterpret_cast<TopicRegistryEntry *>(shared_memory->getPtr() + CACHE_LINE_SIZE);
+}
+
+//! @brief トピックの登録
+//! @param [in] info トピックの情報
+//! @return bool 登録できた場合は真、表に空きが無い場合は偽
+//! @details 同じ名前のエントリがあれば更新し、無ければ名前のハッシュから順に空きエントリを探して確保する．
+bool
+TopicRegistry::registerTopic(const TopicInfo &info)
+{
+  std::string name = normalizeName(info.name);
+  if (name.empty() || name.size() >= sizeof(TopicRegistryEntry::name))
+  {
+    throw std::runtime_error("shm::TopicRegistry: Topic name is empty or too long!");
+  }
+
+  size_t start = static_cast<size_t>(hashFingerprint(FINGERPRINT_OFFSET_BASIS, name.c_str()) % ENTRY_NUM);
+  for (size_t i = 0; i < ENTRY_NUM; i++)
+  {
+    TopicRegistryEntry &entry    = entry_list[(start + i) % ENTRY_NUM];
+    uint32_t            sequence = entry.sequence.load(std::memory_order_acquire);
+    if (sequence == 0)
+    {
+      if (entry.sequence.compare_exchange_strong(sequence, 1, std::memory_order_acq_rel))
+      {
+        std::memcpy(entry.name, name.c_str(), name.size() + 1);
+        entry.pid.store(static_cast<uint32_t>(info.pid), std::memory_order_relaxed);
+        entry.type_hash.store(info.type_hash, std::memory_order_relaxed);
+        entry.element_size.store(info.element_size, std::memory_order_relaxed);
+        entry.buffer_num.store(info.buffer_num, std::memory_order_relaxed);
+        entry.sequence.store(2, std::memory_order_release);
+        return true;
+      }
+      // Another process claimed it first; it may be claiming it for the same name
+    }
+    sequence = waitForClaim(entry);
+    if (sequence == 1 || std::strncmp(entry.name, name.c_str(), sizeof(entry.name)) != 0)
+    {
+      continue;
+    }
+
+    // Names never change once written, so only the fields are updated under the seqlock
+    while (true)
+    {
+      sequence = entry.sequence.load(std::memory_order_relaxed);
+      if ((sequence & 1) == 0 &&
+          entry.sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire))
+      {
+        break;
+      }
+      std::this_thread::yield();
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.pid.store(static_cast<uint32_t>(info.pid), std::memory_order_relaxed);
+    entry.type_hash.store(info.type_hash, std::memory_order_relaxed);
+    entry.element_size.store(info.element_size, std::memory_order_relaxed);
+    entry.buffer_num.store(info.buffer_num, std::memory_order_relaxed);
+    entry.sequence.store(sequence + 2, std::memory_order_release);
+    return true;
+  }
+  return false;
+}
+
+//! @brief トピックの検索
+//! @param [in] name トピック名
+//! @param [out] info 見つかったトピックの情報
+//! @return bool 登録されていれば真
+//! @details 名前のハッシュから順に調べ、一度も使われていないエントリに達した時点で未登録と判断する．
+bool
+TopicRegistry::lookup(const std::string &name, TopicInfo *info) const
+{
+  std::string key   = normalizeName(name);
+  size_t      start = static_cast<size_t>(hashFingerprint(FINGERPRINT_OFFSET_BASIS, key.c_str()) % ENTRY_NUM);
+  for (size_t i = 0; i < ENTRY_NUM; i++)
+  {
+    const TopicRegistryEntry &entry    = entry_list[(start + i) % ENTRY_NUM];
+    uint32_t                  sequence = waitForClaim(entry);
+    if (sequence == 0)
+    {
+      return false;
+    }
+    if (sequence != 1 && std::strncmp(entry.name, key.c_str(), sizeof(entry.name)) == 0)
+    {
+      return readEntry(entry, info);
+    }
+  }
+  return false;
+}
+
+//! @brief 登録されている全トピックの取得
+//! @return std::vector<TopicInfo> トピックの情報の一覧
+std::vector<TopicInfo>
+TopicRegistry::getTopicList() const
+{
+  std::vector<TopicInfo> topic_list;
+  for (size_t i = 0; i < ENTRY_NUM; i++)
+  {
+    TopicInfo info;
+    if (entry_list[i].sequence.load(std::memory_order_acquire) > 1 && readEntry(entry_list[i], &info))
+    {
+      topic_list.push_back(info);
+    }
+  }
+  return topic_list;
+}
+
+//! @brief エントリの読み込み
+//! @param [in] entry 書き込み済みのエントリ
+//! @param [out] info 読み込んだトピックの情報
+//! @return bool 読み込めた場合は真、更新が終わらなかった場合は偽
+//! @details 更新中であれば、シーケンス番号が変わらずに読み込めるまで繰り返す．
+bool
+TopicRegistry::readEntry(const TopicRegistryEntry &entry, TopicInfo *info) const
+{
+  uint64_t start_time = getCurrentTimeUSec();
+  while (getCurrentTimeUSec() - start_time < CLAIM_WAIT_USEC)
+  {
+    uint32_t sequence = entry.sequence.load(std::memory_order_acquire);
+    if ((sequence & 1) != 0)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    info->pid          = static_cast<pid_t>(entry.pid.load(std::memory_order_relaxed));
+    info->type_hash    = entry.type_hash.load(std::memory_order_relaxed);
+    info->element_size = static_cast<size_t>(entry.element_size.load(std::memory_order_relaxed));
+    info->buffer_num   = static_cast<size_t>(entry.buffer_num.load(std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (entry.sequence.load(std::memory_order_relaxed) == sequence)
+    {
+      info->name = entry.name;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace shm
+
+}  // namespace irlab
@@ -0,0 +1,396 @@
+#include <shm_trace.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sys/syscall.h>
+
+namespace irlab
+{
+
+namespace shm
+{
+
+std::atomic<bool> tracing_enabled(false);
+
+namespace
+{
+
+//! プロセスのトレースリング．記録中のスレッドが参照している可能性があるため、プロセスの終了まで解放しない
+std::atomic<TraceBuffer *> process_trace(nullptr);
+std::mutex                 trace_mutex;
+
+//! @brief 呼び出したスレッドのID
+//! @return pid_t スレッドID
+pid_t
+getThreadId()
+{
+  thread_local pid_t thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+  return thread_id;
+}
+
+//! @brief 正常終了時のトレースリングの削除
+//! @details マッピングは残すため、終了処理中のスレッドが記録しても問題ない．異常終了した場合は事後の解析のために残る．
+void
+unlinkProcessTrace()
+{
+  disconnectMemory(TraceBuffer::getMemoryName(getpid()));
+}
+
+//! @brief 環境変数 SHM_TRACE によるトレースの開始
+//! @details 値が正の数であればレコード数として使う．コードを変更せずに、リリースビルドのプロセスを記録できる．
+struct EnvironmentTrace
+{
+  EnvironmentTrace()
+  {
+    const char *trace_value = std::getenv("SHM_TRACE");
+    if (trace_value == nullptr || trace_value[0] == '\0' || std::strcmp(trace_value, "0") == 0)
+    {
+      return;
+    }
+    long long record_num = std::atoll(trace_value);
+    try
+    {
+      enableTracing(record_num > 1 ? static_cast<size_t>(record_num) : TraceBuffer::DEFAULT_RECORD_NUM);
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+};
+EnvironmentTrace environment_trace;
+
+//! @brief JSONの文字列としてのエスケープ
+//! @param [in] text 文字列
+//! @return std::string エスケープした文字列
+std::string
+escapeJson(const std::string &text)
+{
+  std::string escaped;
+  for (char c : text)
+  {
+    if (c == '"' || c == '\\')
+    {
+      escaped += '\\';
+      escaped += c;
+    }
+    else if (static_cast<unsigned char>(c) < 0x20)
+    {
+      escaped += ' ';
+    }
+    else
+    {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+//! @brief トレースポイントのChrome trace形式での表現
+//! @param [in] event トレースポイント
+//! @param [out] label イベント名の接頭辞
+//! @param [out] phase フェーズ("B"、"E"または"i")
+//! @details 出版とサービスは同じスレッドの開始と終了の組として、それ以外は瞬間のイベントとして表示する．
+void
+getChromeEvent(TRACE_EVENT event, const char **label, const char **phase)
+{
+  switch (event)
+  {
+  case TRACE_PUBLISH_BEGIN:
+    *label = "publish";
+    *phase = "B";
+    return;
+  case TRACE_PUBLISH_COMMIT:
+    *label = "publish";
+    *phase = "E";
+    return;
+  case TRACE_SUBSCRIBE:
+    *label = "subscribe";
+    break;
+  case TRACE_WAIT_WAKE:
+    *label = "wake";
+    break;
+  case TRACE_SERVICE_REQUEST:
+    *label = "service";
+    *phase = "B";
+    return;
+  case TRACE_SERVICE_RESPONSE:
+    *label = "service";
+    *phase = "E";
+    return;
+  case TRACE_ACTION_GOAL:
+    *label = "goal";
+    break;
+  case TRACE_ACTION_FEEDBACK:
+    *label = "feedback";
+    break;
+  case TRACE_ACTION_RESULT:
+    *label = "result";
+    break;
+  default:
+    *label = "unknown";
+    break;
+  }
+  *phase = "i";
+}
+
+}  // namespace
+
+//! @brief トレースの開始
+//! @param [in] record_num 初めて開始する場合のリングのレコード数
+//! @return なし
+//! @details 共有メモリ "trace_<pid>" にトレースリングを作成する．既に作成済みであればそのリングに記録を再開する．
+void
+enableTracing(size_t record_num)
+{
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  if (process_trace.load(std::memory_order_acquire) == nullptr)
+  {
+    // A ring with this PID can only be left over by a crashed process that had the same PID
+    std::string trace_name = TraceBuffer::getMemoryName(getpid());
+    disconnectMemory(trace_name);
+    process_trace.store(new TraceBuffer(trace_name, record_num), std::memory_order_release);
+    std::atexit(unlinkProcessTrace);
+  }
+  tracing_enabled.store(true, std::memory_order_release);
+}
+
+//! @brief トレースの停止
+//! @param なし
+//! @return なし
+//! @details 記録済みのレコードは残るため、停止後も readTrace() や "shm_tool trace" で読み出せる．
+void
+disableTracing()
+{
+  tracing_enabled.store(false, std::memory_order_release);
+}
+
+//! @brief トレースポイントの記録
+//! @param [in] event トレースポイント
+//! @param [in] name トピック名
+//! @param [in] sequence トピックの通し番号、呼び出しIDまたはゴールID
+//! @param [in] time_us 時刻[usec]．0の場合は現在時刻
+//! @return なし
+//! @details 通常は SHM_TRACE() から呼ばれる．
+void
+recordTrace(TRACE_EVENT event, const std::string &name, uint64_t sequence, uint64_t time_us)
+{
+  TraceBuffer *trace = process_trace.load(std::memory_order_acquire);
+  if (trace == nullptr || !tracing_enabled.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+  trace->record(event, name, sequence, (time_us != 0) ? time_us : getCurrentTimeUSec());
+}
+
+//! @brief このプロセスのトレースの読み出し
+//! @param なし
+//! @return std::vector<TraceRecord> 古い順のレコード(トレースを開始していない場合は空)
+std::vector<TraceRecord>
+readTrace()
+{
+  TraceBuffer *trace = process_trace.load(std::memory_order_acquire);
+  return (trace != nullptr) ? trace->read() : std::vector<TraceRecord>();
+}
+
+//! @brief Chrome trace形式(JSON)での書き出し
+//! @param [out] stream 出力先
+//! @param [in] record_list レコード
+//! @return なし
+//! @details chrome://tracing や Perfetto で開ける．時刻はマイクロ秒のまま "ts" に書き出す．
+void
+writeChromeTrace(std::ostream &stream, const std::vector<TraceRecord> &record_list)
+{
+  stream << "{\"traceEvents\":[";
+  for (size_t i = 0; i < record_list.size(); i++)
+  {
+    const TraceRecord &record = record_list[i];
+    const char        *label  = nullptr;
+    const char        *phase  = nullptr;
+    getChromeEvent(record.event, &label, &phase);
+
+    stream << ((i == 0) ? "\n" : ",\n");
+    stream << "{\"name\":\"" << label << " " << escapeJson(record.name) << "\",\"cat\":\"" << label
+           << "\",\"ph\":\"" << phase << "\",\"ts\":" << record.time_us << ",\"pid\":" << record.pid
+           << ",\"tid\":" << record.thread_id;
+    if (phase[0] == 'i')
+    {
+      stream << ",\"s\":\"t\"";
+    }
+    stream << ",\"args\":{\"sequence\":" << record.sequence << "}}";
+  }
+  stream << "\n],\"displayTimeUnit\":\"ms\"}" << std::endl;
+}
+
+//! @brief コンストラクタ
+//! @param [in] trace_name トレースリングの共有メモリ名
+//! @param [in] record_num レコード数
+//! @param [in] perm 作成する場合の権限
+//! @return なし
+//! @details 同じ名前のリングがあれば、そのレコード数のまま接続する．ヘッダには版数、レコード数、作成したプロセスIDを置く．
+TraceBuffer::TraceBuffer(const std::string &trace_name, size_t record_num, PERM perm)
+  : shared_memory(std::make_unique<SharedMemoryPosix>(trace_name, O_RDWR | O_CREAT, perm))
+  , write_index(nullptr)
+  , slot_list(nullptr)
+  , slot_num(0)
+{
+  if (record_num == 0)
+  {
+    throw std::runtime_error("shm::TraceBuffer: Record number must be positive!");
+  }
+  shared_memory->connect(getSize(record_num));
+  if (shared_memory->isDisconnected())
+  {
+    throw std::runtime_error("shm::TraceBuffer: Cannot get memory!");
+  }
+
+  unsigned char         *first_ptr      = shared_memory->getPtr();
+  std::atomic<uint32_t> *layout_version = reinterpret_cast<std::atomic<uint32_t> *>(first_ptr);
+  std::atomic<uint64_t> *header_num     = reinterpret_cast<std::atomic<uint64_t> *>(first_ptr + sizeof(uint64_t));
+  std::atomic<uint32_t> *header_pid     = reinterpret_cast<std::atomic<uint32_t> *>(first_ptr + sizeof(uint64_t) * 2);
+  uint32_t               version        = 0;
+  if (layout_version->compare_exchange_strong(version, LAYOUT_VERSION, std::memory_order_acq_rel))
+  {
+    header_pid->store(static_cast<uint32_t>(getpid()), std::memory_order_relaxed);
+    header_num->store(record_num, std::memory_order_release);
+  }
+  else if (version != LAYOUT_VERSION)
+  {
+    throw std::runtime_error("shm::TraceBuffer: Trace layout version mismatch!");
+  }
+  slot_num = static_cast<size_t>(header_num->load(std::memory_order_acquire));
+  if (slot_num == 0 || getSize(slot_num) > shared_memory->getSize())
+  {
+    throw std::runtime_error("shm::TraceBuffer: Trace ring is not initialized!");
+  }
+  write_index = reinterpret_cast<std::atomic<uint64_t> *>(first_ptr + CACHE_LINE_SIZE);
+  slot_list   = reinterpret_cast<TraceSlot *>(first_ptr + CACHE_LINE_SIZE * 2);
+}
+
+//! @brief トレースポイントの記録
+//! @param [in] event トレースポイント
+//! @param [in] name トピック名(TraceSlot の容量に切り詰める)
+//! @param [in] sequence トピックの通し番号、呼び出しIDまたはゴールID
+//! @param [in] time_us 時刻[usec]
+//! @return なし
+//! @details 一周遅れの書き込み側とレコードが重なった場合、読み込み側は完了したシーケンスを見るまでそのレコードを飛ばす．
+void
+TraceBuffer::record(TRACE_EVENT event, const std::string &name, uint64_t sequence, uint64_t time_us)
+{
+  uint64_t   index = write_index->fetch_add(1, std::memory_order_relaxed);
+  TraceSlot &slot  = slot_list[index % slot_num];
+  slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot.time_us.store(time_us, std::memory_order_relaxed);
+  slot.topic_sequence.store(sequence, std::memory_order_relaxed);
+  slot.event.store(event, std::memory_order_relaxed);
+  slot.thread_id.store(static_cast<uint32_t>(getThreadId()), std::memory_order_relaxed);
+  // The last byte always stays NUL
+  char   name_buffer[sizeof(TraceSlot::name)] = {};
+  size_t name_size                            = std::min(name.size(), sizeof(name_buffer) - 1);
+  std::memcpy(name_buffer, name.data(), name_size);
+  for (size_t i = 0; i < sizeof(TraceSlot::name) / sizeof(uint64_t); i++)
+  {
+    uint64_t word;
+    std::memcpy(&word, name_buffer + i * sizeof(uint64_t), sizeof(uint64_t));
+    slot.name[i].store(word, std::memory_order_relaxed);
+  }
+  slot.sequence.store(index * 2 + 2, std::memory_order_release);
+}
+
+//! @brief レコードの読み出し
+//! @param なし
+//! @return std::vector<TraceRecord> 古い順のレコード
+std::vector<TraceRecord>
+TraceBuffer::read() const
+{
+  std::vector<TraceRecord> record_list;
+  readRecords(shared_memory->getPtr(), shared_memory->getSize(), &record_list);
+  return record_list;
+}
+
+//! @brief 共有メモリの大きさの計算
+//! @param [in] record_num レコード数
+//! @return size_t 共有メモリの大きさ[byte]
+size_t
+TraceBuffer::getSize(size_t record_num)
+{
+  return CACHE_LINE_SIZE * 2 + sizeof(TraceSlot) * record_num;
+}
+
+//! @brief 割り当て済みのトレースリングからのレコードの読み出し
+//! @param [in] first_ptr 共有メモリの先頭アドレス(読み込み専用でよい)
+//! @param [in] size 共有メモリの大きさ[byte]
+//! @param [out] record_list 古い順のレコード
+//! @return bool トレースリングであれば真
+//! @details 書き込みを行わないため、記録中のプロセスに影響を与えない．読み込み中に上書きされたレコードは飛ばす．
+bool
+TraceBuffer::readRecords(const unsigned char *first_ptr, size_t size, std::vector<TraceRecord> *record_list)
+{
+  record_list->clear();
+  if (size < getSize(1) ||
+      reinterpret_cast<const std::atomic<uint32_t> *>(first_ptr)->load(std::memory_order_acquire) != LAYOUT_VERSION)
+  {
+    return false;
+  }
+  size_t record_num = static_cast<size_t>(
+      reinterpret_cast<const std::atomic<uint64_t> *>(first_ptr + sizeof(uint64_t))->load(std::memory_order_acquire));
+  if (record_num == 0 || getSize(record_num) > size)
+  {
+    return false;
+  }
+  const std::atomic<uint64_t> *write_index =
+      reinterpret_cast<const std::atomic<uint64_t> *>(first_ptr + CACHE_LINE_SIZE);
+  const TraceSlot *slot_list = reinterpret_cast<const TraceSlot *>(first_ptr + CACHE_LINE_SIZE * 2);
+  pid_t            pid       = static_cast<pid_t>(
+      reinterpret_cast<const std::atomic<uint32_t> *>(first_ptr + sizeof(uint64_t) * 2)->load(std::memory_order_relaxed));
+
+  uint64_t end_index   = write_index->load(std::memory_order_acquire);
+  uint64_t begin_index = (end_index > record_num) ? end_index - record_num : 0;
+  record_list->reserve(static_cast<size_t>(end_index - begin_index));
+  for (uint64_t index = begin_index; index < end_index; index++)
+  {
+    const TraceSlot &slot     = slot_list[index % record_num];
+    uint64_t         sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != index * 2 + 2)
+    {
+      // Still being written, or already overwritten by the next lap
+      continue;
+    }
+    TraceRecord record;
+    record.time_us   = slot.time_us.load(std::memory_order_relaxed);
+    record.sequence  = slot.topic_sequence.load(std::memory_order_relaxed);
+    record.event     = static_cast<TRACE_EVENT>(slot.event.load(std::memory_order_relaxed));
+    record.thread_id = static_cast<pid_t>(slot.thread_id.load(std::memory_order_relaxed));
+    char name_buffer[sizeof(TraceSlot::name)];
+    for (size_t i = 0; i < sizeof(TraceSlot::name) / sizeof(uint64_t); i++)
+    {
+      uint64_t word = slot.name[i].load(std::memory_order_relaxed);
+      std::memcpy(name_buffer + i * sizeof(uint64_t), &word, sizeof(uint64_t));
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+    {
+      continue;
+    }
+    name_buffer[sizeof(name_buffer) - 1] = '\0';
+    record.name                          = name_buffer;
+    record.pid                           = pid;
+    record_list->push_back(record);
+  }
+  return true;
+}
+
+//! @brief プロセスのトレースリングの共有メモリ名
+//! @param [in] pid プロセスID
+//! @return std::string 共有メモリ名("trace_<pid>"、ファイルは /dev/shm/shm_trace_<pid>)
+std::string
+TraceBuffer::getMemoryName(pid_t pid)
+{
+  return "trace_" + std::to_string(pid);
+}
+
+}  // namespace shm
+
+}  // namespace irlab
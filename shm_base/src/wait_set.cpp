@@ -0,0 +1,126 @@
+#include <shm_base.hpp>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace irlab
+{
+
+namespace shm
+{
+
+//! @brief 待機するオブジェクトを登録する
+//! @param [in] get_target 待機に使うfutexワードを取得する関数．共有メモリに未接続の場合は偽を返す
+//! @return size_t 準備ができた際に wait() が返すハンドル
+size_t
+WaitSet::addTarget(std::function<bool(WaitTarget *)> get_target)
+{
+  entry_list.push_back(std::move(get_target));
+  target_list.emplace_back();
+  return entry_list.size() - 1;
+}
+
+//! @brief 登録を解除する
+//! @param [in] handle add() で得たハンドル
+//! @details 他のオブジェクトのハンドルは変わらない．
+void
+WaitSet::remove(size_t handle)
+{
+  if (handle < entry_list.size())
+  {
+    entry_list[handle] = nullptr;
+    target_list[handle] = WaitTarget();
+  }
+}
+
+//! @brief 登録されているオブジェクト数を取得する
+//! @return size_t 登録数
+size_t
+WaitSet::size() const
+{
+  return static_cast<size_t>(std::count_if(entry_list.begin(), entry_list.end(),
+                                           [](const std::function<bool(WaitTarget *)> &entry) { return bool(entry); }));
+}
+
+//! @brief いずれかのオブジェクトの準備ができるまで待機する
+//! @param [in] timeout_usec 待ち時間[usec]
+//! @return std::vector<size_t> 準備ができたオブジェクトのハンドル(タイムアウトした場合は空)
+//! @details 準備ができたかの判定は各オブジェクトの待機関数と同じであり、読み込みや処理を行うまで真のままである．
+std::vector<size_t>
+WaitSet::wait(uint64_t timeout_usec)
+{
+  std::vector<size_t> ready_list;
+  uint64_t            start_time = getCurrentTimeUSec();
+  while (true)
+  {
+    word_list.clear();
+    waiter_list.clear();
+    value_list.clear();
+    bool needs_recheck = false;
+    for (size_t i = 0; i < entry_list.size(); i++)
+    {
+      if (!entry_list[i])
+      {
+        continue;
+      }
+      WaitTarget &target = target_list[i];
+      if (!entry_list[i](&target))
+      {
+        needs_recheck = true;
+        continue;
+      }
+      // Read the sequence before checking so that an update in between makes the wait return
+      uint32_t sequence = target.sequence->load(std::memory_order_seq_cst);
+      if (target.is_ready())
+      {
+        ready_list.push_back(i);
+        continue;
+      }
+      if (word_list.size() < WATCH_MAX_NUM)
+      {
+        word_list.push_back(target.sequence);
+        waiter_list.push_back(target.waiter_num);
+        value_list.push_back(sequence);
+      }
+      else
+      {
+        needs_recheck = true;
+      }
+    }
+    if (!ready_list.empty())
+    {
+      return ready_list;
+    }
+
+    uint64_t elapsed = getCurrentTimeUSec() - start_time;
+    if (elapsed >= timeout_usec)
+    {
+      return ready_list;
+    }
+    uint64_t wait_usec = timeout_usec - elapsed;
+    if (needs_recheck)
+    {
+      wait_usec = std::min(wait_usec, RECHECK_PERIOD_USEC);
+    }
+
+    if (word_list.empty())
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(wait_usec));
+      continue;
+    }
+    // Registered after reading the sequences: a writer either changes a word we compare or sees our waiter
+    for (auto waiter_num : waiter_list)
+    {
+      waiter_num->fetch_add(1, std::memory_order_seq_cst);
+    }
+    futexWaitMultiple(word_list.data(), value_list.data(), word_list.size(), wait_usec);
+    for (auto waiter_num : waiter_list)
+    {
+      waiter_num->fetch_sub(1, std::memory_order_seq_cst);
+    }
+  }
+}
+
+}  // namespace shm
+
+}  // namespace irlab
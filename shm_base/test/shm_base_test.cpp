@@ -4,11 +4,33 @@
 #include <vector>
 #include <atomic>
 #include <cstring>
+#include <memory>
+#include <sstream>
 
 #include "shm_base.hpp"
+#include "shm_trace.hpp"
 
 using namespace irlab::shm;
 
+// Reflected messages for the flat codec tests
+struct CodecPoint
+{
+    double x;
+    std::string label;
+};
+SHM_REFLECT(CodecPoint, x, label)
+
+struct CodecMessage
+{
+    int id;
+    std::string name;
+    std::vector<std::string> tags;
+    std::vector<double> values;
+    std::array<CodecPoint, 2> ends;
+    std::vector<CodecPoint> points;
+};
+SHM_REFLECT(CodecMessage, id, name, tags, values, ends, points)
+
 // Test fixture for SharedMemoryPosix tests
 class SharedMemoryPosixTest : public ::testing::Test {
 protected:
@@ -207,12 +229,67 @@ TEST_F(SharedMemoryPosixTest, ErrorHandling) {
     }
 }
 
+TEST_F(SharedMemoryPosixTest, BackingOptions) {
+    // Pre-faulted and locked mapping behaves like a plain one
+    SharedMemoryOptions options;
+    options.populate = true;
+    options.lock = true;
+    SharedMemoryPosix writer(test_name, O_RDWR | O_CREAT, DEFAULT_PERM, options);
+    ASSERT_TRUE(writer.connect(test_size));
+    strcpy(reinterpret_cast<char*>(writer.getPtr()), "populated");
+
+    SharedMemoryPosix reader(test_name, O_RDWR, DEFAULT_PERM);
+    ASSERT_TRUE(reader.connect());
+    EXPECT_STREQ(reinterpret_cast<char*>(reader.getPtr()), "populated");
+    EXPECT_EQ(reader.disconnect(), 0);
+
+    // A backing directory replaces /dev/shm for every process using the same options
+    SharedMemoryOptions file_options;
+    file_options.huge_page_dir = "/tmp";
+    SharedMemoryPosix file_writer("/test_shm_backing_dir", O_RDWR | O_CREAT, DEFAULT_PERM, file_options);
+    ASSERT_TRUE(file_writer.connect(test_size));
+    strcpy(reinterpret_cast<char*>(file_writer.getPtr()), "backed");
+
+    SharedMemoryPosix default_reader("/test_shm_backing_dir", O_RDWR, DEFAULT_PERM);
+    EXPECT_FALSE(default_reader.connect());
+    SharedMemoryPosix file_reader("/test_shm_backing_dir", O_RDWR, DEFAULT_PERM, file_options);
+    ASSERT_TRUE(file_reader.connect());
+    EXPECT_STREQ(reinterpret_cast<char*>(file_reader.getPtr()), "backed");
+    EXPECT_EQ(file_reader.disconnect(), 0);
+
+    EXPECT_EQ(file_writer.disconnectAndUnlink(), 0);
+    EXPECT_NE(access("/tmp/shm_test_shm_backing_dir", F_OK), 0);
+}
+
+TEST_F(SharedMemoryPosixTest, WaitForSize) {
+    disconnectMemory(test_name);
+    SharedMemoryPosix reader(test_name, O_RDWR, DEFAULT_PERM);
+    EXPECT_FALSE(reader.waitForSize(test_size, 10000));
+
+    // Creation and resize are reported by the directory watch rather than found by polling
+    std::thread creator([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        SharedMemoryPosix writer(test_name, O_RDWR | O_CREAT, DEFAULT_PERM);
+        writer.connect(test_size);
+    });
+    auto start_time = std::chrono::steady_clock::now();
+    EXPECT_TRUE(reader.waitForSize(test_size, 2000000));
+    auto elapsed = std::chrono::steady_clock::now() - start_time;
+    EXPECT_LT(elapsed, std::chrono::milliseconds(1000));
+    creator.join();
+
+    EXPECT_TRUE(reader.waitForSize(test_size, 0));
+    EXPECT_FALSE(reader.waitForSize(test_size * 2, 10000));
+}
+
 // RingBuffer size calculation tests
 TEST_F(RingBufferTest, SizeCalculation) {
     // Test size calculation for different configurations
     EXPECT_GT(RingBuffer::getSize(sizeof(int), 1), sizeof(int));
     EXPECT_GT(RingBuffer::getSize(sizeof(int), 3), RingBuffer::getSize(sizeof(int), 1));
-    EXPECT_GT(RingBuffer::getSize(sizeof(double), 3), RingBuffer::getSize(sizeof(int), 3));
+    // Slots are padded to a cache line, so element sizes within one line share a slot size
+    EXPECT_EQ(RingBuffer::getSize(sizeof(double), 3), RingBuffer::getSize(sizeof(int), 3));
+    EXPECT_GT(RingBuffer::getSize(CACHE_LINE_SIZE + 1, 3), RingBuffer::getSize(CACHE_LINE_SIZE, 3));
     
     // Test with zero values (should handle gracefully)
     EXPECT_GT(RingBuffer::getSize(0, 1), 0);
@@ -264,8 +341,8 @@ TEST_F(RingBufferTest, TimestampManagement) {
         ring_buffer->setTimestamp_us(timestamps[i], buffer_id);
         
         // Write test data
-        int* data_ptr = reinterpret_cast<int*>(ring_buffer->getDataList());
-        data_ptr[buffer_id] = 100 + i;
+        int* data_ptr = reinterpret_cast<int*>(ring_buffer->getBufferPtr(buffer_id));
+        *data_ptr = 100 + i;
     }
     
     // Newest buffer should be the one with the latest timestamp
@@ -274,8 +351,8 @@ TEST_F(RingBufferTest, TimestampManagement) {
         EXPECT_EQ(ring_buffer->getTimestamp_us(), timestamps[2]); // Latest timestamp
         
         // Verify data integrity
-        int* data_ptr = reinterpret_cast<int*>(ring_buffer->getDataList());
-        EXPECT_EQ(data_ptr[newest], 102); // Should be the data from the newest buffer
+        int* data_ptr = reinterpret_cast<int*>(ring_buffer->getBufferPtr(newest));
+        EXPECT_EQ(*data_ptr, 102); // Should be the data from the newest buffer
     } else {
         // If no valid buffer found, check if all timestamps are considered expired
         EXPECT_LT(newest, 0);
@@ -325,8 +402,8 @@ TEST_F(RingBufferTest, ConcurrentAccess) {
                 int buffer_id = ring_buffer->getOldestBufferNum();
                 if (ring_buffer->allocateBuffer(buffer_id)) {
                     // Write unique data
-                    int* data_ptr = reinterpret_cast<int*>(ring_buffer->getDataList());
-                    data_ptr[buffer_id] = t * 1000 + i;
+                    int* data_ptr = reinterpret_cast<int*>(ring_buffer->getBufferPtr(buffer_id));
+                    *data_ptr = t * 1000 + i;
                     
                     // Set timestamp
                     auto timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(
@@ -395,6 +472,56 @@ TEST_F(RingBufferTest, WaitForWithData) {
     EXPECT_LT(duration.count(), 80); // Should return before timeout
 }
 
+TEST_F(RingBufferTest, WaitForWakesOnSignal) {
+    // The waiter should be woken by signal() instead of discovering the update by polling
+    std::atomic<uint64_t> signal_time_us(0);
+    std::thread writer_thread([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        int buffer_id = ring_buffer->getOldestBufferNum();
+        ASSERT_TRUE(ring_buffer->allocateBuffer(buffer_id));
+        uint64_t now_us = getCurrentTimeUSec();
+        ring_buffer->setTimestamp_us(now_us, buffer_id);
+        signal_time_us.store(now_us);
+        ring_buffer->signal();
+    });
+
+    bool result = ring_buffer->waitFor(1000000); // 1s timeout
+    uint64_t wake_time_us = getCurrentTimeUSec();
+    writer_thread.join();
+
+    EXPECT_TRUE(result);
+    EXPECT_LT(wake_time_us - signal_time_us.load(), 20000u); // Woken well before the next poll would matter
+}
+
+TEST_F(RingBufferTest, WaitForSpinPhase) {
+    ring_buffer->setSpinTime_us(200000); // Spin for up to 200ms before sleeping
+
+    std::thread writer_thread([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        int buffer_id = ring_buffer->getOldestBufferNum();
+        ASSERT_TRUE(ring_buffer->allocateBuffer(buffer_id));
+        ring_buffer->setTimestamp_us(getCurrentTimeUSec(), buffer_id);
+        ring_buffer->signal();
+    });
+
+    auto start_time = std::chrono::steady_clock::now();
+    bool result = ring_buffer->waitFor(500000);
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+    writer_thread.join();
+
+    EXPECT_TRUE(result);
+    EXPECT_LT(duration.count(), 150); // Detected during the spin phase, not after it
+
+    // Spin phase must not extend beyond the timeout
+    ring_buffer->getNewestBufferNum();
+    start_time = std::chrono::steady_clock::now();
+    EXPECT_FALSE(ring_buffer->waitFor(30000));
+    duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+    EXPECT_GE(duration.count(), 25);
+    EXPECT_LE(duration.count(), 100);
+}
+
 TEST_F(RingBufferTest, IsUpdated) {
     // Initially no updates
     EXPECT_FALSE(ring_buffer->isUpdated());
@@ -415,6 +542,298 @@ TEST_F(RingBufferTest, IsUpdated) {
     EXPECT_FALSE(ring_buffer->isUpdated());
 }
 
+TEST_F(RingBufferTest, CacheLineLayout) {
+    // Writer-hot and reader-hot fields never share a cache line, and each slot starts on its own line
+    RingBufferLayout layout = RingBuffer::calculateAlignedLayout(element_size, buffer_num);
+    std::vector<size_t> line_offsets = { layout.notify_offset, layout.write_index_offset,
+                                         layout.reserve_index_offset, layout.timestamp_offset,
+                                         layout.pin_offset, layout.client_offset, layout.metrics_offset,
+                                         layout.data_offset };
+    for (size_t i = 0; i < line_offsets.size(); ++i) {
+        EXPECT_EQ(line_offsets[i] % CACHE_LINE_SIZE, 0u);
+        if (i > 0) {
+            EXPECT_GE(line_offsets[i], line_offsets[i - 1] + CACHE_LINE_SIZE);
+        }
+    }
+    EXPECT_EQ(sizeof(RingBufferClient), CACHE_LINE_SIZE);
+    for (int i = 0; i < buffer_num; ++i) {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(ring_buffer->getBufferPtr(i)) % CACHE_LINE_SIZE, 0u);
+    }
+
+    // Large payloads are page aligned
+    RingBufferLayout large_layout = RingBuffer::calculateAlignedLayout(RingBuffer::PAGE_ALIGNED_ELEMENT_SIZE + 1, 2);
+    EXPECT_EQ(large_layout.data_offset % RingBuffer::SLOT_PAGE_SIZE, 0u);
+    EXPECT_EQ(large_layout.slot_size % RingBuffer::SLOT_PAGE_SIZE, 0u);
+
+    // A peer with a different layout revision is rejected instead of being misread
+    ring_buffer->registerClient(RingBuffer::CLIENT_PUBLISHER);
+    EXPECT_TRUE(RingBuffer::checkLayoutVersion(shared_memory->getPtr()));
+    EXPECT_TRUE(RingBuffer::checkAttachable(shared_memory->getPtr(), element_size, buffer_num));
+    uint32_t* version = reinterpret_cast<uint32_t*>(shared_memory->getPtr() + layout.layout_version_offset);
+    *version = RingBuffer::LAYOUT_VERSION - 1;
+    EXPECT_FALSE(RingBuffer::checkAttachable(shared_memory->getPtr(), element_size, buffer_num));
+    EXPECT_THROW(RingBuffer(shared_memory->getPtr()), std::runtime_error);
+    *version = RingBuffer::LAYOUT_VERSION;
+}
+
+TEST_F(RingBufferTest, WaitSetMultipleRings) {
+    SharedMemoryPosix second_memory("/test_ring_buffer2", O_RDWR | O_CREAT, DEFAULT_PERM);
+    ASSERT_TRUE(second_memory.connect(total_size));
+    RingBuffer second_ring(second_memory.getPtr(), element_size, buffer_num);
+
+    bool is_attached = false;
+    WaitSet wait_set;
+    size_t first_handle = wait_set.add(*ring_buffer);
+    size_t second_handle = wait_set.addTarget([&](WaitTarget* target) {
+        if (!is_attached) {
+            return false;
+        }
+        second_ring.getWaitTarget(target);
+        return true;
+    });
+    EXPECT_EQ(wait_set.size(), 2u);
+    EXPECT_TRUE(wait_set.wait(10000).empty());
+
+    // One futex_waitv call covers both rings; the second one is only re-checked until it is attached
+    is_attached = true;
+    uint64_t signal_time_us = 0;
+    std::thread writer_thread([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        int buffer_id = second_ring.reserveBuffer();
+        *reinterpret_cast<int*>(second_ring.getBufferPtr(buffer_id)) = 7;
+        signal_time_us = getCurrentTimeUSec();
+        second_ring.commitBuffer(buffer_id, signal_time_us);
+        second_ring.signal();
+    });
+    std::vector<size_t> ready_list = wait_set.wait(1000000);
+    uint64_t wake_time_us = getCurrentTimeUSec();
+    writer_thread.join();
+    ASSERT_EQ(ready_list.size(), 1u);
+    EXPECT_EQ(ready_list[0], second_handle);
+    EXPECT_LT(wake_time_us - signal_time_us, 20000u);
+
+    // Readiness lasts until the ring is read
+    EXPECT_EQ(wait_set.wait(0), ready_list);
+    EXPECT_GE(second_ring.getNewestBufferNum(), 0);
+    EXPECT_TRUE(wait_set.wait(1000).empty());
+
+    wait_set.remove(second_handle);
+    EXPECT_EQ(wait_set.size(), 1u);
+    int buffer_id = ring_buffer->reserveBuffer();
+    ring_buffer->commitBuffer(buffer_id, getCurrentTimeUSec());
+    ring_buffer->signal();
+    EXPECT_EQ(wait_set.wait(1000), std::vector<size_t>{first_handle});
+}
+
+TEST_F(RingBufferTest, ReserveCommitOrdering) {
+    // Order must follow the write index even when every timestamp ties
+    uint64_t timestamp_us = getCurrentTimeUSec();
+    auto slot = [&](int buffer_id) { return reinterpret_cast<int*>(ring_buffer->getBufferPtr(buffer_id)); };
+    for (int i = 0; i < 10; ++i) {
+        int buffer_id = ring_buffer->reserveBuffer();
+        EXPECT_EQ(buffer_id, i % buffer_num);
+        *slot(buffer_id) = i;
+        ring_buffer->commitBuffer(buffer_id, timestamp_us);
+
+        int newest = ring_buffer->getNewestBufferNum();
+        ASSERT_EQ(newest, buffer_id);
+        EXPECT_EQ(*slot(newest), i);
+        EXPECT_TRUE(ring_buffer->verifyBuffer(newest));
+        EXPECT_FALSE(ring_buffer->isUpdated());
+    }
+}
+
+TEST_F(RingBufferTest, VerifyBufferDetectsOverwrite) {
+    int buffer_id = ring_buffer->reserveBuffer();
+    ring_buffer->commitBuffer(buffer_id, getCurrentTimeUSec());
+
+    int newest = ring_buffer->getNewestBufferNum();
+    ASSERT_EQ(newest, buffer_id);
+    EXPECT_TRUE(ring_buffer->verifyBuffer(newest));
+
+    // Wrap around the ring until the slot being read is reserved again
+    for (int i = 0; i < buffer_num - 1; ++i) {
+        ring_buffer->commitBuffer(ring_buffer->reserveBuffer(), getCurrentTimeUSec());
+    }
+    EXPECT_TRUE(ring_buffer->verifyBuffer(newest));
+    EXPECT_EQ(ring_buffer->reserveBuffer(), newest);
+    EXPECT_FALSE(ring_buffer->verifyBuffer(newest));
+}
+
+TEST_F(RingBufferTest, QueueReadInOrder) {
+    auto slot = [&](int buffer_id) { return reinterpret_cast<int*>(ring_buffer->getBufferPtr(buffer_id)); };
+    auto write = [&](int value) {
+        int buffer_id = ring_buffer->reserveBuffer();
+        *slot(buffer_id) = value;
+        ring_buffer->commitBuffer(buffer_id, getCurrentTimeUSec());
+    };
+
+    // Messages that fit in the ring are all read in publication order
+    write(1);
+    write(2);
+    for (int expected : {1, 2}) {
+        int buffer_id = ring_buffer->getNextBufferNum();
+        ASSERT_GE(buffer_id, 0);
+        EXPECT_EQ(*slot(buffer_id), expected);
+        EXPECT_TRUE(ring_buffer->consumeBuffer(buffer_id));
+    }
+    EXPECT_LT(ring_buffer->getNextBufferNum(), 0);
+    EXPECT_FALSE(ring_buffer->isUpdated());
+
+    // Lapping the reader skips to the oldest message still in the ring and counts the loss
+    for (int i = 3; i <= 10; ++i) {
+        write(i);
+    }
+    EXPECT_TRUE(ring_buffer->isUpdated());
+    for (int expected = 10 - buffer_num + 1; expected <= 10; ++expected) {
+        int buffer_id = ring_buffer->getNextBufferNum();
+        ASSERT_GE(buffer_id, 0);
+        EXPECT_EQ(*slot(buffer_id), expected);
+        EXPECT_TRUE(ring_buffer->consumeBuffer(buffer_id));
+    }
+    EXPECT_EQ(ring_buffer->getOverrunNum(), static_cast<uint64_t>(8 - buffer_num));
+    EXPECT_LT(ring_buffer->getNextBufferNum(), 0);
+}
+
+TEST_F(RingBufferTest, MultiWriterTickets) {
+    constexpr int NUM_WRITERS = 8;
+    constexpr int WRITES_PER_WRITER = 2000;
+    auto slot = [&](int buffer_id) { return reinterpret_cast<int*>(ring_buffer->getBufferPtr(buffer_id)); };
+
+    // Start the reader's cursor before any write so that every message is either read or counted as lost
+    EXPECT_LT(ring_buffer->getNextBufferNum(), 0);
+
+    // Each writer thread uses its own RingBuffer instance, as separate processes would
+    std::vector<std::thread> writers;
+    for (int w = 0; w < NUM_WRITERS; ++w) {
+        writers.emplace_back([&, w]() {
+            RingBuffer writer_ring(shared_memory->getPtr());
+            for (int i = 0; i < WRITES_PER_WRITER; ++i) {
+                int buffer_id = writer_ring.reserveBuffer();
+                ASSERT_GE(buffer_id, 0);
+                *reinterpret_cast<int*>(writer_ring.getBufferPtr(buffer_id)) = w * WRITES_PER_WRITER + i;
+                writer_ring.commitBuffer(buffer_id, getCurrentTimeUSec());
+            }
+        });
+    }
+
+    // Queue reader: per-writer order must be preserved and nothing may be read twice
+    std::vector<int> last_seen(NUM_WRITERS, -1);
+    uint64_t read_num = 0;
+    std::atomic<bool> writers_done(false);
+    std::thread joiner([&]() {
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        writers_done.store(true);
+    });
+    while (true) {
+        bool done = writers_done.load();
+        int buffer_id = ring_buffer->getNextBufferNum();
+        if (buffer_id < 0) {
+            if (done) {
+                break;
+            }
+            continue;
+        }
+        int value = *slot(buffer_id);
+        if (ring_buffer->consumeBuffer(buffer_id)) {
+            int writer = value / WRITES_PER_WRITER;
+            ASSERT_GE(writer, 0);
+            ASSERT_LT(writer, NUM_WRITERS);
+            EXPECT_GT(value % WRITES_PER_WRITER, last_seen[writer]);
+            last_seen[writer] = value % WRITES_PER_WRITER;
+            ++read_num;
+        }
+    }
+    joiner.join();
+
+    // Every ticket was completed: the frontier reached the total number of writes
+    EXPECT_EQ(ring_buffer->getOldestBufferNum(), (NUM_WRITERS * WRITES_PER_WRITER) % buffer_num);
+    EXPECT_EQ(read_num + ring_buffer->getOverrunNum(), static_cast<uint64_t>(NUM_WRITERS * WRITES_PER_WRITER));
+    EXPECT_GE(ring_buffer->getNewestBufferNum(), 0);
+}
+
+TEST_F(RingBufferTest, ClientRegistry) {
+    EXPECT_EQ(ring_buffer->getClientNum(RingBuffer::CLIENT_SUBSCRIBER), 0u);
+    EXPECT_EQ(ring_buffer->getSlowestCursor(), std::numeric_limits<uint64_t>::max());
+
+    RingBuffer reader(shared_memory->getPtr());
+    ASSERT_TRUE(reader.registerClient(RingBuffer::CLIENT_SUBSCRIBER));
+    EXPECT_EQ(ring_buffer->getClientNum(RingBuffer::CLIENT_SUBSCRIBER), 1u);
+    EXPECT_EQ(ring_buffer->getSlowestCursor(), 0u);
+
+    for (int i = 0; i < 2; ++i) {
+        ring_buffer->commitBuffer(ring_buffer->reserveBuffer(), getCurrentTimeUSec());
+    }
+    int buffer_id = reader.getNextBufferNum();
+    ASSERT_GE(buffer_id, 0);
+    EXPECT_TRUE(reader.consumeBuffer(buffer_id));
+    EXPECT_EQ(ring_buffer->getSlowestCursor(), 1u);
+
+    // Only live publishers make an existing ring attachable
+    EXPECT_FALSE(RingBuffer::checkAttachable(shared_memory->getPtr(), element_size, buffer_num));
+    ASSERT_TRUE(ring_buffer->registerClient(RingBuffer::CLIENT_PUBLISHER));
+    EXPECT_TRUE(RingBuffer::checkAttachable(shared_memory->getPtr(), element_size, buffer_num));
+    EXPECT_FALSE(RingBuffer::checkAttachable(shared_memory->getPtr(), element_size * 2, buffer_num));
+
+    reader.unregisterClient();
+    ring_buffer->unregisterClient();
+    EXPECT_EQ(ring_buffer->getClientNum(RingBuffer::CLIENT_SUBSCRIBER), 0u);
+    EXPECT_FALSE(RingBuffer::checkAttachable(shared_memory->getPtr(), element_size, buffer_num));
+}
+
+TEST_F(RingBufferTest, Metrics) {
+    ASSERT_TRUE(ring_buffer->registerClient(RingBuffer::CLIENT_PUBLISHER));
+    RingBuffer reader(shared_memory->getPtr());
+    ASSERT_TRUE(reader.registerClient(RingBuffer::CLIENT_SUBSCRIBER));
+
+    // Reading the same message twice counts as one read
+    for (int i = 0; i < 3; ++i) {
+        ring_buffer->commitBuffer(ring_buffer->reserveBuffer(), getCurrentTimeUSec());
+        ASSERT_GE(reader.getNewestBufferNum(), 0);
+        ASSERT_GE(reader.getNewestBufferNum(), 0);
+    }
+    RingBufferMetrics metrics = reader.getMetrics();
+    EXPECT_EQ(metrics.publish_num, 3u);
+    EXPECT_EQ(metrics.read_num, 3u);
+    EXPECT_EQ(metrics.drop_num, 0u);
+    EXPECT_GT(metrics.last_publish_time_us, 0u);
+    uint64_t histogram_sum = 0;
+    for (uint64_t bucket : metrics.latency_histogram) {
+        histogram_sum += bucket;
+    }
+    EXPECT_EQ(histogram_sum, metrics.read_num);
+
+    // A fully pinned ring drops the message after skipping every slot
+    std::vector<std::unique_ptr<RingBuffer>> pinners;
+    std::vector<int> pinned_buffers;
+    for (int i = 0; i < buffer_num; ++i) {
+        ring_buffer->commitBuffer(ring_buffer->reserveBuffer(), getCurrentTimeUSec());
+        pinners.emplace_back(new RingBuffer(shared_memory->getPtr()));
+        pinned_buffers.push_back(pinners.back()->getNewestBufferNum());
+        ASSERT_TRUE(pinners.back()->pinBuffer(pinned_buffers.back()));
+    }
+    EXPECT_LT(ring_buffer->reserveBuffer(), 0);
+    for (int i = 0; i < buffer_num; ++i) {
+        pinners[i]->unpinBuffer(pinned_buffers[i]);
+    }
+    metrics = ring_buffer->getMetrics();
+    EXPECT_EQ(metrics.publish_num, static_cast<uint64_t>(3 + buffer_num));
+    EXPECT_EQ(metrics.drop_num, 1u);
+    EXPECT_GE(metrics.retry_num, static_cast<uint64_t>(buffer_num));
+
+    // A process that only maps the segment sees the same totals
+    RingBuffer observer(shared_memory->getPtr());
+    RingBufferMetrics observed = observer.getMetrics();
+    EXPECT_EQ(observed.publish_num, metrics.publish_num);
+    EXPECT_EQ(observed.read_num, metrics.read_num);
+    EXPECT_EQ(observed.drop_num, metrics.drop_num);
+
+    reader.unregisterClient();
+    ring_buffer->unregisterClient();
+}
+
 // Integration tests combining SharedMemory and RingBuffer
 TEST(SHMBaseIntegrationTest, MultipleRingBuffers) {
     const std::string shm_name = "/test_multiple_rings";
@@ -444,11 +863,11 @@ TEST(SHMBaseIntegrationTest, MultipleRingBuffers) {
     EXPECT_TRUE(ring2.allocateBuffer(buffer_id2));
     
     // Write different data to each ring buffer
-    int* data1 = reinterpret_cast<int*>(ring1.getDataList());
-    double* data2 = reinterpret_cast<double*>(ring2.getDataList());
+    int* data1 = reinterpret_cast<int*>(ring1.getBufferPtr(buffer_id1));
+    double* data2 = reinterpret_cast<double*>(ring2.getBufferPtr(buffer_id2));
     
-    data1[buffer_id1] = 42;
-    data2[buffer_id2] = 3.14159;
+    *data1 = 42;
+    *data2 = 3.14159;
     
     // Set timestamps
     uint64_t timestamp = 1000000;
@@ -456,8 +875,8 @@ TEST(SHMBaseIntegrationTest, MultipleRingBuffers) {
     ring2.setTimestamp_us(timestamp + 1000, buffer_id2);
     
     // Verify data integrity
-    EXPECT_EQ(data1[buffer_id1], 42);
-    EXPECT_DOUBLE_EQ(data2[buffer_id2], 3.14159);
+    EXPECT_EQ(*data1, 42);
+    EXPECT_DOUBLE_EQ(*data2, 3.14159);
 
     // Clean up: disconnect() only unmaps memory, then explicitly unlink
     shm.disconnect();
@@ -484,6 +903,326 @@ TEST(SHMBaseIntegrationTest, UtilityFunctions) {
     // This might fail, which is expected behavior
 }
 
+TEST(SHMBaseCodecTest, FlatCodecRoundTrip) {
+    static_assert(is_serialized_message<CodecMessage>::value, "Reflected types must use their codec");
+    static_assert(!is_serialized_message<int>::value, "Standard-layout types must be copied as they are");
+    static_assert(is_transferable_message<CodecMessage>(), "Reflected types must be transferable");
+
+    CodecMessage message;
+    message.id     = 7;
+    message.name   = "arm";
+    message.tags   = { "left", "", "gripper" };
+    message.values = { 1.5, -2.0, 3.25 };
+    message.ends   = { { { 0.5, "start" }, { 1.0, "goal" } } };
+    message.points = { { 2.0, "via" } };
+
+    size_t size = MessageCodec<CodecMessage>::getSize(message);
+    std::vector<unsigned char> buffer(size);
+    EXPECT_EQ(MessageCodec<CodecMessage>::serialize(message, buffer.data()), size);
+
+    // The destination is reused, so stale contents must be replaced
+    CodecMessage result;
+    result.tags   = { "stale", "stale", "stale", "stale" };
+    result.points = { { 9.0, "stale" }, { 9.0, "stale" } };
+    ASSERT_TRUE(MessageCodec<CodecMessage>::deserialize(buffer.data(), size, &result));
+    EXPECT_EQ(result.id, 7);
+    EXPECT_EQ(result.name, "arm");
+    EXPECT_EQ(result.tags, message.tags);
+    EXPECT_EQ(result.values, message.values);
+    EXPECT_EQ(result.ends[1].label, "goal");
+    ASSERT_EQ(result.points.size(), 1u);
+    EXPECT_EQ(result.points[0].label, "via");
+
+    // Truncated or corrupted input is rejected instead of read past its end
+    EXPECT_FALSE(MessageCodec<CodecMessage>::deserialize(buffer.data(), size - 1, &result));
+    std::vector<unsigned char> corrupted = buffer;
+    std::memset(corrupted.data() + sizeof(int), 0xff, sizeof(uint32_t));
+    EXPECT_FALSE(MessageCodec<CodecMessage>::deserialize(corrupted.data(), size, &result));
+
+    // Fixed-capacity storage used by services and actions
+    MessageStorage<CodecMessage>::type storage;
+    ASSERT_TRUE(MessageStorage<CodecMessage>::store(&storage, message));
+    CodecMessage loaded;
+    ASSERT_TRUE(MessageStorage<CodecMessage>::load(storage, &loaded));
+    EXPECT_EQ(loaded.tags, message.tags);
+    MessageStorage<CodecMessage>::invalidate(&storage);
+    EXPECT_FALSE(MessageStorage<CodecMessage>::load(storage, &loaded));
+}
+
+// Standard-layout messages whose fingerprints include their fields
+struct LayoutPose
+{
+    double x;
+    double y;
+};
+SHM_LAYOUT(LayoutPose, x, y)
+
+struct LayoutVelocity
+{
+    double x;
+    double theta;
+};
+SHM_LAYOUT(LayoutVelocity, x, theta)
+
+TEST(SHMBaseCodecTest, TypeFingerprint) {
+    static_assert(getTypeFingerprint<int>() != getTypeFingerprint<float>(), "Same size, different kind");
+    static_assert(getTypeFingerprint<int>() != getTypeFingerprint<unsigned int>(), "Signedness is part of the type");
+    static_assert(getTypeFingerprint<int[3]>() != getTypeFingerprint<int[4]>(), "Extent is part of the type");
+    static_assert(getTypeFingerprint<std::array<double, 2>>() == getTypeFingerprint<double[2]>(),
+                  "std::array has the layout of a built-in array");
+    static_assert(getTypeFingerprint<LayoutPose>() != getTypeFingerprint<LayoutVelocity>(),
+                  "Field names are part of the layout");
+    static_assert(getTypeFingerprint<CodecMessage>() != getTypeFingerprint<CodecPoint>(),
+                  "Reflected types are fingerprinted by their fields");
+    static_assert(getTopicTypeHash<unsigned char>() == 0, "Byte topics are untyped");
+    static_assert(checkTypeHash(0, getTopicTypeHash<int>()) && !checkTypeHash(1, 2), "0 matches any type");
+
+    // The fingerprint given at creation is kept in the header for later attaches
+    irlab::shm::disconnectMemory("test_type_hash");
+    {
+        SharedMemoryPosix shared_memory("test_type_hash", O_RDWR | O_CREAT, DEFAULT_PERM);
+        ASSERT_TRUE(shared_memory.connect(RingBuffer::getSize(sizeof(LayoutPose), 3)));
+        RingBuffer writer(shared_memory.getPtr(), sizeof(LayoutPose), 3, getTopicTypeHash<LayoutPose>());
+        RingBuffer reader(shared_memory.getPtr());
+        EXPECT_EQ(reader.getTypeHash(), getTopicTypeHash<LayoutPose>());
+    }
+    irlab::shm::disconnectMemory("test_type_hash");
+}
+
+TEST(SHMBaseRegistryTest, RegisterAndLookup) {
+    std::string registry_name = "test_topic_registry";
+    irlab::shm::disconnectMemory(registry_name);
+    {
+        TopicRegistry registry(registry_name);
+        TopicRegistry other(registry_name);
+        TopicInfo     info;
+        EXPECT_FALSE(registry.lookup("/pose", &info));
+
+        info.name         = "/pose";
+        info.type_hash    = 11;
+        info.element_size = 16;
+        info.buffer_num   = 3;
+        info.pid          = getpid();
+        ASSERT_TRUE(registry.registerTopic(info));
+
+        // Visible to other mappings, and "pose" names the same segment as "/pose"
+        TopicInfo found;
+        ASSERT_TRUE(other.lookup("pose", &found));
+        EXPECT_EQ(found.name, "pose");
+        EXPECT_EQ(found.type_hash, 11u);
+        EXPECT_EQ(found.element_size, 16u);
+
+        // Re-registering updates the entry instead of adding one
+        info.element_size = 64;
+        ASSERT_TRUE(other.registerTopic(info));
+        ASSERT_TRUE(registry.lookup("/pose", &found));
+        EXPECT_EQ(found.element_size, 64u);
+
+        // Fill the table; names colliding in the hash probe to the next entry
+        for (size_t i = 1; i < TopicRegistry::ENTRY_NUM; i++)
+        {
+            info.name      = "/topic_" + std::to_string(i);
+            info.type_hash = i;
+            ASSERT_TRUE(registry.registerTopic(info));
+        }
+        info.name = "/overflow";
+        EXPECT_FALSE(registry.registerTopic(info));
+        EXPECT_EQ(registry.getTopicList().size(), TopicRegistry::ENTRY_NUM);
+        ASSERT_TRUE(other.lookup("/topic_200", &found));
+        EXPECT_EQ(found.type_hash, 200u);
+
+        info.name = std::string(200, 'x');
+        EXPECT_THROW(registry.registerTopic(info), std::runtime_error);
+    }
+    irlab::shm::disconnectMemory(registry_name);
+}
+
+TEST(SHMBaseConnectionTest, AttachAndGeneration) {
+    std::string name = "test_topic_connection";
+    irlab::shm::disconnectMemory(name);
+    {
+        TopicConnection connection(name);
+        EXPECT_FALSE(connection.poll());
+        EXPECT_EQ(connection.getMapNum(), 0u);
+        auto start = std::chrono::steady_clock::now();
+        EXPECT_FALSE(connection.waitForAttach(20000));
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+
+        // waitForAttach() wakes on the creation of the segment
+        SharedMemoryPosix           creator(name, O_RDWR | O_CREAT, DEFAULT_PERM);
+        std::unique_ptr<RingBuffer> ring;
+        std::thread create_thread([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            creator.connect(RingBuffer::getSize(8, 4));
+            ring = std::make_unique<RingBuffer>(creator.getPtr(), 8, 4);
+        });
+        EXPECT_TRUE(connection.waitForAttach(2000000));
+        create_thread.join();
+        EXPECT_TRUE(connection.poll());
+        EXPECT_EQ(connection.getAttachNum(), 1u);
+        EXPECT_EQ(connection.getMapNum(), 1u);
+
+        // A restart in place is a new attach on the same mapping
+        uint32_t generation = RingBuffer::getGeneration(creator.getPtr());
+        ring = std::make_unique<RingBuffer>(creator.getPtr(), 8, 4);
+        EXPECT_EQ(RingBuffer::getGeneration(creator.getPtr()), generation + 1);
+        EXPECT_TRUE(connection.poll());
+        EXPECT_EQ(connection.getAttachNum(), 2u);
+        EXPECT_EQ(connection.getMapNum(), 1u);
+
+        // A ring that no longer fits the mapping is re-mapped
+        SharedMemoryPosix grower(name, O_RDWR | O_CREAT, DEFAULT_PERM);
+        grower.connect(RingBuffer::getSize(4096, 8));
+        ring = std::make_unique<RingBuffer>(grower.getPtr(), 4096, 8);
+        EXPECT_TRUE(connection.poll());
+        EXPECT_EQ(connection.getAttachNum(), 3u);
+        EXPECT_EQ(connection.getMapNum(), 2u);
+        EXPECT_EQ(RingBuffer(connection.getPtr()).getElementSize(), 4096u);
+
+        // An unlinked and recreated segment is re-mapped
+        ring.reset();
+        irlab::shm::disconnectMemory(name);
+        SharedMemoryPosix recreator(name, O_RDWR | O_CREAT, DEFAULT_PERM);
+        recreator.connect(RingBuffer::getSize(8, 4));
+        ring = std::make_unique<RingBuffer>(recreator.getPtr(), 8, 4);
+        EXPECT_TRUE(connection.poll());
+        EXPECT_EQ(connection.getAttachNum(), 4u);
+        EXPECT_EQ(connection.getMapNum(), 3u);
+        EXPECT_TRUE(connection.poll());
+        EXPECT_EQ(connection.getAttachNum(), 4u);
+    }
+    irlab::shm::disconnectMemory(name);
+}
+
+TEST(SHMBaseClockTest, SimulatedClock) {
+    std::string clock_name = "test_simulated_clock";
+    irlab::shm::disconnectMemory(clock_name);
+    {
+        SimulatedClock driver(clock_name);
+        driver.setTime_us(1000);
+        EXPECT_FALSE(isSimulatedClock());
+        EXPECT_NE(getClockTimeUSec(), 1000u);
+
+        // Every mapping of the clock follows the driver
+        useSimulatedClock(clock_name);
+        EXPECT_TRUE(isSimulatedClock());
+        EXPECT_EQ(getClockTimeUSec(), 1000u);
+        driver.advance_us(500);
+        EXPECT_EQ(getClockTimeUSec(), 1500u);
+        EXPECT_EQ(SimulatedClock(clock_name).getTime_us(), 1500u);
+
+        // Expiry is measured in simulated time, however fast it runs
+        SharedMemoryPosix shm("test_simulated_clock_ring", O_RDWR | O_CREAT, DEFAULT_PERM);
+        shm.connect(RingBuffer::getSize(sizeof(int), 2));
+        RingBuffer ring(shm.getPtr(), sizeof(int), 2);
+        ring.setDataExpiryTime_us(1000);
+        int buffer = ring.reserveBuffer();
+        ring.commitBuffer(buffer, getClockTimeUSec());
+        EXPECT_EQ(ring.getNewestBufferNum(), buffer);
+        driver.advance_us(2000);
+        EXPECT_EQ(ring.getNewestBufferNum(), -1);
+
+        useSystemClock();
+        EXPECT_FALSE(isSimulatedClock());
+        shm.disconnect();
+        irlab::shm::disconnectMemory("test_simulated_clock_ring");
+    }
+    irlab::shm::disconnectMemory(clock_name);
+}
+
+TEST(SHMBaseTraceTest, TraceRing) {
+    std::string trace_name = "test_trace_ring";
+    irlab::shm::disconnectMemory(trace_name);
+    {
+        TraceBuffer trace(trace_name, 4);
+        for (uint64_t i = 1; i <= 6; i++)
+        {
+            trace.record(i % 2 ? TRACE_PUBLISH_BEGIN : TRACE_PUBLISH_COMMIT,
+                         "/a_topic_name_longer_than_one_trace_slot", i, 100 + i);
+        }
+
+        // The ring keeps the newest records in order after wrapping around
+        std::vector<TraceRecord> record_list = trace.read();
+        ASSERT_EQ(record_list.size(), 4u);
+        for (size_t i = 0; i < record_list.size(); i++)
+        {
+            EXPECT_EQ(record_list[i].sequence, i + 3);
+            EXPECT_EQ(record_list[i].time_us, i + 103);
+            EXPECT_EQ(record_list[i].pid, getpid());
+        }
+        EXPECT_EQ(record_list[0].event, TRACE_PUBLISH_BEGIN);
+        EXPECT_EQ(record_list[0].name, std::string("/a_topic_name_longer_than_one_trace_slot").substr(0, 31));
+
+        // Another mapping reads the same records, as shm_tool does
+        SharedMemoryPosix shm(trace_name, O_RDWR, static_cast<PERM>(0));
+        ASSERT_TRUE(shm.connect(0));
+        std::vector<TraceRecord> mapped_list;
+        EXPECT_TRUE(TraceBuffer::readRecords(shm.getPtr(), shm.getSize(), &mapped_list));
+        EXPECT_EQ(mapped_list.size(), 4u);
+        shm.disconnect();
+
+        std::ostringstream json;
+        writeChromeTrace(json, record_list);
+        EXPECT_NE(json.str().find("\"traceEvents\""), std::string::npos);
+        EXPECT_NE(json.str().find("\"ph\":\"B\",\"ts\":103"), std::string::npos);
+        EXPECT_NE(json.str().find("\"ph\":\"E\",\"ts\":104"), std::string::npos);
+        EXPECT_NE(json.str().find("\"args\":{\"sequence\":6}"), std::string::npos);
+    }
+    irlab::shm::disconnectMemory(trace_name);
+
+    std::vector<unsigned char> not_trace(TraceBuffer::getSize(1), 0);
+    std::vector<TraceRecord>   record_list;
+    EXPECT_FALSE(TraceBuffer::readRecords(not_trace.data(), not_trace.size(), &record_list));
+
+    // Every segment kind carries its own tag, so a topic registry is never taken for a trace ring
+    EXPECT_NE(TraceBuffer::LAYOUT_VERSION, TopicRegistry::LAYOUT_VERSION);
+    EXPECT_NE(TraceBuffer::LAYOUT_VERSION, SimulatedClock::LAYOUT_VERSION);
+    EXPECT_NE(TraceBuffer::LAYOUT_VERSION, RingBuffer::LAYOUT_VERSION);
+    std::string registry_name = "test_trace_registry";
+    irlab::shm::disconnectMemory(registry_name);
+    {
+        TopicRegistry     registry(registry_name);
+        SharedMemoryPosix shm(registry_name, O_RDWR, static_cast<PERM>(0));
+        ASSERT_TRUE(shm.connect(0));
+        EXPECT_FALSE(TraceBuffer::readRecords(shm.getPtr(), shm.getSize(), &record_list));
+        EXPECT_THROW(TraceBuffer(registry_name, 4), std::runtime_error);
+        shm.disconnect();
+    }
+    irlab::shm::disconnectMemory(registry_name);
+}
+
+TEST(SHMBaseThreadTest, ApplyThreadAttributes) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed))
+    {
+        cpu++;
+    }
+
+    // Applied from inside a thread so that the test process keeps its own affinity
+    std::thread thread([cpu]() {
+        ThreadAttributes attributes;
+        attributes.cpu_list = { cpu };
+        EXPECT_NO_THROW(applyThreadAttributes(attributes));
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        ASSERT_EQ(pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set), 0);
+        EXPECT_EQ(CPU_COUNT(&cpu_set), 1);
+        EXPECT_TRUE(CPU_ISSET(cpu, &cpu_set));
+        EXPECT_EQ(sched_getcpu(), cpu);
+
+        attributes.cpu_list = { -1 };
+        EXPECT_THROW(applyThreadAttributes(attributes), std::runtime_error);
+        attributes.cpu_list.clear();
+        attributes.sched_policy   = SCHED_RR;
+        attributes.sched_priority = 0;
+        EXPECT_THROW(applyThreadAttributes(attributes), std::runtime_error);
+    });
+    thread.join();
+}
+
 // Performance tests (optional, can be disabled for regular testing)
 TEST(SHMBasePerformanceTest, RingBufferThroughput) {
     const std::string shm_name = "/test_performance";
@@ -504,8 +1243,8 @@ TEST(SHMBasePerformanceTest, RingBufferThroughput) {
     for (int i = 0; i < num_operations; ++i) {
         int buffer_id = ring_buffer.getOldestBufferNum();
         if (ring_buffer.allocateBuffer(buffer_id)) {
-            int* data_ptr = reinterpret_cast<int*>(ring_buffer.getDataList());
-            data_ptr[buffer_id] = i;
+            int* data_ptr = reinterpret_cast<int*>(ring_buffer.getBufferPtr(buffer_id));
+            *data_ptr = i;
             
             auto timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(
                 std::chrono::steady_clock::now().time_since_epoch()).count();
@@ -0,0 +1,253 @@
+//!
+//! @file shm_bridge.hpp
+//! @brief トピックを別のホストの共有メモリへ中継するための送信・受信クラスの定義
+//! @note 記法はROSに準拠する
+//!       http://wiki.ros.org/ja/CppStyleGuide
+//!
+
+#ifndef __SHM_BRIDGE_LIB_H__
+#define __SHM_BRIDGE_LIB_H__
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "shm_base.hpp"
+#include "shm_pub_sub.hpp"
+#include "shm_pub_sub_vector.hpp"
+
+namespace irlab
+{
+
+namespace shm
+{
+
+//! @enum BRIDGE_TRANSPORT
+//! @brief 中継に使うトランスポート
+enum BRIDGE_TRANSPORT
+{
+  BRIDGE_UDP,
+  BRIDGE_TCP,
+};
+
+//! UDPで一つのデータグラムに載せられる大きさ[byte]の上限
+constexpr size_t BRIDGE_MAX_DATAGRAM_SIZE = 65507;
+//! ジャンボフレーム(MTU 9000)からIPv4とUDPのヘッダを除いた大きさ[byte]
+constexpr size_t BRIDGE_JUMBO_FRAME_SIZE = 8972;
+
+// ****************************************************************************
+//! @struct BridgeOptions
+//! @brief 中継の設定
+//! @details 送信側と受信側で transport を揃えること．
+// ****************************************************************************
+struct BridgeOptions
+{
+  BRIDGE_TRANSPORT transport = BRIDGE_UDP;
+  //! 一つのフレームの大きさ[byte]の上限．小さなトピックはまとめて一つのフレームに詰め、大きなトピックは分割する
+  size_t max_frame_size = BRIDGE_JUMBO_FRAME_SIZE;
+  //! sendmmsg/recvmmsg の一回の呼び出しで送受信するフレーム数
+  size_t batch_num = 32;
+  //! 真の場合は最新のトピックのみを送信し、前回送信したものから更新されていなければ送信しない
+  bool latest_only = false;
+  //! 受信側でマルチキャストグループに参加する場合のグループのアドレス(空の場合は参加しない)
+  std::string multicast_group;
+  //! マルチキャストの送受信に使うインターフェースのアドレス(空の場合は既定のインターフェース)
+  std::string multicast_interface;
+  //! 送信側のマルチキャストのTTL
+  int multicast_ttl = 1;
+  //! 受信側で出版し直すトピック名の前に付ける名前．同じホストで折り返す場合の名前の衝突を避ける
+  std::string topic_prefix;
+  //! ソケットの送受信バッファの大きさ[byte]
+  int socket_buffer_size = 4 * 1024 * 1024;
+  //! 受信側で受け付けるスロットの大きさ[byte]の上限．これを超えるレコードは確保も組み立てもせずに捨てる
+  size_t max_message_size = 64 * 1024 * 1024;
+  //! 受信側で受け付けるバッファ数の上限．これを超えるレコードは捨てる
+  size_t max_buffer_num = 1024;
+};
+
+// ****************************************************************************
+//! @struct BridgeFrameHeader
+//! @brief 一つのフレームの先頭に置くヘッダ
+//! @details フレームはヘッダの後に BridgeRecordHeader とトピック名、トピックのバイト列を8バイト境界に揃えて並べる．
+//! 数値は送信したホストのバイト順で書き込む．
+// ****************************************************************************
+struct BridgeFrameHeader
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_num;
+  uint32_t frame_size;
+  uint32_t reserved;
+  //! 送信側のインスタンスごとの識別子．送信側が再起動した場合に受信側がシーケンス番号を初期化する
+  uint64_t session_id;
+  uint64_t frame_sequence;
+};
+
+// ****************************************************************************
+//! @struct BridgeRecordHeader
+//! @brief フレーム内の一つのトピック(またはその断片)のヘッダ
+// ****************************************************************************
+struct BridgeRecordHeader
+{
+  //! トピックごとに単調増加するシーケンス番号
+  uint64_t sequence;
+  uint32_t total_size;
+  uint32_t offset;
+  uint32_t fragment_size;
+  //! 送信側のリングバッファのスロットの大きさ[byte]とバッファ数．受信側は同じ大きさで出版する
+  uint32_t element_size;
+  uint32_t buffer_num;
+  uint16_t name_size;
+  uint16_t reserved;
+};
+
+// ****************************************************************************
+//! @class BridgeSender
+//! @brief 複数のトピックをキューモードの購読者として読み込み、UDPまたはTCPで受信側へ送信するクラス
+//! @details トピックの型を知らずに、リングバッファのスロットのバイト列をそのままフレームに詰める．
+//! 一回の forwardOnce() で届いたトピックをまとめてフレームに詰め、UDPでは sendmmsg() で一度に送信する．
+//! リングバッファが一周する前に読み込めなかったトピックは失われ、getLostNum() に数えられる．
+//! 宛先がマルチキャストアドレスの場合はマルチキャストで送信する．
+// ****************************************************************************
+class BridgeSender
+{
+public:
+  BridgeSender(const std::vector<std::string> &topic_name_list, const std::string &address, uint16_t port,
+               const BridgeOptions &options = BridgeOptions());
+  ~BridgeSender();
+
+  BridgeSender(const BridgeSender &)            = delete;
+  BridgeSender &operator=(const BridgeSender &) = delete;
+
+  size_t   forwardOnce(uint64_t timeout_usec);
+  uint64_t getForwardedNum() const;
+  uint64_t getFrameNum() const;
+  uint64_t getLostNum() const;
+
+private:
+  struct Topic
+  {
+    std::string                        name;
+    std::unique_ptr<SharedMemoryPosix> shared_memory;
+    std::unique_ptr<RingBuffer>        ring_buffer;
+    int                                buffer_num = 0;
+    //! 作り直されたリングバッファでもシーケンス番号が戻らないよう、接続し直す際に加える値
+    uint64_t sequence_base = 0;
+    uint64_t last_sequence = 0;
+  };
+
+  struct Frame
+  {
+    std::vector<unsigned char> data;
+    size_t                     size       = 0;
+    uint16_t                   record_num = 0;
+  };
+
+  //! 一つのトピックを詰め始める前のフレームの位置．コピー中に上書きされた場合に巻き戻す
+  struct FramePosition
+  {
+    size_t   frame_index;
+    size_t   size;
+    uint16_t record_num;
+  };
+
+  bool          connectTopic(Topic &topic);
+  size_t        drainTopic(Topic &topic);
+  FramePosition getFramePosition() const;
+  void          rewindFrame(const FramePosition &position);
+  void          appendRecord(const Topic &topic, uint64_t sequence, const unsigned char *data, size_t size);
+  void          openFrame();
+  void          flushFrames();
+  bool          connectSocket();
+  void          closeSocket();
+
+  BridgeOptions                       bridge_options;
+  std::string                         peer_address;
+  uint16_t                            peer_port;
+  int                                 socket_fd;
+  uint64_t                            session_id;
+  std::vector<std::unique_ptr<Topic>> topic_list;
+  WaitSet                             wait_set;
+  std::vector<Frame>                  frame_list;
+  size_t                              frame_num;
+  std::vector<mmsghdr>                message_list;
+  std::vector<iovec>                  iovec_list;
+  uint64_t                            frame_sequence;
+  uint64_t                            forwarded_num;
+  uint64_t                            sent_frame_num;
+  uint64_t                            lost_num;
+};
+
+// ****************************************************************************
+//! @class BridgeReceiver
+//! @brief BridgeSender から受信したトピックをローカルの共有メモリへ出版し直すクラス
+//! @details 各トピックは Publisher<std::vector<unsigned char>> で送信側と同じスロットの大きさに確保して出版するため、
+//! 固定長のトピックは Subscriber<T>、可変長のトピックは Subscriber<std::vector<T>> でそのまま読み込める．
+//! 重複したもの、順序が前後して古くなったもの、断片が欠けたもの、壊れたフレームは出版せずに getDroppedNum() に数える．
+//! 受信するソケットは認証しないため、大きさやバッファ数が BridgeOptions の上限を超えるトピックも同様に捨てる．
+//! TCPの場合は複数の送信側からの接続を受け付ける．
+// ****************************************************************************
+class BridgeReceiver
+{
+public:
+  explicit BridgeReceiver(uint16_t port, const BridgeOptions &options = BridgeOptions());
+  ~BridgeReceiver();
+
+  BridgeReceiver(const BridgeReceiver &)            = delete;
+  BridgeReceiver &operator=(const BridgeReceiver &) = delete;
+
+  size_t   receiveOnce(uint64_t timeout_usec);
+  uint64_t getReceivedNum() const;
+  uint64_t getDroppedNum() const;
+
+private:
+  using TopicPublisher = Publisher<std::vector<unsigned char>>;
+
+  struct Topic
+  {
+    std::unique_ptr<TopicPublisher> publisher;
+    size_t                          element_size  = 0;
+    uint64_t                        session_id    = 0;
+    uint64_t                        last_sequence = 0;
+    //! 分割されたトピックの組み立て中のバイト列
+    std::vector<unsigned char> assembly;
+    uint64_t                   assembly_sequence = 0;
+  };
+
+  struct Connection
+  {
+    int                        fd;
+    std::vector<unsigned char> stream;
+    size_t                     stream_size;
+  };
+
+  size_t receiveDatagrams();
+  size_t receiveStream(Connection &connection, bool *is_closed);
+  void   acceptConnection();
+  size_t parseFrame(const unsigned char *data, size_t size, bool *is_valid);
+  size_t handleRecord(uint64_t session_id, const BridgeRecordHeader &record, const std::string &name,
+                      const unsigned char *payload);
+  void   publishTopic(Topic &topic, const std::string &name, const BridgeRecordHeader &record,
+                      const unsigned char *data);
+
+  BridgeOptions                                 bridge_options;
+  int                                           socket_fd;
+  std::vector<Connection>                       connection_list;
+  std::vector<std::vector<unsigned char>>       datagram_list;
+  std::vector<mmsghdr>                          message_list;
+  std::vector<iovec>                            iovec_list;
+  std::string                                   record_name;
+  std::map<std::string, std::unique_ptr<Topic>> topic_map;
+  uint64_t                                      received_num;
+  uint64_t                                      dropped_num;
+};
+
+}  // namespace shm
+
+}  // namespace irlab
+
+#endif /* __SHM_BRIDGE_LIB_H__ */
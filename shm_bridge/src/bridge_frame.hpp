@@ -0,0 +1,49 @@
+//!
+//! @file bridge_frame.hpp
+//! @brief 送信側と受信側で共有するフレームの書式の定数
+//!
+
+#ifndef __SHM_BRIDGE_FRAME_H__
+#define __SHM_BRIDGE_FRAME_H__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "shm_bridge.hpp"
+
+namespace irlab
+{
+
+namespace shm
+{
+
+//! フレームの先頭の識別子("SHMB")
+constexpr uint32_t BRIDGE_FRAME_MAGIC = 0x424d4853;
+//! フレームの書式の版
+constexpr uint16_t BRIDGE_FRAME_VERSION = 1;
+//! フレーム内の各レコードの境界[byte]
+constexpr size_t BRIDGE_ALIGNMENT = 8;
+
+//! @brief レコードの大きさを境界に揃える
+//! @param [in] size 大きさ[byte]
+//! @return size_t BRIDGE_ALIGNMENT の倍数に切り上げた大きさ[byte]
+inline size_t
+alignFrameSize(size_t size)
+{
+  return (size + BRIDGE_ALIGNMENT - 1) & ~(BRIDGE_ALIGNMENT - 1);
+}
+
+//! @brief トピック名を含むレコードのヘッダの大きさ
+//! @param [in] name_size トピック名の長さ[byte]
+//! @return size_t 境界に揃えたヘッダの大きさ[byte]
+inline size_t
+getRecordHeaderSize(size_t name_size)
+{
+  return alignFrameSize(sizeof(BridgeRecordHeader) + name_size);
+}
+
+}  // namespace shm
+
+}  // namespace irlab
+
+#endif /* __SHM_BRIDGE_FRAME_H__ */
@@ -0,0 +1,451 @@
+#include <shm_bridge.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+#include "bridge_frame.hpp"
+
+namespace irlab
+{
+
+namespace shm
+{
+
+//! @brief コンストラクタ
+//! @param [in] port 待ち受けるポート番号
+//! @param [in] options 中継の設定
+//! @return なし
+//! @details 出版者は各トピックを最初に受信した時点で作る．
+BridgeReceiver::BridgeReceiver(uint16_t port, const BridgeOptions &options)
+  : bridge_options(options)
+  , socket_fd(-1)
+  , received_num(0)
+  , dropped_num(0)
+{
+  if (bridge_options.batch_num == 0)
+  {
+    throw std::runtime_error("shm::BridgeReceiver: The number of frames per batch must be positive!");
+  }
+  if (bridge_options.max_buffer_num == 0 ||
+      bridge_options.max_buffer_num > static_cast<size_t>(std::numeric_limits<int>::max()))
+  {
+    throw std::runtime_error("shm::BridgeReceiver: The maximum number of buffers is out of range!");
+  }
+
+  int type  = (bridge_options.transport == BRIDGE_UDP) ? SOCK_DGRAM : SOCK_STREAM;
+  socket_fd = socket(AF_INET, type | SOCK_CLOEXEC, 0);
+  if (socket_fd < 0)
+  {
+    throw std::runtime_error("shm::BridgeReceiver: Cannot open a socket!");
+  }
+  int flag = 1;
+  setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+  setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &bridge_options.socket_buffer_size, sizeof(int));
+
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family      = AF_INET;
+  address.sin_port        = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(socket_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+  {
+    close(socket_fd);
+    throw std::runtime_error("shm::BridgeReceiver: Cannot bind the port!");
+  }
+
+  if (type == SOCK_STREAM)
+  {
+    if (listen(socket_fd, SOMAXCONN) < 0)
+    {
+      close(socket_fd);
+      throw std::runtime_error("shm::BridgeReceiver: Cannot listen on the port!");
+    }
+    return;
+  }
+
+  if (!bridge_options.multicast_group.empty())
+  {
+    ip_mreq request;
+    request.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (inet_pton(AF_INET, bridge_options.multicast_group.c_str(), &request.imr_multiaddr) != 1 ||
+        (!bridge_options.multicast_interface.empty() &&
+         inet_pton(AF_INET, bridge_options.multicast_interface.c_str(), &request.imr_interface) != 1) ||
+        setsockopt(socket_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) < 0)
+    {
+      close(socket_fd);
+      throw std::runtime_error("shm::BridgeReceiver: Cannot join the multicast group!");
+    }
+  }
+
+  // Sized for the largest datagram so that the sender alone chooses the frame size
+  datagram_list.resize(bridge_options.batch_num, std::vector<unsigned char>(BRIDGE_MAX_DATAGRAM_SIZE));
+  message_list.resize(bridge_options.batch_num);
+  iovec_list.resize(bridge_options.batch_num);
+}
+
+BridgeReceiver::~BridgeReceiver()
+{
+  for (Connection &connection : connection_list)
+  {
+    close(connection.fd);
+  }
+  close(socket_fd);
+}
+
+//! @brief 届いたフレームの受信
+//! @param [in] timeout_usec いずれかのフレームが届くまで待つ最長の時間[usec]
+//! @return size_t 出版し直したトピック数
+//! @details 届いているフレームは待たずに全て受信する．
+size_t
+BridgeReceiver::receiveOnce(uint64_t timeout_usec)
+{
+  std::vector<pollfd> poll_list(connection_list.size() + 1);
+  poll_list[0].fd     = socket_fd;
+  poll_list[0].events = POLLIN;
+  for (size_t i = 0; i < connection_list.size(); i++)
+  {
+    poll_list[i + 1].fd     = connection_list[i].fd;
+    poll_list[i + 1].events = POLLIN;
+  }
+
+  timespec timeout;
+  timeout.tv_sec  = static_cast<time_t>(timeout_usec / 1000000);
+  timeout.tv_nsec = static_cast<long>((timeout_usec % 1000000) * 1000);
+  if (ppoll(poll_list.data(), poll_list.size(), &timeout, nullptr) <= 0)
+  {
+    return 0;
+  }
+
+  size_t receive_num = 0;
+  // Connections accepted below are polled from the next call on
+  size_t connection_num = connection_list.size();
+  if (poll_list[0].revents & POLLIN)
+  {
+    if (bridge_options.transport == BRIDGE_UDP)
+    {
+      receive_num += receiveDatagrams();
+    }
+    else
+    {
+      acceptConnection();
+    }
+  }
+
+  std::vector<bool> is_closed_list(connection_num, false);
+  for (size_t i = 0; i < connection_num; i++)
+  {
+    if (poll_list[i + 1].revents != 0)
+    {
+      bool is_closed = false;
+      receive_num += receiveStream(connection_list[i], &is_closed);
+      is_closed_list[i] = is_closed;
+    }
+  }
+  for (size_t i = connection_num; i > 0; i--)
+  {
+    if (is_closed_list[i - 1])
+    {
+      close(connection_list[i - 1].fd);
+      connection_list.erase(connection_list.begin() + static_cast<std::ptrdiff_t>(i - 1));
+    }
+  }
+
+  received_num += receive_num;
+  return receive_num;
+}
+
+//! @brief 出版し直したトピック数の取得
+//! @param なし
+//! @return uint64_t 出版し直したトピック数
+uint64_t
+BridgeReceiver::getReceivedNum() const
+{
+  return received_num;
+}
+
+//! @brief 出版しなかったトピック数の取得
+//! @param なし
+//! @return uint64_t 重複、順序の逆転、断片の欠落により捨てたトピックと、壊れたフレームの数
+uint64_t
+BridgeReceiver::getDroppedNum() const
+{
+  return dropped_num;
+}
+
+//! @brief 届いているデータグラムをまとめて受信する
+//! @param なし
+//! @return size_t 出版し直したトピック数
+//! @details recvmmsg() で batch_num 個ずつ、受信待ちのデータグラムが無くなるまで受信する．
+size_t
+BridgeReceiver::receiveDatagrams()
+{
+  size_t receive_num = 0;
+  while (true)
+  {
+    for (size_t i = 0; i < bridge_options.batch_num; i++)
+    {
+      iovec_list[i].iov_base = datagram_list[i].data();
+      iovec_list[i].iov_len  = datagram_list[i].size();
+      std::memset(&message_list[i], 0, sizeof(mmsghdr));
+      message_list[i].msg_hdr.msg_iov    = &iovec_list[i];
+      message_list[i].msg_hdr.msg_iovlen = 1;
+    }
+    int result = recvmmsg(socket_fd, message_list.data(), static_cast<unsigned int>(bridge_options.batch_num),
+                          MSG_DONTWAIT, nullptr);
+    if (result <= 0)
+    {
+      break;
+    }
+    for (int i = 0; i < result; i++)
+    {
+      bool is_valid = false;
+      if (!(message_list[i].msg_hdr.msg_flags & MSG_TRUNC))
+      {
+        receive_num += parseFrame(datagram_list[i].data(), message_list[i].msg_len, &is_valid);
+      }
+      if (!is_valid)
+      {
+        dropped_num++;
+      }
+    }
+    if (static_cast<size_t>(result) < bridge_options.batch_num)
+    {
+      break;
+    }
+  }
+  return receive_num;
+}
+
+//! @brief 接続から届いているバイト列を受信する
+//! @param [in,out] connection 接続
+//! @param [out] is_closed 接続が切れた、または壊れたフレームを受信した場合は真
+//! @return size_t 出版し直したトピック数
+//! @details 揃ったフレームのみを処理し、途中までのフレームは次回の受信まで保持する．
+size_t
+BridgeReceiver::receiveStream(Connection &connection, bool *is_closed)
+{
+  size_t receive_num = 0;
+  while (true)
+  {
+    ssize_t read_size = recv(connection.fd, connection.stream.data() + connection.stream_size,
+                             connection.stream.size() - connection.stream_size, MSG_DONTWAIT);
+    if (read_size == 0 || (read_size < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+      *is_closed = true;
+      return receive_num;
+    }
+    if (read_size < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return receive_num;
+    }
+    connection.stream_size += static_cast<size_t>(read_size);
+
+    size_t offset = 0;
+    while (connection.stream_size - offset >= sizeof(BridgeFrameHeader))
+    {
+      BridgeFrameHeader header;
+      std::memcpy(&header, connection.stream.data() + offset, sizeof(header));
+      if (header.magic != BRIDGE_FRAME_MAGIC || header.frame_size < sizeof(header) ||
+          header.frame_size > BRIDGE_MAX_DATAGRAM_SIZE)
+      {
+        // The frame boundaries are lost, so the rest of the stream cannot be read
+        dropped_num++;
+        *is_closed = true;
+        return receive_num;
+      }
+      if (connection.stream_size - offset < header.frame_size)
+      {
+        break;
+      }
+      bool is_valid = false;
+      receive_num += parseFrame(connection.stream.data() + offset, header.frame_size, &is_valid);
+      if (!is_valid)
+      {
+        dropped_num++;
+      }
+      offset += header.frame_size;
+    }
+    std::memmove(connection.stream.data(), connection.stream.data() + offset, connection.stream_size - offset);
+    connection.stream_size -= offset;
+  }
+}
+
+//! @brief 送信側からの接続を受け付ける
+//! @param なし
+//! @return なし
+void
+BridgeReceiver::acceptConnection()
+{
+  int fd = accept4(socket_fd, nullptr, nullptr, SOCK_CLOEXEC);
+  if (fd < 0)
+  {
+    return;
+  }
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bridge_options.socket_buffer_size, sizeof(int));
+  // Room for two of the largest frames, so a complete frame always fits behind a partial one
+  connection_list.push_back({ fd, std::vector<unsigned char>(BRIDGE_MAX_DATAGRAM_SIZE * 2), 0 });
+}
+
+//! @brief 一つのフレームの処理
+//! @param [in] data フレームのバイト列
+//! @param [in] size フレームの大きさ[byte]
+//! @param [out] is_valid フレームの書式が正しい場合は真
+//! @return size_t 出版し直したトピック数
+//! @details 範囲を超えるレコードが見つかった場合は、それ以降のレコードを捨てる．
+//! スロットの大きさやバッファ数が上限を超えるレコードは、そのレコードのみを捨てる．
+size_t
+BridgeReceiver::parseFrame(const unsigned char *data, size_t size, bool *is_valid)
+{
+  *is_valid = false;
+  BridgeFrameHeader header;
+  if (size < sizeof(header))
+  {
+    return 0;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (header.magic != BRIDGE_FRAME_MAGIC || header.version != BRIDGE_FRAME_VERSION || header.frame_size != size)
+  {
+    return 0;
+  }
+
+  size_t receive_num = 0;
+  size_t offset      = sizeof(header);
+  for (uint16_t i = 0; i < header.record_num; i++)
+  {
+    BridgeRecordHeader record;
+    if (offset + sizeof(record) > size)
+    {
+      return receive_num;
+    }
+    std::memcpy(&record, data + offset, sizeof(record));
+    size_t header_size = getRecordHeaderSize(record.name_size);
+    if (offset + header_size + record.fragment_size > size || record.offset > record.total_size ||
+        record.fragment_size > record.total_size - record.offset)
+    {
+      return receive_num;
+    }
+    if (record.total_size > record.element_size || record.element_size > bridge_options.max_message_size ||
+        record.buffer_num < 1 || record.buffer_num > bridge_options.max_buffer_num)
+    {
+      // Well-formed but beyond what this receiver allocates for: skip it and keep the rest of the frame
+      if (record.offset == 0)
+      {
+        dropped_num++;
+      }
+      offset += header_size + alignFrameSize(record.fragment_size);
+      continue;
+    }
+    record_name.assign(reinterpret_cast<const char *>(data + offset + sizeof(record)), record.name_size);
+    receive_num += handleRecord(header.session_id, record, record_name, data + offset + header_size);
+    offset += header_size + alignFrameSize(record.fragment_size);
+  }
+  *is_valid = true;
+  return receive_num;
+}
+
+//! @brief 一つのレコードの処理
+//! @param [in] session_id 送信側の識別子
+//! @param [in] record レコードのヘッダ
+//! @param [in] name トピック名
+//! @param [in] payload トピックのバイト列(またはその断片)
+//! @return size_t 出版し直したトピック数(0または1)
+//! @details 分割されたトピックは先頭から順に断片が揃った場合のみ出版する．
+size_t
+BridgeReceiver::handleRecord(uint64_t session_id, const BridgeRecordHeader &record, const std::string &name,
+                             const unsigned char *payload)
+{
+  std::unique_ptr<Topic> &entry = topic_map[name];
+  if (entry == nullptr)
+  {
+    entry = std::make_unique<Topic>();
+  }
+  Topic &topic = *entry;
+  if (topic.session_id != session_id)
+  {
+    // The sender restarted, its sequence numbers start over
+    topic.session_id        = session_id;
+    topic.last_sequence     = 0;
+    topic.assembly_sequence = 0;
+    topic.assembly.clear();
+  }
+
+  if (record.sequence <= topic.last_sequence)
+  {
+    // Duplicated, or overtaken by a newer message
+    if (record.offset == 0)
+    {
+      dropped_num++;
+    }
+    return 0;
+  }
+
+  if (record.offset == 0)
+  {
+    if (topic.assembly_sequence != 0)
+    {
+      // The rest of the previous message never arrived
+      dropped_num++;
+      topic.assembly_sequence = 0;
+    }
+    if (record.fragment_size == record.total_size)
+    {
+      publishTopic(topic, name, record, payload);
+      return 1;
+    }
+    topic.assembly.assign(payload, payload + record.fragment_size);
+    topic.assembly_sequence = record.sequence;
+    return 0;
+  }
+
+  if (record.sequence != topic.assembly_sequence || record.offset != topic.assembly.size())
+  {
+    // A fragment of a message whose beginning was lost
+    return 0;
+  }
+  topic.assembly.insert(topic.assembly.end(), payload, payload + record.fragment_size);
+  if (topic.assembly.size() < record.total_size)
+  {
+    return 0;
+  }
+  topic.assembly_sequence = 0;
+  publishTopic(topic, name, record, topic.assembly.data());
+  return 1;
+}
+
+//! @brief トピックをローカルの共有メモリへ出版する
+//! @param [in,out] topic トピック
+//! @param [in] name 送信側のトピック名
+//! @param [in] record 最後のレコードのヘッダ
+//! @param [in] data トピックのバイト列
+//! @return なし
+//! @details 送信側と同じバッファ数とスロットの大きさで確保するため、Subscriber<T> でそのまま読み込める．
+void
+BridgeReceiver::publishTopic(Topic &topic, const std::string &name, const BridgeRecordHeader &record,
+                             const unsigned char *data)
+{
+  if (topic.publisher == nullptr)
+  {
+    // parseFrame() bounded buffer_num to [1, max_buffer_num] and element_size to max_message_size
+    topic.publisher = std::make_unique<TopicPublisher>(bridge_options.topic_prefix + name,
+                                                       static_cast<int>(record.buffer_num));
+  }
+  if (record.element_size > topic.element_size)
+  {
+    topic.publisher->reserve(record.element_size);
+    topic.element_size = record.element_size;
+  }
+  topic.publisher->publish(data, record.total_size);
+  topic.last_sequence = record.sequence;
+}
+
+}  // namespace shm
+
+}  // namespace irlab
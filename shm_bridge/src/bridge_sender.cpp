@@ -0,0 +1,518 @@
+#include <shm_bridge.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include "bridge_frame.hpp"
+
+namespace irlab
+{
+
+namespace shm
+{
+
+//! @brief コンストラクタ
+//! @param [in] topic_name_list 送信するトピック名の一覧
+//! @param [in] address 受信側のアドレス(ホスト名、またはマルチキャストグループのアドレス)
+//! @param [in] port 受信側のポート番号
+//! @param [in] options 中継の設定
+//! @return なし
+//! @details まだ出版されていないトピックは、出版された時点から送信する．
+//! TCPの場合、受信側に接続できるまではフレームを送信する度に接続し直す．
+BridgeSender::BridgeSender(const std::vector<std::string> &topic_name_list, const std::string &address,
+                           uint16_t port, const BridgeOptions &options)
+  : bridge_options(options)
+  , peer_address(address)
+  , peer_port(port)
+  , socket_fd(-1)
+  , frame_num(0)
+  , frame_sequence(0)
+  , forwarded_num(0)
+  , sent_frame_num(0)
+  , lost_num(0)
+{
+  if (bridge_options.max_frame_size > BRIDGE_MAX_DATAGRAM_SIZE)
+  {
+    throw std::runtime_error("shm::BridgeSender: Frame size exceeds the largest UDP datagram!");
+  }
+  if (bridge_options.batch_num == 0)
+  {
+    throw std::runtime_error("shm::BridgeSender: The number of frames per batch must be positive!");
+  }
+  for (const std::string &name : topic_name_list)
+  {
+    if (name.size() > UINT16_MAX ||
+        sizeof(BridgeFrameHeader) + getRecordHeaderSize(name.size()) + BRIDGE_ALIGNMENT > bridge_options.max_frame_size)
+    {
+      throw std::runtime_error("shm::BridgeSender: Frame size is too small for the topic name!");
+    }
+  }
+
+  std::random_device random;
+  session_id = (static_cast<uint64_t>(random()) << 32) ^ random() ^ getCurrentTimeUSec();
+  message_list.resize(bridge_options.batch_num);
+  iovec_list.resize(bridge_options.batch_num);
+
+  if (!connectSocket() && bridge_options.transport == BRIDGE_UDP)
+  {
+    throw std::runtime_error("shm::BridgeSender: Cannot open a socket to the peer!");
+  }
+
+  for (const std::string &name : topic_name_list)
+  {
+    topic_list.push_back(std::make_unique<Topic>());
+    Topic *topic = topic_list.back().get();
+    topic->name  = name;
+    wait_set.addTarget([this, topic](WaitTarget *target)
+                       { return connectTopic(*topic) && topic->ring_buffer->getWaitTarget(target); });
+  }
+}
+
+BridgeSender::~BridgeSender()
+{
+  closeSocket();
+}
+
+//! @brief 届いたトピックの送信
+//! @param [in] timeout_usec いずれかのトピックが届くまで待つ最長の時間[usec]
+//! @return size_t 送信したトピック数
+//! @details 届いたトピックを全てフレームに詰めてから送信するため、小さなトピックは一つのフレームにまとまる．
+//! 出版者が共有メモリを作り直したことは待機中には検出できないため、短い待ち時間で繰り返し呼び出すこと．
+size_t
+BridgeSender::forwardOnce(uint64_t timeout_usec)
+{
+  size_t forward_num = 0;
+  for (size_t handle : wait_set.wait(timeout_usec))
+  {
+    forward_num += drainTopic(*topic_list[handle]);
+  }
+  if (frame_num > 0)
+  {
+    flushFrames();
+  }
+  forwarded_num += forward_num;
+  return forward_num;
+}
+
+//! @brief 送信したトピック数の取得
+//! @param なし
+//! @return uint64_t 送信したトピック数
+uint64_t
+BridgeSender::getForwardedNum() const
+{
+  return forwarded_num;
+}
+
+//! @brief 送信したフレーム数の取得
+//! @param なし
+//! @return uint64_t 送信したフレーム数
+uint64_t
+BridgeSender::getFrameNum() const
+{
+  return sent_frame_num;
+}
+
+//! @brief 送信できなかったトピック数の取得
+//! @param なし
+//! @return uint64_t 読み込む前に出版者に上書きされたトピック数
+uint64_t
+BridgeSender::getLostNum() const
+{
+  uint64_t result = lost_num;
+  for (const auto &topic : topic_list)
+  {
+    if (topic->ring_buffer != nullptr && !bridge_options.latest_only)
+    {
+      result += topic->ring_buffer->getOverrunNum();
+    }
+  }
+  return result;
+}
+
+//! @brief トピックの共有メモリへの接続
+//! @param [in,out] topic 接続するトピック
+//! @return bool 接続できた場合は真
+//! @details 共有メモリが作り直されていた場合は、古い共有メモリに残ったトピックを送信してから接続し直す．
+bool
+BridgeSender::connectTopic(Topic &topic)
+{
+  if (topic.shared_memory == nullptr)
+  {
+    topic.shared_memory = std::make_unique<SharedMemoryPosix>(topic.name, O_RDWR, static_cast<PERM>(0));
+  }
+  if (!topic.shared_memory->isDisconnected())
+  {
+    if (topic.ring_buffer != nullptr)
+    {
+      return true;
+    }
+  }
+  else if (topic.ring_buffer != nullptr)
+  {
+    // The old mapping stays valid after unlink, so nothing published before the recreation is lost
+    forwarded_num += drainTopic(topic);
+    if (!bridge_options.latest_only)
+    {
+      lost_num += topic.ring_buffer->getOverrunNum();
+    }
+    topic.ring_buffer.reset();
+  }
+
+  topic.shared_memory->disconnect();
+  topic.shared_memory->connect();
+  unsigned char *ptr = topic.shared_memory->getPtr();
+  if (topic.shared_memory->isDisconnected() || ptr == nullptr || !RingBuffer::checkInitialized(ptr) ||
+      !RingBuffer::checkLayoutVersion(ptr))
+  {
+    return false;
+  }
+
+  topic.ring_buffer = std::make_unique<RingBuffer>(ptr);
+  topic.ring_buffer->registerClient(RingBuffer::CLIENT_SUBSCRIBER);
+
+  RingBufferLayout header_layout = RingBuffer::calculateAlignedLayout(0, 1);
+  topic.buffer_num    = static_cast<int>(*reinterpret_cast<size_t *>(ptr + header_layout.buf_num_offset));
+  // The new ring counts from the beginning again
+  topic.sequence_base = topic.last_sequence;
+  return true;
+}
+
+//! @brief 未読のトピックを全てフレームに詰める
+//! @param [in,out] topic 送信するトピック
+//! @return size_t フレームに詰めたトピック数
+//! @details スロットからフレームへ直接コピーし、コピー中に上書きされた場合は巻き戻す．
+//! latest_only の場合は最新のトピックのみを、前回送信したものから更新されている場合に詰める．
+size_t
+BridgeSender::drainTopic(Topic &topic)
+{
+  RingBuffer *ring = topic.ring_buffer.get();
+  if (ring == nullptr)
+  {
+    return 0;
+  }
+
+  if (bridge_options.latest_only)
+  {
+    while (true)
+    {
+      int buffer = ring->getNewestBufferNum();
+      if (buffer < 0)
+      {
+        return 0;
+      }
+      uint64_t sequence = topic.sequence_base + ring->getReadSequence() / 2;
+      if (sequence == topic.last_sequence)
+      {
+        return 0;
+      }
+      FramePosition position = getFramePosition();
+      appendRecord(topic, sequence, ring->getBufferPtr(buffer),
+                   std::min(ring->getDataSize(buffer), ring->getElementSize()));
+      if (ring->verifyBuffer(buffer))
+      {
+        topic.last_sequence = sequence;
+        return 1;
+      }
+      rewindFrame(position);
+    }
+  }
+
+  size_t forward_num = 0;
+  int    buffer      = ring->getNextBufferNum();
+  while (buffer >= 0)
+  {
+    uint64_t      sequence = topic.sequence_base + ring->getReadSequence() / 2;
+    FramePosition position = getFramePosition();
+    appendRecord(topic, sequence, ring->getBufferPtr(buffer),
+                 std::min(ring->getDataSize(buffer), ring->getElementSize()));
+    if (ring->consumeBuffer(buffer))
+    {
+      topic.last_sequence = sequence;
+      forward_num++;
+      if (frame_num >= bridge_options.batch_num)
+      {
+        flushFrames();
+      }
+    }
+    else
+    {
+      rewindFrame(position);
+    }
+    buffer = ring->getNextBufferNum();
+  }
+  return forward_num;
+}
+
+//! @brief 現在のフレームの位置の取得
+//! @param なし
+//! @return FramePosition 次のトピックを詰める位置
+BridgeSender::FramePosition
+BridgeSender::getFramePosition() const
+{
+  if (frame_num == 0)
+  {
+    return { 0, 0, 0 };
+  }
+  const Frame &frame = frame_list[frame_num - 1];
+  return { frame_num, frame.size, frame.record_num };
+}
+
+//! @brief フレームの巻き戻し
+//! @param [in] position getFramePosition() で取得した位置
+//! @return なし
+//! @details 位置を取得した後に開いたフレームは破棄する．
+void
+BridgeSender::rewindFrame(const FramePosition &position)
+{
+  frame_num = position.frame_index;
+  if (frame_num > 0)
+  {
+    frame_list[frame_num - 1].size       = position.size;
+    frame_list[frame_num - 1].record_num = position.record_num;
+  }
+}
+
+//! @brief トピックをフレームに詰める
+//! @param [in] topic トピック
+//! @param [in] sequence シーケンス番号
+//! @param [in] data トピックのバイト列
+//! @param [in] size トピックの大きさ[byte]
+//! @return なし
+//! @details 現在のフレームに収まらない分は新しいフレームに分割して詰める．
+void
+BridgeSender::appendRecord(const Topic &topic, uint64_t sequence, const unsigned char *data, size_t size)
+{
+  size_t header_size = getRecordHeaderSize(topic.name.size());
+  size_t offset      = 0;
+  do
+  {
+    // Open a new frame unless the current one holds the record header and some of the payload
+    size_t minimum_size = header_size + (size > 0 ? BRIDGE_ALIGNMENT : 0);
+    if (frame_num == 0 || frame_list[frame_num - 1].record_num == UINT16_MAX ||
+        frame_list[frame_num - 1].size + minimum_size > bridge_options.max_frame_size)
+    {
+      openFrame();
+    }
+    Frame &frame = frame_list[frame_num - 1];
+
+    size_t room          = (bridge_options.max_frame_size - frame.size - header_size) & ~(BRIDGE_ALIGNMENT - 1);
+    size_t fragment_size = std::min(size - offset, room);
+
+    BridgeRecordHeader record;
+    record.sequence      = sequence;
+    record.total_size    = static_cast<uint32_t>(size);
+    record.offset        = static_cast<uint32_t>(offset);
+    record.fragment_size = static_cast<uint32_t>(fragment_size);
+    record.element_size  = static_cast<uint32_t>(topic.ring_buffer->getElementSize());
+    record.buffer_num    = static_cast<uint32_t>(topic.buffer_num);
+    record.name_size     = static_cast<uint16_t>(topic.name.size());
+    record.reserved      = 0;
+
+    unsigned char *ptr = frame.data.data() + frame.size;
+    std::memcpy(ptr, &record, sizeof(record));
+    std::memcpy(ptr + sizeof(record), topic.name.data(), topic.name.size());
+    std::memcpy(ptr + header_size, data + offset, fragment_size);
+
+    frame.size += header_size + alignFrameSize(fragment_size);
+    frame.record_num++;
+    offset += fragment_size;
+  } while (offset < size);
+}
+
+//! @brief 新しいフレームを開く
+//! @param なし
+//! @return なし
+//! @details フレームのバッファは送信後も再利用する．
+void
+BridgeSender::openFrame()
+{
+  if (frame_num == frame_list.size())
+  {
+    frame_list.emplace_back();
+    frame_list.back().data.resize(bridge_options.max_frame_size);
+  }
+  Frame &frame     = frame_list[frame_num++];
+  frame.size       = sizeof(BridgeFrameHeader);
+  frame.record_num = 0;
+}
+
+//! @brief 詰めたフレームを全て送信する
+//! @param なし
+//! @return なし
+//! @details UDPでは batch_num 個ずつ sendmmsg() で送信し、TCPでは sendmsg() で続けて書き込む．
+//! TCPで接続できない場合や接続が切れた場合、フレームは破棄して次回に接続し直す．
+void
+BridgeSender::flushFrames()
+{
+  for (size_t i = 0; i < frame_num; i++)
+  {
+    Frame            &frame = frame_list[i];
+    BridgeFrameHeader header;
+    header.magic          = BRIDGE_FRAME_MAGIC;
+    header.version        = BRIDGE_FRAME_VERSION;
+    header.record_num     = frame.record_num;
+    header.frame_size     = static_cast<uint32_t>(frame.size);
+    header.reserved       = 0;
+    header.session_id     = session_id;
+    header.frame_sequence = ++frame_sequence;
+    std::memcpy(frame.data.data(), &header, sizeof(header));
+  }
+
+  if (!connectSocket())
+  {
+    frame_num = 0;
+    return;
+  }
+
+  size_t first = 0;
+  while (first < frame_num)
+  {
+    size_t batch_size = std::min(bridge_options.batch_num, frame_num - first);
+    for (size_t i = 0; i < batch_size; i++)
+    {
+      iovec_list[i].iov_base = frame_list[first + i].data.data();
+      iovec_list[i].iov_len  = frame_list[first + i].size;
+    }
+
+    if (bridge_options.transport == BRIDGE_UDP)
+    {
+      for (size_t i = 0; i < batch_size; i++)
+      {
+        std::memset(&message_list[i], 0, sizeof(mmsghdr));
+        message_list[i].msg_hdr.msg_iov    = &iovec_list[i];
+        message_list[i].msg_hdr.msg_iovlen = 1;
+      }
+      int result = sendmmsg(socket_fd, message_list.data(), static_cast<unsigned int>(batch_size), 0);
+      if (result < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        // Nobody listens yet (ECONNREFUSED) or the send buffer is full: drop the rest of this batch
+        break;
+      }
+      first          += static_cast<size_t>(result);
+      sent_frame_num += static_cast<uint64_t>(result);
+      continue;
+    }
+
+    iovec *iov     = iovec_list.data();
+    size_t iov_num = batch_size;
+    while (iov_num > 0)
+    {
+      msghdr message;
+      std::memset(&message, 0, sizeof(message));
+      message.msg_iov    = iov;
+      message.msg_iovlen = iov_num;
+      ssize_t written    = sendmsg(socket_fd, &message, MSG_NOSIGNAL);
+      if (written < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        // A frame may be cut halfway, so the stream cannot be continued
+        closeSocket();
+        frame_num = 0;
+        return;
+      }
+      while (iov_num > 0 && static_cast<size_t>(written) >= iov->iov_len)
+      {
+        written -= static_cast<ssize_t>(iov->iov_len);
+        iov++;
+        iov_num--;
+      }
+      if (iov_num > 0)
+      {
+        iov->iov_base = static_cast<unsigned char *>(iov->iov_base) + written;
+        iov->iov_len -= static_cast<size_t>(written);
+      }
+    }
+    first          += batch_size;
+    sent_frame_num += batch_size;
+  }
+  frame_num = 0;
+}
+
+//! @brief 受信側へのソケットの接続
+//! @param なし
+//! @return bool 接続済み、または接続できた場合は真
+//! @details 宛先がマルチキャストアドレスの場合は、TTLと送信に使うインターフェースを設定する．
+bool
+BridgeSender::connectSocket()
+{
+  if (socket_fd >= 0)
+  {
+    return true;
+  }
+
+  int      type = (bridge_options.transport == BRIDGE_UDP) ? SOCK_DGRAM : SOCK_STREAM;
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_INET;
+  hints.ai_socktype = type;
+  addrinfo *result  = nullptr;
+  if (getaddrinfo(peer_address.c_str(), std::to_string(peer_port).c_str(), &hints, &result) != 0)
+  {
+    return false;
+  }
+
+  int fd = socket(AF_INET, type | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    freeaddrinfo(result);
+    return false;
+  }
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bridge_options.socket_buffer_size, sizeof(int));
+
+  const sockaddr_in *peer = reinterpret_cast<const sockaddr_in *>(result->ai_addr);
+  if (type == SOCK_DGRAM && IN_MULTICAST(ntohl(peer->sin_addr.s_addr)))
+  {
+    unsigned char ttl = static_cast<unsigned char>(bridge_options.multicast_ttl);
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    in_addr interface_address;
+    if (!bridge_options.multicast_interface.empty() &&
+        inet_pton(AF_INET, bridge_options.multicast_interface.c_str(), &interface_address) == 1)
+    {
+      setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &interface_address, sizeof(interface_address));
+    }
+  }
+  if (type == SOCK_STREAM)
+  {
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  }
+
+  int connect_result = connect(fd, result->ai_addr, result->ai_addrlen);
+  freeaddrinfo(result);
+  if (connect_result < 0)
+  {
+    close(fd);
+    return false;
+  }
+  socket_fd = fd;
+  return true;
+}
+
+//! @brief ソケットを閉じる
+//! @param なし
+//! @return なし
+void
+BridgeSender::closeSocket()
+{
+  if (socket_fd >= 0)
+  {
+    close(socket_fd);
+    socket_fd = -1;
+  }
+}
+
+}  // namespace shm
+
+}  // namespace irlab
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <numeric>
+#include <unistd.h>
+
+#include "shm_base.hpp"
+#include "shm_pub_sub.hpp"
+#include "shm_pub_sub_vector.hpp"
+#include "shm_bridge.hpp"
+
+// Test fixture looping a sender back to a receiver on the same host
+class SHMBridgeTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        port = static_cast<uint16_t>(40000 + getpid() % 20000);
+        options.topic_prefix = "/remote";
+        cleanUp();
+    }
+
+    void TearDown() override
+    {
+        cleanUp();
+    }
+
+    void cleanUp()
+    {
+        for (const char *name : { "test_bridge_int", "test_bridge_vector" })
+        {
+            irlab::shm::disconnectMemory(name);
+            irlab::shm::disconnectMemory(std::string("remote/") + name);
+        }
+    }
+
+    // Forwards and receives until the receiver has published num messages in total
+    bool relay(irlab::shm::BridgeSender &sender, irlab::shm::BridgeReceiver &receiver, uint64_t num)
+    {
+        auto start = std::chrono::steady_clock::now();
+        while (receiver.getReceivedNum() < num)
+        {
+            if (std::chrono::steady_clock::now() - start > std::chrono::seconds(2))
+            {
+                return false;
+            }
+            sender.forwardOnce(1000);
+            receiver.receiveOnce(1000);
+        }
+        return true;
+    }
+
+    uint16_t                  port;
+    irlab::shm::BridgeOptions options;
+};
+
+// Small messages are batched into a single datagram and re-published for Subscriber<T>
+TEST_F(SHMBridgeTest, UdpForwardTest)
+{
+    irlab::shm::Publisher<int>                int_pub("/test_bridge_int", 64);
+    irlab::shm::Publisher<std::vector<float>> vector_pub("/test_bridge_vector", 8);
+    irlab::shm::BridgeReceiver                receiver(port, options);
+    irlab::shm::BridgeSender sender({ "/test_bridge_int", "/test_bridge_vector" }, "127.0.0.1", port, options);
+
+    // The first messages create the remote topics, so subscribers attach after them
+    int_pub.publish(-1);
+    vector_pub.publish(std::vector<float>(3, 1.0f));
+    ASSERT_TRUE(relay(sender, receiver, 2));
+    irlab::shm::Subscriber<int>                int_sub("/remote/test_bridge_int");
+    irlab::shm::Subscriber<std::vector<float>> vector_sub("/remote/test_bridge_vector");
+    bool                                       is_success = false;
+    EXPECT_EQ(vector_sub.subscribe(&is_success), std::vector<float>(3, 1.0f));
+    EXPECT_TRUE(is_success);
+
+    // A new subscriber reads the newest message first; skip it before the burst
+    do
+    {
+        int_sub.subscribeNext(&is_success);
+    } while (is_success);
+
+    uint64_t frame_num = sender.getFrameNum();
+    for (int i = 0; i < 50; i++)
+    {
+        int_pub.publish(i);
+    }
+    ASSERT_TRUE(relay(sender, receiver, 52));
+    EXPECT_EQ(sender.getFrameNum() - frame_num, 1u);
+    for (int i = 0; i < 50; i++)
+    {
+        EXPECT_EQ(int_sub.subscribeNext(&is_success), i);
+        ASSERT_TRUE(is_success);
+    }
+    EXPECT_EQ(sender.getLostNum(), 0u);
+    EXPECT_EQ(receiver.getDroppedNum(), 0u);
+}
+
+// Messages larger than a frame are split and reassembled over TCP
+TEST_F(SHMBridgeTest, TcpFragmentTest)
+{
+    options.transport      = irlab::shm::BRIDGE_TCP;
+    options.max_frame_size = 1500;
+    irlab::shm::Publisher<std::vector<float>> vector_pub("/test_bridge_vector", 8);
+    irlab::shm::BridgeReceiver                receiver(port, options);
+    irlab::shm::BridgeSender                  sender({ "/test_bridge_vector" }, "127.0.0.1", port, options);
+
+    vector_pub.publish(std::vector<float>(1, 0.0f));
+    ASSERT_TRUE(relay(sender, receiver, 1));
+    irlab::shm::Subscriber<std::vector<float>> vector_sub("/remote/test_bridge_vector");
+
+    for (size_t size : { 10000u, 3u, 40000u })
+    {
+        std::vector<float> data(size);
+        std::iota(data.begin(), data.end(), static_cast<float>(size));
+        vector_pub.publish(data);
+        ASSERT_TRUE(relay(sender, receiver, receiver.getReceivedNum() + 1));
+
+        bool is_success = false;
+        EXPECT_EQ(vector_sub.subscribe(&is_success), data);
+        EXPECT_TRUE(is_success);
+    }
+    EXPECT_GT(sender.getFrameNum(), 40000u * sizeof(float) / 1500);
+    EXPECT_EQ(receiver.getDroppedNum(), 0u);
+}
+
+// Only the newest message is forwarded, and not again while it is unchanged
+TEST_F(SHMBridgeTest, LatestOnlyTest)
+{
+    options.latest_only = true;
+    irlab::shm::Publisher<int> int_pub("/test_bridge_int", 16);
+    irlab::shm::BridgeReceiver receiver(port, options);
+    irlab::shm::BridgeSender   sender({ "/test_bridge_int" }, "127.0.0.1", port, options);
+
+    for (int i = 0; i < 10; i++)
+    {
+        int_pub.publish(i);
+    }
+    ASSERT_TRUE(relay(sender, receiver, 1));
+    EXPECT_EQ(sender.getForwardedNum(), 1u);
+    EXPECT_EQ(sender.forwardOnce(10000), 0u);
+
+    irlab::shm::Subscriber<int> int_sub("/remote/test_bridge_int");
+    bool                        is_success = false;
+    EXPECT_EQ(int_sub.subscribe(&is_success), 9);
+    EXPECT_TRUE(is_success);
+
+    int_pub.publish(10);
+    ASSERT_TRUE(relay(sender, receiver, 2));
+    EXPECT_EQ(int_sub.subscribe(&is_success), 10);
+}
+
+// Records whose slot size or buffer number exceed the receiver limits are dropped, not allocated
+TEST_F(SHMBridgeTest, ReceiverLimitTest)
+{
+    irlab::shm::BridgeOptions receiver_options = options;
+    receiver_options.max_message_size          = 1024;
+    receiver_options.max_buffer_num            = 16;
+    irlab::shm::Publisher<int>                int_pub("/test_bridge_int", 64);
+    irlab::shm::Publisher<std::vector<float>> vector_pub("/test_bridge_vector", 8);
+    irlab::shm::BridgeReceiver                receiver(port, receiver_options);
+    irlab::shm::BridgeSender sender({ "/test_bridge_int", "/test_bridge_vector" }, "127.0.0.1", port, options);
+
+    vector_pub.publish(std::vector<float>(16, 1.0f));
+    ASSERT_TRUE(relay(sender, receiver, 1));
+
+    // Too many buffers, then too large a slot
+    int_pub.publish(1);
+    vector_pub.publish(std::vector<float>(1000, 2.0f));
+    auto start = std::chrono::steady_clock::now();
+    while (receiver.getDroppedNum() < 2 && std::chrono::steady_clock::now() - start < std::chrono::seconds(2))
+    {
+        sender.forwardOnce(1000);
+        receiver.receiveOnce(1000);
+    }
+    EXPECT_EQ(receiver.getDroppedNum(), 2u);
+    EXPECT_EQ(receiver.getReceivedNum(), 1u);
+    EXPECT_FALSE(irlab::shm::SharedMemoryPosix("/remote/test_bridge_int", O_RDONLY, static_cast<irlab::shm::PERM>(0))
+                     .isExists());
+
+    irlab::shm::Subscriber<std::vector<float>> vector_sub("/remote/test_bridge_vector");
+    bool                                       is_success = false;
+    EXPECT_EQ(vector_sub.subscribe(&is_success), std::vector<float>(16, 1.0f));
+    EXPECT_TRUE(is_success);
+
+    irlab::shm::BridgeOptions invalid_options = options;
+    invalid_options.max_buffer_num            = 0;
+    EXPECT_THROW(irlab::shm::BridgeReceiver(port + 1, invalid_options), std::runtime_error);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
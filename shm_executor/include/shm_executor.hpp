@@ -0,0 +1,231 @@
+//!
+//! @file shm_executor.hpp
+//! @brief 購読、タイマー、サービス、アクションのコールバックを実行するクラスの定義
+//! @note 記法はROSに準拠する
+//!       http://wiki.ros.org/ja/CppStyleGuide
+//!
+
+#ifndef __SHM_EXECUTOR_LIB_H__
+#define __SHM_EXECUTOR_LIB_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "shm_base.hpp"
+#include "shm_pub_sub.hpp"
+#include "shm_service.hpp"
+#include "shm_action.hpp"
+
+namespace irlab
+{
+
+namespace shm
+{
+
+// ****************************************************************************
+//! @struct ExecutorCallbackOptions
+//! @brief コールバックごとの実行設定
+// ****************************************************************************
+struct ExecutorCallbackOptions
+{
+  //! 優先度．同時に準備ができた場合は値の大きいものから実行する
+  int priority = 0;
+  //! 準備ができてからコールバックが終わるまでの期限[usec]．0の場合は期限を確認しない
+  uint64_t deadline_usec = 0;
+  //! 期限を過ぎた際に呼ばれる関数．引数は準備ができてから終わるまでの時間[usec]
+  std::function<void(uint64_t)> on_deadline_miss;
+};
+
+// ****************************************************************************
+//! @struct ExecutorCallbackStats
+//! @brief コールバックの実行統計
+//! @details 遅延はWaitSetの起床またはタイマーの予定時刻からコールバックが終わるまでの時間である．
+// ****************************************************************************
+struct ExecutorCallbackStats
+{
+  uint64_t call_num          = 0;
+  uint64_t deadline_miss_num = 0;
+  uint64_t last_latency_usec = 0;
+  uint64_t max_latency_usec  = 0;
+};
+
+// ****************************************************************************
+//! @class Executor
+//! @brief 複数のSubscriber、タイマー、ServiceServer、ActionServerのコールバックを実行するクラス
+//! @details 登録したオブジェクトを一つのWaitSetでまとめて待ち、準備ができたものを優先度順に実行する．
+//! spinOnce() を呼んだスレッド、または spin() で起動した複数のスレッドで実行できる．
+//! 複数のスレッドで実行する場合、一つのスレッドが待機を担当し、準備ができたコールバックは空いているスレッドが取り出す．
+//! 同じコールバックが同時に複数のスレッドで実行されることはない．
+//! ServiceServerはworker_numを0として生成したものを登録すること．
+//! 登録したオブジェクトは remove() するか、Executorを破棄するまで存在している必要がある．
+// ****************************************************************************
+class Executor
+{
+public:
+  Executor();
+  ~Executor();
+
+  Executor(const Executor &)            = delete;
+  Executor &operator=(const Executor &) = delete;
+
+  template <typename T>
+  size_t addSubscription(Subscriber<T> &subscriber, std::function<void(const T &)> on_message,
+                         const ExecutorCallbackOptions &options = ExecutorCallbackOptions());
+  template <class Req, class Res>
+  size_t addService(ServiceServer<Req, Res> &server,
+                    const ExecutorCallbackOptions &options = ExecutorCallbackOptions());
+  template <class Goal, class Result, class Feedback>
+  size_t addAction(ActionServer<Goal, Result, Feedback> &server,
+                   std::function<void(ActionGoalId, const Goal &)> on_goal,
+                   const ExecutorCallbackOptions &options = ExecutorCallbackOptions());
+  size_t addTimer(uint64_t period_usec, std::function<void()> callback,
+                  const ExecutorCallbackOptions &options = ExecutorCallbackOptions());
+  size_t addWaitable(std::function<bool(WaitTarget *)> get_target, std::function<void()> callback,
+                     const ExecutorCallbackOptions &options = ExecutorCallbackOptions());
+  void   remove(size_t handle);
+
+  bool spinOnce(uint64_t timeout_usec);
+  void spin(int thread_num = 1, const ThreadAttributes &attributes = ThreadAttributes());
+  void stop();
+
+  ExecutorCallbackStats getStats(size_t handle) const;
+
+  //! spin() の各スレッドが停止要求を確認する周期[usec]
+  static constexpr uint64_t SPIN_WAIT_USEC = 100000;
+
+private:
+  struct Entry
+  {
+    size_t                            handle;
+    std::function<bool(WaitTarget *)> get_target;
+    std::function<void()>             callback;
+    ExecutorCallbackOptions           options;
+    uint64_t                          period_usec;
+    uint64_t                          next_time_usec;
+    uint64_t                          ready_time_usec;
+    uint64_t                          ready_order;
+    size_t                            wait_handle;
+    bool                              is_watched;
+    bool                              is_queued;
+    bool                              is_running;
+    bool                              is_removed;
+    std::atomic<bool>                 is_busy;
+    std::thread::id                   running_thread;
+    ExecutorCallbackStats             stats;
+  };
+
+  size_t                 addEntry(std::shared_ptr<Entry> entry);
+  bool                   runOnce(uint64_t timeout_usec, bool stop_on_request);
+  void                   applyWaitSetChanges();
+  void                   waitForReadyEntries(std::unique_lock<std::mutex> &lock, uint64_t timeout_usec);
+  void                   queueEntry(const std::shared_ptr<Entry> &entry, uint64_t ready_time_usec);
+  uint64_t               queueDueTimers(uint64_t current_time);
+  std::shared_ptr<Entry> popReadyEntry();
+  void                   execute(const std::shared_ptr<Entry> &entry, std::unique_lock<std::mutex> &lock);
+  void                   finishEntry(const std::shared_ptr<Entry> &entry, uint64_t finish_time);
+  void                   wake();
+
+  mutable std::mutex                        mutex;
+  std::condition_variable                   condition;
+  std::map<size_t, std::shared_ptr<Entry>>  entry_map;
+  std::vector<std::shared_ptr<Entry>>       timer_list;
+  std::vector<std::shared_ptr<Entry>>       run_queue;
+  std::vector<std::shared_ptr<Entry>>       pending_add_list;
+  std::vector<std::shared_ptr<Entry>>       pending_remove_list;
+  std::vector<std::shared_ptr<Entry>>       wait_entry_list;
+  WaitSet                                   wait_set;
+  size_t                                    wake_handle;
+  std::atomic<uint32_t>                     wake_sequence;
+  std::atomic<uint32_t>                     wake_waiter_num;
+  std::atomic<bool>                         wake_requested;
+  size_t                                    next_handle;
+  uint64_t                                  next_ready_order;
+  bool                                      has_waiter;
+  bool                                      stop_requested;
+};
+
+// ****************************************************************************
+// 関数定義
+// （テンプレートクラス内の関数の定義はコンパイル時に実体化するのでヘッダに書く）
+// ****************************************************************************
+
+//! @brief トピックを購読するコールバックを登録する
+//! @param [in] subscriber 購読者
+//! @param [in] on_message トピックが更新された際に最新のデータで呼ばれる関数
+//! @param [in] options 優先度と期限
+//! @return size_t コールバックのハンドル
+//! @details 実行までに複数回更新された場合は、最新のデータで一度だけ呼ばれる．
+template <typename T>
+size_t
+Executor::addSubscription(Subscriber<T> &subscriber, std::function<void(const T &)> on_message,
+                          const ExecutorCallbackOptions &options)
+{
+  if (!on_message)
+  {
+    throw std::runtime_error("shm::Executor: Callback is empty!");
+  }
+  return addWaitable([&subscriber](WaitTarget *target) { return subscriber.getWaitTarget(target); },
+                     [&subscriber, on_message]()
+                     {
+                       bool     is_success = false;
+                       const T &data       = subscriber.subscribe(&is_success);
+                       if (is_success)
+                       {
+                         on_message(data);
+                       }
+                     },
+                     options);
+}
+
+//! @brief サービスのリクエストを処理するコールバックを登録する
+//! @param [in] server worker_numを0として生成したサーバー
+//! @param [in] options 優先度と期限
+//! @return size_t コールバックのハンドル
+//! @details 一度の実行で一つのリクエストを処理する．
+template <class Req, class Res>
+size_t
+Executor::addService(ServiceServer<Req, Res> &server, const ExecutorCallbackOptions &options)
+{
+  return addWaitable([&server](WaitTarget *target) { return server.getWaitTarget(target); },
+                     [&server]() { server.spinOnce(); }, options);
+}
+
+//! @brief アクションのゴールを受理するコールバックを登録する
+//! @param [in] server サーバー
+//! @param [in] on_goal 受理したゴールのIDと内容で呼ばれる関数
+//! @param [in] options 優先度と期限
+//! @return size_t コールバックのハンドル
+//! @details 一度の実行で一つのゴールを受理する．結果は on_goal の中、または後から publishResult() で返す．
+template <class Goal, class Result, class Feedback>
+size_t
+Executor::addAction(ActionServer<Goal, Result, Feedback> &server,
+                    std::function<void(ActionGoalId, const Goal &)> on_goal, const ExecutorCallbackOptions &options)
+{
+  if (!on_goal)
+  {
+    throw std::runtime_error("shm::Executor: Callback is empty!");
+  }
+  return addWaitable([&server](WaitTarget *target) { return server.getWaitTarget(target); },
+                     [&server, on_goal]()
+                     {
+                       if (!server.waitNewGoalAvailable(0))
+                       {
+                         return;
+                       }
+                       ActionGoalId goal_id;
+                       Goal         goal = server.acceptNewGoal(&goal_id);
+                       on_goal(goal_id, goal);
+                     },
+                     options);
+}
+
+}  // namespace shm
+
+}  // namespace irlab
+
+#endif /* __SHM_EXECUTOR_LIB_H__ */
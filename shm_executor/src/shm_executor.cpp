@@ -0,0 +1,519 @@
+#include <shm_executor.hpp>
+#include <algorithm>
+#include <exception>
+#include <limits>
+
+namespace irlab
+{
+
+namespace shm
+{
+
+Executor::Executor()
+: wake_sequence(0)
+, wake_waiter_num(0)
+, wake_requested(false)
+, next_handle(0)
+, next_ready_order(0)
+, has_waiter(false)
+, stop_requested(false)
+{
+  wake_handle = wait_set.addTarget(
+      [this](WaitTarget *target)
+      {
+        target->sequence   = &wake_sequence;
+        target->waiter_num = &wake_waiter_num;
+        target->is_ready   = [this]() { return wake_requested.load(std::memory_order_seq_cst); };
+        return true;
+      });
+}
+
+//! @brief デストラクタ
+//! @details spin() や spinOnce() を実行中のスレッドが無い状態で破棄すること．
+Executor::~Executor()
+{
+}
+
+//! @brief タイマーのコールバックを登録する
+//! @param [in] period_usec 周期[usec]
+//! @param [in] callback 周期ごとに呼ばれる関数
+//! @param [in] options 優先度と期限
+//! @return size_t コールバックのハンドル
+//! @details 最初の呼び出しは登録から一周期後である．実行が周期より長引いた場合、遅れた分の呼び出しは行わない．
+size_t
+Executor::addTimer(uint64_t period_usec, std::function<void()> callback, const ExecutorCallbackOptions &options)
+{
+  if (period_usec == 0)
+  {
+    throw std::runtime_error("shm::Executor: Timer period must be positive!");
+  }
+  if (!callback)
+  {
+    throw std::runtime_error("shm::Executor: Callback is empty!");
+  }
+  auto entry            = std::make_shared<Entry>();
+  entry->callback       = std::move(callback);
+  entry->options        = options;
+  entry->period_usec    = period_usec;
+  entry->next_time_usec = getCurrentTimeUSec() + period_usec;
+  return addEntry(entry);
+}
+
+//! @brief WaitTargetを持つ任意のオブジェクトのコールバックを登録する
+//! @param [in] get_target 待機に使うfutexワードを取得する関数．WaitSet::addTarget() と同じ
+//! @param [in] callback 準備ができた際に呼ばれる関数．準備ができた状態を解消する処理を行うこと
+//! @param [in] options 優先度と期限
+//! @return size_t コールバックのハンドル
+size_t
+Executor::addWaitable(std::function<bool(WaitTarget *)> get_target, std::function<void()> callback,
+                      const ExecutorCallbackOptions &options)
+{
+  if (!get_target || !callback)
+  {
+    throw std::runtime_error("shm::Executor: Callback is empty!");
+  }
+  auto entry         = std::make_shared<Entry>();
+  entry->get_target  = std::move(get_target);
+  entry->callback    = std::move(callback);
+  entry->options     = options;
+  entry->period_usec = 0;
+  return addEntry(entry);
+}
+
+size_t
+Executor::addEntry(std::shared_ptr<Entry> entry)
+{
+  entry->ready_time_usec = 0;
+  entry->ready_order     = 0;
+  entry->wait_handle     = 0;
+  entry->is_watched      = false;
+  entry->is_queued       = false;
+  entry->is_running      = false;
+  entry->is_removed      = false;
+  entry->is_busy         = false;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  entry->handle = next_handle++;
+  entry_map[entry->handle] = entry;
+  if (entry->get_target)
+  {
+    pending_add_list.push_back(entry);
+  }
+  else
+  {
+    timer_list.push_back(entry);
+  }
+  wake();
+  return entry->handle;
+}
+
+//! @brief コールバックの登録を解除する
+//! @param [in] handle 登録時に得たハンドル
+//! @details 戻った時点で、このコールバックは実行されておらず、以降も実行されない．
+//! そのため、戻った後は登録したオブジェクトを破棄してよい．
+//! コールバックの中から自身を解除した場合は、そのコールバックの終了を待たずに戻る．
+void
+Executor::remove(size_t handle)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  auto it = entry_map.find(handle);
+  if (it == entry_map.end())
+  {
+    return;
+  }
+  std::shared_ptr<Entry> entry = it->second;
+  entry_map.erase(it);
+  entry->is_removed = true;
+  entry->is_queued  = false;
+  run_queue.erase(std::remove(run_queue.begin(), run_queue.end(), entry), run_queue.end());
+  timer_list.erase(std::remove(timer_list.begin(), timer_list.end(), entry), timer_list.end());
+  pending_add_list.erase(std::remove(pending_add_list.begin(), pending_add_list.end(), entry),
+                         pending_add_list.end());
+  if (entry->is_watched)
+  {
+    pending_remove_list.push_back(entry);
+    if (!has_waiter)
+    {
+      // Nobody is inside WaitSet::wait(), so the set can be changed from this thread
+      applyWaitSetChanges();
+    }
+    else
+    {
+      wake();
+    }
+  }
+  condition.wait(lock,
+                 [&]()
+                 {
+                   return !entry->is_watched &&
+                          (!entry->is_running || entry->running_thread == std::this_thread::get_id());
+                 });
+}
+
+//! @brief 準備ができたコールバックを一つ実行する
+//! @param [in] timeout_usec 準備ができるまでの待ち時間[usec]
+//! @return bool コールバックを実行した場合は真、タイムアウトした場合は偽
+//! @details 待機を担当するスレッドが他にいる場合は、そのスレッドが見つけたコールバックを実行する．
+//! コールバックが投げた例外はそのまま呼び出し元に伝わる．
+bool
+Executor::spinOnce(uint64_t timeout_usec)
+{
+  return runOnce(timeout_usec, false);
+}
+
+//! @brief stop() が呼ばれるまでコールバックを実行し続ける
+//! @param [in] thread_num 実行に使うスレッド数．呼び出したスレッドを含む
+//! @param [in] attributes 各スレッドに適用するスケジューリングとCPU固定の設定
+//! @details 全てのスレッドが終了してから戻る．戻った後は再び spin() を呼べる．
+//! いずれかのスレッドでコールバックが例外を投げた場合は、全てのスレッドを止めてからその例外を投げる．
+//! attributes は呼び出したスレッドにも適用され、戻った後もそのまま残る．stack_size は無視する．
+void
+Executor::spin(int thread_num, const ThreadAttributes &attributes)
+{
+  if (thread_num <= 0)
+  {
+    throw std::runtime_error("shm::Executor: The number of threads must be positive!");
+  }
+  std::exception_ptr exception;
+  auto run = [&]()
+  {
+    try
+    {
+      applyThreadAttributes(attributes);
+      while (true)
+      {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (stop_requested)
+          {
+            return;
+          }
+        }
+        runOnce(SPIN_WAIT_USEC, true);
+      }
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!exception)
+      {
+        exception = std::current_exception();
+      }
+      stop_requested = true;
+      wake();
+      condition.notify_all();
+    }
+  };
+
+  std::vector<std::thread> thread_list;
+  for (int i = 1; i < thread_num; i++)
+  {
+    thread_list.emplace_back(run);
+  }
+  run();
+  for (auto &thread : thread_list)
+  {
+    thread.join();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop_requested = false;
+  }
+  if (exception)
+  {
+    std::rethrow_exception(exception);
+  }
+}
+
+//! @brief spin() を終了させる
+//! @details 実行中のコールバックは最後まで実行される．spin() の開始前に呼んだ場合、その spin() はすぐに戻る．
+void
+Executor::stop()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  stop_requested = true;
+  wake();
+  condition.notify_all();
+}
+
+//! @brief コールバックの実行統計を取得する
+//! @param [in] handle 登録時に得たハンドル
+//! @return ExecutorCallbackStats 実行回数、期限超過回数、遅延
+ExecutorCallbackStats
+Executor::getStats(size_t handle) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = entry_map.find(handle);
+  if (it == entry_map.end())
+  {
+    throw std::runtime_error("shm::Executor: Unknown callback handle!");
+  }
+  return it->second->stats;
+}
+
+//! @brief 準備ができたコールバックを一つ実行する
+//! @param [in] timeout_usec 準備ができるまでの待ち時間[usec]
+//! @param [in] stop_on_request 停止要求があった場合に待機をやめるか
+//! @return bool コールバックを実行した場合は真、それ以外は偽
+bool
+Executor::runOnce(uint64_t timeout_usec, bool stop_on_request)
+{
+  uint64_t                     start_time = getCurrentTimeUSec();
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    std::shared_ptr<Entry> entry = popReadyEntry();
+    if (entry)
+    {
+      execute(entry, lock);
+      return true;
+    }
+    if (stop_on_request && stop_requested)
+    {
+      return false;
+    }
+    uint64_t elapsed = getCurrentTimeUSec() - start_time;
+    if (elapsed >= timeout_usec)
+    {
+      return false;
+    }
+    if (!has_waiter)
+    {
+      waitForReadyEntries(lock, timeout_usec - elapsed);
+      continue;
+    }
+    condition.wait_for(lock, std::chrono::microseconds(timeout_usec - elapsed));
+  }
+}
+
+//! @brief 登録と解除をWaitSetに反映する
+//! @details mutexを保持し、WaitSet::wait() を実行中のスレッドが無い状態で呼び出すこと．
+void
+Executor::applyWaitSetChanges()
+{
+  for (auto &entry : pending_remove_list)
+  {
+    wait_set.remove(entry->wait_handle);
+    wait_entry_list[entry->wait_handle] = nullptr;
+    entry->is_watched = false;
+  }
+  if (!pending_remove_list.empty())
+  {
+    pending_remove_list.clear();
+    condition.notify_all();
+  }
+
+  for (auto &entry : pending_add_list)
+  {
+    // A callback that is queued or running reports a word that never becomes ready, so the waiting
+    // thread does not wake up again for data that is about to be read
+    Entry *raw_entry   = entry.get();
+    entry->wait_handle = wait_set.addTarget(
+        [this, raw_entry](WaitTarget *target)
+        {
+          if (raw_entry->is_busy.load(std::memory_order_acquire))
+          {
+            target->sequence   = &wake_sequence;
+            target->waiter_num = &wake_waiter_num;
+            target->is_ready   = []() { return false; };
+            return true;
+          }
+          return raw_entry->get_target(target);
+        });
+    if (wait_entry_list.size() <= entry->wait_handle)
+    {
+      wait_entry_list.resize(entry->wait_handle + 1);
+    }
+    wait_entry_list[entry->wait_handle] = entry;
+    entry->is_watched                   = true;
+  }
+  pending_add_list.clear();
+}
+
+//! @brief 待機担当としてコールバックの準備ができるまで待つ
+//! @param [in] lock 保持しているmutexのロック
+//! @param [in] timeout_usec 待ち時間[usec]
+//! @details WaitSetを扱うのは待機担当のスレッドのみである．待機中はmutexを解放する．
+void
+Executor::waitForReadyEntries(std::unique_lock<std::mutex> &lock, uint64_t timeout_usec)
+{
+  has_waiter = true;
+  applyWaitSetChanges();
+
+  uint64_t current_time = getCurrentTimeUSec();
+  uint64_t next_time    = queueDueTimers(current_time);
+  if (run_queue.empty())
+  {
+    uint64_t wait_usec = std::min(timeout_usec, next_time - current_time);
+    lock.unlock();
+    std::vector<size_t> ready_list = wait_set.wait(wait_usec);
+    lock.lock();
+
+    current_time = getCurrentTimeUSec();
+    for (size_t wait_handle : ready_list)
+    {
+      if (wait_handle == wake_handle)
+      {
+        wake_requested.store(false, std::memory_order_seq_cst);
+        continue;
+      }
+      if (wait_handle < wait_entry_list.size() && wait_entry_list[wait_handle])
+      {
+        queueEntry(wait_entry_list[wait_handle], current_time);
+      }
+    }
+    queueDueTimers(current_time);
+  }
+
+  // Apply removals requested during the wait so that remove() can return without another round
+  applyWaitSetChanges();
+  has_waiter = false;
+  condition.notify_all();
+}
+
+//! @brief コールバックを実行待ちにする
+//! @param [in] entry コールバック
+//! @param [in] ready_time_usec 準備ができた時刻[usec]．遅延の計測の起点となる
+void
+Executor::queueEntry(const std::shared_ptr<Entry> &entry, uint64_t ready_time_usec)
+{
+  if (entry->is_removed || entry->is_queued || entry->is_running)
+  {
+    return;
+  }
+  entry->is_queued       = true;
+  entry->is_busy         = true;
+  entry->ready_time_usec = ready_time_usec;
+  entry->ready_order     = next_ready_order++;
+  run_queue.push_back(entry);
+}
+
+//! @brief 予定時刻を過ぎたタイマーを実行待ちにする
+//! @param [in] current_time 現在時刻[usec]
+//! @return uint64_t 次のタイマーの予定時刻[usec]．タイマーが無い場合は最大値
+uint64_t
+Executor::queueDueTimers(uint64_t current_time)
+{
+  uint64_t next_time = std::numeric_limits<uint64_t>::max();
+  for (auto &entry : timer_list)
+  {
+    if (entry->is_queued || entry->is_running)
+    {
+      continue;
+    }
+    if (entry->next_time_usec <= current_time)
+    {
+      queueEntry(entry, entry->next_time_usec);
+      continue;
+    }
+    next_time = std::min(next_time, entry->next_time_usec);
+  }
+  return std::max(next_time, current_time);
+}
+
+//! @brief 最も優先度の高いコールバックを取り出す
+//! @return std::shared_ptr<Entry> コールバック．実行待ちが無い場合はnullptr
+//! @details 優先度が同じ場合は準備ができた順に取り出す．
+std::shared_ptr<Executor::Entry>
+Executor::popReadyEntry()
+{
+  if (run_queue.empty())
+  {
+    return nullptr;
+  }
+  auto it = std::min_element(run_queue.begin(), run_queue.end(),
+                             [](const std::shared_ptr<Entry> &a, const std::shared_ptr<Entry> &b)
+                             {
+                               if (a->options.priority != b->options.priority)
+                               {
+                                 return a->options.priority > b->options.priority;
+                               }
+                               return a->ready_order < b->ready_order;
+                             });
+  std::shared_ptr<Entry> entry = *it;
+  run_queue.erase(it);
+  entry->is_queued = false;
+  return entry;
+}
+
+//! @brief コールバックを実行する
+//! @param [in] entry コールバック
+//! @param [in] lock 保持しているmutexのロック．実行中は解放する
+void
+Executor::execute(const std::shared_ptr<Entry> &entry, std::unique_lock<std::mutex> &lock)
+{
+  entry->is_running     = true;
+  entry->running_thread = std::this_thread::get_id();
+  lock.unlock();
+  try
+  {
+    entry->callback();
+  }
+  catch (...)
+  {
+    lock.lock();
+    finishEntry(entry, getCurrentTimeUSec());
+    throw;
+  }
+  uint64_t finish_time = getCurrentTimeUSec();
+  uint64_t latency     = finish_time - std::min(finish_time, entry->ready_time_usec);
+  if (entry->options.deadline_usec > 0 && latency > entry->options.deadline_usec && entry->options.on_deadline_miss)
+  {
+    entry->options.on_deadline_miss(latency);
+  }
+  lock.lock();
+  finishEntry(entry, finish_time);
+}
+
+//! @brief 実行を終えたコールバックの統計を更新し、再び待機の対象にする
+//! @param [in] entry コールバック
+//! @param [in] finish_time 実行を終えた時刻[usec]
+void
+Executor::finishEntry(const std::shared_ptr<Entry> &entry, uint64_t finish_time)
+{
+  uint64_t latency = finish_time - std::min(finish_time, entry->ready_time_usec);
+  entry->stats.call_num++;
+  entry->stats.last_latency_usec = latency;
+  entry->stats.max_latency_usec  = std::max(entry->stats.max_latency_usec, latency);
+  if (entry->options.deadline_usec > 0 && latency > entry->options.deadline_usec)
+  {
+    entry->stats.deadline_miss_num++;
+  }
+
+  if (entry->period_usec > 0)
+  {
+    // Skip the periods that were missed while running instead of firing them back to back
+    entry->next_time_usec += entry->period_usec;
+    if (entry->next_time_usec <= finish_time)
+    {
+      entry->next_time_usec += (finish_time - entry->next_time_usec) / entry->period_usec * entry->period_usec +
+                               entry->period_usec;
+    }
+  }
+  entry->is_running = false;
+  entry->is_busy    = false;
+  if (has_waiter)
+  {
+    // The waiting thread skipped this callback while it was busy
+    wake();
+  }
+  condition.notify_all();
+}
+
+//! @brief WaitSetで待機中のスレッドを起こす
+//! @details mutexを保持した状態で呼び出すこと．
+void
+Executor::wake()
+{
+  wake_requested.store(true, std::memory_order_seq_cst);
+  wake_sequence.fetch_add(1, std::memory_order_seq_cst);
+  if (wake_waiter_num.load(std::memory_order_seq_cst) > 0)
+  {
+    futexWake(&wake_sequence);
+  }
+}
+
+}  // namespace shm
+
+}  // namespace irlab
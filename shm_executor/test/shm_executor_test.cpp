@@ -0,0 +1,297 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include "shm_base.hpp"
+#include "shm_pub_sub.hpp"
+#include "shm_service.hpp"
+#include "shm_action.hpp"
+#include "shm_executor.hpp"
+
+// Test data structures
+class SimpleGoal
+{
+public:
+    SimpleGoal() : value(0) {}
+    SimpleGoal(int v) : value(v) {}
+
+    int value;
+};
+
+class SimpleResult
+{
+public:
+    SimpleResult() : result(0) {}
+    SimpleResult(int r) : result(r) {}
+
+    int result;
+};
+
+class SimpleFeedback
+{
+public:
+    SimpleFeedback() : progress(0.0f) {}
+    SimpleFeedback(float p) : progress(p) {}
+
+    float progress;
+};
+
+int addOneService(int request)
+{
+    return request + 1;
+}
+
+int sleepyAddOneService(int request)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    return request + 1;
+}
+
+// Test fixture for Executor
+class SHMExecutorTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        cleanUp();
+    }
+
+    void TearDown() override
+    {
+        cleanUp();
+    }
+
+    void cleanUp()
+    {
+        irlab::shm::disconnectMemory("test_executor_topic_0");
+        irlab::shm::disconnectMemory("test_executor_topic_1");
+        irlab::shm::disconnectMemory("test_executor_service");
+        irlab::shm::disconnectMemory("test_executor_action");
+        for (int i = 0; i < 4; i++)
+        {
+            irlab::shm::disconnectMemory("test_executor_service_" + std::to_string(i));
+        }
+    }
+};
+
+// One thread receives every topic through a single WaitSet
+TEST_F(SHMExecutorTest, SubscriptionCallbackTest)
+{
+    irlab::shm::Publisher<int>  first_pub("/test_executor_topic_0");
+    irlab::shm::Publisher<int>  second_pub("/test_executor_topic_1");
+    irlab::shm::Subscriber<int> first_sub("/test_executor_topic_0");
+    irlab::shm::Subscriber<int> second_sub("/test_executor_topic_1");
+
+    std::mutex       result_mutex;
+    std::vector<int> first_values;
+    std::vector<int> second_values;
+    std::thread::id  callback_thread;
+    std::atomic<int> callback_num{0};
+
+    irlab::shm::Executor executor;
+    executor.addSubscription<int>(first_sub, [&](const int &value)
+    {
+        std::lock_guard<std::mutex> lock(result_mutex);
+        first_values.push_back(value);
+        callback_thread = std::this_thread::get_id();
+        callback_num++;
+    });
+    executor.addSubscription<int>(second_sub, [&](const int &value)
+    {
+        std::lock_guard<std::mutex> lock(result_mutex);
+        second_values.push_back(value);
+        callback_num++;
+    });
+    EXPECT_FALSE(executor.spinOnce(10000));
+
+    std::thread spin_thread([&]() { executor.spin(); });
+    for (int i = 0; i < 5; i++)
+    {
+        int expected_num = callback_num + 2;
+        first_pub.publish(i);
+        second_pub.publish(i * 10);
+        for (int retry = 0; retry < 1000 && callback_num < expected_num; retry++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    std::thread::id spin_thread_id = spin_thread.get_id();
+    executor.stop();
+    spin_thread.join();
+
+    EXPECT_EQ(first_values, std::vector<int>({ 0, 1, 2, 3, 4 }));
+    EXPECT_EQ(second_values, std::vector<int>({ 0, 10, 20, 30, 40 }));
+    EXPECT_EQ(callback_thread, spin_thread_id);
+}
+
+// Callbacks that are ready together run in priority order
+TEST_F(SHMExecutorTest, PriorityTest)
+{
+    irlab::shm::Publisher<int>  low_pub("/test_executor_topic_0");
+    irlab::shm::Publisher<int>  high_pub("/test_executor_topic_1");
+    irlab::shm::Subscriber<int> low_sub("/test_executor_topic_0");
+    irlab::shm::Subscriber<int> high_sub("/test_executor_topic_1");
+
+    std::vector<std::string> order;
+    irlab::shm::Executor     executor;
+    irlab::shm::ExecutorCallbackOptions low_options;
+    low_options.priority = 0;
+    irlab::shm::ExecutorCallbackOptions high_options;
+    high_options.priority = 10;
+    executor.addSubscription<int>(low_sub, [&](const int &) { order.push_back("low"); }, low_options);
+    executor.addSubscription<int>(high_sub, [&](const int &) { order.push_back("high"); }, high_options);
+
+    low_pub.publish(1);
+    high_pub.publish(2);
+    EXPECT_TRUE(executor.spinOnce(100000));
+    EXPECT_TRUE(executor.spinOnce(100000));
+    EXPECT_FALSE(executor.spinOnce(10000));
+    EXPECT_EQ(order, std::vector<std::string>({ "high", "low" }));
+}
+
+// Timers fire at their period and late runs are counted against the deadline
+TEST_F(SHMExecutorTest, TimerDeadlineTest)
+{
+    irlab::shm::Executor executor;
+    std::atomic<int>     tick_num{0};
+    size_t timer = executor.addTimer(10000, [&]() { tick_num++; });
+
+    std::atomic<int>                    miss_num{0};
+    irlab::shm::ExecutorCallbackOptions slow_options;
+    slow_options.deadline_usec    = 5000;
+    slow_options.on_deadline_miss = [&](uint64_t latency_usec)
+    {
+        EXPECT_GT(latency_usec, 5000u);
+        miss_num++;
+    };
+    size_t slow_timer = executor.addTimer(
+        30000, []() { std::this_thread::sleep_for(std::chrono::milliseconds(10)); }, slow_options);
+
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(200))
+    {
+        executor.spinOnce(10000);
+    }
+
+    irlab::shm::ExecutorCallbackStats stats = executor.getStats(timer);
+    EXPECT_EQ(stats.call_num, static_cast<uint64_t>(tick_num.load()));
+    EXPECT_GE(tick_num, 12);
+    EXPECT_LE(tick_num, 21);
+
+    irlab::shm::ExecutorCallbackStats slow_stats = executor.getStats(slow_timer);
+    EXPECT_GE(slow_stats.call_num, 4u);
+    EXPECT_EQ(slow_stats.deadline_miss_num, slow_stats.call_num);
+    EXPECT_EQ(static_cast<uint64_t>(miss_num.load()), slow_stats.deadline_miss_num);
+    EXPECT_GE(slow_stats.max_latency_usec, 10000u);
+
+    executor.remove(timer);
+    EXPECT_THROW(executor.getStats(timer), std::runtime_error);
+}
+
+// Services and actions are served from the same executor as the topics
+TEST_F(SHMExecutorTest, ServiceActionTest)
+{
+    irlab::shm::ServiceServerOptions options;
+    options.worker_num = 0;
+    irlab::shm::ServiceServer<int, int> service_server("/test_executor_service", addOneService,
+                                                       irlab::shm::DEFAULT_PERM,
+                                                       irlab::shm::DEFAULT_SERVICE_SLOT_NUM, options);
+    irlab::shm::ActionServer<SimpleGoal, SimpleResult, SimpleFeedback> action_server("/test_executor_action");
+
+    irlab::shm::Executor executor;
+    executor.addService(service_server);
+    executor.addAction<SimpleGoal, SimpleResult, SimpleFeedback>(
+        action_server, [&](irlab::shm::ActionGoalId goal_id, const SimpleGoal &goal)
+        { action_server.publishResult(goal_id, SimpleResult(goal.value * 2)); });
+    std::thread spin_thread([&]() { executor.spin(); });
+
+    irlab::shm::ServiceClient<int, int> service_client("/test_executor_service");
+    for (int i = 0; i < 10; i++)
+    {
+        int response = 0;
+        EXPECT_TRUE(service_client.call(i, &response));
+        EXPECT_EQ(response, i + 1);
+    }
+
+    irlab::shm::ActionClient<SimpleGoal, SimpleResult, SimpleFeedback> action_client("/test_executor_action");
+    ASSERT_TRUE(action_client.waitForServer(1000000));
+    irlab::shm::ActionGoalId goal_id;
+    ASSERT_TRUE(action_client.sendGoal(SimpleGoal(21), &goal_id));
+    EXPECT_TRUE(action_client.waitForResult(goal_id, 1000000));
+    EXPECT_EQ(action_client.getResult(goal_id).result, 42);
+
+    executor.stop();
+    spin_thread.join();
+}
+
+// A pool of threads runs independent callbacks at the same time
+TEST_F(SHMExecutorTest, ThreadPoolTest)
+{
+    irlab::shm::ServiceServerOptions options;
+    options.worker_num = 0;
+    std::vector<std::unique_ptr<irlab::shm::ServiceServer<int, int>>> servers;
+    std::vector<std::unique_ptr<irlab::shm::ServiceClient<int, int>>> clients;
+    irlab::shm::Executor executor;
+    for (int i = 0; i < 4; i++)
+    {
+        std::string name = "/test_executor_service_" + std::to_string(i);
+        servers.emplace_back(new irlab::shm::ServiceServer<int, int>(name, sleepyAddOneService,
+                                                                     irlab::shm::DEFAULT_PERM,
+                                                                     irlab::shm::DEFAULT_SERVICE_SLOT_NUM, options));
+        clients.emplace_back(new irlab::shm::ServiceClient<int, int>(name));
+        executor.addService(*servers.back());
+    }
+    std::thread spin_thread([&]() { executor.spin(4); });
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 4; i++)
+    {
+        futures.push_back(clients[i]->callAsync(i * 10));
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        EXPECT_EQ(futures[i].get(), i * 10 + 1);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    // The four 50ms handlers ran concurrently rather than one after another
+    EXPECT_LT(elapsed.count(), 150);
+
+    executor.stop();
+    spin_thread.join();
+}
+
+// Removing a callback stops it, and an exception from a callback ends spin()
+TEST_F(SHMExecutorTest, RemoveAndExceptionTest)
+{
+    irlab::shm::Publisher<int>  pub("/test_executor_topic_0");
+    irlab::shm::Subscriber<int> sub("/test_executor_topic_0");
+
+    irlab::shm::Executor executor;
+    std::atomic<int>     callback_num{0};
+    size_t handle = executor.addSubscription<int>(sub, [&](const int &) { callback_num++; });
+    pub.publish(1);
+    EXPECT_TRUE(executor.spinOnce(100000));
+    EXPECT_EQ(callback_num, 1);
+
+    executor.remove(handle);
+    pub.publish(2);
+    EXPECT_FALSE(executor.spinOnce(10000));
+    EXPECT_EQ(callback_num, 1);
+
+    executor.addTimer(1000, []() { throw std::runtime_error("timer failure"); });
+    EXPECT_THROW(executor.spin(2), std::runtime_error);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
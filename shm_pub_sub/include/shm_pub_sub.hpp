@@ -36,6 +36,7 @@ extern "C" {
 #include <sys/shm.h>
 }
 #include "shm_base.hpp"
+#include "shm_trace.hpp"
 
 namespace irlab
 {
@@ -43,13 +44,98 @@ namespace irlab
 namespace shm
 {
 
+// ****************************************************************************
+//! @class LoanedMessage
+//! @brief   \~english     Writable handle to a ring slot loaned by Publisher::loan()
+//!          \~japanese-en Publisher::loan() で貸し出されたリングバッファのスロットへの書き込みハンドル
+//! @details \~english     The topic is written directly into shared memory and made visible by
+//!          \~english     Publisher::publish(LoanedMessage&&). The slot still holds the bytes of an older message,
+//!          \~english     so every field must be written. Destroying an unpublished handle discards the slot.
+//!          \~japanese-en 共有メモリ上に直接トピックを書き込み、Publisher::publish(LoanedMessage&&) で公開する．
+//!          \~japanese-en スロットには古いトピックが残っているため、全てのメンバを書き込むこと．
+//!          \~japanese-en 公開せずに破棄した場合、スロットは空になる．
+// ****************************************************************************
+template <typename T>
+class LoanedMessage
+{
+public:
+  LoanedMessage();
+  LoanedMessage(RingBuffer *ring_buffer, int buffer_num);
+  ~LoanedMessage();
+
+  // コピーは禁止
+  LoanedMessage(const LoanedMessage &)            = delete;
+  LoanedMessage &operator=(const LoanedMessage &) = delete;
+
+  LoanedMessage(LoanedMessage &&other) noexcept;
+  LoanedMessage &operator=(LoanedMessage &&other) noexcept;
+
+  bool isValid() const;
+  T   *get() const;
+  T   &operator*() const;
+  T   *operator->() const;
+
+private:
+  template <typename U>
+  friend class Publisher;
+
+  RingBuffer *ring_buffer;
+  int         buffer_num;
+};
+
+// ****************************************************************************
+//! @class BorrowedMessage
+//! @brief   \~english     Read-only view of a ring slot pinned by Subscriber::borrow()
+//!          \~japanese-en Subscriber::borrow() で固定されたリングバッファのスロットへの読み込み専用ビュー
+//! @details \~english     While the view is alive the publisher skips the slot, so the topic can be read
+//!          \~english     without copying it. Release it promptly: each view removes one slot from the ring.
+//!          \~english     The view shares the ring buffer and its mapping, so it stays readable after the
+//!          \~english     Subscriber reconnects or is destroyed. A publisher restarted on the same segment
+//!          \~english     no longer honours the pin and may overwrite the slot.
+//!          \~japanese-en ビューが存在する間はPublisherがスロットを飛ばすため、コピーせずにトピックを参照できる．
+//!          \~japanese-en ビュー1つにつきリングバッファのスロットが1つ減るため、速やかに解放すること．
+//!          \~japanese-en ビューはリングバッファとそのマッピングを共有するため、Subscriberが再接続または
+//!          \~japanese-en 破棄された後も読み込める．同じ共有メモリ上で再起動したPublisherは固定を考慮せず、
+//!          \~japanese-en スロットを上書きする場合がある．
+// ****************************************************************************
+template <typename T>
+class BorrowedMessage
+{
+public:
+  BorrowedMessage();
+  BorrowedMessage(std::shared_ptr<RingBuffer> ring_buffer, int buffer_num);
+  ~BorrowedMessage();
+
+  // コピーは禁止
+  BorrowedMessage(const BorrowedMessage &)            = delete;
+  BorrowedMessage &operator=(const BorrowedMessage &) = delete;
+
+  BorrowedMessage(BorrowedMessage &&other) noexcept;
+  BorrowedMessage &operator=(BorrowedMessage &&other) noexcept;
+
+  bool     isValid() const;
+  const T *get() const;
+  size_t   size() const;
+  const T &operator*() const;
+  const T *operator->() const;
+  void     release();
+
+private:
+  std::shared_ptr<RingBuffer> ring_buffer;
+  int                         buffer_num;
+};
+
 // ****************************************************************************
 //! @class Publisher
 //! @brief   \~english     Class representing a publisher that outputs topics to shared memory
 //!          \~japanese-en 共有メモリにトピックを出力する出版者を表現するクラス
 //! @details \~english     This class is used to output the type or class given as template class as a topic.
 //!          \~japanese-en template classとして与えられた型またはクラスをトピックとして出力するためのクラスである．
+//!          \~english     Types that are not standard layout are encoded by their MessageCodec (SHM_REFLECT() for
+//!          \~english     the flat codec) straight into the slot, which grows like that of a vector topic.
 //!          \~japanese-en sizeofによってメモリの使用量が把握できる型およびクラスに対応している．
+//!          \~japanese-en 標準レイアウトでない型は MessageCodec (フラット形式の場合は SHM_REFLECT()) で直接スロットに
+//!          \~japanese-en 符号化され、スロットは可変長のトピックと同様に拡張される．
 //!          \~japanese-en また、特殊なものはtemplate classを特殊化して対応する．
 //!
 //! @note \~japanese-en 通常であれば、生成された共有メモリはデストラクタで破棄されるべきだと考えるのが自然であるが、
@@ -64,7 +150,8 @@ template <typename T>
 class Publisher
 {
 public:
-  Publisher(std::string name = "", int buffer_num = 3, PERM perm = DEFAULT_PERM);
+  Publisher(std::string name = "", int buffer_num = 3, PERM perm = DEFAULT_PERM,
+            const SharedMemoryOptions &options = SharedMemoryOptions());
   ~Publisher() = default;
 
   // コピーは禁止
@@ -74,14 +161,22 @@ public:
   // ムーブコンストラクタ：ポインタを奪い、元を nullptr に
   Publisher(Publisher &&other) noexcept = default;
 
-  void publish(const T &data);
+  void             publish(const T &data);
+  LoanedMessage<T> loan();
+  void             publish(LoanedMessage<T> &&message);
+  void             reserve(size_t size);
 
 private:
-  std::string                   shm_name;
-  int                           shm_buf_num;
-  PERM                          shm_perm;
-  std::unique_ptr<SharedMemory> shared_memory;
-  std::unique_ptr<RingBuffer>   ring_buffer;
+  void publishSerialized(const T &data);
+  void reconnectRingBuffer();
+  void registerTopic();
+
+  std::string                    shm_name;
+  int                            shm_buf_num;
+  PERM                           shm_perm;
+  std::unique_ptr<SharedMemory>  shared_memory;
+  std::unique_ptr<RingBuffer>    ring_buffer;
+  std::unique_ptr<TopicRegistry> topic_registry;
 
   size_t data_size;
 };
@@ -99,7 +194,7 @@ template <typename T>
 class Subscriber
 {
 public:
-  Subscriber(std::string name = "");
+  Subscriber(std::string name = "", const SharedMemoryOptions &options = SharedMemoryOptions());
   ~Subscriber() = default;
 
   // コピーは禁止
@@ -109,19 +204,33 @@ public:
   // ムーブコンストラクタ：ポインタを奪い、元を nullptr に
   Subscriber(Subscriber &&other) noexcept = default;
 
-  const T &subscribe(bool *state);
-  bool     waitFor(uint64_t timeout_usec);
-  void     setDataExpiryTime_us(uint64_t time_us);
-  // 共有メモリが存在し、初期化済みかを確認。未接続なら接続を試み、初期化を待つ。ring_bufferは作らない。
+  const T           &subscribe(bool *state);
+  const T           &subscribeNext(bool *is_success);
+  size_t             drain(T *data, size_t max_num);
+  uint64_t           getOverrunNum() const;
+  BorrowedMessage<T> borrow();
+  bool               waitFor(uint64_t timeout_usec);
+  bool               getWaitTarget(WaitTarget *target);
+  void               setDataExpiryTime_us(uint64_t time_us);
+  void               setSpinTime_us(uint64_t time_us);
+  // 共有メモリが存在し、初期化済みかを確認。待たずに接続を1段階進める。ring_bufferは作らない。
   bool existsPublisherMemory();
 
 private:
-  std::string                   shm_name;
-  std::unique_ptr<SharedMemory> shared_memory;
-  std::unique_ptr<RingBuffer>   ring_buffer;
-  int                           current_reading_buffer;
-  uint64_t                      data_expiry_time_us;
-  T                             return_buffer_;
+  bool pollConnection();
+  bool connectRingBuffer();
+  void checkTopicType(uint64_t type_hash);
+  bool copyBuffer(int buffer_num, T *data);
+
+  std::string                      shm_name;
+  std::unique_ptr<TopicConnection> connection;
+  std::shared_ptr<RingBuffer>      ring_buffer;
+  std::unique_ptr<TopicRegistry>   topic_registry;
+  uint64_t                         attach_num;
+  int                              current_reading_buffer;
+  uint64_t                         data_expiry_time_us;
+  uint64_t                         spin_time_us;
+  T                                return_buffer_;
 };
 
 // ****************************************************************************
@@ -130,6 +239,188 @@ private:
 // （テンプレートクラス内の関数の定義はコンパイル時に実体化するのでヘッダに書く）
 // ****************************************************************************
 
+template <typename T>
+LoanedMessage<T>::LoanedMessage()
+  : ring_buffer(nullptr)
+  , buffer_num(-1)
+{
+}
+
+template <typename T>
+LoanedMessage<T>::LoanedMessage(RingBuffer *ring_buffer, int buffer_num)
+  : ring_buffer(ring_buffer)
+  , buffer_num(buffer_num)
+{
+}
+
+//! @brief \~english     Destructor
+//!        \~japanese-en デストラクタ
+//! @details \~english     Discards the slot if the message has not been published.
+//!          \~japanese-en 公開されていない場合はスロットを破棄する．
+template <typename T>
+LoanedMessage<T>::~LoanedMessage()
+{
+  if (isValid())
+  {
+    ring_buffer->abortBuffer(buffer_num);
+  }
+}
+
+template <typename T>
+LoanedMessage<T>::LoanedMessage(LoanedMessage &&other) noexcept
+  : ring_buffer(other.ring_buffer)
+  , buffer_num(other.buffer_num)
+{
+  other.ring_buffer = nullptr;
+  other.buffer_num  = -1;
+}
+
+template <typename T>
+LoanedMessage<T> &
+LoanedMessage<T>::operator=(LoanedMessage &&other) noexcept
+{
+  if (this != &other)
+  {
+    if (isValid())
+    {
+      ring_buffer->abortBuffer(buffer_num);
+    }
+    ring_buffer       = other.ring_buffer;
+    buffer_num        = other.buffer_num;
+    other.ring_buffer = nullptr;
+    other.buffer_num  = -1;
+  }
+  return *this;
+}
+
+template <typename T>
+bool
+LoanedMessage<T>::isValid() const
+{
+  return ring_buffer != nullptr && buffer_num >= 0;
+}
+
+template <typename T>
+T *
+LoanedMessage<T>::get() const
+{
+  return isValid() ? reinterpret_cast<T *>(ring_buffer->getBufferPtr(buffer_num)) : nullptr;
+}
+
+template <typename T>
+T &
+LoanedMessage<T>::operator*() const
+{
+  return *get();
+}
+
+template <typename T>
+T *
+LoanedMessage<T>::operator->() const
+{
+  return get();
+}
+
+template <typename T>
+BorrowedMessage<T>::BorrowedMessage()
+  : ring_buffer(nullptr)
+  , buffer_num(-1)
+{
+}
+
+template <typename T>
+BorrowedMessage<T>::BorrowedMessage(std::shared_ptr<RingBuffer> ring_buffer, int buffer_num)
+  : ring_buffer(std::move(ring_buffer))
+  , buffer_num(buffer_num)
+{
+}
+
+//! @brief \~english     Destructor
+//!        \~japanese-en デストラクタ
+//! @details \~english     Unpins the slot so that the publisher can overwrite it again.
+//!          \~japanese-en スロットの固定を解除し、Publisherが再び上書きできるようにする．
+template <typename T>
+BorrowedMessage<T>::~BorrowedMessage()
+{
+  release();
+}
+
+template <typename T>
+BorrowedMessage<T>::BorrowedMessage(BorrowedMessage &&other) noexcept
+  : ring_buffer(std::move(other.ring_buffer))
+  , buffer_num(other.buffer_num)
+{
+  other.buffer_num = -1;
+}
+
+template <typename T>
+BorrowedMessage<T> &
+BorrowedMessage<T>::operator=(BorrowedMessage &&other) noexcept
+{
+  if (this != &other)
+  {
+    release();
+    ring_buffer      = std::move(other.ring_buffer);
+    buffer_num       = other.buffer_num;
+    other.buffer_num = -1;
+  }
+  return *this;
+}
+
+template <typename T>
+bool
+BorrowedMessage<T>::isValid() const
+{
+  return ring_buffer != nullptr && buffer_num >= 0;
+}
+
+template <typename T>
+const T *
+BorrowedMessage<T>::get() const
+{
+  return isValid() ? reinterpret_cast<const T *>(ring_buffer->getBufferPtr(buffer_num)) : nullptr;
+}
+
+//! @brief \~english     Number of elements in the pinned slot
+//!        \~japanese-en 固定したスロットの要素数
+//! @return size_t \~english     1 for a fixed-size topic, the length for a vector topic, 0 if invalid
+//!                \~japanese-en 固定長のトピックでは1、可変長のトピックでは要素数、無効な場合は0
+template <typename T>
+size_t
+BorrowedMessage<T>::size() const
+{
+  return isValid() ? ring_buffer->getDataSize(buffer_num) / sizeof(T) : 0;
+}
+
+template <typename T>
+const T &
+BorrowedMessage<T>::operator*() const
+{
+  return *get();
+}
+
+template <typename T>
+const T *
+BorrowedMessage<T>::operator->() const
+{
+  return get();
+}
+
+//! @brief \~english     Release the pinned slot before destruction
+//!        \~japanese-en 破棄前にスロットの固定を解除する
+template <typename T>
+void
+BorrowedMessage<T>::release()
+{
+  if (isValid())
+  {
+    ring_buffer->unpinBuffer(buffer_num);
+  }
+  // Unmaps the segment if the subscriber has already moved on to a new one
+  ring_buffer.reset();
+  buffer_num = -1;
+}
+
 //! @brief \~english     Constructor
 //!        \~japanese-en コンストラクタ
 //! @param [in] name       \~english     Shared-memory name
@@ -138,27 +429,30 @@ private:
 //!                        \~japanese-en バッファ数
 //! @param [in] perm       \~english     Permission infomation
 //!                        \~japanese-en 権限情報
+//! @param [in] options    \~english     Backing and placement options of the shared memory
+//!                        \~japanese-en 共有メモリの確保方法と配置に関する設定
 //! @return                \~english     None
 //!                        \~japanese-en なし
 //! @details \~english     Create shared memory objects and initialize mutex and condition variables.
 //!          \~japanese-en 共有メモリオブジェクトの生成、mutexや条件変数の初期化を行う．
 template <typename T>
-Publisher<T>::Publisher(std::string name, int buffer_num, PERM perm)
+Publisher<T>::Publisher(std::string name, int buffer_num, PERM perm, const SharedMemoryOptions &options)
   : shm_name(name)
   , shm_buf_num(buffer_num)
   , shm_perm(perm)
   , shared_memory(nullptr)
   , ring_buffer(nullptr)
-  , data_size(sizeof(T))
+  , topic_registry(nullptr)
+  , data_size(is_serialized_message<T>::value ? 0 : sizeof(T))
 {
   // Enhanced type checking for shared memory compatibility
-  if (!std::is_standard_layout<T>::value)
+  if (!is_transferable_message<T>())
   {
-    throw std::runtime_error("shm::Publisher: Type must have standard layout for shared memory!");
+    throw std::runtime_error("shm::Publisher: Type must have standard layout or a MessageCodec for shared memory!");
   }
 
   // Only enforce strict requirements on ARM platforms
-  if constexpr (is_arm_platform())
+  if constexpr (is_arm_platform() && !is_serialized_message<T>::value)
   {
     if (!std::is_trivially_copyable<T>::value)
     {
@@ -179,34 +473,47 @@ Publisher<T>::Publisher(std::string name, int buffer_num, PERM perm)
 
   try
   {
-    shared_memory = std::make_unique<SharedMemoryPosix>(shm_name, O_RDWR | O_CREAT, shm_perm);
-    shared_memory->connect(RingBuffer::getSize(sizeof(T), shm_buf_num));
+    shared_memory = std::make_unique<SharedMemoryPosix>(shm_name, O_RDWR | O_CREAT, shm_perm, options);
+    shared_memory->connect(RingBuffer::getSize(data_size, shm_buf_num));
 
     if (shared_memory->isDisconnected())
     {
       throw std::runtime_error("shm::Publisher: Cannot get memory!");
     }
 
-    ring_buffer = std::make_unique<RingBuffer>(shared_memory->getPtr(), sizeof(T), shm_buf_num);
-
-    // Enhanced initialization synchronization for ARM processors
-    // Wait for pthread structures to be properly initialized
-    uint64_t       start_time = getCurrentTimeUSec();
-    const uint64_t timeout    = 1000;  // 1 second timeout
-
-    while (getCurrentTimeUSec() - start_time < timeout)
+    // A serialized topic joins the ring whatever slot size the other publisher has grown it to
+    bool is_attachable = is_serialized_message<T>::value
+                             ? RingBuffer::checkAttachable(shared_memory->getPtr(), shm_buf_num)
+                             : RingBuffer::checkAttachable(shared_memory->getPtr(), data_size, shm_buf_num);
+    if (is_attachable)
     {
-      if (RingBuffer::checkInitialized(shared_memory->getPtr()))
+      // Another publisher is alive on this topic: join its ring instead of resetting it
+      ring_buffer = std::make_unique<RingBuffer>(shared_memory->getPtr());
+      if (!checkTypeHash(ring_buffer->getTypeHash(), getTopicTypeHash<T>()))
       {
-        break;
+        throw std::runtime_error("Topic type does not match that of the other publisher!");
       }
-      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      data_size = ring_buffer->getElementSize();
+    }
+    else
+    {
+      ring_buffer =
+          std::make_unique<RingBuffer>(shared_memory->getPtr(), data_size, shm_buf_num, getTopicTypeHash<T>());
     }
+    ring_buffer->registerClient(RingBuffer::CLIENT_PUBLISHER);
 
-    if (!RingBuffer::checkInitialized(shared_memory->getPtr()))
+    // Enhanced initialization synchronization for ARM processors
+    // Wait on the initialization futex for pthread structures to be properly initialized (1 second timeout)
+    if (!RingBuffer::waitForInitialization(shared_memory->getPtr(), 1000000))
     {
       throw std::runtime_error("shm::Publisher: RingBuffer initialization timeout");
     }
+
+    if (options.use_topic_registry)
+    {
+      topic_registry = std::make_unique<TopicRegistry>();
+      registerTopic();
+    }
   }
   catch (const std::runtime_error &e)
   {
@@ -219,85 +526,296 @@ Publisher<T>::Publisher(std::string name, int buffer_num, PERM perm)
 //! @param [in] data
 //! @return  \~english     None
 //!          \~japanese-en なし
-//! @details \~english     Writes the topic to the buffer with the oldest timestamp and updates the timestamp.
-//!          \~english     It also sends a resume signal to the waiting process via a pthread condition variable.
-//!          \~japanese-en タイムスタンプが最も古いバッファにトピックを書き込み、タイムスタンプを更新する．
-//!          \~japanese-en また、pthreadの条件変数を介して、待機中のプロセスに再開信号を送る．
+//! @details \~english     Writes the topic to the slot pointed to by the write index and commits it.
+//!          \~english     It also wakes up the waiting processes via a futex.
+//!          \~japanese-en 書き込みインデックスが指すスロットにトピックを書き込み、確定する．
+//!          \~japanese-en また、futexを介して、待機中のプロセスに再開信号を送る．
 template <typename T>
 void
 Publisher<T>::publish(const T &data)
 {
-  int oldest_buffer = ring_buffer->getOldestBufferNum();
-  for (size_t i = 0; i < 10; i++)
+  if (ring_buffer->hasReservedBuffer())
   {
-    if (ring_buffer->allocateBuffer(oldest_buffer))
-    {
-      break;
-    }
-    usleep(1000);  // Wait for 1ms
-    oldest_buffer = ring_buffer->getOldestBufferNum();
+    throw std::runtime_error("shm::Publisher: Cannot publish while a loaned message is outstanding!");
+  }
+  if constexpr (is_serialized_message<T>::value)
+  {
+    publishSerialized(data);
+    return;
   }
+  [[maybe_unused]] uint64_t begin_time_us = SHM_TRACE_TIME();
+  int                       oldest_buffer = ring_buffer->reserveBuffer();
+  if (oldest_buffer < 0)
+  {
+    // Every slot is pinned by subscribers: drop the message rather than overwrite a borrowed one
+    return;
+  }
+  SHM_TRACE_AT(PUBLISH_BEGIN, shm_name, ring_buffer->getSequenceNumber(oldest_buffer), begin_time_us);
 
   // Cross-platform aligned memory access
-  unsigned char *data_ptr      = ring_buffer->getDataList();
-  size_t         buffer_offset = oldest_buffer * sizeof(T);
+  unsigned char *data_ptr = ring_buffer->getBufferPtr(oldest_buffer);
 
   if constexpr (is_arm_platform())
   {
     // ARM: Use memcpy for safer memory access
-    if (!irlab::shm::is_aligned<T>(data_ptr + buffer_offset))
+    if (!irlab::shm::is_aligned<T>(data_ptr))
     {
       // Use memcpy for unaligned access on ARM
-      std::memcpy(data_ptr + buffer_offset, &data, sizeof(T));
+      std::memcpy(data_ptr, &data, sizeof(T));
     }
     else
     {
-      T *typed_ptr = irlab::shm::align_pointer<T>(data_ptr + buffer_offset);
+      T *typed_ptr = irlab::shm::align_pointer<T>(data_ptr);
       *typed_ptr   = data;
     }
   }
   else
   {
     // x86/x64: Direct cast is safe
-    T *typed_ptr = reinterpret_cast<T *>(data_ptr + buffer_offset);
+    T *typed_ptr = reinterpret_cast<T *>(data_ptr);
     *typed_ptr   = data;
   }
 
-  // struct timespec t;
-  // clock_gettime(CLOCK_MONOTONIC_RAW, &t);
-  // ring_buffer->setTimestamp_us(((uint64_t) t.tv_sec * 1000000L) + ((uint64_t) t.tv_nsec / 1000L), oldest_buffer);
+  uint64_t current_time_us = getClockTimeUSec();
+  ring_buffer->commitBuffer(oldest_buffer, current_time_us);
+  SHM_TRACE(PUBLISH_COMMIT, shm_name, ring_buffer->getSequenceNumber(oldest_buffer));
 
-  uint64_t current_time_us = getCurrentTimeUSec();
-  ring_buffer->setTimestamp_us(current_time_us, oldest_buffer);
+  ring_buffer->signal();
+}
+
+//! @brief \~english     Loan the next ring slot for zero-copy writing
+//!        \~japanese-en 次のスロットをコピーなしの書き込み用に借りる
+//! @param None \~japanese-en なし
+//! @return LoanedMessage<T> \~english     Handle to the slot (invalid if every slot is pinned by subscribers)
+//!                          \~japanese-en スロットへのハンドル(全てのスロットが固定されている場合は無効)
+//! @details \~english     Only one loan may be outstanding per publisher.
+//!          \~japanese-en 1つのPublisherにつき、同時に借りられるスロットは1つのみである．
+template <typename T>
+LoanedMessage<T>
+Publisher<T>::loan()
+{
+  static_assert(!is_serialized_message<T>::value, "shm::Publisher: Serialized topics cannot be loaned");
+  if (ring_buffer->hasReservedBuffer())
+  {
+    throw std::runtime_error("shm::Publisher: Previous loaned message is not published yet!");
+  }
+  [[maybe_unused]] uint64_t begin_time_us = SHM_TRACE_TIME();
+  int                       buffer_num    = ring_buffer->reserveBuffer();
+  if (buffer_num < 0)
+  {
+    return LoanedMessage<T>();
+  }
+  SHM_TRACE_AT(PUBLISH_BEGIN, shm_name, ring_buffer->getSequenceNumber(buffer_num), begin_time_us);
+  return LoanedMessage<T>(ring_buffer.get(), buffer_num);
+}
+
+//! @brief \~english     Publish a loaned message
+//!        \~japanese-en 借りたスロットのトピックを公開する
+//! @param [in] message \~english     Handle returned by loan()
+//!                     \~japanese-en loan() で取得したハンドル
+//! @return  \~english     None
+//!          \~japanese-en なし
+//! @details \~english     Commits the slot without copying and wakes up the waiting processes.
+//!          \~japanese-en コピーせずにスロットを確定し、待機中のプロセスを起床させる．
+template <typename T>
+void
+Publisher<T>::publish(LoanedMessage<T> &&message)
+{
+  if (!message.isValid())
+  {
+    return;
+  }
+  if (message.ring_buffer != ring_buffer.get())
+  {
+    throw std::runtime_error("shm::Publisher: Loaned message belongs to another publisher!");
+  }
+
+  ring_buffer->commitBuffer(message.buffer_num, getClockTimeUSec());
+  SHM_TRACE(PUBLISH_COMMIT, shm_name, ring_buffer->getSequenceNumber(message.buffer_num));
+  message.ring_buffer = nullptr;
+  message.buffer_num  = -1;
 
   ring_buffer->signal();
 }
 
+//! @brief \~english     Reserve the slot size of a serialized topic
+//!        \~japanese-en シリアライズするトピックのスロットの大きさを確保する
+//! @param [in] size \~english     Encoded size each slot must hold [byte]
+//!                  \~japanese-en 1スロットに格納できる符号化後の大きさ[byte]
+//! @return  \~english     None
+//!          \~japanese-en なし
+//! @details \~english     Growing the slots seals the ring and recreates the shared memory, so subscribers and
+//!          \~english     other publishers reconnect on their next access.
+//!          \~english     Reserving the largest expected size before publishing avoids the reconnection.
+//!          \~japanese-en スロットを拡張するとリングバッファを封鎖して共有メモリを作り直すため、
+//!          \~japanese-en 購読者と他のPublisherは次回の読み書きの際に再接続する．
+//!          \~japanese-en 出版前に想定される最大の大きさを確保しておくことで再接続を避けられる．
+template <typename T>
+void
+Publisher<T>::reserve(size_t size)
+{
+  static_assert(is_serialized_message<T>::value, "shm::Publisher: Only serialized topics have a variable slot size");
+  if (shared_memory->isDisconnected() || !ring_buffer->isCurrentGeneration())
+  {
+    reconnectRingBuffer();
+  }
+  while (size > data_size && !ring_buffer->sealForResize())
+  {
+    // Another publisher is growing the ring: follow it, it may already have made enough room
+    reconnectRingBuffer();
+  }
+  if (size <= data_size)
+  {
+    return;
+  }
+
+  // The sealed segment is unlinked as before, so subscribers still drain what was published into it
+  data_size = size;
+  ring_buffer.reset();
+  shared_memory->disconnectAndUnlink();
+  shared_memory->connect(RingBuffer::getSize(data_size, shm_buf_num));
+  if (shared_memory->isDisconnected())
+  {
+    throw std::runtime_error("shm::Publisher: Cannot allocate shared memory!");
+  }
+
+  ring_buffer = std::make_unique<RingBuffer>(shared_memory->getPtr(), data_size, shm_buf_num, getTopicTypeHash<T>());
+  ring_buffer->registerClient(RingBuffer::CLIENT_PUBLISHER);
+  registerTopic();
+}
+
+//! @brief \~english     Encode a topic straight into the next slot
+//!        \~japanese-en トピックを次のスロットに直接符号化する
+//! @param [in] data \~english     Topic to publish
+//!                  \~japanese-en 出版するトピック
+//! @details \~english     The slot grows geometrically when the encoded topic does not fit.
+//!          \~japanese-en 符号化したトピックが収まらない場合は、スロットを倍々に拡張する．
+template <typename T>
+void
+Publisher<T>::publishSerialized(const T &data)
+{
+  if (shared_memory->isDisconnected() || !ring_buffer->isCurrentGeneration())
+  {
+    reconnectRingBuffer();
+  }
+  size_t size = MessageCodec<T>::getSize(data);
+  if (size > data_size)
+  {
+    reserve(std::max(size, data_size * 2));
+  }
+
+  [[maybe_unused]] uint64_t begin_time_us = SHM_TRACE_TIME();
+  int                       oldest_buffer = ring_buffer->reserveBuffer();
+  if (oldest_buffer < 0)
+  {
+    // Every slot is pinned by subscribers: drop the message rather than overwrite a borrowed one
+    return;
+  }
+  if (!ring_buffer->isCurrentGeneration())
+  {
+    // Another publisher sealed the ring to grow it; write into the new generation instead
+    ring_buffer->abortBuffer(oldest_buffer);
+    publishSerialized(data);
+    return;
+  }
+  SHM_TRACE_AT(PUBLISH_BEGIN, shm_name, ring_buffer->getSequenceNumber(oldest_buffer), begin_time_us);
+  MessageCodec<T>::serialize(data, ring_buffer->getBufferPtr(oldest_buffer));
+  ring_buffer->setDataSize(oldest_buffer, size);
+  ring_buffer->commitBuffer(oldest_buffer, getClockTimeUSec());
+  SHM_TRACE(PUBLISH_COMMIT, shm_name, ring_buffer->getSequenceNumber(oldest_buffer));
+
+  ring_buffer->signal();
+}
+
+//! @brief \~english     Reconnect to shared memory recreated by another publisher
+//!        \~japanese-en 他の出版者が作り直した共有メモリへ接続し直す
+//! @details \~english     Takes over the slot size of the new shared memory.
+//!          \~japanese-en 新しい共有メモリのスロットの大きさを引き継ぐ．
+template <typename T>
+void
+Publisher<T>::reconnectRingBuffer()
+{
+  // The entry belongs to the previous generation and may have been handed to another client
+  ring_buffer->abandonClient();
+  ring_buffer.reset();
+  // The growing publisher seals the old segment before unlinking it, so the name may still refer to the
+  // sealed one for a while: reopen until the new segment is initialized
+  uint64_t start_time = getCurrentTimeUSec();
+  while (true)
+  {
+    shared_memory->disconnect();
+    shared_memory->connect();
+    if (!shared_memory->isDisconnected() && RingBuffer::waitForInitialization(shared_memory->getPtr(), 10000) &&
+        !shared_memory->isDisconnected() &&
+        RingBuffer::getRequiredSize(shared_memory->getPtr()) <= shared_memory->getSize())
+    {
+      break;
+    }
+    if (getCurrentTimeUSec() - start_time >= 500000)
+    {
+      throw std::runtime_error("shm::Publisher: Cannot reconnect to shared memory!");
+    }
+  }
+
+  ring_buffer = std::make_unique<RingBuffer>(shared_memory->getPtr());
+  data_size   = ring_buffer->getElementSize();
+  ring_buffer->registerClient(RingBuffer::CLIENT_PUBLISHER);
+}
+
+//! @brief \~english     Record the topic in the topic registry
+//!        \~japanese-en トピックをトピックレジストリに記録する
+//! @details \~english     Does nothing unless SharedMemoryOptions::use_topic_registry was set.
+//!          \~japanese-en SharedMemoryOptions::use_topic_registry を指定していない場合は何もしない．
+template <typename T>
+void
+Publisher<T>::registerTopic()
+{
+  if (topic_registry == nullptr)
+  {
+    return;
+  }
+  TopicInfo info;
+  info.name         = shm_name;
+  info.type_hash    = getTopicTypeHash<T>();
+  info.element_size = data_size;
+  info.buffer_num   = static_cast<size_t>(shm_buf_num);
+  info.pid          = getpid();
+  if (!topic_registry->registerTopic(info))
+  {
+    throw std::runtime_error("shm::Publisher: Topic registry is full!");
+  }
+}
+
 //! @brief \~english     Constructor
 //!        \~japanese-en コンストラクタ
-//! @param [in] name \~english     Shared-memory name
-//!                  \~japanese-en 共有メモリ名
+//! @param [in] name    \~english     Shared-memory name
+//!                     \~japanese-en 共有メモリ名
+//! @param [in] options \~english     Backing and placement options of the shared memory
+//!                     \~japanese-en 共有メモリの確保方法と配置に関する設定
 //! @return  \~english     None
 //!          \~japanese-en なし
 //! @details \~english     Access to shared memory.
 //!          \~japanese-en 共有メモリへのアクセスを行う．
 template <typename T>
-Subscriber<T>::Subscriber(std::string name)
+Subscriber<T>::Subscriber(std::string name, const SharedMemoryOptions &options)
   : shm_name(name)
-  , shared_memory(nullptr)
+  , connection(nullptr)
   , ring_buffer(nullptr)
+  , topic_registry(nullptr)
+  , attach_num(0)
   , current_reading_buffer(0)
   , data_expiry_time_us(2000000)
+  , spin_time_us(0)
   , return_buffer_()
 {
   // Enhanced type checking for shared memory compatibility
-  if (!std::is_standard_layout<T>::value)
+  if (!is_transferable_message<T>())
   {
-    throw std::runtime_error("shm::Subscriber: Type must have standard layout for shared memory!");
+    throw std::runtime_error("shm::Subscriber: Type must have standard layout or a MessageCodec for shared memory!");
   }
 
   // Only enforce strict requirements on ARM platforms
-  if constexpr (is_arm_platform())
+  if constexpr (is_arm_platform() && !is_serialized_message<T>::value)
   {
     if (!std::is_trivially_copyable<T>::value)
     {
@@ -318,7 +836,11 @@ Subscriber<T>::Subscriber(std::string name)
 
   try
   {
-    shared_memory = std::make_unique<SharedMemoryPosix>(shm_name, O_RDWR, static_cast<PERM>(0));
+    connection = std::make_unique<TopicConnection>(shm_name, options);
+    if (options.use_topic_registry)
+    {
+      topic_registry = std::make_unique<TopicRegistry>();
+    }
   }
   catch (const std::runtime_error &e)
   {
@@ -341,132 +863,324 @@ template <typename T>
 const T &
 Subscriber<T>::subscribe(bool *is_success)
 {
-  if (shared_memory->isDisconnected())
+  if (!connectRingBuffer())
   {
-    if (ring_buffer != nullptr)
-    {
-      ring_buffer.reset();
-    }
-    shared_memory->connect();
-    if (shared_memory->isDisconnected())
+    *is_success = false;
+    return return_buffer_;
+  }
+
+  // Copy the newest slot and retry if the publisher overwrote it during the copy
+  int  newest_buffer;
+  bool is_copied;
+  do
+  {
+    newest_buffer = ring_buffer->getNewestBufferNum();
+    if (newest_buffer < 0)
     {
       *is_success = false;
       return return_buffer_;
     }
-    try
+    is_copied = copyBuffer(newest_buffer, &return_buffer_);
+  } while (!ring_buffer->verifyBuffer(newest_buffer));
+
+  *is_success            = is_copied;
+  current_reading_buffer = newest_buffer;
+  SHM_TRACE(SUBSCRIBE, shm_name, ring_buffer->getReadSequence() / 2);
+  return return_buffer_;
+}
+
+//! @brief \~english     Subscribe the next unread topic in publication order
+//!        \~japanese-en 未読のトピックを出版順に1つ読み込む
+//! @param [out] is_success \~english     True if an unread topic was loaded
+//!                         \~japanese-en 未読のトピックを読み込めた場合は真
+//! @return const T& \~english     Const reference to the loaded topic.
+//!                  \~japanese-en 読み込んだトピックへのconst参照
+//! @details \~english     Queue mode: each subscriber keeps its own read cursor, starting from the oldest topic
+//!          \~english     left in the ring. Topics overwritten before being read are counted by getOverrunNum().
+//!          \~japanese-en キューモード：Subscriberごとに読み込みカーソルを持ち、リングバッファに残る最も古いトピックから読み込む．
+//!          \~japanese-en 読み込む前に上書きされたトピックは getOverrunNum() で数えられる．
+template <typename T>
+const T &
+Subscriber<T>::subscribeNext(bool *is_success)
+{
+  *is_success = false;
+  if (!connectRingBuffer())
+  {
+    return return_buffer_;
+  }
+
+  while (true)
+  {
+    int next_buffer = ring_buffer->getNextBufferNum();
+    if (next_buffer < 0)
     {
-      if (shared_memory->getPtr() == nullptr)
-      {
-        *is_success = false;
-        return return_buffer_;
-      }
-      // Wait for initialization to complete
-      if (!RingBuffer::waitForInitialization(shared_memory->getPtr(), 500000))
-      {  // 500ms timeout (increased)
-        *is_success = false;
-        return return_buffer_;
-      }
-      ring_buffer = std::make_unique<RingBuffer>(shared_memory->getPtr());
+      return return_buffer_;
     }
-    catch (const std::bad_alloc &e)
+    bool is_copied = copyBuffer(next_buffer, &return_buffer_);
+    if (ring_buffer->consumeBuffer(next_buffer) && is_copied)
     {
-      *is_success = false;
+      *is_success            = true;
+      current_reading_buffer = next_buffer;
+      SHM_TRACE(SUBSCRIBE, shm_name, ring_buffer->getReadSequence() / 2);
       return return_buffer_;
     }
-    ring_buffer->setDataExpiryTime_us(data_expiry_time_us);
   }
-  // 既に接続済みだが ring_buffer が未初期化の場合に対応
-  else if (ring_buffer == nullptr)
+}
+
+//! @brief \~english     Read every unread topic in publication order
+//!        \~japanese-en 未読のトピックを出版順にまとめて読み込む
+//! @param [out] data    \~english     Destination array
+//!                      \~japanese-en 格納先の配列
+//! @param [in]  max_num \~english     Capacity of the destination array
+//!                      \~japanese-en 格納先の配列の要素数
+//! @return size_t \~english     Number of topics stored
+//!                \~japanese-en 格納したトピックの数
+//! @details \~english     Batch version of subscribeNext() for consumers waking up after a stall.
+//!          \~japanese-en 停止後に起床したSubscriber向けの subscribeNext() の一括版．
+template <typename T>
+size_t
+Subscriber<T>::drain(T *data, size_t max_num)
+{
+  if (data == nullptr || !connectRingBuffer())
+  {
+    return 0;
+  }
+
+  size_t read_num = 0;
+  while (read_num < max_num)
   {
-    try
+    int next_buffer = ring_buffer->getNextBufferNum();
+    if (next_buffer < 0)
     {
-      ring_buffer = std::make_unique<RingBuffer>(shared_memory->getPtr());
-      ring_buffer->setDataExpiryTime_us(data_expiry_time_us);
+      break;
     }
-    catch (const std::bad_alloc &e)
+    bool is_copied = copyBuffer(next_buffer, &data[read_num]);
+    if (ring_buffer->consumeBuffer(next_buffer) && is_copied)
     {
-      *is_success = false;
-      return return_buffer_;
+      current_reading_buffer = next_buffer;
+      read_num++;
+      SHM_TRACE(SUBSCRIBE, shm_name, ring_buffer->getReadSequence() / 2);
     }
   }
+  return read_num;
+}
 
-  int newest_buffer = ring_buffer->getNewestBufferNum();
-  if (newest_buffer < 0)
+//! @brief \~english     Number of topics lost in queue mode
+//!        \~japanese-en キューモードで取りこぼしたトピックの数
+//! @param None \~japanese-en なし
+//! @return uint64_t \~english     Topics overwritten by the publisher before subscribeNext()/drain() read them
+//!                  \~japanese-en subscribeNext()/drain() で読み込む前にPublisherに上書きされたトピックの数
+template <typename T>
+uint64_t
+Subscriber<T>::getOverrunNum() const
+{
+  return (ring_buffer != nullptr) ? ring_buffer->getOverrunNum() : 0;
+}
+
+//! @brief \~english     Borrow the newest topic without copying
+//!        \~japanese-en 最新のトピックをコピーせずに借りる
+//! @param None \~japanese-en なし
+//! @return BorrowedMessage<T> \~english     View pinned to the newest slot (invalid if no topic is available)
+//!                            \~japanese-en 最新のスロットに固定されたビュー(トピックがない場合は無効)
+template <typename T>
+BorrowedMessage<T>
+Subscriber<T>::borrow()
+{
+  static_assert(!is_serialized_message<T>::value, "shm::Subscriber: Serialized topics cannot be borrowed");
+  if (!connectRingBuffer())
   {
-    *is_success = false;
-    return return_buffer_;
+    return BorrowedMessage<T>();
   }
-  // Cross-platform aligned memory access
-  unsigned char *data_ptr      = ring_buffer->getDataList();
-  size_t         buffer_offset = newest_buffer * sizeof(T);
 
-  *is_success            = true;
+  int newest_buffer;
+  do
+  {
+    newest_buffer = ring_buffer->getNewestBufferNum();
+    if (newest_buffer < 0)
+    {
+      return BorrowedMessage<T>();
+    }
+  } while (!ring_buffer->pinBuffer(newest_buffer));
+
   current_reading_buffer = newest_buffer;
+  SHM_TRACE(SUBSCRIBE, shm_name, ring_buffer->getReadSequence() / 2);
+  return BorrowedMessage<T>(ring_buffer, newest_buffer);
+}
 
-  if constexpr (is_arm_platform())
+//! @brief \~english     Copy a ring slot
+//!        \~japanese-en リングバッファのスロットをコピーする
+//! @param [in]  buffer_num \~english     Slot to copy
+//!                         \~japanese-en コピーするスロット
+//! @param [out] data       \~english     Destination
+//!                         \~japanese-en コピー先
+//! @return bool \~english     False if a serialized topic could not be decoded
+//!              \~japanese-en シリアライズしたトピックを復号できなかった場合は偽
+template <typename T>
+bool
+Subscriber<T>::copyBuffer(int buffer_num, T *data)
+{
+  // Cross-platform aligned memory access
+  unsigned char *buffer_ptr = ring_buffer->getBufferPtr(buffer_num);
+
+  if constexpr (is_serialized_message<T>::value)
+  {
+    // Decoded into the reused object; a slot overwritten meanwhile fails here or at verification
+    return MessageCodec<T>::deserialize(buffer_ptr, ring_buffer->getDataSize(buffer_num), data);
+  }
+  else if constexpr (is_arm_platform())
   {
     // ARM: Use safer memory copy approach
-    if (!irlab::shm::is_aligned<T>(data_ptr + buffer_offset))
+    if (!irlab::shm::is_aligned<T>(buffer_ptr))
     {
       // Use memcpy for unaligned access on ARM
-      std::memcpy(&return_buffer_, data_ptr + buffer_offset, sizeof(T));
+      std::memcpy(data, buffer_ptr, sizeof(T));
     }
     else
     {
-      T *typed_ptr   = irlab::shm::align_pointer<T>(data_ptr + buffer_offset);
-      return_buffer_ = *typed_ptr;
+      T *typed_ptr = irlab::shm::align_pointer<T>(buffer_ptr);
+      *data        = *typed_ptr;
     }
-    return return_buffer_;
   }
   else
   {
     // x86/x64: Direct cast is safe
-    T *typed_ptr   = reinterpret_cast<T *>(data_ptr + buffer_offset);
-    return_buffer_ = *typed_ptr;
-    return return_buffer_;
+    T *typed_ptr = reinterpret_cast<T *>(buffer_ptr);
+    *data        = *typed_ptr;
   }
+  return true;
 }
 
+//! @brief \~english     Advance the connection without blocking
+//!        \~japanese-en ブロックせずに接続を進める
+//! @param None \~japanese-en なし
+//! @return bool \~english     True if an initialized ring buffer is mapped
+//!              \~japanese-en 初期化済みのリングバッファをマップしていれば真
+//! @details \~english     The ring buffer is dropped without touching the client registry when the segment was
+//!          \~english     re-initialized or re-mapped, since its entry may belong to another client by then.
+//!          \~japanese-en 共有メモリが初期化し直された場合やマップし直された場合は、エントリが既に他のクライアントの
+//!          \~japanese-en ものになっている可能性があるため、クライアント登録に触れずにリングバッファを破棄する．
 template <typename T>
 bool
-Subscriber<T>::waitFor(uint64_t timeout_usec)
+Subscriber<T>::pollConnection()
 {
-  if (shared_memory->isDisconnected())
+  bool is_attached = connection->poll();
+  if (ring_buffer != nullptr && (!is_attached || connection->getAttachNum() != attach_num))
   {
-    if (ring_buffer != nullptr)
-    {
-      ring_buffer.reset();
-    }
-    shared_memory->connect();
-    if (shared_memory->isDisconnected())
-    {
-      return false;
-    }
+    ring_buffer->abandonClient();
+    ring_buffer.reset();
+  }
+  return is_attached;
+}
 
-    // Wait for initialization to complete
-    if (!RingBuffer::waitForInitialization(shared_memory->getPtr(), 500000))
-    {  // 500ms timeout (increased)
+//! @brief \~english     Connect to the shared memory and attach the ring buffer
+//!        \~japanese-en 共有メモリに接続し、リングバッファを構築する
+//! @param None \~japanese-en なし
+//! @return bool \~english     True if the ring buffer is ready to read
+//!              \~japanese-en リングバッファが読み込み可能であれば真
+//! @details \~english     The ring buffer is rebuilt only when the connection attached to a new generation.
+//!          \~japanese-en リングバッファは、接続が新しい世代に接続した場合のみ作り直す．
+template <typename T>
+bool
+Subscriber<T>::connectRingBuffer()
+{
+  if (connection->getPtr() == nullptr && topic_registry != nullptr)
+  {
+    // An unregistered topic is rejected without opening its shared memory
+    TopicInfo info;
+    if (!topic_registry->lookup(shm_name, &info))
+    {
       return false;
     }
-
-    ring_buffer = std::make_unique<RingBuffer>(shared_memory->getPtr());
-    ring_buffer->setDataExpiryTime_us(data_expiry_time_us);
+    checkTopicType(info.type_hash);
   }
-  // 既に接続済みだが ring_buffer が未初期化の場合に対応
-  else if (ring_buffer == nullptr)
+  if (!pollConnection())
+  {
+    return false;
+  }
+  if (ring_buffer == nullptr)
   {
     try
     {
-      ring_buffer = std::make_unique<RingBuffer>(shared_memory->getPtr());
-      ring_buffer->setDataExpiryTime_us(data_expiry_time_us);
+      ring_buffer = connection->createRingBuffer();
     }
     catch (const std::bad_alloc &e)
     {
       return false;
     }
+    attach_num = connection->getAttachNum();
+    checkTopicType(ring_buffer->getTypeHash());
+    ring_buffer->setDataExpiryTime_us(data_expiry_time_us);
+    ring_buffer->setSpinTime_us(spin_time_us);
+    ring_buffer->registerClient(RingBuffer::CLIENT_SUBSCRIBER);
   }
+  return true;
+}
 
-  return ring_buffer->waitFor(timeout_usec);
+//! @brief \~english     Check the type fingerprint of the topic against T
+//!        \~japanese-en トピックの型の指紋をTと照合する
+//! @param [in] type_hash \~english     Fingerprint recorded by the publisher
+//!                       \~japanese-en 出版者が記録した指紋
+//! @details \~english     Throws on a mismatch instead of returning unrelated bytes as T. The shared memory is
+//!          \~english     released first, so every later read checks again.
+//!          \~japanese-en 一致しない場合は、無関係なバイト列をTとして返さずに例外を投げる．
+//!          \~japanese-en 先に共有メモリを解放するため、以降の読み込みでも再度確認する．
+template <typename T>
+void
+Subscriber<T>::checkTopicType(uint64_t type_hash)
+{
+  if (!checkTypeHash(type_hash, getTopicTypeHash<T>()))
+  {
+    ring_buffer.reset();
+    connection->disconnect();
+    throw std::runtime_error("shm::Subscriber: Topic type does not match that of the publisher!");
+  }
+}
+
+//! @brief \~english     Wait for the topic to be updated
+//!        \~japanese-en トピックの更新を待つ
+//! @param [in] timeout_usec \~english     Timeout [usec]
+//!                          \~japanese-en 待ち時間[usec]
+//! @return bool \~english     True if the topic was updated within the timeout
+//!              \~japanese-en 時間内にトピックが更新された場合は真
+//! @details \~english     Before the publisher is available, the time is spent waiting for it to appear.
+//!          \~japanese-en Publisherが存在しない間は、その作成を待つことに時間を使う．
+template <typename T>
+bool
+Subscriber<T>::waitFor(uint64_t timeout_usec)
+{
+  uint64_t start_time = getCurrentTimeUSec();
+  if (!connectRingBuffer())
+  {
+    if (!connection->waitForAttach(timeout_usec) || !connectRingBuffer())
+    {
+      return false;
+    }
+  }
+
+  uint64_t elapsed    = getCurrentTimeUSec() - start_time;
+  bool     is_updated = ring_buffer->waitFor(elapsed < timeout_usec ? timeout_usec - elapsed : 0);
+  if (is_updated)
+  {
+    SHM_TRACE(WAIT_WAKE, shm_name, ring_buffer->getWriteIndex());
+  }
+  return is_updated;
+}
+
+//! @brief \~english     Futex word for waiting on this topic with WaitSet
+//!        \~japanese-en WaitSetでこのトピックを待つためのfutexワードを取得する
+//! @param [out] target \~english     Update sequence of the ring buffer and the check used by waitFor()
+//!                     \~japanese-en リングバッファの更新シーケンスと waitFor() と同じ更新の確認
+//! @return bool \~english     False while the publisher's shared memory is not available
+//!              \~japanese-en Publisherの共有メモリが存在しない間は偽
+template <typename T>
+bool
+Subscriber<T>::getWaitTarget(WaitTarget *target)
+{
+  if (!connectRingBuffer())
+  {
+    return false;
+  }
+  return ring_buffer->getWaitTarget(target);
 }
 
 template <typename T>
@@ -480,30 +1194,37 @@ Subscriber<T>::setDataExpiryTime_us(uint64_t time_us)
   }
 }
 
+//! @brief \~english     Set the busy-wait duration used by waitFor() before sleeping
+//!        \~japanese-en waitFor() でスリープする前にビジーウェイトする時間を設定する
+//! @param [in] time_us \~english     Spin duration [usec] (0 disables spinning)
+//!                     \~japanese-en ビジーウェイト時間[usec]（0で無効）
+//! @details \~english     Intended for subscribers pinned to isolated cores, where the wake-up latency of the futex
+//!          \~english     sleep matters more than the CPU time spent polling.
+//!          \~japanese-en 専有コアに割り当てたSubscriber向けの設定であり、CPU時間よりも起床遅延を優先する場合に使用する．
 template <typename T>
-bool
-Subscriber<T>::existsPublisherMemory()
+void
+Subscriber<T>::setSpinTime_us(uint64_t time_us)
 {
-  // safety check
-  if (shared_memory == nullptr)
+  spin_time_us = time_us;
+  if (ring_buffer != nullptr)
   {
-    return false;
+    ring_buffer->setSpinTime_us(spin_time_us);
   }
+}
 
-  // 既に接続済みで初期化済みなら true
-  if (!shared_memory->isDisconnected())
+template <typename T>
+bool
+Subscriber<T>::existsPublisherMemory()
+{
+  // レジストリを使う場合：未接続の間は共有メモリを開かずに登録の有無で判断する
+  if (topic_registry != nullptr && connection->getPtr() == nullptr)
   {
-    unsigned char *ptr = shared_memory->getPtr();
-    if (ptr != nullptr && RingBuffer::checkInitialized(ptr))
-    {
-      return true;
-    }
+    TopicInfo info;
+    return topic_registry->lookup(shm_name, &info);
   }
 
-  // 未接続の場合：OS レベルで共有メモリの存在確認のみ
-  // connect() は呼ばず、exists() で存在と初期化を確認
-  // ファイルが存在して未初期化なら、タイムアウト付きで初期化待ち
-  return shared_memory->isExists(500000);  // 500ms timeout
+  // 待たずに接続を1段階進める．マッピングはそのまま購読に使う
+  return pollConnection();
 }
 
 }  // namespace shm
@@ -8,6 +8,7 @@
 #ifndef __SHM_PS_VECTOR_LIB_H__
 #define __SHM_PS_VECTOR_LIB_H__
 
+#include <algorithm>
 #include <iostream>
 #include <limits>
 #include <string>
@@ -39,27 +40,36 @@ namespace shm
 //! @note 通常であれば、生成された共有メモリはデストラクタで破棄されるべきだと考えるのが自然であるが、
 //! 意図せずプログラムが再起動したような場合に共有メモリが破棄されてしまうと、値の更新が読み取れなかったり
 //! 以前に送っていた指令が読み取れなくなったりするなどの問題が生じる可能性があるため、あえて破棄していない．
-//! 一度確保した共有メモリにサイズの異なるデータを格納しようとするとデータが破損するため、
-//! システムを再度立ち上げ直す際には共有メモリを破棄する操作を行うことを推奨する．
+//! 各スロットは容量(要素数)分の領域を持ち、実際に書き込んだ長さはスロットごとに記録される．
+//! 容量を超えるデータが出版された場合のみ、容量を倍増させて共有メモリを作り直す．
+//! 作り直す前に古いリングバッファを封鎖するため、同じトピックの他のPublisherは新しい共有メモリに接続し直す．
 // ****************************************************************************
 template <class T>
 class Publisher<std::vector<T>>
 {
 public:
-  Publisher(std::string name = "", int buffer_num = 3, PERM perm = DEFAULT_PERM);
+  Publisher(std::string name = "", int buffer_num = 3, PERM perm = DEFAULT_PERM,
+            const SharedMemoryOptions &options = SharedMemoryOptions());
   ~Publisher() = default;
 
-  void publish(const std::vector<T> &data);
-  void _publish(const std::vector<T> data);
+  void   publish(const std::vector<T> &data);
+  void   publish(const T *data, size_t num);
+  void   _publish(const std::vector<T> data);
+  void   reserve(size_t capacity);
+  size_t capacity() const;
 
 private:
-  std::string                   shm_name;
-  int                           shm_buf_num;
-  PERM                          shm_perm;
-  std::unique_ptr<SharedMemory> shared_memory;
-  std::unique_ptr<RingBuffer>   ring_buffer;
+  void reconnectRingBuffer();
+  void registerTopic();
 
-  size_t vector_size;
+  std::string                    shm_name;
+  int                            shm_buf_num;
+  PERM                           shm_perm;
+  std::unique_ptr<SharedMemory>  shared_memory;
+  std::unique_ptr<RingBuffer>    ring_buffer;
+  std::unique_ptr<TopicRegistry> topic_registry;
+
+  size_t vector_capacity;
 };
 
 // ****************************************************************************
@@ -71,22 +81,36 @@ template <typename T>
 class Subscriber<std::vector<T>>
 {
 public:
-  Subscriber(std::string name = "");
+  Subscriber(std::string name = "", const SharedMemoryOptions &options = SharedMemoryOptions());
   ~Subscriber() = default;
 
   const std::vector<T> &subscribe(bool *is_success);
+  bool                  subscribe(std::vector<T> &data, bool skip_unchanged = false);
+  size_t                subscribe(T *data, size_t max_num, bool *is_success, bool skip_unchanged = false);
+  BorrowedMessage<T>    borrow();
   bool                  waitFor(uint64_t timeout_usec);
+  bool                  getWaitTarget(WaitTarget *target);
   void                  setDataExpiryTime_us(uint64_t time_us);
+  void                  setSpinTime_us(uint64_t time_us);
 
 private:
-  std::string                   shm_name;
-  std::unique_ptr<SharedMemory> shared_memory;
-  std::unique_ptr<RingBuffer>   ring_buffer;
-  int                           current_reading_buffer;
-  uint64_t                      data_expiry_time_us;
-
-  size_t         vector_size;
+  bool connectRingBuffer();
+  void checkTopicType(uint64_t type_hash);
+  void copyBuffer(int buffer_num, std::vector<T> &data);
+
+  std::string                      shm_name;
+  std::unique_ptr<TopicConnection> connection;
+  std::shared_ptr<RingBuffer>      ring_buffer;
+  std::unique_ptr<TopicRegistry>   topic_registry;
+  uint64_t                         attach_num;
+  int                              current_reading_buffer;
+  uint64_t                         data_expiry_time_us;
+  uint64_t                         spin_time_us;
+
+  uint64_t       last_read_sequence;
+  size_t         last_read_num;
   std::vector<T> return_buffer_;
+  uint64_t       return_buffer_sequence;
 };
 
 // ****************************************************************************
@@ -98,86 +122,232 @@ private:
 //! @param [in] name 共有メモリ名
 //! @param [in] buffer_num バッファ数
 //! @param [in] perm 権限情報
+//! @param [in] options 共有メモリの確保方法と配置に関する設定
 //! @return なし
 //! @details 共有メモリオブジェクトの生成、mutexや条件変数の初期化を行う．
+//! 動作中の他のPublisherがいる場合は初期化せずに参加し、そのリングバッファの容量を引き継ぐ．
 template <typename T>
-Publisher<std::vector<T>>::Publisher(std::string name, int buffer_num, PERM perm)
+Publisher<std::vector<T>>::Publisher(std::string name, int buffer_num, PERM perm,
+                                     const SharedMemoryOptions &options)
   : shm_name(name)
   , shm_buf_num(buffer_num)
   , shm_perm(perm)
   , shared_memory(nullptr)
   , ring_buffer(nullptr)
-  , vector_size(0)
+  , topic_registry(nullptr)
+  , vector_capacity(0)
 {
   if (!std::is_standard_layout<T>::value)
   {
     throw std::runtime_error("shm::Publisher: Be setted not POD class in vector!");
   }
 
-  shared_memory = std::make_unique<SharedMemoryPosix>(shm_name, O_RDWR | O_CREAT, shm_perm);
-  shared_memory->connect(RingBuffer::getSize(vector_size, shm_buf_num));
+  shared_memory = std::make_unique<SharedMemoryPosix>(shm_name, O_RDWR | O_CREAT, shm_perm, options);
+  shared_memory->connect(RingBuffer::getSize(vector_capacity, shm_buf_num));
   if (shared_memory->isDisconnected())
   {
     throw std::runtime_error("shm::Publisher: Cannot get memory!");
   }
 
-  ring_buffer = std::make_unique<RingBuffer>(shared_memory->getPtr(), vector_size, shm_buf_num);
+  if (RingBuffer::checkAttachable(shared_memory->getPtr(), shm_buf_num))
+  {
+    // Another publisher is alive on this topic: join its ring with whatever capacity it has grown to
+    ring_buffer = std::make_unique<RingBuffer>(shared_memory->getPtr());
+    if (!checkTypeHash(ring_buffer->getTypeHash(), getTopicTypeHash<T>()))
+    {
+      throw std::runtime_error("shm::Publisher: Topic type does not match that of the other publisher!");
+    }
+    vector_capacity = ring_buffer->getElementSize() / sizeof(T);
+  }
+  else
+  {
+    ring_buffer =
+        std::make_unique<RingBuffer>(shared_memory->getPtr(), vector_capacity, shm_buf_num, getTopicTypeHash<T>());
+  }
+  ring_buffer->registerClient(RingBuffer::CLIENT_PUBLISHER);
+
+  if (options.use_topic_registry)
+  {
+    topic_registry = std::make_unique<TopicRegistry>();
+    registerTopic();
+  }
 }
 
-//! @brief トピックの書き込み
-//! @param [in] data
+//! @brief スロットの容量を確保する
+//! @param [in] capacity 1スロットあたりに格納できる要素数
 //! @return なし
-//! @details タイムスタンプが最も古いバッファにトピックを書き込み、タイムスタンプを更新する．
-//! また、pthreadの条件変数を介して、待機中のプロセスに再開信号を送る．
-//! @note python対応のために、boostを使用しているので、boostの条件変数でも良いかもしれない。
+//! @details 現在の容量以下であれば何もしない．容量を増やす場合は古いリングバッファを封鎖してから共有メモリを
+//! 作り直すため、購読者と他のPublisherは次回の読み書きの際に再接続する．
+//! 最大長が既知であれば、出版前に呼び出すことで再接続を避けられる．
 template <typename T>
 void
-Publisher<std::vector<T>>::publish(const std::vector<T> &data)
+Publisher<std::vector<T>>::reserve(size_t capacity)
 {
-  if (data.size() != vector_size)
+  if (shared_memory->isDisconnected() || !ring_buffer->isCurrentGeneration())
   {
-    vector_size = data.size();
-    ring_buffer.reset();
-    shared_memory->disconnectAndUnlink();
-    shared_memory->connect(RingBuffer::getSize(sizeof(T) * vector_size, shm_buf_num));
+    reconnectRingBuffer();
+  }
+  while (capacity > vector_capacity && !ring_buffer->sealForResize())
+  {
+    // Another publisher is growing the ring: follow it, it may already have made enough room
+    reconnectRingBuffer();
+  }
+  if (capacity <= vector_capacity)
+  {
+    return;
+  }
 
-    if (shared_memory->isDisconnected())
-    {
-      throw std::runtime_error("shm::Publisher: Cannot allocate shared memory!");
-    }
+  // The sealed segment is unlinked as before, so readers still drain what was published into it
+  vector_capacity = capacity;
+  ring_buffer.reset();
+  shared_memory->disconnectAndUnlink();
+  shared_memory->connect(RingBuffer::getSize(sizeof(T) * vector_capacity, shm_buf_num));
 
-    ring_buffer = std::make_unique<RingBuffer>(shared_memory->getPtr(), sizeof(T) * vector_size, shm_buf_num);
+  if (shared_memory->isDisconnected())
+  {
+    throw std::runtime_error("shm::Publisher: Cannot allocate shared memory!");
   }
 
-  int oldest_buffer = ring_buffer->getOldestBufferNum();
-  for (size_t i = 0; i < 10; i++)
+  ring_buffer = std::make_unique<RingBuffer>(shared_memory->getPtr(), sizeof(T) * vector_capacity, shm_buf_num,
+                                             getTopicTypeHash<T>());
+  ring_buffer->registerClient(RingBuffer::CLIENT_PUBLISHER);
+  registerTopic();
+}
+
+//! @brief スロットの容量の取得
+//! @return size_t 1スロットあたりに格納できる要素数
+template <typename T>
+size_t
+Publisher<std::vector<T>>::capacity() const
+{
+  return vector_capacity;
+}
+
+//! @brief 他の出版者が作り直した共有メモリへ接続し直す
+//! @return なし
+//! @details 同じトピックの別の出版者が容量を増やした場合に、新しい共有メモリの容量を引き継ぐ．
+template <typename T>
+void
+Publisher<std::vector<T>>::reconnectRingBuffer()
+{
+  // The entry belongs to the previous generation and may have been handed to another client
+  ring_buffer->abandonClient();
+  ring_buffer.reset();
+  // The growing publisher seals the old segment before unlinking it, so the name may still refer to the
+  // sealed one for a while: reopen until the new segment is initialized
+  uint64_t start_time = getCurrentTimeUSec();
+  while (true)
   {
-    if (ring_buffer->allocateBuffer(oldest_buffer))
+    shared_memory->disconnect();
+    shared_memory->connect();
+    if (!shared_memory->isDisconnected() && RingBuffer::waitForInitialization(shared_memory->getPtr(), 10000) &&
+        !shared_memory->isDisconnected() &&
+        RingBuffer::getRequiredSize(shared_memory->getPtr()) <= shared_memory->getSize())
     {
       break;
     }
-    usleep(1000);  // Wait for 1ms
-    oldest_buffer = ring_buffer->getOldestBufferNum();
+    if (getCurrentTimeUSec() - start_time >= 500000)
+    {
+      throw std::runtime_error("shm::Publisher: Cannot reconnect to shared memory!");
+    }
+  }
+
+  ring_buffer     = std::make_unique<RingBuffer>(shared_memory->getPtr());
+  vector_capacity = ring_buffer->getElementSize() / sizeof(T);
+  ring_buffer->registerClient(RingBuffer::CLIENT_PUBLISHER);
+}
+
+//! @brief トピックをトピックレジストリに記録する
+//! @return なし
+//! @details SharedMemoryOptions::use_topic_registry を指定していない場合は何もしない．
+template <typename T>
+void
+Publisher<std::vector<T>>::registerTopic()
+{
+  if (topic_registry == nullptr)
+  {
+    return;
+  }
+  TopicInfo info;
+  info.name         = shm_name;
+  info.type_hash    = getTopicTypeHash<T>();
+  info.element_size = sizeof(T) * vector_capacity;
+  info.buffer_num   = static_cast<size_t>(shm_buf_num);
+  info.pid          = getpid();
+  if (!topic_registry->registerTopic(info))
+  {
+    throw std::runtime_error("shm::Publisher: Topic registry is full!");
+  }
+}
+
+//! @brief トピックの書き込み
+//! @param [in] data
+//! @return なし
+//! @details 書き込みインデックスが指すスロットにトピックと長さを書き込み、確定する．
+//! 容量を超える場合のみ共有メモリを作り直す．
+//! また、futexを介して、待機中のプロセスに再開信号を送る．
+template <typename T>
+void
+Publisher<std::vector<T>>::publish(const std::vector<T> &data)
+{
+  publish(data.data(), data.size());
+}
+
+//! @brief 配列をトピックとして書き込む
+//! @param [in] data 先頭アドレス
+//! @param [in] num 要素数
+//! @return なし
+//! @details std::vector を経由せずに、呼び出し側の配列から1回のコピーで書き込む．
+template <typename T>
+void
+Publisher<std::vector<T>>::publish(const T *data, size_t num)
+{
+  if (shared_memory->isDisconnected() || !ring_buffer->isCurrentGeneration())
+  {
+    reconnectRingBuffer();
+  }
+  if (num > vector_capacity)
+  {
+    // Grow geometrically so that a slowly growing topic does not recreate the segment on every publish
+    reserve(std::max(num, vector_capacity * 2));
+  }
+
+  [[maybe_unused]] uint64_t begin_time_us = SHM_TRACE_TIME();
+  int                       oldest_buffer = ring_buffer->reserveBuffer();
+  if (oldest_buffer < 0)
+  {
+    // Every candidate slot is pinned by a reader; drop the message as the scalar publisher does
+    return;
+  }
+  if (!ring_buffer->isCurrentGeneration())
+  {
+    // Another publisher sealed the ring to grow it; write into the new generation instead
+    ring_buffer->abortBuffer(oldest_buffer);
+    publish(data, num);
+    return;
   }
+  SHM_TRACE_AT(PUBLISH_BEGIN, shm_name, ring_buffer->getSequenceNumber(oldest_buffer), begin_time_us);
 
   // Cross-platform aligned memory access for vectors
-  unsigned char *data_ptr      = ring_buffer->getDataList();
-  size_t         buffer_offset = oldest_buffer * vector_size * sizeof(T);
+  unsigned char *data_ptr  = ring_buffer->getBufferPtr(oldest_buffer);
+  size_t         data_size = sizeof(T) * num;
 
   if constexpr (is_arm_platform())
   {
     // ARM: Always use memcpy for vector data safety
-    std::memcpy(data_ptr + buffer_offset, data.data(), sizeof(T) * vector_size);
+    std::memcpy(data_ptr, data, data_size);
   }
   else
   {
     // x86/x64: Direct pointer access is safe
-    T *first_ptr = reinterpret_cast<T *>(data_ptr + buffer_offset);
-    std::memcpy(first_ptr, data.data(), sizeof(T) * vector_size);
+    T *first_ptr = reinterpret_cast<T *>(data_ptr);
+    std::memcpy(first_ptr, data, data_size);
   }
+  ring_buffer->setDataSize(oldest_buffer, data_size);
 
-  uint64_t current_time_us = getCurrentTimeUSec();
-  ring_buffer->setTimestamp_us(current_time_us, oldest_buffer);
+  uint64_t current_time_us = getClockTimeUSec();
+  ring_buffer->commitBuffer(oldest_buffer, current_time_us);
+  SHM_TRACE(PUBLISH_COMMIT, shm_name, ring_buffer->getSequenceNumber(oldest_buffer));
 
   ring_buffer->signal();
 }
@@ -194,23 +364,132 @@ Publisher<std::vector<T>>::_publish(const std::vector<T> data)
 }
 
 //! @brief コンストラクタ
-//! @param [in] 共有メモリ名
+//! @param [in] name 共有メモリ名
+//! @param [in] options 共有メモリの確保方法と配置に関する設定
 //! @return なし
 //! @details 共有メモリへのアクセスを行う．
 template <typename T>
-Subscriber<std::vector<T>>::Subscriber(std::string name)
+Subscriber<std::vector<T>>::Subscriber(std::string name, const SharedMemoryOptions &options)
   : shm_name(name)
-  , shared_memory(nullptr)
+  , connection(nullptr)
   , ring_buffer(nullptr)
+  , topic_registry(nullptr)
+  , attach_num(0)
   , current_reading_buffer(0)
   , data_expiry_time_us(2000000)
+  , spin_time_us(0)
+  , last_read_sequence(0)
+  , last_read_num(0)
   , return_buffer_(0)
+  , return_buffer_sequence(0)
 {
   if (!std::is_standard_layout<T>::value)
   {
     throw std::runtime_error("shm::Subscriber: Be setted not POD class!");
   }
-  shared_memory = std::make_unique<SharedMemoryPosix>(shm_name, O_RDWR, static_cast<PERM>(0));
+  connection = std::make_unique<TopicConnection>(shm_name, options);
+  if (options.use_topic_registry)
+  {
+    topic_registry = std::make_unique<TopicRegistry>();
+  }
+}
+
+//! @brief リングバッファへの接続
+//! @param なし
+//! @return bool 接続できた場合は真
+//! @details 待たずに接続を進め、新しい世代のリングバッファに接続した場合のみ作り直して購読者として登録する．
+//! スロットごとに長さが記録されるため、要素数が変わっても再接続は不要である．
+template <typename T>
+bool
+Subscriber<std::vector<T>>::connectRingBuffer()
+{
+  if (connection->getPtr() == nullptr && topic_registry != nullptr)
+  {
+    // An unregistered topic is rejected without opening its shared memory
+    TopicInfo info;
+    if (!topic_registry->lookup(shm_name, &info))
+    {
+      return false;
+    }
+    checkTopicType(info.type_hash);
+  }
+
+  bool is_attached = connection->poll();
+  if (ring_buffer != nullptr && (!is_attached || connection->getAttachNum() != attach_num))
+  {
+    // The entry of a re-initialized or unmapped segment may belong to another client by now
+    ring_buffer->abandonClient();
+    ring_buffer.reset();
+  }
+  if (!is_attached)
+  {
+    return false;
+  }
+  if (ring_buffer != nullptr)
+  {
+    return true;
+  }
+
+  try
+  {
+    ring_buffer = connection->createRingBuffer();
+    attach_num  = connection->getAttachNum();
+    checkTopicType(ring_buffer->getTypeHash());
+    // Sequences restart in a recreated segment, so previously read data must not be treated as current
+    last_read_sequence     = 0;
+    return_buffer_sequence = 0;
+    ring_buffer->setDataExpiryTime_us(data_expiry_time_us);
+    ring_buffer->setSpinTime_us(spin_time_us);
+    ring_buffer->registerClient(RingBuffer::CLIENT_SUBSCRIBER);
+  }
+  catch (const std::bad_alloc &e)
+  {
+    return false;
+  }
+  return true;
+}
+
+//! @brief トピックの型の指紋を要素の型Tと照合する
+//! @param [in] type_hash 出版者が記録した指紋
+//! @return なし
+//! @details 一致しない場合は、スロットの長さを sizeof(T) で割った無関係な要素を返さずに例外を投げる．
+//! 先に共有メモリを解放するため、以降の読み込みでも再度確認する．
+template <typename T>
+void
+Subscriber<std::vector<T>>::checkTopicType(uint64_t type_hash)
+{
+  if (!checkTypeHash(type_hash, getTopicTypeHash<T>()))
+  {
+    ring_buffer.reset();
+    connection->disconnect();
+    throw std::runtime_error("shm::Subscriber: Topic type does not match that of the publisher!");
+  }
+}
+
+//! @brief スロットの内容をバッファにコピーする
+//! @param [in] buffer_num バッファ番号
+//! @param [out] data コピー先
+//! @return なし
+//! @details スロットに記録された長さだけコピーする．コピー先は容量が不足する場合のみ再確保される．
+template <typename T>
+void
+Subscriber<std::vector<T>>::copyBuffer(int buffer_num, std::vector<T> &data)
+{
+  unsigned char *data_ptr = ring_buffer->getBufferPtr(buffer_num);
+  size_t         data_num = ring_buffer->getDataSize(buffer_num) / sizeof(T);
+  data.resize(data_num);
+
+  if constexpr (is_arm_platform())
+  {
+    // ARM: Use safer memory copy approach for vectors
+    std::memcpy(data.data(), data_ptr, sizeof(T) * data_num);
+  }
+  else
+  {
+    // x86/x64: Direct pointer construction is safe
+    T *first_ptr = reinterpret_cast<T *>(data_ptr);
+    std::memcpy(data.data(), first_ptr, sizeof(T) * data_num);
+  }
 }
 
 //! @brief トピックを読み込む
@@ -222,142 +501,196 @@ template <typename T>
 const std::vector<T> &
 Subscriber<std::vector<T>>::subscribe(bool *is_success)
 {
-  if (shared_memory == nullptr || shared_memory->isDisconnected())
+  if (!connectRingBuffer())
   {
-    if (ring_buffer != nullptr)
-    {
-      ring_buffer.reset();
-    }
+    *is_success = false;
+    return return_buffer_;
+  }
 
-    // Clean up old connection before reconnecting
-    shared_memory->disconnect();
-    shared_memory->connect();
-    if (shared_memory->isDisconnected())
+  // Copy the newest slot and retry if the publisher overwrote it during the copy
+  int newest_buffer;
+  do
+  {
+    newest_buffer = ring_buffer->getNewestBufferNum();
+    if (newest_buffer < 0)
     {
       *is_success = false;
       return return_buffer_;
     }
-
-    try
+    if (ring_buffer->getReadSequence() == return_buffer_sequence)
     {
-      if (shared_memory->getPtr() == nullptr)
-      {
-        *is_success = false;
-        return return_buffer_;
-      }
+      // The internal buffer already holds this topic
+      break;
+    }
+    copyBuffer(newest_buffer, return_buffer_);
+  } while (!ring_buffer->verifyBuffer(newest_buffer));
 
-      std::cerr << "[Subscriber::subscribe] Waiting for initialization..." << std::endl;
-      // Wait for initialization to complete
-      if (!RingBuffer::waitForInitialization(shared_memory->getPtr(), 500000))
-      {  // 500ms timeout (increased)
-        *is_success = false;
-        return return_buffer_;
-      }
+  *is_success            = true;
+  current_reading_buffer = newest_buffer;
+  return_buffer_sequence = ring_buffer->getReadSequence();
+  last_read_sequence     = return_buffer_sequence;
+  last_read_num          = return_buffer_.size();
+  SHM_TRACE(SUBSCRIBE, shm_name, last_read_sequence / 2);
+  return return_buffer_;
+}
+
+//! @brief トピックを呼び出し側のバッファに読み込む
+//! @param [out] data 読み込み先．容量が不足する場合のみ再確保される
+//! @param [in] skip_unchanged 真の場合、前回読み込んだトピックから更新されていなければコピーしない
+//! @return bool 読み込みに成功した場合は真
+//! @details 内部バッファを経由せずに1回のコピーで読み込む．
+//! skip_unchanged を真にする場合は、前回と同じバッファを渡すこと(更新がなければ内容はそのまま残る)．
+template <typename T>
+bool
+Subscriber<std::vector<T>>::subscribe(std::vector<T> &data, bool skip_unchanged)
+{
+  if (!connectRingBuffer())
+  {
+    return false;
+  }
 
-      ring_buffer         = std::make_unique<RingBuffer>(shared_memory->getPtr());
-      size_t element_size = ring_buffer->getElementSize();
-      vector_size         = element_size / sizeof(T);
-      return_buffer_.resize(vector_size);
+  int newest_buffer;
+  do
+  {
+    newest_buffer = ring_buffer->getNewestBufferNum();
+    if (newest_buffer < 0)
+    {
+      return false;
     }
-    catch (const std::bad_alloc &e)
+    if (skip_unchanged && ring_buffer->getReadSequence() == last_read_sequence)
     {
-      *is_success = false;
-      return return_buffer_;
+      break;
     }
-    ring_buffer->setDataExpiryTime_us(data_expiry_time_us);
+    copyBuffer(newest_buffer, data);
+  } while (!ring_buffer->verifyBuffer(newest_buffer));
+
+  current_reading_buffer = newest_buffer;
+  last_read_sequence     = ring_buffer->getReadSequence();
+  last_read_num          = data.size();
+  SHM_TRACE(SUBSCRIBE, shm_name, last_read_sequence / 2);
+  return true;
+}
+
+//! @brief トピックを呼び出し側の配列に読み込む
+//! @param [out] data 読み込み先の先頭アドレス
+//! @param [in] max_num 読み込み先に格納できる要素数
+//! @param [out] is_success 読み込みに成功した場合は真
+//! @param [in] skip_unchanged 真の場合、前回読み込んだトピックから更新されていなければコピーしない
+//! @return size_t トピックの要素数
+//! @details トピックの要素数が max_num を超える場合はコピーせずに失敗とし、必要な要素数を返す．
+template <typename T>
+size_t
+Subscriber<std::vector<T>>::subscribe(T *data, size_t max_num, bool *is_success, bool skip_unchanged)
+{
+  *is_success = false;
+  if (!connectRingBuffer())
+  {
+    return 0;
   }
-  // 既に接続済みだが ring_buffer が未初期化の場合に対応
-  else if (ring_buffer == nullptr)
+
+  int    newest_buffer;
+  size_t data_num;
+  do
   {
-    try
+    newest_buffer = ring_buffer->getNewestBufferNum();
+    if (newest_buffer < 0)
     {
-      ring_buffer         = std::make_unique<RingBuffer>(shared_memory->getPtr());
-      size_t element_size = ring_buffer->getElementSize();
-      vector_size         = element_size / sizeof(T);
-      return_buffer_.resize(vector_size);
-      ring_buffer->setDataExpiryTime_us(data_expiry_time_us);
+      return 0;
     }
-    catch (const std::bad_alloc &e)
+    if (skip_unchanged && ring_buffer->getReadSequence() == last_read_sequence)
     {
-      *is_success = false;
-      return return_buffer_;
+      *is_success = true;
+      return last_read_num;
     }
-  }
-  int newest_buffer = ring_buffer->getNewestBufferNum();
-  if (newest_buffer < 0)
-  {
-    *is_success = false;
-    return return_buffer_;
-  }
+    data_num = ring_buffer->getDataSize(newest_buffer) / sizeof(T);
+    if (data_num > max_num)
+    {
+      if (ring_buffer->verifyBuffer(newest_buffer))
+      {
+        return data_num;
+      }
+      continue;
+    }
+    std::memcpy(data, ring_buffer->getBufferPtr(newest_buffer), sizeof(T) * data_num);
+  } while (!ring_buffer->verifyBuffer(newest_buffer));
 
   *is_success            = true;
   current_reading_buffer = newest_buffer;
+  last_read_sequence     = ring_buffer->getReadSequence();
+  last_read_num          = data_num;
+  SHM_TRACE(SUBSCRIBE, shm_name, last_read_sequence / 2);
+  return data_num;
+}
 
-  // Cross-platform aligned memory access for successful case
-  unsigned char *data_ptr      = ring_buffer->getDataList();
-  size_t         buffer_offset = newest_buffer * vector_size * sizeof(T);
-
-  if constexpr (is_arm_platform())
+//! @brief 最新のトピックをコピーせずに借りる
+//! @param なし
+//! @return BorrowedMessage<T> 最新のスロットに固定されたビュー(トピックがない場合は無効)
+//! @details 要素数は BorrowedMessage::size() で取得する．Publisherが容量を拡張すると、次回の読み込み時に
+//! 共有メモリへ接続し直すが、古い領域はビューが全て解放されるまでマップしたまま残る．
+template <typename T>
+BorrowedMessage<T>
+Subscriber<std::vector<T>>::borrow()
+{
+  if (!connectRingBuffer())
   {
-    // ARM: Use safer memory copy approach for vectors
-    std::memcpy(return_buffer_.data(), data_ptr + buffer_offset, sizeof(T) * vector_size);
-    return return_buffer_;
+    return BorrowedMessage<T>();
   }
-  else
+
+  int newest_buffer;
+  do
   {
-    // x86/x64: Direct pointer construction is safe
-    T *first_ptr = reinterpret_cast<T *>(data_ptr + buffer_offset);
-    std::memcpy(return_buffer_.data(), first_ptr, sizeof(T) * vector_size);
-    return return_buffer_;
-  }
+    newest_buffer = ring_buffer->getNewestBufferNum();
+    if (newest_buffer < 0)
+    {
+      return BorrowedMessage<T>();
+    }
+  } while (!ring_buffer->pinBuffer(newest_buffer));
+
+  current_reading_buffer = newest_buffer;
+  last_read_sequence     = ring_buffer->getReadSequence();
+  last_read_num          = ring_buffer->getDataSize(newest_buffer) / sizeof(T);
+  SHM_TRACE(SUBSCRIBE, shm_name, last_read_sequence / 2);
+  return BorrowedMessage<T>(ring_buffer, newest_buffer);
 }
 
+//! @brief トピックの更新待ち
+//! @param [in] timeout_usec 待ち時間[usec]
+//! @return bool 時間内にトピックが更新された場合は真
+//! @details Publisherが存在しない間は、その作成を待つことに時間を使う．
 template <typename T>
 bool
 Subscriber<std::vector<T>>::waitFor(uint64_t timeout_usec)
 {
-  if (shared_memory->isDisconnected())
+  uint64_t start_time = getCurrentTimeUSec();
+  if (!connectRingBuffer())
   {
-    if (ring_buffer != nullptr)
-    {
-      ring_buffer.reset();
-    }
-    // Clean up old connection before reconnecting
-    shared_memory->disconnect();
-    shared_memory->connect();
-    if (shared_memory->isDisconnected())
+    if (!connection->waitForAttach(timeout_usec) || !connectRingBuffer())
     {
       return false;
     }
-    // Wait for initialization to complete
-    if (!RingBuffer::waitForInitialization(shared_memory->getPtr(), 500000))
-    {  // 500ms timeout (increased)
-      return false;
-    }
-    ring_buffer         = std::make_unique<RingBuffer>(shared_memory->getPtr());
-    size_t element_size = ring_buffer->getElementSize();
-    vector_size         = element_size / sizeof(T);
-    return_buffer_.resize(vector_size);
-    ring_buffer->setDataExpiryTime_us(data_expiry_time_us);
   }
-  // 既に接続済みだが ring_buffer が未初期化の場合に対応
-  else if (ring_buffer == nullptr)
+
+  uint64_t elapsed    = getCurrentTimeUSec() - start_time;
+  bool     is_updated = ring_buffer->waitFor(elapsed < timeout_usec ? timeout_usec - elapsed : 0);
+  if (is_updated)
   {
-    try
-    {
-      ring_buffer         = std::make_unique<RingBuffer>(shared_memory->getPtr());
-      size_t element_size = ring_buffer->getElementSize();
-      vector_size         = element_size / sizeof(T);
-      return_buffer_.resize(vector_size);
-      ring_buffer->setDataExpiryTime_us(data_expiry_time_us);
-    }
-    catch (const std::bad_alloc &e)
-    {
-      return false;
-    }
+    SHM_TRACE(WAIT_WAKE, shm_name, ring_buffer->getWriteIndex());
   }
+  return is_updated;
+}
 
-  return ring_buffer->waitFor(timeout_usec);
+//! @brief WaitSetでこのトピックを待つためのfutexワードを取得する
+//! @param [out] target リングバッファの更新シーケンスと waitFor() と同じ更新の確認
+//! @return bool Publisherの共有メモリが存在しない間は偽
+template <typename T>
+bool
+Subscriber<std::vector<T>>::getWaitTarget(WaitTarget *target)
+{
+  if (!connectRingBuffer())
+  {
+    return false;
+  }
+  return ring_buffer->getWaitTarget(target);
 }
 
 template <typename T>
@@ -371,6 +704,20 @@ Subscriber<std::vector<T>>::setDataExpiryTime_us(uint64_t time_us)
   }
 }
 
+//! @brief waitFor() でスリープする前にビジーウェイトする時間を設定する
+//! @param [in] time_us ビジーウェイト時間[usec]（0で無効）
+//! @return なし
+template <typename T>
+void
+Subscriber<std::vector<T>>::setSpinTime_us(uint64_t time_us)
+{
+  spin_time_us = time_us;
+  if (ring_buffer != nullptr)
+  {
+    ring_buffer->setSpinTime_us(spin_time_us);
+  }
+}
+
 }  // namespace shm
 
 }  // namespace irlab
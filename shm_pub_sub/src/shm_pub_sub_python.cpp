@@ -10,6 +10,7 @@
 #include <boost/python.hpp>
 
 #include "shm_pub_sub.hpp"
+#include "shm_pub_sub_vector.hpp"
 
 class PublisherBool : irlab::shm::Publisher<bool>
 {
@@ -59,7 +60,7 @@ public:
   SubscriberBool(std::string name = "", bool arg = false)
   : Subscriber<bool>(name)
   {};
-  
+
   boost::python::tuple _subscribe()
   {
     bool is_success;
@@ -74,7 +75,7 @@ public:
   SubscriberInt(std::string name = "", int arg = 0)
   : Subscriber<int>(name)
   {};
-  
+
   boost::python::tuple _subscribe()
   {
     bool is_success;
@@ -89,7 +90,7 @@ public:
   SubscriberFloat(std::string name = "", float arg = 0.0f)
   : Subscriber<float>(name)
   {};
-  
+
   boost::python::tuple _subscribe()
   {
     bool is_success;
@@ -98,31 +99,356 @@ public:
   };
 };
 
-BOOST_PYTHON_MODULE(shm_pub_sub) {
-  boost::python::class_<PublisherBool, boost::noncopyable>("Publisher")
-    .def(boost::python::init<std::string, bool, int>())
-    .def("publish",  &PublisherInt::_publish)
-  ;
-  boost::python::class_<PublisherInt, boost::noncopyable>("Publisher")
-    .def(boost::python::init<std::string, int, int>())
-    .def("publish",  &PublisherInt::_publish)
-  ;
-  boost::python::class_<PublisherFloat, boost::noncopyable>("Publisher")
-    .def(boost::python::init<std::string, float, int>())
-    .def("publish", &PublisherFloat::_publish)
-  ;
-
-  boost::python::class_<SubscriberBool, boost::noncopyable>("Subscriber")
-    .def(boost::python::init<std::string, bool>())
-    .def("subscribe", &SubscriberBool::_subscribe)
-  ;
-  boost::python::class_<SubscriberInt, boost::noncopyable>("Subscriber")
-    .def(boost::python::init<std::string, int>())
-    .def("subscribe", &SubscriberInt::_subscribe)
-  ;
-  boost::python::class_<SubscriberFloat, boost::noncopyable>("Subscriber")
-    .def(boost::python::init<std::string, float>())
-    .def("subscribe", &SubscriberFloat::_subscribe)
-  ;
+// ****************************************************************************
+// Buffer protocol bindings for std::vector<T> topics
+// ****************************************************************************
+
+//! @brief 1要素のstructモジュール形式の文字からバイト数を求める
+//! @param [in] format バッファプロトコルの形式文字列(ネイティブのバイト順の1文字のみ対応)
+//! @return Py_ssize_t 要素のバイト数(未対応の形式の場合は0)
+static Py_ssize_t
+getItemSize(const std::string &format)
+{
+  static const std::string FORMAT_LIST = "?bBhHiIlLqQnNefd";
+  static const Py_ssize_t  SIZE_LIST[] = { sizeof(bool),      sizeof(char),      sizeof(unsigned char),
+                                           sizeof(short),     sizeof(unsigned short),
+                                           sizeof(int),       sizeof(unsigned int),
+                                           sizeof(long),      sizeof(unsigned long),
+                                           sizeof(long long), sizeof(unsigned long long),
+                                           sizeof(ssize_t),   sizeof(size_t),
+                                           2,                 sizeof(float),     sizeof(double) };
+  std::string name = (format.size() == 2 && format[0] == '@') ? format.substr(1) : format;
+  size_t      pos  = FORMAT_LIST.find(name);
+  if (name.size() != 1 || pos == std::string::npos)
+  {
+    return 0;
+  }
+  return SIZE_LIST[pos];
 }
 
+//! バッファプロトコルの取得結果を確実に解放するためのクラス
+class PyBufferHolder
+{
+public:
+  PyBufferHolder(PyObject *object, int flags)
+  {
+    if (PyObject_GetBuffer(object, &view, flags) != 0)
+    {
+      boost::python::throw_error_already_set();
+    }
+  }
+  ~PyBufferHolder()
+  {
+    PyBuffer_Release(&view);
+  }
+
+  Py_buffer view;
+};
+
+//! @brief バッファプロトコルに対応した任意のオブジェクトを可変長のトピックとして出力するクラス
+//! @details Publisher<std::vector<T>> と同じ形式で書き込むため、C++側は要素の型に合わせた
+//! Subscriber<std::vector<T>> で読み込める．
+class VectorPublisher : irlab::shm::Publisher<std::vector<unsigned char>>
+{
+public:
+  VectorPublisher(std::string name = "", int buffer_num = 3)
+  : Publisher<std::vector<unsigned char>>(name, buffer_num)
+  {};
+
+  // ! C連続の配列を1回のコピーで書き込む
+  void _publish(boost::python::object data)
+  {
+    PyBufferHolder buffer(data.ptr(), PyBUF_C_CONTIGUOUS);
+    const unsigned char *first_ptr = static_cast<const unsigned char *>(buffer.view.buf);
+    size_t               data_size = static_cast<size_t>(buffer.view.len);
+    // The exported buffer cannot be resized while it is held, so the copy can run without the GIL
+    Py_BEGIN_ALLOW_THREADS
+    publish(first_ptr, data_size);
+    Py_END_ALLOW_THREADS
+  };
+};
+
+//! @brief 可変長のトピックをバッファプロトコルのオブジェクトとして読み込むクラス
+class VectorSubscriber : irlab::shm::Subscriber<std::vector<unsigned char>>
+{
+public:
+  VectorSubscriber(std::string name = "", std::string format = "B")
+  : Subscriber<std::vector<unsigned char>>(name)
+  , format(format)
+  , item_size(getItemSize(format))
+  , last_size(0)
+  {
+    if (item_size == 0)
+    {
+      throw std::runtime_error("shm::VectorSubscriber: Unsupported buffer format '" + format + "'!");
+    }
+  };
+
+  // ! 呼び出し側が所有するbytearrayに1回のコピーで読み込み、要素の形式のmemoryviewとして返す
+  boost::python::tuple _subscribe()
+  {
+    while (true)
+    {
+      boost::python::object data(boost::python::handle<>(PyByteArray_FromStringAndSize(nullptr, last_size)));
+      bool   is_success = false;
+      size_t data_size  = subscribe(reinterpret_cast<unsigned char *>(PyByteArray_AsString(data.ptr())),
+                                    last_size, &is_success);
+      if (!is_success && data_size <= static_cast<size_t>(last_size))
+      {
+        return boost::python::make_tuple(boost::python::object(), false);
+      }
+      if (!is_success)
+      {
+        // The topic grew beyond the previous size: retry with a large enough buffer
+        last_size = static_cast<Py_ssize_t>(data_size);
+        continue;
+      }
+      if (PyByteArray_Resize(data.ptr(), static_cast<Py_ssize_t>(data_size - data_size % item_size)) != 0)
+      {
+        boost::python::throw_error_already_set();
+      }
+      boost::python::object view(boost::python::handle<>(PyMemoryView_FromObject(data.ptr())));
+      if (format != "B")
+      {
+        view = view.attr("cast")(format);
+      }
+      return boost::python::make_tuple(view, true);
+    }
+  };
+
+  // ! pythonでは一時オブジェクトを保持できないための変換関数
+  irlab::shm::BorrowedMessage<unsigned char> _borrow()
+  {
+    return borrow();
+  };
+
+  // ! 待機中はGILを解放する
+  bool _waitFor(uint64_t timeout_usec)
+  {
+    bool result;
+    Py_BEGIN_ALLOW_THREADS
+    result = waitFor(timeout_usec);
+    Py_END_ALLOW_THREADS
+    return result;
+  };
+
+  std::string format;
+  Py_ssize_t  item_size;
+  Py_ssize_t  last_size;
+};
+
+//! 固定したスロットを読み込み専用のバッファとして公開するPythonオブジェクト
+//! @details memoryviewやnumpy配列が参照している間は解放されないため、スロットの固定も維持される．
+struct BorrowedBufferObject
+{
+  PyObject_HEAD
+  irlab::shm::BorrowedMessage<unsigned char> *message;
+  PyObject                                   *owner;
+  const char                                 *format;
+  Py_ssize_t                                  shape;
+  Py_ssize_t                                  item_size;
+};
+
+static int
+getBorrowedBuffer(PyObject *self, Py_buffer *view, int flags)
+{
+  BorrowedBufferObject *object = reinterpret_cast<BorrowedBufferObject *>(self);
+  if (flags & PyBUF_WRITABLE)
+  {
+    PyErr_SetString(PyExc_BufferError, "shm_pub_sub: Borrowed topic is read-only");
+    view->obj = nullptr;
+    return -1;
+  }
+  view->obj = self;
+  Py_INCREF(self);
+  view->buf        = const_cast<unsigned char *>(object->message->get());
+  view->len        = object->shape * object->item_size;
+  view->readonly   = 1;
+  view->itemsize   = object->item_size;
+  view->format     = (flags & PyBUF_FORMAT) ? const_cast<char *>(object->format) : nullptr;
+  view->ndim       = 1;
+  view->shape      = (flags & PyBUF_ND) ? &object->shape : nullptr;
+  view->strides    = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? &object->item_size : nullptr;
+  view->suboffsets = nullptr;
+  view->internal   = nullptr;
+  return 0;
+}
+
+static void
+deallocBorrowedBuffer(PyObject *self)
+{
+  BorrowedBufferObject *object = reinterpret_cast<BorrowedBufferObject *>(self);
+  // Unpins the slot so that the publisher can overwrite it again
+  delete object->message;
+  Py_XDECREF(object->owner);
+  Py_TYPE(self)->tp_free(self);
+}
+
+static PyBufferProcs borrowed_buffer_procs = { getBorrowedBuffer, nullptr };
+
+static PyTypeObject borrowed_buffer_type = []()
+{
+  PyTypeObject type = { PyVarObject_HEAD_INIT(nullptr, 0) };
+  type.tp_name      = "shm_pub_sub.BorrowedBuffer";
+  type.tp_basicsize = sizeof(BorrowedBufferObject);
+  type.tp_dealloc   = deallocBorrowedBuffer;
+  type.tp_as_buffer = &borrowed_buffer_procs;
+  type.tp_flags     = Py_TPFLAGS_DEFAULT;
+  type.tp_doc       = "Ring slot pinned by VectorSubscriber.borrow()";
+  return type;
+}();
+
+//! @brief 最新のトピックをコピーせずに参照するmemoryviewを返す
+//! @param [in] self VectorSubscriber
+//! @return boost::python::object 固定したスロットへのmemoryview(トピックがない場合はNone)
+//! @details memoryviewとそこから作った全てのオブジェクトが破棄されるか、release()されるまでスロットは固定される．
+//! Publisherが再起動または容量を拡張してSubscriberが接続し直しても、古い領域はmemoryviewが解放されるまで残る．
+static boost::python::object
+borrowVector(boost::python::object self)
+{
+  VectorSubscriber                          &subscriber = boost::python::extract<VectorSubscriber &>(self);
+  irlab::shm::BorrowedMessage<unsigned char> message    = subscriber._borrow();
+  if (!message.isValid())
+  {
+    return boost::python::object();
+  }
+
+  PyObject *exporter = borrowed_buffer_type.tp_alloc(&borrowed_buffer_type, 0);
+  if (exporter == nullptr)
+  {
+    boost::python::throw_error_already_set();
+  }
+  BorrowedBufferObject *object = reinterpret_cast<BorrowedBufferObject *>(exporter);
+  object->shape                = static_cast<Py_ssize_t>(message.size()) / subscriber.item_size;
+  object->item_size            = subscriber.item_size;
+  object->format               = subscriber.format.c_str();
+  object->message              = new irlab::shm::BorrowedMessage<unsigned char>(std::move(message));
+  // The message keeps the mapped segment alive; the subscriber is kept for the format string
+  object->owner = self.ptr();
+  Py_INCREF(object->owner);
+
+  PyObject *view = PyMemoryView_FromObject(exporter);
+  Py_DECREF(exporter);
+  if (view == nullptr)
+  {
+    boost::python::throw_error_already_set();
+  }
+  return boost::python::object(boost::python::handle<>(view));
+}
+
+// ****************************************************************************
+// Factories choosing the class from the type of the example value
+// ****************************************************************************
+
+// Never destroyed: the interpreter may already be finalized when static objects are
+static boost::python::object *publisher_bool_class;
+static boost::python::object *publisher_int_class;
+static boost::python::object *publisher_float_class;
+static boost::python::object *publisher_vector_class;
+static boost::python::object *subscriber_bool_class;
+static boost::python::object *subscriber_int_class;
+static boost::python::object *subscriber_float_class;
+static boost::python::object *subscriber_vector_class;
+
+static boost::python::object
+makePublisher(std::string name, boost::python::object arg, int buffer_num)
+{
+  PyObject *arg_ptr = arg.ptr();
+  // bool is a subclass of int, so it must be checked first
+  if (PyBool_Check(arg_ptr))
+  {
+    return (*publisher_bool_class)(name, arg, buffer_num);
+  }
+  if (PyLong_Check(arg_ptr))
+  {
+    return (*publisher_int_class)(name, arg, buffer_num);
+  }
+  if (PyFloat_Check(arg_ptr))
+  {
+    return (*publisher_float_class)(name, arg, buffer_num);
+  }
+  if (PyObject_CheckBuffer(arg_ptr))
+  {
+    return (*publisher_vector_class)(name, buffer_num);
+  }
+  PyErr_SetString(PyExc_TypeError, "shm_pub_sub.Publisher: Type must be bool, int, float or a buffer");
+  boost::python::throw_error_already_set();
+  return boost::python::object();
+}
+
+static boost::python::object
+makeSubscriber(std::string name, boost::python::object arg)
+{
+  PyObject *arg_ptr = arg.ptr();
+  if (PyBool_Check(arg_ptr))
+  {
+    return (*subscriber_bool_class)(name, arg);
+  }
+  if (PyLong_Check(arg_ptr))
+  {
+    return (*subscriber_int_class)(name, arg);
+  }
+  if (PyFloat_Check(arg_ptr))
+  {
+    return (*subscriber_float_class)(name, arg);
+  }
+  if (PyObject_CheckBuffer(arg_ptr))
+  {
+    // The element format of the example buffer, e.g. numpy.zeros(0, numpy.float32), selects the view format
+    PyBufferHolder buffer(arg_ptr, PyBUF_FORMAT);
+    std::string    format = (buffer.view.format != nullptr) ? buffer.view.format : "B";
+    return (*subscriber_vector_class)(name, format);
+  }
+  PyErr_SetString(PyExc_TypeError, "shm_pub_sub.Subscriber: Type must be bool, int, float or a buffer");
+  boost::python::throw_error_already_set();
+  return boost::python::object();
+}
+
+BOOST_PYTHON_MODULE(shm_pub_sub) {
+  using boost::python::arg;
+
+  if (PyType_Ready(&borrowed_buffer_type) < 0)
+  {
+    boost::python::throw_error_already_set();
+  }
+
+  // Each type has its own name; Publisher() and Subscriber() pick one from the example value
+  publisher_bool_class = new boost::python::object(
+    boost::python::class_<PublisherBool, boost::noncopyable>("PublisherBool", boost::python::no_init)
+      .def(boost::python::init<std::string, bool, int>())
+      .def("publish",  &PublisherBool::_publish));
+  publisher_int_class = new boost::python::object(
+    boost::python::class_<PublisherInt, boost::noncopyable>("PublisherInt", boost::python::no_init)
+      .def(boost::python::init<std::string, int, int>())
+      .def("publish",  &PublisherInt::_publish));
+  publisher_float_class = new boost::python::object(
+    boost::python::class_<PublisherFloat, boost::noncopyable>("PublisherFloat", boost::python::no_init)
+      .def(boost::python::init<std::string, float, int>())
+      .def("publish", &PublisherFloat::_publish));
+  publisher_vector_class = new boost::python::object(
+    boost::python::class_<VectorPublisher, boost::noncopyable>("VectorPublisher", boost::python::no_init)
+      .def(boost::python::init<std::string, int>((arg("name"), arg("buffer_num") = 3)))
+      .def("publish", &VectorPublisher::_publish));
+
+  subscriber_bool_class = new boost::python::object(
+    boost::python::class_<SubscriberBool, boost::noncopyable>("SubscriberBool", boost::python::no_init)
+      .def(boost::python::init<std::string, bool>())
+      .def("subscribe", &SubscriberBool::_subscribe));
+  subscriber_int_class = new boost::python::object(
+    boost::python::class_<SubscriberInt, boost::noncopyable>("SubscriberInt", boost::python::no_init)
+      .def(boost::python::init<std::string, int>())
+      .def("subscribe", &SubscriberInt::_subscribe));
+  subscriber_float_class = new boost::python::object(
+    boost::python::class_<SubscriberFloat, boost::noncopyable>("SubscriberFloat", boost::python::no_init)
+      .def(boost::python::init<std::string, float>())
+      .def("subscribe", &SubscriberFloat::_subscribe));
+  subscriber_vector_class = new boost::python::object(
+    boost::python::class_<VectorSubscriber, boost::noncopyable>("VectorSubscriber", boost::python::no_init)
+      .def(boost::python::init<std::string, std::string>((arg("name"), arg("format") = "B")))
+      .def("subscribe", &VectorSubscriber::_subscribe)
+      .def("borrow", &borrowVector)
+      .def("wait_for", &VectorSubscriber::_waitFor));
+
+  boost::python::def("Publisher", &makePublisher, (arg("name"), arg("arg"), arg("buffer_num") = 3));
+  boost::python::def("Subscriber", &makeSubscriber, (arg("name"), arg("arg")));
+}
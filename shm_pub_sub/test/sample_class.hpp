@@ -116,4 +116,14 @@ static_assert(std::is_standard_layout<ComplexStruct>::value,
 static_assert(std::is_trivially_copyable<ComplexStruct>::value, 
               "ComplexStruct must be trivially copyable for shared memory");
 
+// Non-standard-layout message sent through the flat codec
+struct LabeledPose
+{
+  std::string frame;
+  ComplexStruct pose;
+  std::vector<std::string> labels;
+  std::vector<float> covariance;
+};
+SHM_REFLECT(LabeledPose, frame, pose, labels, covariance)
+
 #endif //__COMMON_H__
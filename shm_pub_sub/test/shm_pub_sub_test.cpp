@@ -3,12 +3,16 @@
 #include <thread>
 #include <chrono>
 #include <vector>
+#include <memory>
 #include <atomic>
+#include <algorithm>
+#include <numeric>
 #include <iomanip>
 
 #include "shm_base.hpp"
 #include "shm_pub_sub.hpp"
 #include "shm_pub_sub_vector.hpp"
+#include "shm_trace.hpp"
 #include "sample_class.hpp"
 
 
@@ -790,6 +794,708 @@ TEST(SHMPubSubTest, VectorErrorHandlingTest)
   }
 }
 
+TEST(SHMPubSubTest, VectorCapacityGrowthTest)
+{
+  // Size changes within the capacity must reuse the segment; growth beyond it doubles the capacity
+  const std::string topic_name = "/test_vector_capacity";
+  {
+    irlab::shm::Publisher<std::vector<int>>  pub(topic_name);
+    irlab::shm::Subscriber<std::vector<int>> sub(topic_name);
+
+    pub.publish(std::vector<int>(4, 4));
+    EXPECT_EQ(pub.capacity(), 4u);
+    pub.publish(std::vector<int>(5, 5));
+    EXPECT_EQ(pub.capacity(), 8u);
+
+    irlab::shm::SharedMemoryPosix watcher(topic_name, O_RDWR, static_cast<irlab::shm::PERM>(0));
+    ASSERT_TRUE(watcher.connect());
+
+    for (size_t size : { 8u, 0u, 3u, 7u, 1u })
+    {
+      std::vector<int> data(size);
+      std::iota(data.begin(), data.end(), static_cast<int>(size * 10));
+      pub.publish(data);
+
+      bool             is_successed = false;
+      std::vector<int> result       = sub.subscribe(&is_successed);
+      EXPECT_TRUE(is_successed);
+      EXPECT_EQ(result, data);
+    }
+    EXPECT_EQ(pub.capacity(), 8u);
+    EXPECT_FALSE(watcher.isDisconnected());
+
+    // Growth seals the old ring so that other publishers do not keep writing into it
+    pub.reserve(32);
+    EXPECT_EQ(pub.capacity(), 32u);
+    EXPECT_TRUE(watcher.isDisconnected());
+    EXPECT_FALSE(irlab::shm::RingBuffer::checkInitialized(watcher.getPtr()));
+
+    std::vector<int> large(20, 20);
+    pub.publish(large);
+    bool is_successed = false;
+    EXPECT_EQ(sub.subscribe(&is_successed), large);
+    EXPECT_TRUE(is_successed);
+  }
+  irlab::shm::disconnectMemory(topic_name);
+}
+
+TEST(SHMPubSubTest, VectorCoPublisherTest)
+{
+  // A second publisher joins the grown ring, and growth by either one is followed by the other
+  const std::string topic_name = "/test_vector_co_publisher";
+  {
+    irlab::shm::Publisher<std::vector<int>>  first(topic_name);
+    irlab::shm::Subscriber<std::vector<int>> sub(topic_name);
+    first.publish(std::vector<int>(10, 1));
+
+    irlab::shm::Publisher<std::vector<int>> second(topic_name);
+    EXPECT_EQ(second.capacity(), first.capacity());
+    std::vector<int> result;
+    EXPECT_TRUE(sub.subscribe(result));
+    EXPECT_EQ(result, std::vector<int>(10, 1));
+
+    first.publish(std::vector<int>(10, 2));
+    EXPECT_TRUE(sub.subscribe(result));
+    EXPECT_EQ(result, std::vector<int>(10, 2));
+
+    second.publish(std::vector<int>(100, 3));
+    EXPECT_TRUE(sub.subscribe(result));
+    EXPECT_EQ(result, std::vector<int>(100, 3));
+
+    first.publish(std::vector<int>(10, 4));
+    EXPECT_GE(first.capacity(), 100u);
+    EXPECT_TRUE(sub.subscribe(result));
+    EXPECT_EQ(result, std::vector<int>(10, 4));
+
+    // A smaller reservation after the other publisher grew the ring keeps the larger slots
+    first.reserve(50);
+    second.publish(std::vector<int>(100, 5));
+    EXPECT_TRUE(sub.subscribe(result));
+    EXPECT_EQ(result, std::vector<int>(100, 5));
+  }
+  irlab::shm::disconnectMemory(topic_name);
+}
+
+TEST(SHMPubSubTest, SerializedCoPublisherTest)
+{
+  // A serialized publisher joins a ring whose slots another publisher has already grown
+  const std::string topic_name = "/test_serialized_co_publisher";
+  {
+    irlab::shm::Publisher<LabeledPose>  first(topic_name, 4);
+    irlab::shm::Subscriber<LabeledPose> sub(topic_name);
+    LabeledPose                         data;
+    data.frame = "map";
+    data.labels.assign(8, std::string(16, 'x'));
+    first.publish(data);
+
+    irlab::shm::Publisher<LabeledPose> second(topic_name, 4);
+    bool                               is_successed = false;
+    for (int i = 0; i < 3; i++)
+    {
+      data.pose.id = i;
+      first.publish(data);
+      EXPECT_EQ(sub.subscribe(&is_successed).pose.id, i);
+      EXPECT_TRUE(is_successed);
+    }
+
+    LabeledPose large = data;
+    large.labels.assign(64, std::string(64, 'y'));
+    large.pose.id = 10;
+    second.publish(large);
+    EXPECT_EQ(sub.subscribe(&is_successed).labels, large.labels);
+    EXPECT_TRUE(is_successed);
+
+    data.pose.id = 11;
+    first.publish(data);
+    EXPECT_EQ(sub.subscribe(&is_successed).pose.id, 11);
+    EXPECT_TRUE(is_successed);
+  }
+  irlab::shm::disconnectMemory(topic_name);
+}
+
+TEST(SHMPubSubTest, SerializedMessageTest)
+{
+  // Reflected types are encoded straight into the slot, which grows like that of a vector topic
+  const std::string topic_name = "/test_serialized_message";
+  {
+    irlab::shm::Publisher<LabeledPose>  pub(topic_name, 4);
+    irlab::shm::Subscriber<LabeledPose> sub(topic_name);
+
+    bool is_successed = false;
+    sub.subscribe(&is_successed);
+    EXPECT_FALSE(is_successed);
+
+    for (int i = 0; i < 6; i++)
+    {
+      LabeledPose data;
+      data.frame   = "map";
+      data.pose.id = i;
+      data.labels.assign(static_cast<size_t>(1) << i, std::string(i * 10, 'x'));
+      data.covariance.assign(36, static_cast<float>(i));
+      pub.publish(data);
+
+      const LabeledPose &result = sub.subscribe(&is_successed);
+      ASSERT_TRUE(is_successed);
+      EXPECT_EQ(result.frame, "map");
+      EXPECT_EQ(result.pose.id, i);
+      EXPECT_EQ(result.labels, data.labels);
+      EXPECT_EQ(result.covariance, data.covariance);
+    }
+
+    // Queue mode decodes each message once
+    irlab::shm::Subscriber<LabeledPose> queue_sub(topic_name);
+    do
+    {
+      queue_sub.subscribeNext(&is_successed);
+    } while (is_successed);
+    LabeledPose data;
+    data.labels = { "a", "b" };
+    pub.publish(data);
+    data.labels = { "c" };
+    pub.publish(data);
+    EXPECT_EQ(queue_sub.subscribeNext(&is_successed).labels, std::vector<std::string>({ "a", "b" }));
+    EXPECT_TRUE(is_successed);
+    EXPECT_EQ(queue_sub.subscribeNext(&is_successed).labels, std::vector<std::string>({ "c" }));
+    EXPECT_TRUE(is_successed);
+    queue_sub.subscribeNext(&is_successed);
+    EXPECT_FALSE(is_successed);
+  }
+  irlab::shm::disconnectMemory(topic_name);
+}
+
+TEST(SHMPubSubTest, VectorCallerBufferTest)
+{
+  // Reading into caller-owned storage copies once and can skip unchanged topics
+  const std::string topic_name = "/test_vector_caller_buffer";
+  {
+    irlab::shm::Publisher<std::vector<int>>  pub(topic_name);
+    irlab::shm::Subscriber<std::vector<int>> sub(topic_name);
+
+    std::vector<int> data = { 1, 2, 3, 4 };
+    pub.publish(data);
+
+    std::vector<int> out;
+    out.reserve(16);
+    const int *out_ptr = out.data();
+    EXPECT_TRUE(sub.subscribe(out));
+    EXPECT_EQ(out, data);
+    EXPECT_EQ(out.data(), out_ptr);
+
+    // Unchanged topic: the skipped read leaves the caller's buffer untouched
+    out[0] = -1;
+    EXPECT_TRUE(sub.subscribe(out, true));
+    EXPECT_EQ(out[0], -1);
+    EXPECT_TRUE(sub.subscribe(out));
+    EXPECT_EQ(out, data);
+
+    int  array[3];
+    bool is_successed = true;
+    EXPECT_EQ(sub.subscribe(array, 3, &is_successed), 4u);
+    EXPECT_FALSE(is_successed);
+
+    pub.publish({ 7, 8, 9 });
+    EXPECT_EQ(sub.subscribe(array, 3, &is_successed, true), 3u);
+    EXPECT_TRUE(is_successed);
+    EXPECT_EQ(array[0], 7);
+    EXPECT_EQ(array[2], 9);
+    EXPECT_EQ(sub.subscribe(array, 3, &is_successed, true), 3u);
+    EXPECT_TRUE(is_successed);
+
+    const std::vector<int> &result = sub.subscribe(&is_successed);
+    EXPECT_TRUE(is_successed);
+    EXPECT_EQ(result, std::vector<int>({ 7, 8, 9 }));
+  }
+  irlab::shm::disconnectMemory(topic_name);
+}
+
+TEST(SHMPubSubTest, VectorBorrowTest)
+{
+  // Raw arrays are published with one copy and read back through a pinned view of the slot
+  const std::string topic_name = "/test_vector_borrow";
+  {
+    irlab::shm::Publisher<std::vector<float>>  pub(topic_name, 2);
+    irlab::shm::Subscriber<std::vector<float>> sub(topic_name);
+    EXPECT_FALSE(sub.borrow().isValid());
+
+    const float array[] = { 1.5f, 2.5f, 3.5f };
+    pub.publish(array, 3);
+
+    irlab::shm::BorrowedMessage<float> borrowed = sub.borrow();
+    ASSERT_TRUE(borrowed.isValid());
+    ASSERT_EQ(borrowed.size(), 3u);
+    EXPECT_EQ(borrowed.get()[0], 1.5f);
+    EXPECT_EQ(borrowed.get()[2], 3.5f);
+
+    // The pinned slot is skipped while the ring wraps around
+    for (int i = 0; i < 5; ++i) {
+      pub.publish(std::vector<float>(3, static_cast<float>(i)));
+    }
+    EXPECT_EQ(borrowed.get()[1], 2.5f);
+    borrowed.release();
+    EXPECT_EQ(borrowed.size(), 0u);
+
+    borrowed = sub.borrow();
+    ASSERT_TRUE(borrowed.isValid());
+    EXPECT_EQ(borrowed.size(), 3u);
+    EXPECT_EQ(borrowed.get()[0], 4.0f);
+  }
+  irlab::shm::disconnectMemory(topic_name);
+}
+
+TEST(SHMPubSubTest, BorrowOutlivesReconnectTest)
+{
+  // A view borrowed before the segment is recreated stays mapped until it is released
+  const std::string vector_topic = "/test_borrow_grow";
+  {
+    irlab::shm::Publisher<std::vector<float>>  pub(vector_topic, 2);
+    irlab::shm::Subscriber<std::vector<float>> sub(vector_topic);
+    const float array[] = { 1.5f, 2.5f, 3.5f };
+    pub.publish(array, 3);
+    irlab::shm::BorrowedMessage<float> borrowed = sub.borrow();
+    ASSERT_TRUE(borrowed.isValid());
+
+    // Growing the capacity unlinks the segment and the subscriber maps the new one
+    pub.publish(std::vector<float>(100000, 4.0f));
+    std::vector<float> data;
+    EXPECT_TRUE(sub.subscribe(data));
+    EXPECT_EQ(data.size(), 100000u);
+    ASSERT_EQ(borrowed.size(), 3u);
+    EXPECT_EQ(borrowed.get()[0], 1.5f);
+    EXPECT_EQ(borrowed.get()[2], 3.5f);
+    borrowed.release();
+  }
+  irlab::shm::disconnectMemory(vector_topic);
+
+  // Releasing a view after the publisher restarted in place must not unpin a slot of the new ring
+  const std::string topic_name = "/test_borrow_restart";
+  {
+    auto pub = std::make_unique<irlab::shm::Publisher<SimpleInt>>(topic_name, 4);
+    irlab::shm::Subscriber<SimpleInt> sub(topic_name);
+    pub->publish(SimpleInt(1));
+    irlab::shm::BorrowedMessage<SimpleInt> borrowed = sub.borrow();
+    ASSERT_TRUE(borrowed.isValid());
+
+    pub.reset();
+    pub = std::make_unique<irlab::shm::Publisher<SimpleInt>>(topic_name, 1);
+    pub->publish(SimpleInt(2));
+    bool success = false;
+    EXPECT_EQ(sub.subscribe(&success).value, 2);
+    EXPECT_TRUE(success);
+    EXPECT_TRUE(borrowed.isValid());
+    borrowed.release();
+
+    pub->publish(SimpleInt(3));
+    EXPECT_EQ(sub.subscribe(&success).value, 3);
+    EXPECT_TRUE(success);
+  }
+  irlab::shm::disconnectMemory(topic_name);
+}
+
+TEST(SHMPubSubTest, TornReadDetectionTest)
+{
+  // A publisher overwriting a small ring while the subscriber copies must never yield a mixed vector
+  const std::string topic_name = "/test_torn_read";
+  {
+    irlab::shm::Publisher<std::vector<int>>  pub(topic_name, 2);
+    irlab::shm::Subscriber<std::vector<int>> sub(topic_name);
+    constexpr size_t VECTOR_SIZE = 4096;
+    pub.publish(std::vector<int>(VECTOR_SIZE, 0));
+
+    std::atomic<bool> running(true);
+    std::thread writer([&]() {
+      std::vector<int> data(VECTOR_SIZE);
+      for (int i = 1; running.load(); ++i) {
+        std::fill(data.begin(), data.end(), i);
+        pub.publish(data);
+      }
+    });
+
+    int torn_count = 0;
+    int read_count = 0;
+    auto end_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+    while (std::chrono::steady_clock::now() < end_time) {
+      bool success = false;
+      const std::vector<int>& result = sub.subscribe(&success);
+      if (!success) {
+        continue;
+      }
+      ++read_count;
+      if (std::count(result.begin(), result.end(), result.front()) != static_cast<long>(result.size())) {
+        ++torn_count;
+      }
+    }
+    running.store(false);
+    writer.join();
+
+    EXPECT_GT(read_count, 0);
+    EXPECT_EQ(torn_count, 0);
+  }
+  irlab::shm::disconnectMemory(topic_name.substr(1));
+}
+
+TEST(SHMPubSubTest, LoanBorrowTest)
+{
+  // Loaned slot is published without copying and read through a pinned view
+  {
+    irlab::shm::Publisher<SimpleInt>  pub("/test_loan_borrow", 3);
+    irlab::shm::Subscriber<SimpleInt> sub("/test_loan_borrow");
+
+    irlab::shm::LoanedMessage<SimpleInt> loaned = pub.loan();
+    ASSERT_TRUE(loaned.isValid());
+    loaned->value = 42;
+    EXPECT_THROW(pub.loan(), std::runtime_error);
+    pub.publish(std::move(loaned));
+    EXPECT_FALSE(loaned.isValid());
+
+    irlab::shm::BorrowedMessage<SimpleInt> borrowed = sub.borrow();
+    ASSERT_TRUE(borrowed.isValid());
+    EXPECT_EQ(borrowed->value, 42);
+
+    // The pinned slot survives the ring wrapping around several times
+    for (int i = 0; i < 10; ++i) {
+      pub.publish(SimpleInt(100 + i));
+    }
+    EXPECT_EQ(borrowed->value, 42);
+
+    bool success = false;
+    SimpleInt result = sub.subscribe(&success);
+    EXPECT_TRUE(success);
+    EXPECT_EQ(result.value, 109);
+
+    borrowed.release();
+    EXPECT_FALSE(borrowed.isValid());
+
+    // An unpublished loan is discarded and the previous topic stays readable
+    {
+      irlab::shm::LoanedMessage<SimpleInt> discarded = pub.loan();
+      ASSERT_TRUE(discarded.isValid());
+      discarded->value = -1;
+    }
+    result = sub.subscribe(&success);
+    EXPECT_TRUE(success);
+    EXPECT_EQ(result.value, 109);
+  }
+  irlab::shm::disconnectMemory("test_loan_borrow");
+
+  // With every slot pinned the publisher drops the message instead of overwriting it
+  {
+    irlab::shm::Publisher<SimpleInt>  pub("/test_loan_pinned", 1);
+    irlab::shm::Subscriber<SimpleInt> sub("/test_loan_pinned");
+    pub.publish(SimpleInt(1));
+
+    {
+      irlab::shm::BorrowedMessage<SimpleInt> borrowed = sub.borrow();
+      ASSERT_TRUE(borrowed.isValid());
+      pub.publish(SimpleInt(2));
+      EXPECT_FALSE(pub.loan().isValid());
+      EXPECT_EQ(borrowed->value, 1);
+    }
+
+    pub.publish(SimpleInt(3));
+    irlab::shm::BorrowedMessage<SimpleInt> borrowed = sub.borrow();
+    ASSERT_TRUE(borrowed.isValid());
+    EXPECT_EQ(borrowed->value, 3);
+  }
+  irlab::shm::disconnectMemory("test_loan_pinned");
+}
+
+TEST(SHMPubSubTest, QueueModeTest)
+{
+  {
+    irlab::shm::Publisher<SimpleInt>  pub("/test_queue_mode", 8);
+    irlab::shm::Subscriber<SimpleInt> sub("/test_queue_mode");
+
+    // Every message of a burst is read in order
+    for (int i = 0; i < 5; ++i) {
+      pub.publish(SimpleInt(i));
+    }
+    bool success = false;
+    for (int i = 0; i < 5; ++i) {
+      SimpleInt result = sub.subscribeNext(&success);
+      ASSERT_TRUE(success);
+      EXPECT_EQ(result.value, i);
+    }
+    sub.subscribeNext(&success);
+    EXPECT_FALSE(success);
+    EXPECT_FALSE(sub.waitFor(10000));
+
+    // A burst larger than the ring is drained from the oldest surviving message
+    for (int i = 0; i < 20; ++i) {
+      pub.publish(SimpleInt(100 + i));
+    }
+    EXPECT_TRUE(sub.waitFor(10000));
+    SimpleInt results[16];
+    size_t read_num = sub.drain(results, 16);
+    ASSERT_EQ(read_num, 8u);
+    for (size_t i = 0; i < read_num; ++i) {
+      EXPECT_EQ(results[i].value, static_cast<int>(112 + i));
+    }
+    EXPECT_EQ(sub.getOverrunNum(), 12u);
+    EXPECT_EQ(sub.drain(results, 16), 0u);
+  }
+  irlab::shm::disconnectMemory("test_queue_mode");
+}
+
+TEST(SHMPubSubTest, MultiPublisherTest)
+{
+  constexpr int NUM_PUBLISHERS = 4;
+  constexpr int MESSAGES_PER_PUBLISHER = 200;
+  {
+    irlab::shm::Publisher<SimpleInt>  first_pub("/test_multi_publisher", 1024);
+    irlab::shm::Subscriber<SimpleInt> sub("/test_multi_publisher");
+    first_pub.publish(SimpleInt(-1));
+
+    // A second publisher joins the live ring instead of resetting it
+    std::vector<std::unique_ptr<irlab::shm::Publisher<SimpleInt>>> pubs;
+    for (int p = 0; p < NUM_PUBLISHERS; ++p) {
+      pubs.push_back(std::make_unique<irlab::shm::Publisher<SimpleInt>>("/test_multi_publisher", 1024));
+    }
+    bool success = false;
+    SimpleInt result = sub.subscribeNext(&success);
+    ASSERT_TRUE(success);
+    EXPECT_EQ(result.value, -1);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < NUM_PUBLISHERS; ++p) {
+      threads.emplace_back([&, p]() {
+        for (int i = 0; i < MESSAGES_PER_PUBLISHER; ++i) {
+          pubs[p]->publish(SimpleInt(p * MESSAGES_PER_PUBLISHER + i));
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    std::vector<int> last_seen(NUM_PUBLISHERS, -1);
+    int read_num = 0;
+    while (true) {
+      result = sub.subscribeNext(&success);
+      if (!success) {
+        break;
+      }
+      int publisher = result.value / MESSAGES_PER_PUBLISHER;
+      ASSERT_GE(publisher, 0);
+      ASSERT_LT(publisher, NUM_PUBLISHERS);
+      EXPECT_GT(result.value % MESSAGES_PER_PUBLISHER, last_seen[publisher]);
+      last_seen[publisher] = result.value % MESSAGES_PER_PUBLISHER;
+      ++read_num;
+    }
+    EXPECT_EQ(read_num, NUM_PUBLISHERS * MESSAGES_PER_PUBLISHER);
+    EXPECT_EQ(sub.getOverrunNum(), 0u);
+  }
+  irlab::shm::disconnectMemory("test_multi_publisher");
+}
+
+TEST(SHMPubSubTest, WaitSetTest)
+{
+  {
+    irlab::shm::Publisher<SimpleInt>  first_pub("/test_wait_set_0");
+    irlab::shm::Publisher<SimpleInt>  second_pub("/test_wait_set_1");
+    irlab::shm::Subscriber<SimpleInt> first_sub("/test_wait_set_0");
+    irlab::shm::Subscriber<SimpleInt> second_sub("/test_wait_set_1");
+    irlab::shm::Subscriber<std::vector<int>> missing_sub("/test_wait_set_missing");
+
+    irlab::shm::WaitSet wait_set;
+    size_t first_handle  = wait_set.add(first_sub);
+    size_t second_handle = wait_set.add(second_sub);
+    wait_set.add(missing_sub);
+    EXPECT_EQ(wait_set.size(), 3u);
+    EXPECT_TRUE(wait_set.wait(10000).empty());
+
+    std::thread publish_thread([&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      second_pub.publish(SimpleInt(42));
+    });
+    std::vector<size_t> ready_list = wait_set.wait(1000000);
+    publish_thread.join();
+    ASSERT_EQ(ready_list, std::vector<size_t>{second_handle});
+
+    bool success = false;
+    EXPECT_EQ(second_sub.subscribe(&success).value, 42);
+    EXPECT_TRUE(success);
+    EXPECT_TRUE(wait_set.wait(1000).empty());
+
+    first_pub.publish(SimpleInt(1));
+    second_pub.publish(SimpleInt(2));
+    ready_list = wait_set.wait(1000000);
+    std::sort(ready_list.begin(), ready_list.end());
+    EXPECT_EQ(ready_list, std::vector<size_t>({ first_handle, second_handle }));
+  }
+  irlab::shm::disconnectMemory("test_wait_set_0");
+  irlab::shm::disconnectMemory("test_wait_set_1");
+}
+
+TEST(SHMPubSubTest, TypeFingerprintTest)
+{
+  {
+    irlab::shm::Publisher<int> int_pub("/test_type_fingerprint");
+    int_pub.publish(7);
+
+    // Same size, different type: rejected on attach instead of read as garbage
+    bool                          success = false;
+    irlab::shm::Subscriber<float> float_sub("/test_type_fingerprint");
+    EXPECT_THROW(float_sub.subscribe(&success), std::runtime_error);
+    irlab::shm::Subscriber<std::vector<float>> float_vector_sub("/test_type_fingerprint");
+    EXPECT_THROW(float_vector_sub.subscribe(&success), std::runtime_error);
+    using FloatPublisher = irlab::shm::Publisher<float>;
+    EXPECT_THROW(FloatPublisher("/test_type_fingerprint"), std::runtime_error);
+
+    // Byte topics are untyped and read anything
+    irlab::shm::Subscriber<std::vector<unsigned char>> byte_sub("/test_type_fingerprint");
+    EXPECT_EQ(byte_sub.subscribe(&success).size(), sizeof(int));
+    EXPECT_TRUE(success);
+    irlab::shm::Subscriber<int> int_sub("/test_type_fingerprint");
+    EXPECT_EQ(int_sub.subscribe(&success), 7);
+    EXPECT_TRUE(success);
+  }
+  irlab::shm::disconnectMemory("test_type_fingerprint");
+}
+
+TEST(SHMPubSubTest, TopicRegistryTest)
+{
+  irlab::shm::SharedMemoryOptions options;
+  options.use_topic_registry = true;
+  std::string topic_name     = "/test_topic_registry_" + std::to_string(getpid());
+  {
+    // An unregistered topic is reported missing at once, without waiting for its segment
+    irlab::shm::Subscriber<SimpleInt> sub(topic_name, options);
+    bool                              success = true;
+    auto                              start   = std::chrono::steady_clock::now();
+    EXPECT_FALSE(sub.existsPublisherMemory());
+    sub.subscribe(&success);
+    EXPECT_FALSE(success);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+
+    irlab::shm::Publisher<SimpleInt> pub(topic_name, 4, irlab::shm::DEFAULT_PERM, options);
+    pub.publish(SimpleInt(3));
+    EXPECT_TRUE(sub.existsPublisherMemory());
+    EXPECT_EQ(sub.subscribe(&success).value, 3);
+    EXPECT_TRUE(success);
+
+    irlab::shm::TopicRegistry registry;
+    irlab::shm::TopicInfo     info;
+    ASSERT_TRUE(registry.lookup(topic_name, &info));
+    EXPECT_EQ(info.type_hash, irlab::shm::getTopicTypeHash<SimpleInt>());
+    EXPECT_EQ(info.element_size, sizeof(SimpleInt));
+    EXPECT_EQ(info.buffer_num, 4u);
+    EXPECT_EQ(info.pid, getpid());
+
+    // The registered fingerprint is checked before the segment is opened
+    irlab::shm::Subscriber<float> float_sub(topic_name, options);
+    EXPECT_THROW(float_sub.subscribe(&success), std::runtime_error);
+  }
+  irlab::shm::disconnectMemory(topic_name.substr(1));
+}
+
+TEST(SHMPubSubTest, ReconnectTest)
+{
+  {
+    // A missing topic is reported at once instead of after an initialization timeout
+    irlab::shm::Subscriber<SimpleInt> sub("/test_reconnect");
+    bool                              success = true;
+    auto                              start   = std::chrono::steady_clock::now();
+    EXPECT_FALSE(sub.existsPublisherMemory());
+    sub.subscribe(&success);
+    EXPECT_FALSE(success);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+
+    // waitFor() spends its timeout waiting for the publisher to appear
+    std::unique_ptr<irlab::shm::Publisher<SimpleInt>> pub;
+    std::thread                                       publish_thread([&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      pub = std::make_unique<irlab::shm::Publisher<SimpleInt>>("/test_reconnect", 4);
+      pub->publish(SimpleInt(1));
+    });
+    EXPECT_TRUE(sub.waitFor(2000000));
+    publish_thread.join();
+    EXPECT_EQ(sub.subscribe(&success).value, 1);
+    EXPECT_TRUE(success);
+
+    // A publisher restarting on the same segment with more slots is picked up on the next read
+    pub.reset();
+    pub = std::make_unique<irlab::shm::Publisher<SimpleInt>>("/test_reconnect", 16);
+    for (int i = 0; i < 10; i++)
+    {
+      pub->publish(SimpleInt(10 + i));
+    }
+    EXPECT_EQ(sub.subscribe(&success).value, 19);
+    EXPECT_TRUE(success);
+  }
+  irlab::shm::disconnectMemory("test_reconnect");
+}
+
+TEST(SHMPubSubTest, SimulatedClockTest)
+{
+  std::string clock_name = "test_pub_sub_clock_" + std::to_string(getpid());
+  {
+    irlab::shm::SimulatedClock driver(clock_name);
+    driver.setTime_us(5000000);
+    irlab::shm::useSimulatedClock(clock_name);
+
+    irlab::shm::Publisher<SimpleInt>  pub("/test_simulated_clock");
+    irlab::shm::Subscriber<SimpleInt> sub("/test_simulated_clock");
+    sub.setDataExpiryTime_us(100000);
+    bool success = false;
+    for (int i = 0; i < 3; i++)
+    {
+      pub.publish(SimpleInt(i));
+    }
+    // Messages published within the same simulated microsecond are still read in order
+    EXPECT_EQ(sub.subscribe(&success).value, 2);
+    EXPECT_TRUE(success);
+
+    // Ten simulated seconds pass at once: the topic expires without waiting in real time
+    driver.advance_us(10000000);
+    sub.subscribe(&success);
+    EXPECT_FALSE(success);
+    pub.publish(SimpleInt(3));
+    EXPECT_EQ(sub.subscribe(&success).value, 3);
+    EXPECT_TRUE(success);
+    irlab::shm::useSystemClock();
+  }
+  irlab::shm::disconnectMemory("test_simulated_clock");
+  irlab::shm::disconnectMemory(clock_name);
+}
+
+#if !defined(SHM_DISABLE_TRACING)
+TEST(SHMPubSubTest, TraceTest)
+{
+  {
+    irlab::shm::Publisher<SimpleInt>  pub("/test_trace_topic");
+    irlab::shm::Subscriber<SimpleInt> sub("/test_trace_topic");
+    pub.publish(SimpleInt(0));
+    bool success = false;
+    sub.subscribe(&success);
+
+    irlab::shm::enableTracing();
+    pub.publish(SimpleInt(1));
+    EXPECT_TRUE(sub.waitFor(100000));
+    EXPECT_EQ(sub.subscribe(&success).value, 1);
+    irlab::shm::disableTracing();
+    pub.publish(SimpleInt(2));
+
+    // Only the second topic is recorded, and every event carries its sequence
+    std::vector<irlab::shm::TRACE_EVENT> event_list;
+    for (const irlab::shm::TraceRecord &record : irlab::shm::readTrace())
+    {
+      if (record.name == "/test_trace_topic")
+      {
+        EXPECT_EQ(record.sequence, 2u);
+        EXPECT_EQ(record.pid, getpid());
+        event_list.push_back(record.event);
+      }
+    }
+    std::vector<irlab::shm::TRACE_EVENT> expected_list = { irlab::shm::TRACE_PUBLISH_BEGIN,
+                                                           irlab::shm::TRACE_PUBLISH_COMMIT,
+                                                           irlab::shm::TRACE_WAIT_WAKE,
+                                                           irlab::shm::TRACE_SUBSCRIBE };
+    EXPECT_EQ(event_list, expected_list);
+  }
+  irlab::shm::disconnectMemory("/test_trace_topic");
+}
+#endif
+
 TEST(SHMPubSubTest, ConcurrentCreationRaceConditionTest)
 {
   constexpr int NUM_ITERATIONS = 200;
@@ -3,7 +3,7 @@
 //! @brief メモリの格納方法を規定するクラスの定義
 //! @note 記法はROSに準拠する
 //!       http://wiki.ros.org/ja/CppStyleGuide
-//! 
+//!
 //! @example test1.hpp
 //! 共有メモリに関するテスト
 //! @example test1.cpp
@@ -13,10 +13,19 @@
 #ifndef __SHM_SERVICE_LIB_H__
 #define __SHM_SERVICE_LIB_H__
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
-#include <memory>
+#include <vector>
 #include "shm_base.hpp"
+#include "shm_trace.hpp"
 
 namespace irlab
 {
@@ -24,31 +33,177 @@ namespace irlab
 namespace shm
 {
 
+// ****************************************************************************
+//! @brief サービスのリクエストスロットの既定数
+// ****************************************************************************
+constexpr int DEFAULT_SERVICE_SLOT_NUM = 16;
+
+// ****************************************************************************
+//! @brief クライアントがレスポンスをビジーウェイトで待つ最大時間[usec]
+//! @details 実際のスピン時間は直近の応答時間に合わせて0からこの値の間で調整される．
+// ****************************************************************************
+constexpr uint64_t SERVICE_MAX_SPIN_USEC = 50;
+
+// ****************************************************************************
+//! @brief サーバーのワーカーがリクエストを待つ際のfutexの待ち時間の上限[usec]
+// ****************************************************************************
+constexpr uint64_t SERVICE_IDLE_WAIT_USEC = 100000;
+
+// ****************************************************************************
+//! @struct ServiceServerOptions
+//! @brief サーバーのリクエスト処理スレッドに関する設定
+// ****************************************************************************
+struct ServiceServerOptions
+{
+  //! リクエストを処理するワーカースレッド数．0の場合はワーカーを起動せず、spinOnce() を呼んだスレッドで処理する
+  int worker_num = 1;
+  //! ワーカーを固定するCPU番号．i番目のワーカーはcpu_list[i % cpu_list.size()]に固定される．空の場合は固定しない
+  std::vector<int> cpu_list;
+  //! リクエストが無いとき、スリープする前にビジーウェイトで待つ時間[usec]．専有コアで起床遅延を避けたい場合に設定する
+  uint64_t spin_time_us = 0;
+  //! ワーカーのスケジューリングポリシーと優先度、スタックサイズ、メモリ固定の設定．cpu_list が空でない場合はそちらを優先する
+  ThreadAttributes thread_attributes;
+};
+
+// ****************************************************************************
+//! @enum ServiceSlotState
+//! @brief リクエストスロットの状態
+// ****************************************************************************
+enum ServiceSlotState : uint32_t
+{
+  SERVICE_SLOT_FREE = 0,    //!< 未使用
+  SERVICE_SLOT_CLAIMED,     //!< クライアントがリクエストを書き込み中
+  SERVICE_SLOT_REQUESTED,   //!< クライアントがリクエストを書き込み済み
+  SERVICE_SLOT_PROCESSING,  //!< サーバーが処理中
+  SERVICE_SLOT_RESPONDED,   //!< サーバーがレスポンスを書き込み済み
+  SERVICE_SLOT_ABANDONED,   //!< 処理中にクライアントがタイムアウトした
+};
+
+// ****************************************************************************
+//! @struct ServiceHeader
+//! @brief サービスの共有メモリ先頭に置かれる管理領域
+//! @details スロットの状態遷移は全てatomic操作で行い、待機はfutexで行う．
+//! リクエストの投入と空きスロットの発生はそれぞれシーケンス番号を進め、待機者がいる場合のみ起床させる．
+//! slot_numはサーバーの初期化完了後に最後に書き込まれるため、0の間はクライアントは接続できない．
+// ****************************************************************************
+struct ServiceHeader
+{
+  std::atomic<uint32_t> slot_num;
+  std::atomic<uint64_t> next_call_id;
+  alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> request_sequence;
+  std::atomic<uint32_t> request_waiter_num;
+  alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> free_sequence;
+  std::atomic<uint32_t> free_waiter_num;
+};
+
+// ****************************************************************************
+//! @struct ServiceSlot
+//! @brief 一つの呼び出しのリクエストとレスポンスを保持するスロット
+//! @details 別々のクライアントが使うスロット同士が同じキャッシュラインを共有しないよう整列する．
+//! stateはレスポンスを待つクライアントのfutexを兼ねる．
+//! owner_pidとowner_start_timeはスロットを確保したクライアントのプロセスを表し、
+//! 終了したクライアントのスロットを他のクライアントが回収するために使う．owner_pidは空きの間0となる．
+//! シリアライズする型は SerializedStorageSize の容量に符号化して格納する．
+// ****************************************************************************
+template <class Req, class Res>
+struct alignas(CACHE_LINE_SIZE) ServiceSlot
+{
+  std::atomic<uint32_t>              state;
+  std::atomic<uint32_t>              waiter_num;
+  std::atomic<uint32_t>              owner_pid;
+  std::atomic<uint64_t>              owner_start_time;
+  uint64_t                           call_id;
+  typename MessageStorage<Req>::type request;
+  typename MessageStorage<Res>::type response;
+};
+
+// ****************************************************************************
+//! @struct ServiceCompletion
+//! @brief 非同期呼び出し一つ分の完了待ちを表す
+//! @details completeはレスポンスの到着、期限切れ、または呼び出し元の破棄の際に一度だけ呼ばれる．
+// ****************************************************************************
+struct ServiceCompletion
+{
+  const void            *owner;
+  std::atomic<uint32_t> *state;
+  std::atomic<uint32_t> *waiter_num;
+  uint64_t               deadline_usec;
+  std::function<void()>  complete;
+};
+
+// ****************************************************************************
+//! @class ServiceCompletionNotifier
+//! @brief プロセス内の全ての非同期サービス呼び出しの完了を通知するスレッドを表現するクラス
+//! @details 一つのスレッドで全サービスの処理中スロットを同時に監視し、完了した呼び出しのコールバックを実行する．
+//! コールバックは全てこのスレッド上で呼ばれるため、長時間ブロックする処理を行ってはならない．
+//! コールバックの中から新たな非同期呼び出しを行うことはできる．
+// ****************************************************************************
+class ServiceCompletionNotifier
+{
+public:
+  static ServiceCompletionNotifier &getInstance();
+
+  void add(ServiceCompletion completion);
+  void cancel(const void *owner);
+
+private:
+  ServiceCompletionNotifier();
+  ~ServiceCompletionNotifier();
+
+  bool isReady(const ServiceCompletion &completion, uint64_t current_time) const;
+  void loop();
+
+  std::mutex                     mutex;
+  std::condition_variable        finished_condition;
+  std::vector<ServiceCompletion> pending_list;
+  std::vector<const void *>      cancelled_owner_list;
+  std::vector<const void *>      running_owner_list;
+  std::atomic<uint32_t>          wake_sequence;
+  bool                           shutdown_requested;
+  std::thread                    thread;
+};
+
 // ****************************************************************************
 //! @class ServiceServer
 //! @brief 共有メモリで受信したリクエストからレスポンスを返すサーバーを表現するクラス
 //! @details template classとして与えられた型またはクラスをリクエストおよびレスポンスとしてリクエストからレスポンスを出力するクラスである．
 //! sizeofによってメモリの使用量が把握できる型およびクラスに対応している．
 //! また、特殊なものはtemplate classを特殊化して対応する．
+//! リクエストは複数のスロットに格納されるため、複数のクライアントが同時に呼び出しを行える．
+//! 各呼び出しには一意なIDが振られ、レスポンスは呼び出し元のスロットに返される．
+//! ワーカースレッドを複数にした場合、ハンドラは複数のリクエストに対して同時に呼ばれるため、スレッドセーフである必要がある．
 // ****************************************************************************
 template <class Req, class Res>
 class ServiceServer
 {
 public:
-  ServiceServer(std::string name, Res (*input_func)(Req request), PERM perm = DEFAULT_PERM);
+  ServiceServer(std::string name, std::function<Res(Req)> handler, PERM perm = DEFAULT_PERM,
+                int request_slot_num = DEFAULT_SERVICE_SLOT_NUM,
+                const ServiceServerOptions &options = ServiceServerOptions());
   ~ServiceServer();
 
+  static size_t getMemorySize(int request_slot_num);
+
+  bool spinOnce();
+  bool getWaitTarget(WaitTarget *target);
+
 private:
-  void initializeExclusiveAccess();
+  void startWorkers(const ServiceServerOptions &options);
+  void stopWorkers();
+  bool hasRequest() const;
+  int  takeNextRequest();
+  void serveRequest(int slot, Req *request, Res *response);
+  void waitForRequest();
   void loop();
   static void called_loop(ServiceServer& ref)
   {
     ref.loop();
   }
 
-  Res (*func)(Req request);
-  pthread_t thread;
-  volatile bool shutdown_requested;
+  std::function<Res(Req)> func;
+  std::vector<pthread_t>  threads;
+  std::atomic<bool>       shutdown_requested;
+  uint64_t                spin_time_us;
 
   std::string shm_name;
   PERM shm_perm;
@@ -56,16 +211,12 @@ private:
 
   uint8_t *memory_ptr;
 
-  pthread_mutex_t *request_mutex;
-  pthread_cond_t *request_condition;
-  uint64_t *request_timestamp_usec;
-  Req *request_ptr;
-  pthread_mutex_t *response_mutex;
-  pthread_cond_t *response_condition;
-  uint64_t *response_timestamp_usec;
-  Res *response_ptr;
+  ServiceHeader          *header;
+  ServiceSlot<Req, Res>  *slot_list;
+  int                     slot_num;
 
-  uint64_t current_request_timestamp_usec;
+  std::unique_ptr<Req> spin_request_ptr;
+  std::unique_ptr<Res> spin_response_ptr;
 };
 
 // ****************************************************************************
@@ -73,6 +224,9 @@ private:
 //! @brief 共有メモリからトピックを取得する購読者を表現するクラス
 //! @details template classとして与えられた型またはクラスをトピックとして読み込むためのクラスである．
 //! また、トピックが更新されるまで待機するAPIを持つ．
+//! 一つのインスタンスを複数のスレッドから同時に呼び出してもよい．
+//! レスポンスは直近の応答時間に応じた短時間のビジーウェイトの後、futexでスリープして待つ．
+//! callAsync() はリクエストを投入して直ちに戻り、完了は ServiceCompletionNotifier のスレッドから通知される．
 // ****************************************************************************
 template <class Req, class Res>
 class ServiceClient
@@ -84,22 +238,32 @@ public:
   bool call(Req request, Res *response);
   bool call(Req request, Res *response, unsigned long timeout_usec);
 
+  std::future<Res> callAsync(Req request, unsigned long timeout_usec = 5000000);
+  bool             callAsync(Req request, std::function<void(bool, const Res &)> callback,
+                             unsigned long timeout_usec = 5000000);
+
 private:
+  bool connectService();
+  int  claimSlot(uint64_t deadline_usec);
+  void releaseSlot(ServiceSlot<Req, Res> &slot);
+  bool reclaimDeadSlots();
+  void notifyFreeSlot();
+  int  postRequest(const Req &request, uint64_t deadline_usec);
+  bool waitResponse(ServiceSlot<Req, Res> &slot, uint64_t deadline_usec);
+  bool finishCall(ServiceSlot<Req, Res> &slot, Res *response);
+
   std::string shm_name;
   SharedMemory *shared_memory;
+  std::mutex    connect_mutex;
 
   uint8_t *memory_ptr;
 
-  pthread_mutex_t *request_mutex;
-  pthread_cond_t *request_condition;
-  uint64_t *request_timestamp_usec;
-  Req *request_ptr;
-  pthread_mutex_t *response_mutex;
-  pthread_cond_t *response_condition;
-  uint64_t *response_timestamp_usec;
-  Res *response_ptr;
+  ServiceHeader         *header;
+  ServiceSlot<Req, Res> *slot_list;
+  int                    slot_num;
 
-  uint64_t current_response_timestamp_usec;
+  std::atomic<uint64_t> spin_time_us;
+  std::atomic<bool>     async_used;
 };
 
 // ****************************************************************************
@@ -107,65 +271,92 @@ private:
 // （テンプレートクラス内の関数の定義はコンパイル時に実体化するのでヘッダに書く）
 // ****************************************************************************
 template <class Req, class Res>
-ServiceServer<Req, Res>::ServiceServer(std::string name, Res (*input_func)(Req request), PERM perm)
-: func(input_func)
+ServiceServer<Req, Res>::ServiceServer(std::string name, std::function<Res(Req)> handler, PERM perm,
+                                       int request_slot_num, const ServiceServerOptions &options)
+: func(std::move(handler))
 , shutdown_requested(false)
+, spin_time_us(options.spin_time_us)
 , shm_name(name)
 , shm_perm(perm)
 , shared_memory(nullptr)
 , memory_ptr(nullptr)
+, header(nullptr)
+, slot_list(nullptr)
+, slot_num(request_slot_num)
 {
-  if (!std::is_standard_layout<Req>::value || !std::is_standard_layout<Res>::value)
+  if (!is_transferable_message<Req>() || !is_transferable_message<Res>())
   {
     throw std::runtime_error("shm::ServiceServer: Be setted not POD class!");
   }
-  
+  if (!func)
+  {
+    throw std::runtime_error("shm::ServiceServer: Handler is empty!");
+  }
+  if (slot_num <= 0)
+  {
+    throw std::runtime_error("shm::ServiceServer: The number of request slots must be positive!");
+  }
+  if (options.worker_num < 0)
+  {
+    throw std::runtime_error("shm::ServiceServer: The number of workers must not be negative!");
+  }
+#if defined(__linux__)
+  for (int cpu : options.cpu_list)
+  {
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+      throw std::runtime_error("shm::ServiceServer: Invalid CPU number for worker affinity!");
+    }
+  }
+#endif
+
   shared_memory = new SharedMemoryPosix(shm_name, O_RDWR|O_CREAT, shm_perm);
-  shared_memory->connect( (sizeof(pthread_mutex_t)+sizeof(pthread_cond_t)+sizeof(uint64_t)) * 2 + sizeof(Req) + sizeof(Res));
+  shared_memory->connect(getMemorySize(slot_num));
   if (shared_memory->isDisconnected())
   {
-    throw std::runtime_error("shm::Publisher: Cannot get memory!");
-  }
-
-  uint8_t *data_ptr = shared_memory->getPtr();
-  memory_ptr = data_ptr;
-  request_mutex = reinterpret_cast<pthread_mutex_t *>(data_ptr);
-  data_ptr += sizeof(pthread_mutex_t);
-  request_condition = reinterpret_cast<pthread_cond_t *>(data_ptr);
-  data_ptr += sizeof(pthread_cond_t);
-  request_timestamp_usec = reinterpret_cast<uint64_t *>(data_ptr);
-  data_ptr += sizeof(uint64_t);
-  request_ptr = reinterpret_cast<Req *>(data_ptr);
-  data_ptr += sizeof(Req);
-  response_mutex = reinterpret_cast<pthread_mutex_t *>(data_ptr);
-  data_ptr += sizeof(pthread_mutex_t);
-  response_condition = reinterpret_cast<pthread_cond_t *>(data_ptr);
-  data_ptr += sizeof(pthread_cond_t);
-  response_timestamp_usec = reinterpret_cast<uint64_t *>(data_ptr);
-  data_ptr += sizeof(uint64_t);
-  response_ptr = reinterpret_cast<Res *>(data_ptr);
-
-  initializeExclusiveAccess();
-
-  *request_timestamp_usec = getCurrentTimeUSec();
-  *response_timestamp_usec = *request_timestamp_usec;
-  current_request_timestamp_usec = *request_timestamp_usec;
-
-  pthread_create(&thread, NULL, reinterpret_cast<void* (*)(void*)>(&ServiceServer<Req, Res>::called_loop), this);
+    throw std::runtime_error("shm::ServiceServer: Cannot get memory!");
+  }
+
+  memory_ptr = shared_memory->getPtr();
+  header     = reinterpret_cast<ServiceHeader *>(memory_ptr);
+  slot_list  = reinterpret_cast<ServiceSlot<Req, Res> *>(memory_ptr + sizeof(ServiceHeader));
+
+  // Hide the service from clients until the slots are ready
+  header->slot_num.store(0, std::memory_order_release);
+  header->next_call_id.store(0, std::memory_order_relaxed);
+  header->request_sequence.store(0, std::memory_order_relaxed);
+  header->request_waiter_num.store(0, std::memory_order_relaxed);
+  header->free_sequence.store(0, std::memory_order_relaxed);
+  header->free_waiter_num.store(0, std::memory_order_relaxed);
+  for (int i = 0; i < slot_num; i++)
+  {
+    slot_list[i].call_id = 0;
+    slot_list[i].waiter_num.store(0, std::memory_order_relaxed);
+    slot_list[i].owner_pid.store(0, std::memory_order_relaxed);
+    slot_list[i].owner_start_time.store(0, std::memory_order_relaxed);
+    slot_list[i].state.store(SERVICE_SLOT_FREE, std::memory_order_release);
+    // Clients still waiting on a previous server instance give up instead of sleeping until their deadline
+    futexWake(&slot_list[i].state);
+  }
+  header->slot_num.store(static_cast<uint32_t>(slot_num), std::memory_order_release);
+
+  try
+  {
+    startWorkers(options);
+  }
+  catch (...)
+  {
+    stopWorkers();
+    shared_memory->disconnect();
+    delete shared_memory;
+    throw;
+  }
 }
 
 template <class Req, class Res>
 ServiceServer<Req, Res>::~ServiceServer()
 {
-  // Request graceful shutdown
-  shutdown_requested = true;
-  
-  // Wake up the thread
-  pthread_cond_broadcast(request_condition);
-  
-  // Wait for thread to finish gracefully, then force if needed
-  pthread_cancel(thread);
-  pthread_join(thread, nullptr);
+  stopWorkers();
 
   shared_memory->disconnect();
   if (shared_memory != nullptr)
@@ -174,33 +365,156 @@ ServiceServer<Req, Res>::~ServiceServer()
   }
 }
 
+//! @brief 共有メモリの必要サイズを計算する
+//! @param [in] request_slot_num リクエストスロット数
+//! @return size_t 必要なバイト数
+template <class Req, class Res>
+size_t
+ServiceServer<Req, Res>::getMemorySize(int request_slot_num)
+{
+  return sizeof(ServiceHeader) + sizeof(ServiceSlot<Req, Res>) * static_cast<size_t>(request_slot_num);
+}
+
+//! @brief ワーカースレッドを起動する
+//! @param [in] options ワーカー数とCPU固定、スケジューリングの設定
+//! @details CPUの固定とスケジューリングはスレッド生成時の属性で行うため、ワーカーは最初から指定した設定で動作する．
 template <class Req, class Res>
 void
-ServiceServer<Req, Res>::initializeExclusiveAccess()
-{
-  pthread_condattr_t request_cond_attr;
-  pthread_condattr_init(&request_cond_attr);
-  pthread_condattr_setpshared(&request_cond_attr, PTHREAD_PROCESS_SHARED);
-  pthread_cond_init(request_condition, &request_cond_attr);
-  pthread_condattr_destroy(&request_cond_attr);
-
-  pthread_mutexattr_t request_m_attr;
-  pthread_mutexattr_init(&request_m_attr);
-  pthread_mutexattr_setpshared(&request_m_attr, PTHREAD_PROCESS_SHARED);
-  pthread_mutex_init(request_mutex, &request_m_attr);
-  pthread_mutexattr_destroy(&request_m_attr);
-
-  pthread_condattr_t response_cond_attr;
-  pthread_condattr_init(&response_cond_attr);
-  pthread_condattr_setpshared(&response_cond_attr, PTHREAD_PROCESS_SHARED);
-  pthread_cond_init(response_condition, &response_cond_attr);
-  pthread_condattr_destroy(&response_cond_attr);
-
-  pthread_mutexattr_t response_m_attr;
-  pthread_mutexattr_init(&response_m_attr);
-  pthread_mutexattr_setpshared(&response_m_attr, PTHREAD_PROCESS_SHARED);
-  pthread_mutex_init(response_mutex, &response_m_attr);
-  pthread_mutexattr_destroy(&response_m_attr);
+ServiceServer<Req, Res>::startWorkers(const ServiceServerOptions &options)
+{
+  for (int i = 0; i < options.worker_num; i++)
+  {
+    pthread_attr_t thread_attr;
+    pthread_attr_init(&thread_attr);
+    try
+    {
+      initThreadAttr(&thread_attr, options.thread_attributes);
+    }
+    catch (...)
+    {
+      pthread_attr_destroy(&thread_attr);
+      throw;
+    }
+    if (!options.cpu_list.empty())
+    {
+#if defined(__linux__)
+      int cpu = options.cpu_list[static_cast<size_t>(i) % options.cpu_list.size()];
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(cpu, &cpu_set);
+      pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set), &cpu_set);
+#endif
+    }
+    pthread_t thread;
+    int result = pthread_create(&thread, &thread_attr,
+                                reinterpret_cast<void* (*)(void*)>(&ServiceServer<Req, Res>::called_loop), this);
+    pthread_attr_destroy(&thread_attr);
+    if (result == EPERM)
+    {
+      throw std::runtime_error("shm::ServiceServer: Not permitted to start a worker with real-time scheduling!");
+    }
+    if (result != 0)
+    {
+      throw std::runtime_error("shm::ServiceServer: Cannot start worker thread!");
+    }
+    threads.push_back(thread);
+  }
+}
+
+//! @brief 全てのワーカースレッドを停止させ、終了を待つ
+//! @details 処理中のリクエストはハンドラが戻るまで待つ．
+template <class Req, class Res>
+void
+ServiceServer<Req, Res>::stopWorkers()
+{
+  shutdown_requested.store(true, std::memory_order_seq_cst);
+  header->request_sequence.fetch_add(1, std::memory_order_seq_cst);
+  futexWake(&header->request_sequence);
+
+  for (pthread_t thread : threads)
+  {
+    pthread_join(thread, nullptr);
+  }
+  threads.clear();
+}
+
+//! @brief 処理待ちのリクエストがあるか確認する
+//! @return bool 処理待ちのリクエストがある場合は真
+template <class Req, class Res>
+bool
+ServiceServer<Req, Res>::hasRequest() const
+{
+  for (int i = 0; i < slot_num; i++)
+  {
+    if (slot_list[i].state.load(std::memory_order_acquire) == SERVICE_SLOT_REQUESTED)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+//! @brief 最も古いリクエストを持つスロットを処理中にする
+//! @return int スロット番号(リクエストが無い場合は-1)
+//! @details 複数のワーカーが同じスロットを取り合った場合、状態を書き換えられた一つだけが処理する．
+template <class Req, class Res>
+int
+ServiceServer<Req, Res>::takeNextRequest()
+{
+  while (true)
+  {
+    int next_slot = -1;
+    for (int i = 0; i < slot_num; i++)
+    {
+      if (slot_list[i].state.load(std::memory_order_acquire) == SERVICE_SLOT_REQUESTED &&
+          (next_slot < 0 || slot_list[i].call_id < slot_list[next_slot].call_id))
+      {
+        next_slot = i;
+      }
+    }
+    if (next_slot < 0)
+    {
+      return -1;
+    }
+
+    uint32_t expected = SERVICE_SLOT_REQUESTED;
+    if (slot_list[next_slot].state.compare_exchange_strong(expected, SERVICE_SLOT_PROCESSING,
+                                                           std::memory_order_acq_rel))
+    {
+      return next_slot;
+    }
+  }
+}
+
+//! @brief 新しいリクエストが投入されるまで待機する
+//! @details spin_time_us が設定されている場合はビジーウェイトで確認した後、リクエストのシーケンス番号のfutexでスリープする．
+//! 起床の取りこぼしがあってもSERVICE_IDLE_WAIT_USEC毎に再確認する．
+template <class Req, class Res>
+void
+ServiceServer<Req, Res>::waitForRequest()
+{
+  if (spin_time_us > 0)
+  {
+    uint64_t start_time = getCurrentTimeUSec();
+    while (!hasRequest() && !shutdown_requested.load(std::memory_order_acquire))
+    {
+      if (getCurrentTimeUSec() - start_time >= spin_time_us)
+      {
+        break;
+      }
+      cpu_relax();
+    }
+  }
+
+  // Read the sequence before checking the slots so that a request posted in between makes FUTEX_WAIT return
+  uint32_t sequence = header->request_sequence.load(std::memory_order_seq_cst);
+  if (hasRequest() || shutdown_requested.load(std::memory_order_seq_cst))
+  {
+    return;
+  }
+  header->request_waiter_num.fetch_add(1, std::memory_order_seq_cst);
+  futexWait(&header->request_sequence, sequence, SERVICE_IDLE_WAIT_USEC);
+  header->request_waiter_num.fetch_sub(1, std::memory_order_seq_cst);
 }
 
 template <class Req, class Res>
@@ -210,46 +524,99 @@ ServiceServer<Req, Res>::loop()
   // Pre-allocate objects to avoid repeated allocation/deallocation
   std::unique_ptr<Req> current_request_ptr = std::make_unique<Req>();
   std::unique_ptr<Res> result_ptr = std::make_unique<Res>();
-  
-  while (!shutdown_requested)
+
+  while (!shutdown_requested.load(std::memory_order_acquire))
   {
-    // Fix race condition: Check timestamp inside mutex
-    pthread_mutex_lock(request_mutex);
-    while (current_request_timestamp_usec >= *request_timestamp_usec && !shutdown_requested)
+    // Serve requests in call order
+    int slot = takeNextRequest();
+    if (slot < 0)
     {
-      // Wait on the condvar while holding the mutex
-      pthread_cond_wait(request_condition, request_mutex);
+      waitForRequest();
+      continue;
     }
-    
-    // Check for shutdown request
-    if (shutdown_requested)
+    serveRequest(slot, current_request_ptr.get(), result_ptr.get());
+  }
+}
+
+//! @brief 処理中にしたスロットのリクエストをハンドラに渡し、レスポンスを返す
+//! @param [in] slot takeNextRequest() で得たスロット番号
+//! @param [in] request リクエストのコピー先
+//! @param [in] response レスポンスの格納先
+//! @details 復号できないリクエストにはハンドラを呼ばず、無効なレスポンスを返す．
+template <class Req, class Res>
+void
+ServiceServer<Req, Res>::serveRequest(int slot, Req *request, Res *response)
+{
+  ServiceSlot<Req, Res> &request_slot = slot_list[slot];
+  SHM_TRACE(SERVICE_REQUEST, shm_name, request_slot.call_id);
+  if (MessageStorage<Req>::load(request_slot.request, request))
+  {
+    // The slot stays PROCESSING while the handler runs, so other callers keep using the remaining slots
+    *response = func(*request);
+
+    // A response larger than its slot is marked invalid and fails on the client side
+    MessageStorage<Res>::store(&request_slot.response, *response);
+  }
+  else
+  {
+    MessageStorage<Res>::invalidate(&request_slot.response);
+  }
+  // Recorded before the client can reuse the slot for its next call
+  SHM_TRACE(SERVICE_RESPONSE, shm_name, request_slot.call_id);
+  uint32_t expected = SERVICE_SLOT_PROCESSING;
+  if (request_slot.state.compare_exchange_strong(expected, SERVICE_SLOT_RESPONDED, std::memory_order_seq_cst))
+  {
+    if (request_slot.waiter_num.load(std::memory_order_seq_cst) > 0)
     {
-      pthread_mutex_unlock(request_mutex);
-      break;
+      futexWake(&request_slot.state);
     }
-    
-    // Update current timestamp and copy request data while holding mutex
-    current_request_timestamp_usec = *request_timestamp_usec;
-    *current_request_ptr = *request_ptr;
-    pthread_mutex_unlock(request_mutex);
-
-    // Process request outside of mutex to avoid blocking other clients
-    *result_ptr = func(*current_request_ptr);
-    
-    // Check again for shutdown before responding
-    if (shutdown_requested)
+  }
+  else if (expected == SERVICE_SLOT_ABANDONED)
+  {
+    // The caller has given up, nobody will collect this response
+    request_slot.owner_pid.store(0, std::memory_order_relaxed);
+    request_slot.state.store(SERVICE_SLOT_FREE, std::memory_order_seq_cst);
+    header->free_sequence.fetch_add(1, std::memory_order_seq_cst);
+    if (header->free_waiter_num.load(std::memory_order_seq_cst) > 0)
     {
-      break;
+      futexWake(&header->free_sequence);
     }
-    
-    // Update response under mutex protection
-    pthread_mutex_lock(response_mutex);
-    *response_ptr = *result_ptr;
-    *response_timestamp_usec = getCurrentTimeUSec();
-    pthread_mutex_unlock(response_mutex);
+  }
+}
 
-    pthread_cond_broadcast(response_condition);
+//! @brief 最も古いリクエストを一つ、呼び出したスレッドで処理する
+//! @return bool リクエストを処理した場合は真、処理待ちのリクエストが無い場合は偽
+//! @details ワーカー数を0にした場合に、WaitSetなどを使う外部のループから呼び出す．
+//! ワーカーと併用してもよい．一つのサーバーに対して複数のスレッドから同時に呼び出さないこと．
+template <class Req, class Res>
+bool
+ServiceServer<Req, Res>::spinOnce()
+{
+  int slot = takeNextRequest();
+  if (slot < 0)
+  {
+    return false;
   }
+  if (spin_request_ptr == nullptr)
+  {
+    spin_request_ptr  = std::make_unique<Req>();
+    spin_response_ptr = std::make_unique<Res>();
+  }
+  serveRequest(slot, spin_request_ptr.get(), spin_response_ptr.get());
+  return true;
+}
+
+//! @brief WaitSetでリクエストを待つためのfutexワードを取得する
+//! @param [out] target リクエストの投入で進むシーケンスと処理待ちのリクエストの確認
+//! @return bool 常に真
+template <class Req, class Res>
+bool
+ServiceServer<Req, Res>::getWaitTarget(WaitTarget *target)
+{
+  target->sequence   = &header->request_sequence;
+  target->waiter_num = &header->request_waiter_num;
+  target->is_ready   = [this]() { return hasRequest(); };
+  return true;
 }
 
 
@@ -257,25 +624,249 @@ template <class Req, class Res>
 ServiceClient<Req, Res>::ServiceClient(std::string name)
 : shm_name(name)
 , shared_memory(nullptr)
+, memory_ptr(nullptr)
+, header(nullptr)
+, slot_list(nullptr)
+, slot_num(0)
+, spin_time_us(SERVICE_MAX_SPIN_USEC)
+, async_used(false)
 {
-  if (!std::is_standard_layout<Req>::value || !std::is_standard_layout<Res>::value)
+  if (!is_transferable_message<Req>() || !is_transferable_message<Res>())
   {
     throw std::runtime_error("shm::ServiceClient: Be setted not POD class!");
   }
   shared_memory = new SharedMemoryPosix(shm_name, O_RDWR, static_cast<PERM>(0));
-
-  current_response_timestamp_usec = getCurrentTimeUSec();
 }
 
 template <class Req, class Res>
 ServiceClient<Req, Res>::~ServiceClient()
 {
+  // Outstanding asynchronous calls refer to this mapping; finish them before it goes away
+  if (async_used.load())
+  {
+    ServiceCompletionNotifier::getInstance().cancel(this);
+  }
   if (shared_memory != nullptr)
   {
     delete shared_memory;
   }
 }
 
+//! @brief サービスの共有メモリに接続する
+//! @return bool 接続済みまたは接続に成功した場合は真
+template <class Req, class Res>
+bool
+ServiceClient<Req, Res>::connectService()
+{
+  std::lock_guard<std::mutex> lock(connect_mutex);
+  if (!shared_memory->isDisconnected())
+  {
+    return true;
+  }
+  shared_memory->connect();
+  if (shared_memory->isDisconnected())
+  {
+    return false;
+  }
+
+  memory_ptr = shared_memory->getPtr();
+  header     = reinterpret_cast<ServiceHeader *>(memory_ptr);
+  int num    = 0;
+  if (shared_memory->getSize() >= sizeof(ServiceHeader))
+  {
+    num = static_cast<int>(header->slot_num.load(std::memory_order_acquire));
+  }
+  // The server has not finished initializing, or the segment belongs to another layout
+  if (num <= 0 || shared_memory->getSize() < ServiceServer<Req, Res>::getMemorySize(num))
+  {
+    shared_memory->disconnect();
+    return false;
+  }
+  slot_list = reinterpret_cast<ServiceSlot<Req, Res> *>(memory_ptr + sizeof(ServiceHeader));
+  slot_num  = num;
+  return true;
+}
+
+//! @brief 空きスロットを確保する
+//! @param [in] deadline_usec 待機の期限(getCurrentTimeUSec()の時刻)
+//! @return int 確保したスロット番号(期限までに空かなかった場合は-1)
+//! @details 空きスロットが無い場合は、終了したクライアントが確保したままのスロットを回収する．
+//! 待機中に別のクライアントが終了した場合に備え、SERVICE_IDLE_WAIT_USEC ごとに回収を試みる．
+template <class Req, class Res>
+int
+ServiceClient<Req, Res>::claimSlot(uint64_t deadline_usec)
+{
+  while (true)
+  {
+    // Read the sequence first so that a slot released during the scan makes FUTEX_WAIT return
+    uint32_t sequence = header->free_sequence.load(std::memory_order_seq_cst);
+    for (int i = 0; i < slot_num; i++)
+    {
+      uint32_t expected = SERVICE_SLOT_FREE;
+      if (slot_list[i].state.compare_exchange_strong(expected, SERVICE_SLOT_CLAIMED, std::memory_order_acquire))
+      {
+        // The start time goes first so that a reader of the new pid never pairs it with a stale start time
+        slot_list[i].owner_start_time.store(getCurrentProcessStartTime(), std::memory_order_relaxed);
+        slot_list[i].owner_pid.store(static_cast<uint32_t>(getpid()), std::memory_order_release);
+        return i;
+      }
+    }
+    if (reclaimDeadSlots())
+    {
+      continue;
+    }
+
+    uint64_t current_time = getCurrentTimeUSec();
+    if (current_time >= deadline_usec)
+    {
+      return -1;
+    }
+    header->free_waiter_num.fetch_add(1, std::memory_order_seq_cst);
+    futexWait(&header->free_sequence, sequence, std::min(deadline_usec - current_time, SERVICE_IDLE_WAIT_USEC));
+    header->free_waiter_num.fetch_sub(1, std::memory_order_seq_cst);
+  }
+}
+
+//! @brief スロットを空きに戻し、空きを待つクライアントに通知する
+//! @param [in] slot 解放するスロット
+template <class Req, class Res>
+void
+ServiceClient<Req, Res>::releaseSlot(ServiceSlot<Req, Res> &slot)
+{
+  slot.owner_pid.store(0, std::memory_order_relaxed);
+  slot.state.store(SERVICE_SLOT_FREE, std::memory_order_seq_cst);
+  notifyFreeSlot();
+}
+
+//! @brief 空きスロットが発生したことを空きを待つクライアントに通知する
+template <class Req, class Res>
+void
+ServiceClient<Req, Res>::notifyFreeSlot()
+{
+  header->free_sequence.fetch_add(1, std::memory_order_seq_cst);
+  if (header->free_waiter_num.load(std::memory_order_seq_cst) > 0)
+  {
+    futexWake(&header->free_sequence, 1);
+  }
+}
+
+//! @brief 終了したクライアントが確保したままのスロットを回収する
+//! @return bool 空きに戻したスロットがある場合は真
+//! @details owner_pidを0に置き換えたクライアントだけが回収を行うため、同じスロットが二重に回収されることはない．
+//! 処理中のスロットは破棄済みとし、サーバーが処理を終えた時点で空きに戻す．
+//! owner_pidが0のスロットは確保の直後であるため回収しない．
+template <class Req, class Res>
+bool
+ServiceClient<Req, Res>::reclaimDeadSlots()
+{
+  bool     reclaimed = false;
+  uint32_t self_pid  = static_cast<uint32_t>(getpid());
+  for (int i = 0; i < slot_num; i++)
+  {
+    ServiceSlot<Req, Res> &slot = slot_list[i];
+    uint32_t               pid  = slot.owner_pid.load(std::memory_order_acquire);
+    if (pid == 0 || pid == self_pid ||
+        isProcessAlive(static_cast<pid_t>(pid), slot.owner_start_time.load(std::memory_order_relaxed)))
+    {
+      continue;
+    }
+    if (!slot.owner_pid.compare_exchange_strong(pid, 0, std::memory_order_acq_rel))
+    {
+      continue;
+    }
+
+    // The server may move the slot forward meanwhile, so retry until one transition succeeds
+    uint32_t state = slot.state.load(std::memory_order_acquire);
+    while (true)
+    {
+      if (state == SERVICE_SLOT_PROCESSING)
+      {
+        if (slot.state.compare_exchange_weak(state, SERVICE_SLOT_ABANDONED, std::memory_order_acq_rel))
+        {
+          break;
+        }
+      }
+      else if (state == SERVICE_SLOT_CLAIMED || state == SERVICE_SLOT_REQUESTED || state == SERVICE_SLOT_RESPONDED)
+      {
+        if (slot.state.compare_exchange_weak(state, SERVICE_SLOT_FREE, std::memory_order_acq_rel))
+        {
+          notifyFreeSlot();
+          reclaimed = true;
+          break;
+        }
+      }
+      else
+      {
+        break;
+      }
+    }
+  }
+  return reclaimed;
+}
+
+//! @brief スロットにレスポンスが書き込まれるまで待機する
+//! @param [in] slot 待機するスロット
+//! @param [in] deadline_usec 待機の期限(getCurrentTimeUSec()の時刻)
+//! @return bool レスポンスが書き込まれた場合は真
+//! @details 最初に spin_time_us だけビジーウェイトで確認し、その後スロットの状態のfutexでスリープする．
+//! スピン中に応答が得られた場合はスピン時間を応答時間に合わせ、応答がスピン時間の上限より遅い場合はスピン時間を縮める．
+template <class Req, class Res>
+bool
+ServiceClient<Req, Res>::waitResponse(ServiceSlot<Req, Res> &slot, uint64_t deadline_usec)
+{
+  uint64_t start_time = getCurrentTimeUSec();
+  uint64_t remaining  = deadline_usec > start_time ? deadline_usec - start_time : 0;
+  uint64_t spin_limit = std::min(spin_time_us.load(std::memory_order_relaxed), remaining);
+
+  bool     responded    = false;
+  uint64_t current_time = start_time;
+  while (current_time - start_time < spin_limit)
+  {
+    if (slot.state.load(std::memory_order_acquire) == SERVICE_SLOT_RESPONDED)
+    {
+      responded = true;
+      break;
+    }
+    cpu_relax();
+    current_time = getCurrentTimeUSec();
+  }
+
+  while (!responded)
+  {
+    uint32_t state = slot.state.load(std::memory_order_seq_cst);
+    if (state == SERVICE_SLOT_RESPONDED)
+    {
+      responded = true;
+      break;
+    }
+    // A restarted server has reset the slot table
+    if (state != SERVICE_SLOT_REQUESTED && state != SERVICE_SLOT_PROCESSING)
+    {
+      break;
+    }
+    current_time = getCurrentTimeUSec();
+    if (current_time >= deadline_usec)
+    {
+      break;
+    }
+    slot.waiter_num.fetch_add(1, std::memory_order_seq_cst);
+    futexWait(&slot.state, state, deadline_usec - current_time);
+    slot.waiter_num.fetch_sub(1, std::memory_order_seq_cst);
+  }
+
+  // Adapt the spin phase to the response time of this service
+  uint64_t response_time = getCurrentTimeUSec() - start_time;
+  uint64_t target_spin   = 0;
+  if (response_time <= SERVICE_MAX_SPIN_USEC)
+  {
+    target_spin = std::min(response_time * 2, SERVICE_MAX_SPIN_USEC);
+  }
+  uint64_t current_spin  = spin_time_us.load(std::memory_order_relaxed);
+  spin_time_us.store((current_spin * 3 + target_spin + 3) / 4, std::memory_order_relaxed);
+
+  return responded;
+}
+
 template <class Req, class Res>
 bool
 ServiceClient<Req, Res>::call(Req request, Res *response)
@@ -284,74 +875,178 @@ ServiceClient<Req, Res>::call(Req request, Res *response)
   return call(request, response, 5000000);
 }
 
+//! @brief 空きスロットにリクエストを書き込み、サーバーに通知する
+//! @param [in] request リクエスト
+//! @param [in] deadline_usec 空きスロットを待つ期限(getCurrentTimeUSec()の時刻)
+//! @return int リクエストを書き込んだスロット番号(空きスロットが無い場合は-1)
+template <class Req, class Res>
+int
+ServiceClient<Req, Res>::postRequest(const Req &request, uint64_t deadline_usec)
+{
+  if (!MessageStorage<Req>::fits(request))
+  {
+    throw std::runtime_error("shm::ServiceClient: Request is larger than its serialized slot!");
+  }
+  int slot = claimSlot(deadline_usec);
+  if (slot < 0)
+  {
+    return -1;
+  }
+
+  ServiceSlot<Req, Res> &request_slot = slot_list[slot];
+  request_slot.call_id = header->next_call_id.fetch_add(1, std::memory_order_relaxed) + 1;
+  MessageStorage<Req>::store(&request_slot.request, request);
+  request_slot.state.store(SERVICE_SLOT_REQUESTED, std::memory_order_seq_cst);
+  header->request_sequence.fetch_add(1, std::memory_order_seq_cst);
+  if (header->request_waiter_num.load(std::memory_order_seq_cst) > 0)
+  {
+    futexWake(&header->request_sequence, 1);
+  }
+  return slot;
+}
+
+//! @brief 呼び出しを終了し、スロットを手放す
+//! @param [in] slot リクエストを書き込んだスロット
+//! @param [out] response レスポンスの格納先
+//! @return bool レスポンスを受け取れた場合は真
+//! @details レスポンスが未着の場合はリクエストを取り下げるか、処理中であればサーバーにスロットの解放を任せる．
 template <class Req, class Res>
 bool
-ServiceClient<Req, Res>::call(Req request, Res *response, unsigned long timeout_usec)
+ServiceClient<Req, Res>::finishCall(ServiceSlot<Req, Res> &slot, Res *response)
 {
-  // Check the service shared memory existence.
-  if (shared_memory->isDisconnected())
+  uint32_t state = slot.state.load(std::memory_order_acquire);
+  while (true)
   {
-    shared_memory->connect();
-    if (shared_memory->isDisconnected())
+    if (state == SERVICE_SLOT_RESPONDED)
     {
-      return false;
+      bool is_loaded = MessageStorage<Res>::load(slot.response, response);
+      releaseSlot(slot);
+      return is_loaded;
     }
-    uint8_t *data_ptr = shared_memory->getPtr();
-    memory_ptr = data_ptr;
-    request_mutex = reinterpret_cast<pthread_mutex_t *>(data_ptr);
-    data_ptr += sizeof(pthread_mutex_t);
-    request_condition = reinterpret_cast<pthread_cond_t *>(data_ptr);
-    data_ptr += sizeof(pthread_cond_t);
-    request_timestamp_usec = reinterpret_cast<uint64_t *>(data_ptr);
-    data_ptr += sizeof(uint64_t);
-    request_ptr = reinterpret_cast<Req *>(data_ptr);
-    data_ptr += sizeof(Req);
-    response_mutex = reinterpret_cast<pthread_mutex_t *>(data_ptr);
-    data_ptr += sizeof(pthread_mutex_t);
-    response_condition = reinterpret_cast<pthread_cond_t *>(data_ptr);
-    data_ptr += sizeof(pthread_cond_t);
-    response_timestamp_usec = reinterpret_cast<uint64_t *>(data_ptr);
-    data_ptr += sizeof(uint64_t);
-    response_ptr = reinterpret_cast<Res *>(data_ptr);
-  }
-
-  // Set request to shared memory
-  *request_ptr = request;
-  *request_timestamp_usec = getCurrentTimeUSec();
-
-  pthread_cond_broadcast(request_condition);
-
-  // Simple timeout implementation using loop with small delays
-  uint64_t start_time = *request_timestamp_usec;
-  uint64_t end_time = start_time + timeout_usec;
-
-  while (current_response_timestamp_usec >= *response_timestamp_usec)
-  {
-    // Check timeout
-    uint64_t current_time = getCurrentTimeUSec();
-    if (current_time > end_time)
+    if (state == SERVICE_SLOT_REQUESTED)
+    {
+      // Timed out before a worker picked it up; take the slot back and withdraw the request
+      if (slot.state.compare_exchange_strong(state, SERVICE_SLOT_CLAIMED, std::memory_order_acq_rel))
+      {
+        releaseSlot(slot);
+        return false;
+      }
+      continue;
+    }
+    if (state == SERVICE_SLOT_PROCESSING)
     {
-      return false; // Timeout
+      // Let the worker release the slot once the handler returns
+      if (slot.state.compare_exchange_strong(state, SERVICE_SLOT_ABANDONED, std::memory_order_acq_rel))
+      {
+        return false;
+      }
+      continue;
     }
-    
-    // Wait on the condvar with short timeout
-    pthread_mutex_lock(response_mutex);
-    struct timespec wait_time;
-    wait_time.tv_sec = 0;
-    wait_time.tv_nsec = 10000000; // 10ms
-    pthread_cond_timedwait(response_condition, response_mutex, &wait_time);
-    pthread_mutex_unlock(response_mutex);
+    // The slot was reset by a restarted server
+    return false;
   }
-  current_response_timestamp_usec = *response_timestamp_usec;
+}
 
-  // Get response from shared memory
-  *response = *response_ptr;
+template <class Req, class Res>
+bool
+ServiceClient<Req, Res>::call(Req request, Res *response, unsigned long timeout_usec)
+{
+  // Check the service shared memory existence.
+  if (!connectService())
+  {
+    return false;
+  }
+
+  // All waits below share one absolute deadline on the monotonic clock
+  uint64_t deadline_usec = getCurrentTimeUSec() + timeout_usec;
+
+  int slot = postRequest(request, deadline_usec);
+  if (slot < 0)
+  {
+    return false;
+  }
+  waitResponse(slot_list[slot], deadline_usec);
+  return finishCall(slot_list[slot], response);
+}
 
+//! @brief リクエストを投入し、完了をコールバックで受け取る
+//! @param [in] request リクエスト
+//! @param [in] callback 完了時に呼ばれる関数．第1引数はレスポンスを受け取れたか、第2引数はレスポンス
+//! @param [in] timeout_usec 投入からの待ち時間[usec]
+//! @return bool リクエストを投入できた場合は真．偽の場合コールバックは呼ばれない
+//! @details 空きスロットを待たずに戻る．コールバックは ServiceCompletionNotifier のスレッドから一度だけ呼ばれる．
+template <class Req, class Res>
+bool
+ServiceClient<Req, Res>::callAsync(Req request, std::function<void(bool, const Res &)> callback,
+                                   unsigned long timeout_usec)
+{
+  if (!connectService())
+  {
+    return false;
+  }
+
+  uint64_t current_time = getCurrentTimeUSec();
+  int      slot         = postRequest(request, current_time);
+  if (slot < 0)
+  {
+    return false;
+  }
+
+  async_used.store(true);
+  ServiceSlot<Req, Res> &request_slot = slot_list[slot];
+  ServiceCompletion completion;
+  completion.owner         = this;
+  completion.state         = &request_slot.state;
+  completion.waiter_num    = &request_slot.waiter_num;
+  completion.deadline_usec = current_time + timeout_usec;
+  completion.complete      = [this, &request_slot, callback]()
+  {
+    Res  response;
+    bool result = finishCall(request_slot, &response);
+    if (callback)
+    {
+      callback(result, response);
+    }
+  };
+  ServiceCompletionNotifier::getInstance().add(std::move(completion));
   return true;
 }
 
+//! @brief リクエストを投入し、レスポンスをfutureで受け取る
+//! @param [in] request リクエスト
+//! @param [in] timeout_usec 投入からの待ち時間[usec]
+//! @return std::future<Res> レスポンス．投入できなかった場合や期限切れの場合は std::runtime_error を保持する
+template <class Req, class Res>
+std::future<Res>
+ServiceClient<Req, Res>::callAsync(Req request, unsigned long timeout_usec)
+{
+  auto             promise = std::make_shared<std::promise<Res>>();
+  std::future<Res> future  = promise->get_future();
+  bool posted = callAsync(
+      request,
+      [promise](bool result, const Res &response)
+      {
+        if (result)
+        {
+          promise->set_value(response);
+        }
+        else
+        {
+          promise->set_exception(
+              std::make_exception_ptr(std::runtime_error("shm::ServiceClient: Service call timed out!")));
+        }
+      },
+      timeout_usec);
+  if (!posted)
+  {
+    promise->set_exception(
+        std::make_exception_ptr(std::runtime_error("shm::ServiceClient: Cannot post request to the service!")));
+  }
+  return future;
+}
+
 }
 
 }
 
-#endif //__SHM_SERVICE_LIB_H__
\ No newline at end of file
+#endif //__SHM_SERVICE_LIB_H__
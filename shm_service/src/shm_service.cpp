@@ -1,4 +1,6 @@
 #include <shm_service.hpp>
+#include <algorithm>
+#include <iterator>
 
 namespace irlab
 {
@@ -6,6 +8,205 @@ namespace irlab
 namespace shm
 {
 
+//! 一度に監視できる呼び出し数(futex_waitvの上限から起床用のワード分を引いた数)
+constexpr size_t NOTIFIER_WATCH_NUM = 127;
+//! 監視対象が無い場合や監視しきれない場合の再確認周期[usec]
+constexpr uint64_t NOTIFIER_IDLE_WAIT_USEC = 100000;
+
+//! @brief プロセスで共有する通知スレッドを取得する
+//! @return ServiceCompletionNotifier& 通知スレッド
+//! @details 最初の非同期呼び出しの際に生成される．
+ServiceCompletionNotifier &
+ServiceCompletionNotifier::getInstance()
+{
+  static ServiceCompletionNotifier instance;
+  return instance;
+}
+
+ServiceCompletionNotifier::ServiceCompletionNotifier()
+: wake_sequence(0)
+, shutdown_requested(false)
+{
+  thread = std::thread(&ServiceCompletionNotifier::loop, this);
+}
+
+ServiceCompletionNotifier::~ServiceCompletionNotifier()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    shutdown_requested = true;
+  }
+  wake_sequence.fetch_add(1);
+  futexWake(&wake_sequence);
+  if (thread.joinable())
+  {
+    thread.join();
+  }
+}
+
+//! @brief 完了待ちの呼び出しを登録する
+//! @param [in] completion 完了待ちの呼び出し
+void
+ServiceCompletionNotifier::add(ServiceCompletion completion)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending_list.push_back(std::move(completion));
+  }
+  wake_sequence.fetch_add(1);
+  futexWake(&wake_sequence);
+}
+
+//! @brief 指定した呼び出し元の完了待ちを全て打ち切る
+//! @param [in] owner 呼び出し元
+//! @details 打ち切った呼び出しのコールバックは失敗として呼ばれる．
+//! 戻った時点で、この呼び出し元のコールバックは全て終了している．
+void
+ServiceCompletionNotifier::cancel(const void *owner)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  auto is_owned = [owner](const ServiceCompletion &completion) { return completion.owner == owner; };
+
+  if (std::this_thread::get_id() == thread.get_id())
+  {
+    // Called from a callback: the loop is not waiting on any slot, so finish the calls right here
+    std::vector<ServiceCompletion> cancelled_list;
+    auto it = std::stable_partition(pending_list.begin(), pending_list.end(),
+                                    [&](const ServiceCompletion &completion) { return !is_owned(completion); });
+    std::move(it, pending_list.end(), std::back_inserter(cancelled_list));
+    pending_list.erase(it, pending_list.end());
+    lock.unlock();
+    for (auto &completion : cancelled_list)
+    {
+      completion.complete();
+    }
+    return;
+  }
+
+  cancelled_owner_list.push_back(owner);
+  wake_sequence.fetch_add(1);
+  futexWake(&wake_sequence);
+  finished_condition.wait(lock, [&]()
+                          {
+                            return std::none_of(pending_list.begin(), pending_list.end(), is_owned) &&
+                                   std::find(running_owner_list.begin(), running_owner_list.end(), owner) ==
+                                       running_owner_list.end();
+                          });
+  cancelled_owner_list.erase(std::find(cancelled_owner_list.begin(), cancelled_owner_list.end(), owner));
+}
+
+//! @brief 呼び出しが完了したか確認する
+//! @param [in] completion 完了待ちの呼び出し
+//! @param [in] current_time 現在時刻[usec]
+//! @return bool レスポンスが届いた、期限が過ぎた、または打ち切られた場合は真
+//! @details mutexを保持した状態で呼び出すこと．
+bool
+ServiceCompletionNotifier::isReady(const ServiceCompletion &completion, uint64_t current_time) const
+{
+  uint32_t state = completion.state->load(std::memory_order_acquire);
+  if (state != SERVICE_SLOT_REQUESTED && state != SERVICE_SLOT_PROCESSING)
+  {
+    return true;
+  }
+  if (current_time >= completion.deadline_usec)
+  {
+    return true;
+  }
+  return std::find(cancelled_owner_list.begin(), cancelled_owner_list.end(), completion.owner) !=
+         cancelled_owner_list.end();
 }
 
-}
\ No newline at end of file
+void
+ServiceCompletionNotifier::loop()
+{
+  std::vector<ServiceCompletion>       ready_list;
+  std::vector<std::atomic<uint32_t> *> word_list;
+  std::vector<std::atomic<uint32_t> *> waiter_list;
+  std::vector<uint32_t>                value_list;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!shutdown_requested)
+  {
+    // Read the wake word before scanning so that an add() or cancel() in between makes the wait return
+    uint32_t sequence     = wake_sequence.load(std::memory_order_seq_cst);
+    uint64_t current_time = getCurrentTimeUSec();
+
+    auto it = std::stable_partition(pending_list.begin(), pending_list.end(),
+                                    [&](const ServiceCompletion &completion)
+                                    { return !isReady(completion, current_time); });
+    if (it != pending_list.end())
+    {
+      ready_list.clear();
+      std::move(it, pending_list.end(), std::back_inserter(ready_list));
+      pending_list.erase(it, pending_list.end());
+      for (auto &completion : ready_list)
+      {
+        running_owner_list.push_back(completion.owner);
+      }
+
+      lock.unlock();
+      for (auto &completion : ready_list)
+      {
+        try
+        {
+          completion.complete();
+        }
+        catch (...)
+        {
+          // A throwing callback must not stop the delivery of other completions
+        }
+      }
+      ready_list.clear();
+      lock.lock();
+
+      running_owner_list.clear();
+      finished_condition.notify_all();
+      continue;
+    }
+
+    // Sleep until any watched slot changes, the nearest deadline passes or the list is updated
+    word_list.assign(1, &wake_sequence);
+    value_list.assign(1, sequence);
+    waiter_list.clear();
+    uint64_t wait_usec = NOTIFIER_IDLE_WAIT_USEC;
+    for (auto &completion : pending_list)
+    {
+      wait_usec = std::min(wait_usec, completion.deadline_usec - current_time);
+      if (waiter_list.size() < NOTIFIER_WATCH_NUM)
+      {
+        completion.waiter_num->fetch_add(1, std::memory_order_seq_cst);
+        waiter_list.push_back(completion.waiter_num);
+        uint32_t state = completion.state->load(std::memory_order_seq_cst);
+        if (state != SERVICE_SLOT_REQUESTED && state != SERVICE_SLOT_PROCESSING)
+        {
+          // Completed after the scan and possibly before the server saw our waiter count
+          wait_usec = 0;
+        }
+        word_list.push_back(completion.state);
+        value_list.push_back(state);
+      }
+    }
+    if (pending_list.size() > NOTIFIER_WATCH_NUM)
+    {
+      // Calls beyond the watch limit are picked up by polling
+      wait_usec = std::min(wait_usec, static_cast<uint64_t>(1000));
+    }
+
+    // The slots stay mapped while they are pending, and only this thread removes pending calls
+    if (wait_usec > 0)
+    {
+      lock.unlock();
+      futexWaitMultiple(word_list.data(), value_list.data(), word_list.size(), wait_usec);
+      lock.lock();
+    }
+
+    for (auto waiter_num : waiter_list)
+    {
+      waiter_num->fetch_sub(1, std::memory_order_seq_cst);
+    }
+  }
+}
+
+}  // namespace shm
+
+}  // namespace irlab
@@ -2,7 +2,15 @@
 #include <thread>
 #include <chrono>
 #include <vector>
+#include <algorithm>
 #include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <sched.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "shm_base.hpp"
 #include "shm_service.hpp"
@@ -150,6 +158,18 @@ protected:
         irlab::shm::disconnectMemory("test_reconnection_service");
         irlab::shm::disconnectMemory("test_large_data_service");
         irlab::shm::disconnectMemory("test_performance_service");
+        irlab::shm::disconnectMemory("test_concurrent_callers_service");
+        irlab::shm::disconnectMemory("test_call_timeout_service");
+        irlab::shm::disconnectMemory("test_worker_pool_service");
+        irlab::shm::disconnectMemory("test_worker_affinity_service");
+        irlab::shm::disconnectMemory("test_call_deadline_service");
+        irlab::shm::disconnectMemory("test_async_service_0");
+        irlab::shm::disconnectMemory("test_async_service_1");
+        irlab::shm::disconnectMemory("test_async_service_2");
+        irlab::shm::disconnectMemory("test_async_callback_service");
+        irlab::shm::disconnectMemory("test_wait_set_service_0");
+        irlab::shm::disconnectMemory("test_wait_set_service_1");
+        irlab::shm::disconnectMemory("test_dead_client_service");
 
         // Additional cleanup - wait a bit to ensure cleanup is complete
         std::this_thread::sleep_for(std::chrono::milliseconds(50));
@@ -715,6 +735,484 @@ TEST_F(SHMServiceTest, PerformanceTest)
     }
 }
 
+int slowAddOneService(int request)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(request < 0 ? 200 : 1));
+    return request + 1;
+}
+
+// Concurrent callers must each get the response to their own request, even with fewer slots than callers
+TEST_F(SHMServiceTest, ConcurrentCallersTest)
+{
+    irlab::shm::ServiceServer<int, int> server("/test_concurrent_callers_service", slowAddOneService,
+                                               irlab::shm::DEFAULT_PERM, 4);
+
+    const int caller_num = 8;
+    const int call_num   = 20;
+    std::vector<std::thread> client_threads;
+    std::vector<int> success_counts(caller_num, 0);
+    std::vector<int> mismatch_counts(caller_num, 0);
+
+    // One client per thread and one client shared between threads
+    irlab::shm::ServiceClient<int, int> shared_client("/test_concurrent_callers_service");
+    for (int i = 0; i < caller_num; i++)
+    {
+        client_threads.emplace_back([&, i]()
+                                    {
+            irlab::shm::ServiceClient<int, int> own_client("/test_concurrent_callers_service");
+            irlab::shm::ServiceClient<int, int> &client = (i % 2 == 0) ? own_client : shared_client;
+            for (int j = 0; j < call_num; j++)
+            {
+                int request = i * 1000 + j;
+                int response = 0;
+                if (client.call(request, &response))
+                {
+                    success_counts[i]++;
+                    if (response != request + 1)
+                    {
+                        mismatch_counts[i]++;
+                    }
+                }
+            } });
+    }
+
+    for (auto &t : client_threads)
+    {
+        t.join();
+    }
+
+    for (int i = 0; i < caller_num; i++)
+    {
+        EXPECT_EQ(success_counts[i], call_num) << "Caller " << i;
+        EXPECT_EQ(mismatch_counts[i], 0) << "Caller " << i;
+    }
+}
+
+// A timed-out call must release its slot so that later calls keep working
+TEST_F(SHMServiceTest, CallTimeoutReleasesSlotTest)
+{
+    irlab::shm::ServiceServer<int, int> server("/test_call_timeout_service", slowAddOneService,
+                                               irlab::shm::DEFAULT_PERM, 1);
+    irlab::shm::ServiceClient<int, int> client("/test_call_timeout_service");
+
+    int response = 0;
+    EXPECT_FALSE(client.call(-1, &response, 20000));
+
+    // The only slot is given back once the abandoned call finishes
+    EXPECT_TRUE(client.call(5, &response, 1000000));
+    EXPECT_EQ(response, 6);
+}
+
+// A client killed in the middle of a call must not keep its slot forever
+TEST_F(SHMServiceTest, DeadClientReleasesSlotTest)
+{
+    irlab::shm::ServiceServerOptions options;
+    options.worker_num = 0;
+    irlab::shm::ServiceServer<int, int> server("/test_dead_client_service", addOneService,
+                                               irlab::shm::DEFAULT_PERM, 1, options);
+    irlab::shm::WaitTarget target;
+    server.getWaitTarget(&target);
+    irlab::shm::ServiceClient<int, int> client("/test_dead_client_service");
+
+    // Kill more clients than there are slots
+    for (int i = 0; i < 3; i++)
+    {
+        pid_t child = fork();
+        ASSERT_GE(child, 0);
+        if (child == 0)
+        {
+            // The request stays queued because nobody spins the server
+            irlab::shm::ServiceClient<int, int> child_client("/test_dead_client_service");
+            int child_response = 0;
+            child_client.call(-1, &child_response, 10000000);
+            _exit(0);
+        }
+        for (int j = 0; j < 1000 && !target.is_ready(); j++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        ASSERT_TRUE(target.is_ready());
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+
+        // The dead request may be answered first, then its slot is reclaimed for this call
+        std::atomic<bool> done(false);
+        std::thread spinner([&]()
+                            {
+            while (!done.load())
+            {
+                if (!server.spinOnce())
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            } });
+        int response = 0;
+        EXPECT_TRUE(client.call(i, &response, 1000000)) << "Round " << i;
+        EXPECT_EQ(response, i + 1);
+        done.store(true);
+        spinner.join();
+    }
+}
+
+// A worker pool runs a stateful handler on several requests at once
+TEST_F(SHMServiceTest, WorkerPoolTest)
+{
+    std::atomic<int> active_num(0);
+    std::atomic<int> max_active_num(0);
+    std::atomic<int> handled_num(0);
+    auto handler = [&](int request)
+    {
+        int active = ++active_num;
+        int expected = max_active_num.load();
+        while (active > expected && !max_active_num.compare_exchange_weak(expected, active))
+        {
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        handled_num++;
+        active_num--;
+        return request * 2;
+    };
+
+    irlab::shm::ServiceServerOptions options;
+    options.worker_num = 4;
+    irlab::shm::ServiceServer<int, int> server("/test_worker_pool_service", handler, irlab::shm::DEFAULT_PERM,
+                                               irlab::shm::DEFAULT_SERVICE_SLOT_NUM, options);
+
+    const int caller_num = 8;
+    std::vector<std::thread> client_threads;
+    std::vector<bool> results(caller_num, false);
+    for (int i = 0; i < caller_num; i++)
+    {
+        client_threads.emplace_back([&, i]()
+                                    {
+            irlab::shm::ServiceClient<int, int> client("/test_worker_pool_service");
+            int response = 0;
+            results[i] = client.call(i, &response) && response == i * 2; });
+    }
+    for (auto &t : client_threads)
+    {
+        t.join();
+    }
+
+    for (int i = 0; i < caller_num; i++)
+    {
+        EXPECT_TRUE(results[i]) << "Caller " << i;
+    }
+    EXPECT_EQ(handled_num.load(), caller_num);
+    EXPECT_GT(max_active_num.load(), 1);
+    EXPECT_LE(max_active_num.load(), options.worker_num);
+}
+
+// Workers run on the CPUs they are pinned to
+TEST_F(SHMServiceTest, WorkerAffinityTest)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed))
+    {
+        cpu++;
+    }
+
+    irlab::shm::ServiceServerOptions options;
+    options.worker_num = 2;
+    options.cpu_list   = {cpu};
+    irlab::shm::ServiceServer<int, int> server("/test_worker_affinity_service", [](int) { return sched_getcpu(); },
+                                               irlab::shm::DEFAULT_PERM, irlab::shm::DEFAULT_SERVICE_SLOT_NUM,
+                                               options);
+    irlab::shm::ServiceClient<int, int> client("/test_worker_affinity_service");
+    for (int i = 0; i < 4; i++)
+    {
+        int response = -1;
+        EXPECT_TRUE(client.call(i, &response));
+        EXPECT_EQ(response, cpu);
+    }
+
+    using IntServer  = irlab::shm::ServiceServer<int, int>;
+    options.cpu_list = {-1};
+    EXPECT_THROW(IntServer("/test_worker_affinity_service", addOneService, irlab::shm::DEFAULT_PERM,
+                           irlab::shm::DEFAULT_SERVICE_SLOT_NUM, options),
+                 std::runtime_error);
+}
+
+// Workers are started with the scheduling, affinity and stack size given in the thread attributes
+TEST_F(SHMServiceTest, WorkerThreadAttributesTest)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed))
+    {
+        cpu++;
+    }
+
+    auto get_cpu_and_stack = [](int)
+    {
+        pthread_attr_t attr;
+        size_t         stack_size = 0;
+        pthread_getattr_np(pthread_self(), &attr);
+        pthread_attr_getstacksize(&attr, &stack_size);
+        pthread_attr_destroy(&attr);
+        return sched_getcpu() * 1000 + static_cast<int>(stack_size >> 20);
+    };
+    irlab::shm::ServiceServerOptions options;
+    options.thread_attributes.cpu_list   = {cpu};
+    options.thread_attributes.stack_size = 16 << 20;
+    {
+        irlab::shm::ServiceServer<int, int> server("/test_worker_attributes_service", get_cpu_and_stack,
+                                                   irlab::shm::DEFAULT_PERM, irlab::shm::DEFAULT_SERVICE_SLOT_NUM,
+                                                   options);
+        irlab::shm::ServiceClient<int, int> client("/test_worker_attributes_service");
+        int response = -1;
+        EXPECT_TRUE(client.call(0, &response));
+        // A cached stack of an exited thread may be reused if it is at least as large as requested
+        EXPECT_EQ(response / 1000, cpu);
+        EXPECT_GE(response % 1000, 16);
+    }
+
+    using IntServer                          = irlab::shm::ServiceServer<int, int>;
+    options.thread_attributes.sched_policy   = SCHED_FIFO;
+    options.thread_attributes.sched_priority = sched_get_priority_max(SCHED_FIFO) + 1;
+    EXPECT_THROW(IntServer("/test_worker_attributes_service", addOneService, irlab::shm::DEFAULT_PERM,
+                           irlab::shm::DEFAULT_SERVICE_SLOT_NUM, options),
+                 std::runtime_error);
+
+    // Real-time scheduling needs CAP_SYS_NICE or an RLIMIT_RTPRIO, which the test may not have
+    auto get_policy = [](int)
+    {
+        int         policy = -1;
+        sched_param param;
+        pthread_getschedparam(pthread_self(), &policy, &param);
+        return policy * 1000 + param.sched_priority;
+    };
+    options.thread_attributes.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    std::unique_ptr<IntServer> server;
+    try
+    {
+        server.reset(new IntServer("/test_worker_attributes_service", get_policy, irlab::shm::DEFAULT_PERM,
+                                   irlab::shm::DEFAULT_SERVICE_SLOT_NUM, options));
+    }
+    catch (const std::runtime_error &)
+    {
+        GTEST_SKIP() << "Real-time scheduling is not permitted";
+    }
+    irlab::shm::ServiceClient<int, int> client("/test_worker_attributes_service");
+    int response = -1;
+    EXPECT_TRUE(client.call(0, &response));
+    EXPECT_EQ(response, SCHED_FIFO * 1000 + sched_get_priority_min(SCHED_FIFO));
+}
+
+// A call blocks until its deadline, not longer and not in short polling slices that return early
+TEST_F(SHMServiceTest, CallDeadlineTest)
+{
+    irlab::shm::ServiceServer<int, int> server("/test_call_deadline_service", slowAddOneService);
+    irlab::shm::ServiceClient<int, int> client("/test_call_deadline_service");
+
+    int response = 0;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(client.call(-1, &response, 50000));
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    EXPECT_GE(elapsed.count(), 50000);
+    EXPECT_LT(elapsed.count(), 150000);
+
+    // A fast call right after the abandoned one is answered once the worker is free again
+    EXPECT_TRUE(client.call(1, &response, 1000000));
+    EXPECT_EQ(response, 2);
+}
+
+int sleepyAddOneService(int request)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    return request + 1;
+}
+
+// One caller fans out to several servers at once and collects the futures
+TEST_F(SHMServiceTest, CallAsyncFanOutTest)
+{
+    std::vector<std::unique_ptr<irlab::shm::ServiceServer<int, int>>> servers;
+    std::vector<std::unique_ptr<irlab::shm::ServiceClient<int, int>>> clients;
+    for (int i = 0; i < 3; i++)
+    {
+        std::string name = "/test_async_service_" + std::to_string(i);
+        servers.emplace_back(new irlab::shm::ServiceServer<int, int>(name, sleepyAddOneService));
+        clients.emplace_back(new irlab::shm::ServiceClient<int, int>(name));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 3; i++)
+    {
+        futures.push_back(clients[i]->callAsync(i * 10));
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECT_EQ(futures[i].get(), i * 10 + 1);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    // The three 50ms handlers ran concurrently rather than one after another
+    EXPECT_LT(elapsed.count(), 140);
+
+    // A call that outlives its timeout reports the failure through the future
+    std::future<int> late = clients[0]->callAsync(1, 10000);
+    EXPECT_THROW(late.get(), std::runtime_error);
+
+    // Calling a service that does not exist fails right away
+    irlab::shm::ServiceClient<int, int> missing("/test_async_missing_service");
+    std::future<int> failed = missing.callAsync(1);
+    EXPECT_THROW(failed.get(), std::runtime_error);
+}
+
+// Callbacks are delivered once per call, and destroying the client finishes its outstanding calls
+TEST_F(SHMServiceTest, CallAsyncCallbackTest)
+{
+    irlab::shm::ServiceServer<int, int> server("/test_async_callback_service", sleepyAddOneService,
+                                               irlab::shm::DEFAULT_PERM, 4);
+
+    std::mutex result_mutex;
+    std::vector<int> responses;
+    int failure_num = 0;
+    auto callback = [&](bool result, const int &response)
+    {
+        std::lock_guard<std::mutex> lock(result_mutex);
+        if (result)
+        {
+            responses.push_back(response);
+        }
+        else
+        {
+            failure_num++;
+        }
+    };
+
+    {
+        irlab::shm::ServiceClient<int, int> client("/test_async_callback_service");
+        EXPECT_TRUE(client.callAsync(1, callback));
+        EXPECT_TRUE(client.callAsync(2, callback));
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+        // Leave one call outstanding when the client goes away
+        EXPECT_TRUE(client.callAsync(3, callback));
+    }
+
+    std::lock_guard<std::mutex> lock(result_mutex);
+    std::sort(responses.begin(), responses.end());
+    EXPECT_EQ(responses, std::vector<int>({ 2, 3 }));
+    EXPECT_EQ(failure_num, 1);
+}
+
+// A server without workers is driven from a WaitSet shared with other services
+TEST_F(SHMServiceTest, WaitSetSpinTest)
+{
+    irlab::shm::ServiceServerOptions options;
+    options.worker_num = 0;
+    irlab::shm::ServiceServer<int, int> first_server("/test_wait_set_service_0", addOneService,
+                                                     irlab::shm::DEFAULT_PERM,
+                                                     irlab::shm::DEFAULT_SERVICE_SLOT_NUM, options);
+    irlab::shm::ServiceServer<int, int> second_server("/test_wait_set_service_1", addOneService,
+                                                      irlab::shm::DEFAULT_PERM,
+                                                      irlab::shm::DEFAULT_SERVICE_SLOT_NUM, options);
+    EXPECT_FALSE(first_server.spinOnce());
+
+    irlab::shm::WaitSet wait_set;
+    size_t first_handle  = wait_set.add(first_server);
+    size_t second_handle = wait_set.add(second_server);
+    EXPECT_TRUE(wait_set.wait(10000).empty());
+
+    constexpr int CALL_NUM = 20;
+    std::atomic<int> served_num{0};
+    std::thread spin_thread([&]()
+    {
+        while (served_num < CALL_NUM * 2)
+        {
+            for (size_t handle : wait_set.wait(100000))
+            {
+                if (handle == first_handle)
+                {
+                    served_num += first_server.spinOnce() ? 1 : 0;
+                }
+                else if (handle == second_handle)
+                {
+                    served_num += second_server.spinOnce() ? 1 : 0;
+                }
+            }
+        }
+    });
+
+    irlab::shm::ServiceClient<int, int> first_client("/test_wait_set_service_0");
+    irlab::shm::ServiceClient<int, int> second_client("/test_wait_set_service_1");
+    for (int i = 0; i < CALL_NUM; i++)
+    {
+        int response = 0;
+        EXPECT_TRUE(first_client.call(i, &response));
+        EXPECT_EQ(response, i + 1);
+        EXPECT_TRUE(second_client.call(i * 10, &response));
+        EXPECT_EQ(response, i * 10 + 1);
+    }
+    spin_thread.join();
+    EXPECT_EQ(served_num, CALL_NUM * 2);
+}
+
+// Non-standard-layout request and response sent through the flat codec
+struct PathRequest
+{
+    std::string frame;
+    std::vector<int> waypoints;
+};
+SHM_REFLECT(PathRequest, frame, waypoints)
+
+struct PathResponse
+{
+    std::string summary;
+    std::vector<std::string> names;
+};
+SHM_REFLECT(PathResponse, summary, names)
+
+// Serialized messages are encoded into fixed-capacity slots and oversized requests are refused
+TEST_F(SHMServiceTest, SerializedMessageServiceTest)
+{
+    auto handler = [](const PathRequest &request)
+    {
+        PathResponse response;
+        response.summary = request.frame + ":" + std::to_string(request.waypoints.size());
+        for (int waypoint : request.waypoints)
+        {
+            response.names.push_back("wp" + std::to_string(waypoint));
+        }
+        if (request.frame == "huge")
+        {
+            response.names.assign(1000, "too large for the response slot");
+        }
+        return response;
+    };
+    irlab::shm::ServiceServer<PathRequest, PathResponse> server("/test_serialized_service", handler);
+    irlab::shm::ServiceClient<PathRequest, PathResponse> client("/test_serialized_service");
+
+    PathRequest request;
+    request.frame     = "map";
+    request.waypoints = { 3, 1, 4 };
+    PathResponse response;
+    response.names = { "stale" };
+    ASSERT_TRUE(client.call(request, &response));
+    EXPECT_EQ(response.summary, "map:3");
+    EXPECT_EQ(response.names, std::vector<std::string>({ "wp3", "wp1", "wp4" }));
+
+    request.waypoints.assign(irlab::shm::DEFAULT_SERIALIZED_STORAGE_SIZE, 0);
+    EXPECT_THROW(client.call(request, &response), std::runtime_error);
+
+    // A response that does not fit fails the call instead of being truncated
+    request.frame = "huge";
+    request.waypoints.clear();
+    EXPECT_FALSE(client.call(request, &response));
+
+    request.frame = "odom";
+    ASSERT_TRUE(client.call(request, &response));
+    EXPECT_EQ(response.summary, "odom:0");
+    EXPECT_TRUE(response.names.empty());
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,226 @@
+#include <atomic>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <getopt.h>
+#include <string.h>
+
+#include "shm_bag.hpp"
+
+using namespace irlab::shm;
+
+enum MODE
+{
+  RECORD_MODE,
+  PLAY_MODE,
+  INFO_MODE,
+};
+
+char *progname;
+
+static std::atomic<bool> is_interrupted(false);
+
+void
+handle_signal(int)
+{
+  is_interrupted = true;
+}
+
+void
+general_usage()
+{
+  std::cout << progname << " is a command-line tool to record and replay shared memory topics" << std::endl
+            << std::endl;
+  std::cout << "Commands:" << std::endl;
+  std::cout << "\t" << progname << " record\trecord topics to a log file" << std::endl;
+  std::cout << "\t" << progname << " play\tpublish the topics of a log file again" << std::endl;
+  std::cout << "\t" << progname << " info\tshow the topics and the duration of a log file" << std::endl;
+}
+
+void
+record_usage()
+{
+  std::cout << "Usage: " << progname << " record -o <file> [-d duration_sec] [-c chunk_mib] [-D] <topic_name>..."
+            << std::endl
+            << std::endl;
+  std::cout << "Records until interrupted, or for duration_sec if -d is given." << std::endl;
+  std::cout << "-D writes with O_DIRECT where the file system supports it." << std::endl;
+}
+
+void
+play_usage()
+{
+  std::cout << "Usage: " << progname << " play <file> [-r rate] [-s start_sec]" << std::endl << std::endl;
+  std::cout << "Publishes at the recorded rate multiplied by rate (0 publishes without waiting)," << std::endl;
+  std::cout << "starting start_sec after the beginning of the recording." << std::endl;
+}
+
+void
+info_usage()
+{
+  std::cout << "Usage: " << progname << " info <file>" << std::endl;
+}
+
+//! @brief ログファイルの情報の表示
+//! @param [in] reader 読み込んだログファイル
+//! @return なし
+void
+printInfo(const BagReader &reader)
+{
+  double duration_sec = (reader.getEndTime_us() - reader.getStartTime_us()) / 1000000.0;
+  std::cout << "Duration:  " << std::fixed << std::setprecision(3) << duration_sec << " s" << std::endl;
+  std::cout << "Messages:  " << reader.getMessageNum() << std::endl;
+  std::cout << "Chunks:    " << reader.getChunkNum() << (reader.isIndexed() ? "" : " (index rebuilt, not closed)")
+            << std::endl;
+  std::cout << "Topics:" << std::endl;
+  for (const BagTopicInfo &info : reader.getTopicList())
+  {
+    std::cout << "  " << std::left << std::setw(32) << info.name << std::right << std::setw(10) << info.message_num
+              << " msgs  " << info.buffer_num << " x " << info.element_size << " bytes" << std::endl;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int  opt;
+  MODE mode;
+
+  progname = basename(argv[0]);
+
+  if (argc < 2)
+  {
+    general_usage();
+    return 1;
+  }
+
+  if (!strncmp(argv[1], "record", 6))
+  {
+    mode = RECORD_MODE;
+  }
+  else if (!strncmp(argv[1], "play", 4))
+  {
+    mode = PLAY_MODE;
+  }
+  else if (!strncmp(argv[1], "info", 4))
+  {
+    mode = INFO_MODE;
+  }
+  else
+  {
+    general_usage();
+    return 1;
+  }
+
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+
+  optind = 1;
+  argc--;
+  argv++;
+  try
+  {
+    switch (mode)
+    {
+    case RECORD_MODE:
+    {
+      std::string      path;
+      double           duration_sec = 0.0;
+      BagWriterOptions options;
+      while ((opt = getopt(argc, argv, "o:d:c:Dh")) != -1)
+      {
+        switch (opt)
+        {
+        case 'o':
+          path = optarg;
+          break;
+        case 'd':
+          duration_sec = atof(optarg);
+          break;
+        case 'c':
+          options.chunk_size = static_cast<size_t>(atof(optarg) * 1024 * 1024);
+          break;
+        case 'D':
+          options.use_direct_io = true;
+          break;
+        default:
+          record_usage();
+          return 1;
+        }
+      }
+      if (path.empty() || optind >= argc)
+      {
+        record_usage();
+        return 1;
+      }
+      std::vector<std::string> topic_name_list(argv + optind, argv + argc);
+
+      BagRecorder recorder(path, topic_name_list, options);
+      uint64_t    start_time_us = getCurrentTimeUSec();
+      while (!is_interrupted &&
+             (duration_sec <= 0.0 || getCurrentTimeUSec() - start_time_us < duration_sec * 1000000.0))
+      {
+        recorder.recordOnce(100000);
+      }
+      recorder.close();
+      std::cout << "Recorded " << recorder.getMessageNum() << " messages, lost " << recorder.getLostNum()
+                << std::endl;
+      break;
+    }
+    case PLAY_MODE:
+    {
+      double rate      = 1.0;
+      double start_sec = 0.0;
+      while ((opt = getopt(argc, argv, "r:s:h")) != -1)
+      {
+        switch (opt)
+        {
+        case 'r':
+          rate = atof(optarg);
+          break;
+        case 's':
+          start_sec = atof(optarg);
+          break;
+        default:
+          play_usage();
+          return 1;
+        }
+      }
+      if (optind >= argc || rate < 0.0 || start_sec < 0.0)
+      {
+        play_usage();
+        return 1;
+      }
+
+      BagPlayer player(argv[optind]);
+      player.setRate(rate);
+      player.seek(static_cast<uint64_t>(start_sec * 1000000.0));
+      while (!is_interrupted && player.playOnce())
+      {
+      }
+      std::cout << "Played " << player.getPlayedNum() << " messages" << std::endl;
+      break;
+    }
+    case INFO_MODE:
+    {
+      if (argc < 2)
+      {
+        info_usage();
+        return 1;
+      }
+      BagReader reader(argv[1]);
+      printInfo(reader);
+      break;
+    }
+    default:
+      general_usage();
+    }
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << progname << ": " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
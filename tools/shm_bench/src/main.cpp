@@ -0,0 +1,808 @@
+//!
+//! @file main.cpp
+//! @brief 出版・購読、サービス、アクションの遅延とスループットを計測するベンチマーク
+//! @note 記法はROSに準拠する
+//!       http://wiki.ros.org/ja/CppStyleGuide
+//!
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <getopt.h>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+#include "shm_base.hpp"
+#include "shm_pub_sub.hpp"
+#include "shm_pub_sub_vector.hpp"
+#include "shm_service.hpp"
+#include "shm_action.hpp"
+
+using namespace irlab::shm;
+
+// ****************************************************************************
+// Benchmark settings and results
+// ****************************************************************************
+
+enum class Pinning
+{
+  SAME_CORE,
+  CROSS_CORE,
+  CROSS_SOCKET,
+};
+
+struct BenchConfig
+{
+  std::vector<size_t>      sizes           = { 8, 64, 512, 4096, 32768, 262144, 2097152, 16777216, 67108864 };
+  std::vector<int>         buffer_nums     = { 3, 16 };
+  std::vector<int>         subscriber_nums = { 1, 2, 4 };
+  std::vector<std::string> payloads        = { "pod", "vector" };
+  std::vector<Pinning>     pinnings        = { Pinning::SAME_CORE, Pinning::CROSS_CORE, Pinning::CROSS_SOCKET };
+  std::vector<std::string> wait_modes      = { "waitFor", "poll" };
+  size_t                   iterations      = 1000;
+  uint64_t                 duration_ms     = 200;
+  size_t                   max_memory_mb   = 1024;
+  bool                     run_service     = true;
+  uint64_t                 service_spin_us = 0;
+  bool                     run_action      = true;
+  std::string              output;
+};
+
+struct LatencyStats
+{
+  size_t   samples = 0;
+  size_t   lost    = 0;
+  uint64_t p50_ns  = 0;
+  uint64_t p99_ns  = 0;
+  uint64_t p999_ns = 0;
+  uint64_t max_ns  = 0;
+};
+
+struct ThroughputStats
+{
+  double published_per_sec = 0.0;
+  double received_per_sec  = 0.0;
+  double bytes_per_sec     = 0.0;
+};
+
+struct PubSubCase
+{
+  std::string payload;
+  size_t      size;
+  int         buffer_num;
+  int         subscriber_num;
+  Pinning     pinning;
+  bool        use_wait_for;
+};
+
+// ****************************************************************************
+// Helpers
+// ****************************************************************************
+
+static uint64_t
+nowNs()
+{
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+static const char *
+pinningName(Pinning pinning)
+{
+  switch (pinning)
+  {
+  case Pinning::SAME_CORE:
+    return "same-core";
+  case Pinning::CROSS_CORE:
+    return "cross-core";
+  case Pinning::CROSS_SOCKET:
+    return "cross-socket";
+  }
+  return "unknown";
+}
+
+static int
+readCpuPackage(int cpu)
+{
+  std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/physical_package_id");
+  int           package = -1;
+  if (file)
+  {
+    file >> package;
+  }
+  return package;
+}
+
+//! @brief 配置パターンに応じた出版者と購読者のCPU番号の決定
+//! @return bool 配置できない場合(CPUが1つ、またはソケットが1つ)は偽
+static bool
+assignCpus(Pinning pinning, int subscriber_num, int *publisher_cpu, std::vector<int> *subscriber_cpus)
+{
+  int cpu_num    = static_cast<int>(std::thread::hardware_concurrency());
+  *publisher_cpu = 0;
+  subscriber_cpus->clear();
+  switch (pinning)
+  {
+  case Pinning::SAME_CORE:
+    subscriber_cpus->assign(subscriber_num, 0);
+    return true;
+  case Pinning::CROSS_CORE:
+    if (cpu_num < 2)
+    {
+      return false;
+    }
+    for (int i = 0; i < subscriber_num; i++)
+    {
+      subscriber_cpus->push_back(1 + i % (cpu_num - 1));
+    }
+    return true;
+  case Pinning::CROSS_SOCKET:
+  {
+    int              publisher_package = readCpuPackage(0);
+    std::vector<int> remote_cpus;
+    for (int cpu = 1; cpu < cpu_num; cpu++)
+    {
+      if (readCpuPackage(cpu) != publisher_package)
+      {
+        remote_cpus.push_back(cpu);
+      }
+    }
+    if (publisher_package < 0 || remote_cpus.empty())
+    {
+      return false;
+    }
+    for (int i = 0; i < subscriber_num; i++)
+    {
+      subscriber_cpus->push_back(remote_cpus[i % remote_cpus.size()]);
+    }
+    return true;
+  }
+  }
+  return false;
+}
+
+static void
+pinThread(std::thread &thread, int cpu)
+{
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set);
+}
+
+static void
+pinCurrentThread(int cpu)
+{
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+}
+
+static void
+unpinCurrentThread()
+{
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++)
+  {
+    CPU_SET(cpu, &cpu_set);
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+}
+
+//! @brief 遅延の標本から百分位数を計算する(最近傍順位法)
+static LatencyStats
+summarize(std::vector<uint64_t> samples, size_t lost)
+{
+  LatencyStats stats;
+  stats.samples = samples.size();
+  stats.lost    = lost;
+  if (samples.empty())
+  {
+    return stats;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&](double ratio)
+  {
+    size_t rank = static_cast<size_t>(ratio * static_cast<double>(samples.size() - 1) + 0.5);
+    return samples[std::min(rank, samples.size() - 1)];
+  };
+  stats.p50_ns  = percentile(0.50);
+  stats.p99_ns  = percentile(0.99);
+  stats.p999_ns = percentile(0.999);
+  stats.max_ns  = samples.back();
+  return stats;
+}
+
+static std::string
+latencyJson(const LatencyStats &stats)
+{
+  std::ostringstream json;
+  json << "{\"samples\": " << stats.samples << ", \"lost\": " << stats.lost << ", \"p50_ns\": " << stats.p50_ns
+       << ", \"p99_ns\": " << stats.p99_ns << ", \"p999_ns\": " << stats.p999_ns << ", \"max_ns\": " << stats.max_ns
+       << "}";
+  return json.str();
+}
+
+// ****************************************************************************
+// Payload adapters
+// ****************************************************************************
+
+//! Fixed-size topic; the first 8 bytes carry the send time in nanoseconds
+template <size_t N>
+struct PodPayload
+{
+  uint64_t      send_ns;
+  unsigned char data[N - sizeof(uint64_t)];
+};
+
+template <>
+struct PodPayload<sizeof(uint64_t)>
+{
+  uint64_t send_ns;
+};
+
+template <size_t N>
+struct PodTopic
+{
+  using Type = PodPayload<N>;
+
+  static std::unique_ptr<Type>
+  make(size_t)
+  {
+    return std::make_unique<Type>();
+  }
+
+  static void
+  stamp(Type &data, uint64_t send_ns)
+  {
+    data.send_ns = send_ns;
+  }
+
+  static bool
+  receive(Subscriber<Type> &subscriber, uint64_t *send_ns)
+  {
+    bool        is_success = false;
+    const Type &data       = subscriber.subscribe(&is_success);
+    *send_ns               = data.send_ns;
+    return is_success;
+  }
+};
+
+struct VectorTopic
+{
+  using Type = std::vector<unsigned char>;
+
+  static std::unique_ptr<Type>
+  make(size_t size)
+  {
+    return std::make_unique<Type>(std::max(size, sizeof(uint64_t)));
+  }
+
+  static void
+  stamp(Type &data, uint64_t send_ns)
+  {
+    std::memcpy(data.data(), &send_ns, sizeof(send_ns));
+  }
+
+  static bool
+  receive(Subscriber<Type> &subscriber, uint64_t *send_ns)
+  {
+    thread_local Type data;
+    if (!subscriber.subscribe(data) || data.size() < sizeof(uint64_t))
+    {
+      return false;
+    }
+    std::memcpy(send_ns, data.data(), sizeof(uint64_t));
+    return true;
+  }
+};
+
+// ****************************************************************************
+// Publish / subscribe
+// ****************************************************************************
+
+//! @brief 1つの条件で遅延とスループットを計測する
+//! @details 遅延は全購読者の受信を待ってから次を出版し、キューイングを含まない片道遅延を計る．
+//! スループットは出版者が待たずに出版し続け、各購読者が新しいトピックを受信した数を数える．
+template <class Topic>
+static std::string
+runPubSub(const PubSubCase &bench_case, const BenchConfig &config)
+{
+  using Type = typename Topic::Type;
+
+  int              publisher_cpu;
+  std::vector<int> subscriber_cpus;
+  if (!assignCpus(bench_case.pinning, bench_case.subscriber_num, &publisher_cpu, &subscriber_cpus))
+  {
+    std::cerr << "shm_bench: not enough CPUs or sockets for " << pinningName(bench_case.pinning) << ", skipped"
+              << std::endl;
+    return "";
+  }
+
+  std::string topic_name = "/shm_bench_pub_sub";
+  disconnectMemory(topic_name);
+  auto publisher = std::make_unique<Publisher<Type>>(topic_name, bench_case.buffer_num);
+  auto data      = Topic::make(bench_case.size);
+  Topic::stamp(*data, 0);
+  publisher->publish(*data);
+
+  std::vector<std::unique_ptr<Subscriber<Type>>> subscribers;
+  for (int i = 0; i < bench_case.subscriber_num; i++)
+  {
+    subscribers.push_back(std::make_unique<Subscriber<Type>>(topic_name));
+    uint64_t send_ns;
+    Topic::receive(*subscribers.back(), &send_ns);
+  }
+
+  std::atomic<int>                   phase(0);  // 1: latency, 2: throughput, 3: stop
+  std::atomic<uint64_t>              ack_num(0);
+  std::atomic<uint64_t>              received_num(0);
+  std::vector<std::vector<uint64_t>> latencies(bench_case.subscriber_num);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < bench_case.subscriber_num; i++)
+  {
+    threads.emplace_back(
+        [&, i]()
+        {
+          Subscriber<Type> &subscriber = *subscribers[i];
+          uint64_t          last_ns    = 0;
+          latencies[i].reserve(config.iterations);
+          while (phase.load(std::memory_order_acquire) != 3)
+          {
+            if (bench_case.use_wait_for)
+            {
+              if (!subscriber.waitFor(10000))
+              {
+                continue;
+              }
+            }
+            uint64_t send_ns;
+            if (!Topic::receive(subscriber, &send_ns) || send_ns <= last_ns)
+            {
+              if (!bench_case.use_wait_for)
+              {
+                std::this_thread::yield();
+              }
+              continue;
+            }
+            uint64_t receive_ns = nowNs();
+            last_ns             = send_ns;
+            if (phase.load(std::memory_order_acquire) == 1)
+            {
+              latencies[i].push_back(receive_ns - send_ns);
+              ack_num.fetch_add(1, std::memory_order_release);
+            }
+            else
+            {
+              received_num.fetch_add(1, std::memory_order_relaxed);
+            }
+          }
+        });
+    pinThread(threads.back(), subscriber_cpus[i]);
+  }
+  pinCurrentThread(publisher_cpu);
+
+  // Latency: publish one message at a time and wait until every subscriber has seen it
+  size_t lost = 0;
+  phase.store(1, std::memory_order_release);
+  for (size_t i = 0; i < config.iterations; i++)
+  {
+    uint64_t expected = ack_num.load(std::memory_order_acquire) + bench_case.subscriber_num;
+    Topic::stamp(*data, nowNs());
+    publisher->publish(*data);
+    uint64_t deadline = nowNs() + 1000000000ULL;
+    while (ack_num.load(std::memory_order_acquire) < expected)
+    {
+      if (nowNs() > deadline)
+      {
+        lost += expected - ack_num.load(std::memory_order_acquire);
+        break;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  // Throughput: publish back to back for a fixed duration
+  phase.store(2, std::memory_order_release);
+  uint64_t published_num = 0;
+  uint64_t start_ns      = nowNs();
+  uint64_t end_ns        = start_ns + config.duration_ms * 1000000ULL;
+  uint64_t current_ns    = start_ns;
+  while (current_ns < end_ns)
+  {
+    Topic::stamp(*data, current_ns);
+    publisher->publish(*data);
+    published_num++;
+    current_ns = nowNs();
+  }
+  double elapsed_sec = static_cast<double>(current_ns - start_ns) / 1e9;
+  phase.store(3, std::memory_order_release);
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+  unpinCurrentThread();
+
+  std::vector<uint64_t> samples;
+  for (auto &latency : latencies)
+  {
+    samples.insert(samples.end(), latency.begin(), latency.end());
+  }
+
+  ThroughputStats throughput;
+  throughput.published_per_sec = static_cast<double>(published_num) / elapsed_sec;
+  throughput.received_per_sec =
+      static_cast<double>(received_num.load()) / elapsed_sec / static_cast<double>(bench_case.subscriber_num);
+  throughput.bytes_per_sec = throughput.published_per_sec * static_cast<double>(bench_case.size);
+
+  subscribers.clear();
+  publisher.reset();
+  disconnectMemory(topic_name);
+
+  std::ostringstream json;
+  json << "{\"kind\": \"pub_sub\", \"payload\": \"" << bench_case.payload << "\", \"size\": " << bench_case.size
+       << ", \"buffer_num\": " << bench_case.buffer_num << ", \"subscribers\": " << bench_case.subscriber_num
+       << ", \"pinning\": \"" << pinningName(bench_case.pinning) << "\", \"wait\": \""
+       << (bench_case.use_wait_for ? "waitFor" : "poll") << "\", \"latency\": " << latencyJson(summarize(samples, lost))
+       << ", \"throughput\": {\"published_per_sec\": " << throughput.published_per_sec
+       << ", \"received_per_sec\": " << throughput.received_per_sec
+       << ", \"bytes_per_sec\": " << throughput.bytes_per_sec << "}}";
+  return json.str();
+}
+
+template <size_t N>
+static bool
+dispatchPodSize(size_t size, const PubSubCase &bench_case, const BenchConfig &config, std::string *json)
+{
+  if (size != N)
+  {
+    return false;
+  }
+  *json = runPubSub<PodTopic<N>>(bench_case, config);
+  return true;
+}
+
+//! @brief POD型は要素数がコンパイル時に決まるため、既定の大きさのみ対応する
+static std::string
+runPodPubSub(const PubSubCase &bench_case, const BenchConfig &config)
+{
+  std::string json;
+  size_t      size = bench_case.size;
+  if (dispatchPodSize<8>(size, bench_case, config, &json) || dispatchPodSize<64>(size, bench_case, config, &json) ||
+      dispatchPodSize<512>(size, bench_case, config, &json) || dispatchPodSize<4096>(size, bench_case, config, &json) ||
+      dispatchPodSize<32768>(size, bench_case, config, &json) ||
+      dispatchPodSize<262144>(size, bench_case, config, &json) ||
+      dispatchPodSize<2097152>(size, bench_case, config, &json) ||
+      dispatchPodSize<16777216>(size, bench_case, config, &json) ||
+      dispatchPodSize<67108864>(size, bench_case, config, &json))
+  {
+    return json;
+  }
+  std::cerr << "shm_bench: POD payload of " << size << " bytes is not built in, skipped" << std::endl;
+  return "";
+}
+
+// ****************************************************************************
+// Service / action
+// ****************************************************************************
+
+static uint64_t
+echoService(uint64_t request)
+{
+  return request;
+}
+
+static std::string
+runService(const BenchConfig &config)
+{
+  std::string service_name = "/shm_bench_service";
+  disconnectMemory(service_name);
+  ServiceServerOptions server_options;
+  server_options.spin_time_us = config.service_spin_us;
+  ServiceServer<uint64_t, uint64_t> server(service_name, echoService, DEFAULT_PERM, DEFAULT_SERVICE_SLOT_NUM,
+                                            server_options);
+  ServiceClient<uint64_t, uint64_t> client(service_name);
+
+  std::vector<uint64_t> samples;
+  size_t                lost = 0;
+  for (size_t i = 0; i < config.iterations; i++)
+  {
+    uint64_t response;
+    uint64_t start_ns = nowNs();
+    if (!client.call(i, &response, 1000000))
+    {
+      lost++;
+      continue;
+    }
+    samples.push_back(nowNs() - start_ns);
+  }
+  disconnectMemory(service_name);
+  return "{\"kind\": \"service_call\", \"server_spin_us\": " + std::to_string(config.service_spin_us) +
+         ", \"latency\": " + latencyJson(summarize(samples, lost)) + "}";
+}
+
+static std::string
+runAction(const BenchConfig &config)
+{
+  using BenchActionServer = ActionServer<uint64_t, uint64_t, uint64_t>;
+  using BenchActionClient = ActionClient<uint64_t, uint64_t, uint64_t>;
+
+  std::string action_name = "/shm_bench_action";
+  disconnectMemory(action_name);
+  auto              server = std::make_unique<BenchActionServer>(action_name);
+  BenchActionClient client(action_name);
+  if (!client.waitForServer(1000000))
+  {
+    return "";
+  }
+
+  std::thread server_thread(
+      [&]()
+      {
+        for (size_t i = 0; i < config.iterations; i++)
+        {
+          server->waitNewGoalAvailable();
+          uint64_t goal = server->acceptNewGoal();
+          server->publishResult(goal);
+        }
+      });
+
+  // Goal-to-result time, including the server waking up and accepting the goal
+  std::vector<uint64_t> samples;
+  size_t                lost = 0;
+  for (size_t i = 0; i < config.iterations; i++)
+  {
+    uint64_t start_ns = nowNs();
+    if (!client.sendGoal(i) || !client.waitForResult(1000000))
+    {
+      lost++;
+      continue;
+    }
+    samples.push_back(nowNs() - start_ns);
+  }
+  server_thread.join();
+  server.reset();
+  disconnectMemory(action_name);
+  return "{\"kind\": \"action_goal\", \"latency\": " + latencyJson(summarize(samples, lost)) + "}";
+}
+
+// ****************************************************************************
+// Command line
+// ****************************************************************************
+
+static void
+usage(const char *progname)
+{
+  std::cout << "Usage: " << progname << " [options]" << std::endl << std::endl;
+  std::cout << "Measures one-way publish/subscribe latency and throughput, service round trips and action" << std::endl;
+  std::cout << "goal-to-result time, and prints the results as JSON." << std::endl << std::endl;
+  std::cout << "Options (lists are comma separated):" << std::endl;
+  std::cout << "\t--sizes=BYTES\t\tpayload sizes (default 8 to 64MB)" << std::endl;
+  std::cout << "\t--buffers=NUM\t\tbuffer_num values (default 3,16)" << std::endl;
+  std::cout << "\t--subscribers=NUM\tsubscriber counts (default 1,2,4)" << std::endl;
+  std::cout << "\t--payloads=TYPE\t\tpod,vector" << std::endl;
+  std::cout << "\t--pinning=MODE\t\tsame-core,cross-core,cross-socket" << std::endl;
+  std::cout << "\t--wait=MODE\t\twaitFor,poll" << std::endl;
+  std::cout << "\t--iterations=NUM\tlatency samples per case (default 1000)" << std::endl;
+  std::cout << "\t--duration-ms=MS\tthroughput run per case (default 200)" << std::endl;
+  std::cout << "\t--max-memory-mb=MB\tskip cases whose ring exceeds this size (default 1024)" << std::endl;
+  std::cout << "\t--no-service\t\tskip the service benchmark" << std::endl;
+  std::cout << "\t--service-spin-us=US\tbusy-wait time of the idle service worker (default 0)" << std::endl;
+  std::cout << "\t--no-action\t\tskip the action benchmark" << std::endl;
+  std::cout << "\t--output=FILE\t\twrite JSON to FILE instead of stdout" << std::endl;
+}
+
+template <typename T>
+static std::vector<T>
+splitList(const std::string &text, const std::function<T(const std::string &)> &convert)
+{
+  std::vector<T>     values;
+  std::istringstream stream(text);
+  std::string        item;
+  while (std::getline(stream, item, ','))
+  {
+    if (!item.empty())
+    {
+      values.push_back(convert(item));
+    }
+  }
+  return values;
+}
+
+static Pinning
+parsePinning(const std::string &text)
+{
+  if (text == "same-core")
+  {
+    return Pinning::SAME_CORE;
+  }
+  if (text == "cross-core")
+  {
+    return Pinning::CROSS_CORE;
+  }
+  if (text == "cross-socket")
+  {
+    return Pinning::CROSS_SOCKET;
+  }
+  throw std::invalid_argument("unknown pinning mode: " + text);
+}
+
+int
+main(int argc, char *argv[])
+{
+  enum
+  {
+    OPT_SIZES = 256,
+    OPT_BUFFERS,
+    OPT_SUBSCRIBERS,
+    OPT_PAYLOADS,
+    OPT_PINNING,
+    OPT_WAIT,
+    OPT_ITERATIONS,
+    OPT_DURATION,
+    OPT_MAX_MEMORY,
+    OPT_NO_SERVICE,
+    OPT_SERVICE_SPIN,
+    OPT_NO_ACTION,
+    OPT_OUTPUT,
+  };
+  static const struct option long_options[] = {
+    { "sizes", required_argument, nullptr, OPT_SIZES },
+    { "buffers", required_argument, nullptr, OPT_BUFFERS },
+    { "subscribers", required_argument, nullptr, OPT_SUBSCRIBERS },
+    { "payloads", required_argument, nullptr, OPT_PAYLOADS },
+    { "pinning", required_argument, nullptr, OPT_PINNING },
+    { "wait", required_argument, nullptr, OPT_WAIT },
+    { "iterations", required_argument, nullptr, OPT_ITERATIONS },
+    { "duration-ms", required_argument, nullptr, OPT_DURATION },
+    { "max-memory-mb", required_argument, nullptr, OPT_MAX_MEMORY },
+    { "no-service", no_argument, nullptr, OPT_NO_SERVICE },
+    { "service-spin-us", required_argument, nullptr, OPT_SERVICE_SPIN },
+    { "no-action", no_argument, nullptr, OPT_NO_ACTION },
+    { "output", required_argument, nullptr, OPT_OUTPUT },
+    { "help", no_argument, nullptr, 'h' },
+    { nullptr, 0, nullptr, 0 },
+  };
+
+  BenchConfig config;
+  auto        to_size = [](const std::string &text) { return static_cast<size_t>(std::stoull(text)); };
+  auto        to_int  = [](const std::string &text) { return std::stoi(text); };
+  auto        to_text = [](const std::string &text) { return text; };
+  try
+  {
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, nullptr)) != -1)
+    {
+      switch (opt)
+      {
+      case OPT_SIZES:
+        config.sizes = splitList<size_t>(optarg, to_size);
+        break;
+      case OPT_BUFFERS:
+        config.buffer_nums = splitList<int>(optarg, to_int);
+        break;
+      case OPT_SUBSCRIBERS:
+        config.subscriber_nums = splitList<int>(optarg, to_int);
+        break;
+      case OPT_PAYLOADS:
+        config.payloads = splitList<std::string>(optarg, to_text);
+        break;
+      case OPT_PINNING:
+        config.pinnings = splitList<Pinning>(optarg, parsePinning);
+        break;
+      case OPT_WAIT:
+        config.wait_modes = splitList<std::string>(optarg, to_text);
+        break;
+      case OPT_ITERATIONS:
+        config.iterations = to_size(optarg);
+        break;
+      case OPT_DURATION:
+        config.duration_ms = to_size(optarg);
+        break;
+      case OPT_MAX_MEMORY:
+        config.max_memory_mb = to_size(optarg);
+        break;
+      case OPT_NO_SERVICE:
+        config.run_service = false;
+        break;
+      case OPT_SERVICE_SPIN:
+        config.service_spin_us = to_size(optarg);
+        break;
+      case OPT_NO_ACTION:
+        config.run_action = false;
+        break;
+      case OPT_OUTPUT:
+        config.output = optarg;
+        break;
+      default:
+        usage(basename(argv[0]));
+        return (opt == 'h') ? 0 : 1;
+      }
+    }
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "shm_bench: " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> results;
+  for (const auto &payload : config.payloads)
+  {
+    for (size_t size : config.sizes)
+    {
+      for (int buffer_num : config.buffer_nums)
+      {
+        if (size * buffer_num > config.max_memory_mb * 1024 * 1024)
+        {
+          continue;
+        }
+        for (int subscriber_num : config.subscriber_nums)
+        {
+          for (Pinning pinning : config.pinnings)
+          {
+            for (const auto &wait_mode : config.wait_modes)
+            {
+              PubSubCase bench_case = { payload, size, buffer_num, subscriber_num, pinning, wait_mode == "waitFor" };
+              std::cerr << "shm_bench: " << payload << " size=" << size << " buffer_num=" << buffer_num
+                        << " subscribers=" << subscriber_num << " " << pinningName(pinning) << " " << wait_mode
+                        << std::endl;
+              std::string json = (payload == "pod") ? runPodPubSub(bench_case, config)
+                                                    : runPubSub<VectorTopic>(bench_case, config);
+              if (!json.empty())
+              {
+                results.push_back(json);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  if (config.run_service)
+  {
+    results.push_back(runService(config));
+  }
+  if (config.run_action)
+  {
+    std::string json = runAction(config);
+    if (!json.empty())
+    {
+      results.push_back(json);
+    }
+  }
+
+  std::ostringstream json;
+  json << "{\"machine\": {\"cpus\": " << std::thread::hardware_concurrency()
+       << ", \"cache_line_size\": " << CACHE_LINE_SIZE << "}," << std::endl;
+  json << " \"results\": [" << std::endl;
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    json << "  " << results[i] << (i + 1 < results.size() ? "," : "") << std::endl;
+  }
+  json << " ]}" << std::endl;
+
+  if (config.output.empty())
+  {
+    std::cout << json.str();
+  }
+  else
+  {
+    std::ofstream file(config.output);
+    file << json.str();
+  }
+  return 0;
+}
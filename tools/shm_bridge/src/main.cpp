@@ -0,0 +1,187 @@
+#include <atomic>
+#include <csignal>
+#include <iostream>
+#include <getopt.h>
+#include <string.h>
+
+#include "shm_bridge.hpp"
+
+using namespace irlab::shm;
+
+enum MODE
+{
+  SEND_MODE,
+  RECEIVE_MODE,
+};
+
+char *progname;
+
+static std::atomic<bool> is_interrupted(false);
+
+void
+handle_signal(int)
+{
+  is_interrupted = true;
+}
+
+void
+general_usage()
+{
+  std::cout << progname << " is a command-line tool to forward shared memory topics to another host" << std::endl
+            << std::endl;
+  std::cout << "Commands:" << std::endl;
+  std::cout << "\t" << progname << " send\tforward local topics to a peer" << std::endl;
+  std::cout << "\t" << progname << " receive\tpublish the topics received from peers" << std::endl;
+}
+
+void
+send_usage()
+{
+  std::cout << "Usage: " << progname << " send -a <address> -p <port> [-t] [-l] [-f frame_size] <topic_name>..."
+            << std::endl
+            << std::endl;
+  std::cout << "Sends over UDP, or over TCP if -t is given. A multicast address sends to every receiver" << std::endl;
+  std::cout << "in the group. -l forwards only the newest message of each topic." << std::endl;
+}
+
+void
+receive_usage()
+{
+  std::cout << "Usage: " << progname << " receive -p <port> [-t] [-g group] [-P prefix]" << std::endl << std::endl;
+  std::cout << "Receives over UDP, or over TCP if -t is given. -g joins a multicast group and -P prefixes" << std::endl;
+  std::cout << "the names of the published topics." << std::endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int  opt;
+  MODE mode;
+
+  progname = basename(argv[0]);
+
+  if (argc < 2)
+  {
+    general_usage();
+    return 1;
+  }
+
+  if (!strncmp(argv[1], "send", 4))
+  {
+    mode = SEND_MODE;
+  }
+  else if (!strncmp(argv[1], "receive", 7))
+  {
+    mode = RECEIVE_MODE;
+  }
+  else
+  {
+    general_usage();
+    return 1;
+  }
+
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+
+  optind = 1;
+  argc--;
+  argv++;
+  try
+  {
+    BridgeOptions options;
+    int           port = 0;
+    switch (mode)
+    {
+    case SEND_MODE:
+    {
+      std::string address;
+      while ((opt = getopt(argc, argv, "a:p:tlf:h")) != -1)
+      {
+        switch (opt)
+        {
+        case 'a':
+          address = optarg;
+          break;
+        case 'p':
+          port = atoi(optarg);
+          break;
+        case 't':
+          options.transport = BRIDGE_TCP;
+          break;
+        case 'l':
+          options.latest_only = true;
+          break;
+        case 'f':
+          options.max_frame_size = static_cast<size_t>(atoi(optarg));
+          break;
+        default:
+          send_usage();
+          return 1;
+        }
+      }
+      if (address.empty() || port <= 0 || port > 65535 || optind >= argc)
+      {
+        send_usage();
+        return 1;
+      }
+      std::vector<std::string> topic_name_list(argv + optind, argv + argc);
+
+      BridgeSender sender(topic_name_list, address, static_cast<uint16_t>(port), options);
+      while (!is_interrupted)
+      {
+        sender.forwardOnce(100000);
+      }
+      std::cout << "Forwarded " << sender.getForwardedNum() << " messages in " << sender.getFrameNum()
+                << " frames, lost " << sender.getLostNum() << std::endl;
+      break;
+    }
+    case RECEIVE_MODE:
+    {
+      while ((opt = getopt(argc, argv, "p:tg:P:h")) != -1)
+      {
+        switch (opt)
+        {
+        case 'p':
+          port = atoi(optarg);
+          break;
+        case 't':
+          options.transport = BRIDGE_TCP;
+          break;
+        case 'g':
+          options.multicast_group = optarg;
+          break;
+        case 'P':
+          options.topic_prefix = optarg;
+          break;
+        default:
+          receive_usage();
+          return 1;
+        }
+      }
+      if (port <= 0 || port > 65535)
+      {
+        receive_usage();
+        return 1;
+      }
+
+      BridgeReceiver receiver(static_cast<uint16_t>(port), options);
+      while (!is_interrupted)
+      {
+        receiver.receiveOnce(100000);
+      }
+      std::cout << "Received " << receiver.getReceivedNum() << " messages, dropped " << receiver.getDroppedNum()
+                << std::endl;
+      break;
+    }
+    default:
+      general_usage();
+    }
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << progname << ": " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
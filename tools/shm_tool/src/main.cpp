@@ -1,17 +1,353 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
 #include <iostream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <thread>
 #include <getopt.h>
 #include <string.h>
+#include <dirent.h>
 
 #include "shm_base.hpp"
+#include "shm_trace.hpp"
+
+using namespace irlab::shm;
 
 enum MODE
 {
   LIST_MODE,
   REMOVE_MODE,
+  STAT_MODE,
+  TOP_MODE,
+  TRACE_MODE,
 };
 
 char *progname;
 
+// ****************************************************************************
+// Topic snapshots decoded from the ring buffer header
+// ****************************************************************************
+
+struct TopicSnapshot
+{
+  std::string           name;
+  size_t                segment_size   = 0;
+  size_t                element_size   = 0;
+  size_t                buf_num        = 0;
+  size_t                publisher_num  = 0;
+  size_t                subscriber_num = 0;
+  uint64_t              write_index    = 0;
+  uint64_t              slowest_cursor = 0;
+  uint64_t              sample_time_us = 0;
+  std::vector<uint64_t> timestamp_list;
+  RingBufferMetrics     metrics;
+};
+
+struct TopicRate
+{
+  double   publish_hz    = 0.0;
+  double   drop_percent  = 0.0;
+  double   bandwidth_bps = 0.0;
+  double   age_sec       = -1.0;
+  uint64_t backlog_num   = 0;
+};
+
+static const char *SHM_DIRECTORY = "/dev/shm/";
+
+//! @brief トピック名から共有メモリのファイル名への変換
+//! @param [in] name トピック名("/chatter")または共有メモリのファイル名("shm_chatter")
+//! @return std::string /dev/shm 以下のファイル名
+std::string
+toFileName(const std::string &name)
+{
+  if (name.compare(0, 4, "shm_") == 0)
+  {
+    return name;
+  }
+  // Same naming as SharedMemoryPosix
+  std::string topic_name = (name[0] == '/') ? name.substr(1) : name;
+  return "shm_" + regex_replace(topic_name, std::regex("/"), "_");
+}
+
+//! @brief 共有メモリを読み込み専用で割り当て、リングバッファのヘッダを読み出す
+//! @param [in] file_name /dev/shm 以下のファイル名
+//! @param [out] snapshot 読み出した値
+//! @return bool 初期化済みで同じ版数のリングバッファであれば真
+//! @details 書き込みを行わないため、動作中のPublisher/Subscriberに影響を与えない．
+bool
+readSnapshot(const std::string &file_name, TopicSnapshot *snapshot)
+{
+  int fd = open((SHM_DIRECTORY + file_name).c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat st;
+  RingBufferLayout header_layout = RingBuffer::calculateAlignedLayout(0, 1);
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < header_layout.data_offset)
+  {
+    close(fd);
+    return false;
+  }
+  size_t         map_size = static_cast<size_t>(st.st_size);
+  unsigned char *ptr      = reinterpret_cast<unsigned char *>(mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0));
+  close(fd);
+  if (ptr == MAP_FAILED)
+  {
+    return false;
+  }
+
+  bool is_topic = false;
+  if (RingBuffer::checkInitialized(ptr) && RingBuffer::checkLayoutVersion(ptr))
+  {
+    size_t element_size = *reinterpret_cast<size_t *>(ptr + header_layout.element_size_offset);
+    size_t buf_num      = *reinterpret_cast<size_t *>(ptr + header_layout.buf_num_offset);
+    // Service and action segments place other structures first; reject anything that does not fit the file
+    RingBufferLayout layout = RingBuffer::calculateAlignedLayout(element_size, static_cast<int>(buf_num));
+    if (buf_num > 0 && buf_num <= static_cast<size_t>(std::numeric_limits<int>::max()) &&
+        layout.total_size <= map_size)
+    {
+      RingBuffer ring_buffer(ptr);
+      snapshot->name           = file_name.substr(4);
+      snapshot->segment_size   = map_size;
+      snapshot->element_size   = element_size;
+      snapshot->buf_num        = buf_num;
+      snapshot->publisher_num  = ring_buffer.getClientNum(RingBuffer::CLIENT_PUBLISHER);
+      snapshot->subscriber_num = ring_buffer.getClientNum(RingBuffer::CLIENT_SUBSCRIBER);
+      snapshot->write_index =
+          reinterpret_cast<std::atomic<uint64_t> *>(ptr + layout.write_index_offset)->load(std::memory_order_acquire);
+      snapshot->slowest_cursor = ring_buffer.getSlowestCursor();
+      snapshot->metrics        = ring_buffer.getMetrics();
+      std::atomic<uint64_t> *timestamp_list = reinterpret_cast<std::atomic<uint64_t> *>(ptr + layout.timestamp_offset);
+      snapshot->timestamp_list.resize(buf_num);
+      for (size_t i = 0; i < buf_num; i++)
+      {
+        snapshot->timestamp_list[i] = timestamp_list[i].load(std::memory_order_relaxed);
+      }
+      snapshot->sample_time_us = getClockTimeUSec();
+      is_topic                 = true;
+    }
+  }
+  munmap(ptr, map_size);
+  return is_topic;
+}
+
+//! @brief /dev/shm 以下の全てのトピックを読み出す
+//! @param なし
+//! @return std::map<std::string, TopicSnapshot> トピック名をキーとした読み出し結果
+std::map<std::string, TopicSnapshot>
+readAllSnapshots()
+{
+  std::map<std::string, TopicSnapshot> snapshot_map;
+  DIR *dir = opendir(SHM_DIRECTORY);
+  if (dir == nullptr)
+  {
+    return snapshot_map;
+  }
+  while (struct dirent *entry = readdir(dir))
+  {
+    std::string file_name = entry->d_name;
+    TopicSnapshot snapshot;
+    if (file_name.compare(0, 4, "shm_") == 0 && readSnapshot(file_name, &snapshot))
+    {
+      snapshot_map[snapshot.name] = snapshot;
+    }
+  }
+  closedir(dir);
+  return snapshot_map;
+}
+
+//! @brief 共有メモリを読み込み専用で割り当て、トレースリングのレコードを読み出す
+//! @param [in] file_name /dev/shm 以下のファイル名
+//! @param [out] record_list 読み出したレコード
+//! @return bool 同じ版数のトレースリングであれば真
+//! @details 書き込みを行わないため、記録中のプロセスに影響を与えない．
+bool
+readTraceFile(const std::string &file_name, std::vector<TraceRecord> *record_list)
+{
+  int fd = open((SHM_DIRECTORY + file_name).c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < TraceBuffer::getSize(1))
+  {
+    close(fd);
+    return false;
+  }
+  size_t         map_size = static_cast<size_t>(st.st_size);
+  unsigned char *ptr      = reinterpret_cast<unsigned char *>(mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0));
+  close(fd);
+  if (ptr == MAP_FAILED)
+  {
+    return false;
+  }
+  bool is_trace = TraceBuffer::readRecords(ptr, map_size, record_list);
+  munmap(ptr, map_size);
+  return is_trace;
+}
+
+//! @brief 二回の読み出しの差分から周期、破棄率、帯域を計算する
+//! @param [in] previous 前回の読み出し結果
+//! @param [in] current 今回の読み出し結果
+//! @return TopicRate 計算結果
+//! @details 帯域は要素サイズで計算するため、可変長のトピックでは上限値となる．
+TopicRate
+calculateRate(const TopicSnapshot &previous, const TopicSnapshot &current)
+{
+  TopicRate rate;
+  double    elapsed_sec = (current.sample_time_us - previous.sample_time_us) / 1000000.0;
+  // The publisher may have been restarted and re-initialized the segment between the two samples
+  bool is_same = current.metrics.publish_num >= previous.metrics.publish_num &&
+                 current.metrics.drop_num >= previous.metrics.drop_num;
+  if (elapsed_sec > 0.0 && is_same)
+  {
+    uint64_t publish_num = current.metrics.publish_num - previous.metrics.publish_num;
+    uint64_t drop_num    = current.metrics.drop_num - previous.metrics.drop_num;
+    rate.publish_hz      = publish_num / elapsed_sec;
+    rate.bandwidth_bps   = publish_num * current.element_size / elapsed_sec;
+    if (publish_num + drop_num > 0)
+    {
+      rate.drop_percent = 100.0 * drop_num / (publish_num + drop_num);
+    }
+  }
+  if (current.metrics.last_publish_time_us > 0 && current.sample_time_us >= current.metrics.last_publish_time_us)
+  {
+    rate.age_sec = (current.sample_time_us - current.metrics.last_publish_time_us) / 1000000.0;
+  }
+  if (current.slowest_cursor != std::numeric_limits<uint64_t>::max() &&
+      current.write_index > current.slowest_cursor)
+  {
+    rate.backlog_num = current.write_index - current.slowest_cursor;
+  }
+  return rate;
+}
+
+//! @brief バイト数を単位付きの文字列に変換する
+//! @param [in] value バイト数
+//! @return std::string 変換した文字列
+std::string
+formatBytes(double value)
+{
+  const char *units[] = { "B", "KB", "MB", "GB", "TB" };
+  int         unit    = 0;
+  while (value >= 1024.0 && unit < 4)
+  {
+    value /= 1024.0;
+    unit++;
+  }
+  std::ostringstream stream;
+  stream << std::fixed << std::setprecision(unit == 0 ? 0 : 1) << value << units[unit];
+  return stream.str();
+}
+
+//! @brief 経過時間を文字列に変換する
+//! @param [in] age_sec 経過時間[sec]．負の場合は未出版
+//! @return std::string 変換した文字列
+std::string
+formatAge(double age_sec)
+{
+  if (age_sec < 0.0)
+  {
+    return "-";
+  }
+  std::ostringstream stream;
+  stream << std::fixed << std::setprecision(age_sec < 10.0 ? 3 : 1) << age_sec << "s";
+  return stream.str();
+}
+
+//! @brief 遅延ヒストグラムの分位点を返す
+//! @param [in] metrics 計測値
+//! @param [in] ratio 分位(0.0〜1.0)
+//! @return std::string 分位点を含むバケットの上限
+std::string
+formatLatencyPercentile(const RingBufferMetrics &metrics, double ratio)
+{
+  if (metrics.read_num == 0)
+  {
+    return "-";
+  }
+  uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(metrics.read_num * ratio)));
+  uint64_t sum    = 0;
+  for (size_t i = 0; i < RING_BUFFER_LATENCY_BUCKET_NUM; i++)
+  {
+    sum += metrics.latency_histogram[i];
+    if (sum >= target || i == RING_BUFFER_LATENCY_BUCKET_NUM - 1)
+    {
+      if (i == RING_BUFFER_LATENCY_BUCKET_NUM - 1)
+      {
+        return ">" + std::to_string(1ULL << (i - 1)) + "us";
+      }
+      return "<" + std::to_string(1ULL << i) + "us";
+    }
+  }
+  return "-";
+}
+
+void
+clearScreen()
+{
+  if (isatty(STDOUT_FILENO))
+  {
+    std::cout << "\033[H\033[2J";
+  }
+}
+
+void
+printStat(const TopicSnapshot &snapshot, const TopicRate &rate)
+{
+  const RingBufferMetrics &metrics = snapshot.metrics;
+  std::cout << "Topic:        " << snapshot.name << std::endl;
+  std::cout << "Segment:      " << formatBytes(snapshot.segment_size) << ", " << snapshot.buf_num << " slots of "
+            << formatBytes(snapshot.element_size) << std::endl;
+  std::cout << "Clients:      " << snapshot.publisher_num << " publisher(s), " << snapshot.subscriber_num
+            << " subscriber(s)" << std::endl;
+  std::cout << "Publish:      " << std::fixed << std::setprecision(1) << rate.publish_hz << " Hz, "
+            << formatBytes(rate.bandwidth_bps) << "/s, age " << formatAge(rate.age_sec) << std::endl;
+  std::cout << "Drop:         " << std::setprecision(2) << rate.drop_percent << "% (" << metrics.drop_num
+            << " total, " << metrics.retry_num << " retries)" << std::endl;
+  std::cout << "Read:         " << metrics.read_num << " total, " << metrics.overrun_num << " overrun, backlog "
+            << rate.backlog_num << std::endl;
+  std::cout << "Latency:      p50 " << formatLatencyPercentile(metrics, 0.5) << ", p99 "
+            << formatLatencyPercentile(metrics, 0.99) << ", max " << formatLatencyPercentile(metrics, 1.0)
+            << std::endl;
+  std::cout << "Counters:     " << metrics.publish_num << " published, write index " << snapshot.write_index
+            << std::endl;
+  std::cout << "Slot ages:   ";
+  for (uint64_t timestamp_us : snapshot.timestamp_list)
+  {
+    double age_sec = (timestamp_us == 0 || timestamp_us > snapshot.sample_time_us)
+                         ? -1.0
+                         : (snapshot.sample_time_us - timestamp_us) / 1000000.0;
+    std::cout << " " << formatAge(age_sec);
+  }
+  std::cout << std::endl;
+}
+
+void
+printTop(const std::map<std::string, TopicSnapshot> &current, const std::map<std::string, TopicSnapshot> &previous)
+{
+  std::cout << std::left << std::setw(32) << "TOPIC" << std::right << std::setw(5) << "PUB" << std::setw(5) << "SUB"
+            << std::setw(11) << "RATE[Hz]" << std::setw(12) << "BW[/s]" << std::setw(10) << "AGE" << std::setw(8)
+            << "DROP%" << std::setw(10) << "OVERRUN" << std::setw(9) << "BACKLOG" << std::setw(10) << "P99"
+            << std::endl;
+  for (const auto &item : current)
+  {
+    auto      previous_item = previous.find(item.first);
+    TopicRate rate          = calculateRate((previous_item != previous.end()) ? previous_item->second : item.second,
+                                            item.second);
+    std::cout << std::left << std::setw(32) << item.first << std::right << std::setw(5) << item.second.publisher_num
+              << std::setw(5) << item.second.subscriber_num << std::setw(11) << std::fixed << std::setprecision(1)
+              << rate.publish_hz << std::setw(12) << formatBytes(rate.bandwidth_bps) << std::setw(10)
+              << formatAge(rate.age_sec) << std::setw(8) << std::setprecision(2) << rate.drop_percent
+              << std::setw(10) << item.second.metrics.overrun_num << std::setw(9) << rate.backlog_num
+              << std::setw(10) << formatLatencyPercentile(item.second.metrics, 0.99) << std::endl;
+  }
+}
+
 void
 general_usage()
 {
@@ -19,6 +355,9 @@ general_usage()
   std::cout << "Commands:" << std::endl;
   std::cout << "\t" << progname << " list\tlist up shared memory" << std::endl;
   std::cout << "\t" << progname << " remove\tremove shared memory" << std::endl;
+  std::cout << "\t" << progname << " stat\tshow the counters of one topic" << std::endl;
+  std::cout << "\t" << progname << " top\tshow the counters of every topic" << std::endl;
+  std::cout << "\t" << progname << " trace\tdump the trace rings as Chrome trace JSON" << std::endl;
 }
 
 void
@@ -27,6 +366,52 @@ remove_usage()
   std::cout << "Usage: " << progname << " remove <shm_name>" << std::endl;
 }
 
+void
+monitor_usage()
+{
+  std::cout << "Usage: " << progname << " stat <topic_name> [-d interval_sec] [-n count]" << std::endl;
+  std::cout << "       " << progname << " top [-d interval_sec] [-n count]" << std::endl << std::endl;
+  std::cout << "Maps each segment read-only and refreshes every interval (default 1s) until interrupted," << std::endl;
+  std::cout << "or count times if -n is given." << std::endl;
+}
+
+void
+trace_usage()
+{
+  std::cout << "Usage: " << progname << " trace [-o output_file] [pid ...]" << std::endl << std::endl;
+  std::cout << "Dumps the trace rings of the given processes, or of every traced process, as Chrome trace" << std::endl;
+  std::cout << "JSON for chrome://tracing or https://ui.perfetto.dev. Processes record only when started with" << std::endl;
+  std::cout << "SHM_TRACE=1 or after calling enableTracing(). Writes to stdout unless -o is given." << std::endl;
+}
+
+//! @brief stat, top の共通オプションの解析
+//! @param [in] argc 引数の数
+//! @param [in] argv 引数
+//! @param [out] interval_usec 更新周期[usec]
+//! @param [out] count 更新回数(0の場合は無制限)
+//! @return bool 解析できた場合は真
+bool
+parse_monitor_options(int argc, char *argv[], uint64_t *interval_usec, int *count)
+{
+  int opt;
+  optind = 1;
+  while ((opt = getopt(argc, argv, "d:n:h")) != -1)
+  {
+    switch (opt)
+    {
+    case 'd':
+      *interval_usec = static_cast<uint64_t>(atof(optarg) * 1000000.0);
+      break;
+    case 'n':
+      *count = atoi(optarg);
+      break;
+    default:
+      return false;
+    }
+  }
+  return *interval_usec > 0 && *count >= 0;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -49,6 +434,23 @@ main(int argc, char *argv[])
   {
     mode = REMOVE_MODE;
   }
+  else if (!strncmp(argv[1], "stat", 4))
+  {
+    mode = STAT_MODE;
+  }
+  else if (!strncmp(argv[1], "top", 3))
+  {
+    mode = TOP_MODE;
+  }
+  else if (!strncmp(argv[1], "trace", 5))
+  {
+    mode = TRACE_MODE;
+  }
+  else
+  {
+    general_usage();
+    return 1;
+  }
 
   FILE *fp;
   char buf[256];
@@ -102,6 +504,125 @@ main(int argc, char *argv[])
     }
     irlab::shm::disconnectMemory(argv[2]);
     break;
+  case STAT_MODE:
+  {
+    uint64_t interval_usec = 1000000;
+    int      count         = 0;
+    if (argc < 3 || argv[2][0] == '-' || !parse_monitor_options(argc - 2, argv + 2, &interval_usec, &count))
+    {
+      monitor_usage();
+      return 1;
+    }
+    std::string   file_name = toFileName(argv[2]);
+    TopicSnapshot previous;
+    if (!readSnapshot(file_name, &previous))
+    {
+      std::cerr << progname << ": " << argv[2] << " is not a topic" << std::endl;
+      return 1;
+    }
+    for (int i = 0; count == 0 || i < count; i++)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(interval_usec));
+      TopicSnapshot current;
+      if (!readSnapshot(file_name, &current))
+      {
+        std::cerr << progname << ": " << argv[2] << " was removed" << std::endl;
+        return 1;
+      }
+      clearScreen();
+      printStat(current, calculateRate(previous, current));
+      previous = current;
+    }
+    break;
+  }
+  case TOP_MODE:
+  {
+    uint64_t interval_usec = 1000000;
+    int      count         = 0;
+    if (!parse_monitor_options(argc - 1, argv + 1, &interval_usec, &count))
+    {
+      monitor_usage();
+      return 1;
+    }
+    std::map<std::string, TopicSnapshot> previous = readAllSnapshots();
+    for (int i = 0; count == 0 || i < count; i++)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(interval_usec));
+      std::map<std::string, TopicSnapshot> current = readAllSnapshots();
+      clearScreen();
+      printTop(current, previous);
+      previous = current;
+    }
+    break;
+  }
+  case TRACE_MODE:
+  {
+    std::string output_file;
+    optind = 1;
+    while ((opt = getopt(argc - 1, argv + 1, "o:h")) != -1)
+    {
+      if (opt != 'o')
+      {
+        trace_usage();
+        return 1;
+      }
+      output_file = optarg;
+    }
+
+    std::vector<std::string> file_list;
+    for (int i = optind + 1; i < argc; i++)
+    {
+      file_list.push_back("shm_" + TraceBuffer::getMemoryName(static_cast<pid_t>(atoi(argv[i]))));
+    }
+    if (file_list.empty())
+    {
+      DIR *dir = opendir(SHM_DIRECTORY);
+      while (struct dirent *entry = (dir != nullptr) ? readdir(dir) : nullptr)
+      {
+        std::string file_name = entry->d_name;
+        // Topics may also start with "trace_": only "shm_trace_<pid>" is a trace ring
+        if (file_name.compare(0, 10, "shm_trace_") == 0 && file_name.size() > 10 &&
+            file_name.find_first_not_of("0123456789", 10) == std::string::npos)
+        {
+          file_list.push_back(file_name);
+        }
+      }
+      if (dir != nullptr)
+      {
+        closedir(dir);
+      }
+    }
+
+    std::vector<TraceRecord> record_list;
+    for (const std::string &file_name : file_list)
+    {
+      std::vector<TraceRecord> process_record_list;
+      if (!readTraceFile(file_name, &process_record_list))
+      {
+        std::cerr << progname << ": " << file_name << " is not a trace ring" << std::endl;
+        continue;
+      }
+      record_list.insert(record_list.end(), process_record_list.begin(), process_record_list.end());
+    }
+    // Begin/end pairs stay in order: each thread records its events in time order
+    std::stable_sort(record_list.begin(), record_list.end(),
+                     [](const TraceRecord &a, const TraceRecord &b) { return a.time_us < b.time_us; });
+
+    if (output_file.empty())
+    {
+      writeChromeTrace(std::cout, record_list);
+      break;
+    }
+    std::ofstream stream(output_file);
+    if (!stream)
+    {
+      std::cerr << progname << ": Cannot open " << output_file << std::endl;
+      return 1;
+    }
+    writeChromeTrace(stream, record_list);
+    std::cerr << progname << ": " << record_list.size() << " records written to " << output_file << std::endl;
+    break;
+  }
   default:
     general_usage();
   }